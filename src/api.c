@@ -26,21 +26,41 @@
 #include <libavformat/avformat.h>
 #include <libavutil/avassert.h>
 #include <libavutil/avstring.h>
+#include <libavutil/hwcontext_drm.h>
 #include <libavutil/opt.h>
 #include <libavutil/rational.h>
+#include <libavutil/threadmessage.h>
 #include <libavutil/time.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/pixdesc.h>
 
 #include "nopemd.h"
 #include "async.h"
+#include "audio_ring.h"
+#include "frame_cache.h"
+#include "image_cache.h"
 #include "log.h"
 #include "internal.h"
+#include "media_pool.h"
+#include "mem_budget.h"
+#include "obj_pool.h"
+#include "segment_export.h"
+#include "thread_budget.h"
+#include "trace.h"
+#include "waveform.h"
 
 #if HAVE_MEDIACODEC_HWACCEL
 #include <libavcodec/mediacodec.h>
 #endif
 
+enum request_state {
+    REQ_NONE,                               // no frame requested
+    REQ_START,                              // waiting for the stream position to be known
+    REQ_PROBE,                              // waiting for a first frame to locate the stream
+    REQ_CONSUME,                            // consuming frames up to the requested time
+    REQ_DONE,                               // request honored, waiting to be polled
+};
+
 struct nmd_ctx {
     const AVClass *class;                   // necessary for the AVOption mechanism
     struct log_ctx *log_ctx;
@@ -52,7 +72,40 @@ struct nmd_ctx {
     struct async_context *actx;
     int context_configured;
 
+    /* Contexts sharing the same demuxer (see nmd_get_audio_context()) */
+    struct nmd_ctx *parent;                 // owner of the pipeline if this is an audio context
+    struct nmd_ctx *audio_ctx;              // audio context attached to this one
+    int branch;                             // index of the async branch used by this context
+    int position_gen;                       // generation of the latest stream position change seen
+    int64_t restart_ts;                     // media time the stream restarted from after a sibling seek
+
     AVFrame *cached_frame;
+    struct frame_cache *frame_cache;        // recently decoded frames (NULL if disabled)
+    struct media_pool_entry *pool_entry;    // media shared with other contexts (NULL if disabled)
+    int cache_desync;                       // pipeline not positioned around the latest frame returned
+    struct obj_pool *frame_pool;            // frames recycled back into the pipeline
+    struct obj_pool *container_pool;        // nmd_frame containers returned to the user
+
+    /* Still image shared through the image cache (see nmd_set_image_cache_size()) */
+    AVFrame *image;                         // served instead of the pipeline frames if set
+    struct nmd_info image_info;
+    int image_lookup;                       // the image cache was looked up
+    int image_popped;                       // the image was poped since the latest restart
+
+    /* Audio samples served by nmd_read_audio() */
+    struct audio_ring *audio_ring;          // latest samples obtained from the pipeline (NULL until the first read)
+    int audio_eof;                          // no more samples after the ones of the ring
+
+    /* Audio overview (see nmd_get_waveform()) */
+    struct waveform *waveform;
+    struct nmd_ctx *waveform_reader;        // context decoding the audio for the overview
+
+    /* Segmented decoding of nmd_get_next_frame() (see the export_segments option) */
+    struct segment_export *segment_export;
+    struct nmd_ctx **export_readers;        // contexts decoding the segments concurrently
+    int nb_export_readers;
+    struct nmd_ctx *export_scanner;         // locates the keyframes ahead of the readers
+    int export_scan_eof;
 
     AVRational st_timebase;                 // stream timebase
 
@@ -61,7 +114,31 @@ struct nmd_ctx {
     int64_t last_frame_poped_ts;
     int64_t first_ts;
     int64_t last_ts;
+    int64_t frame_duration;                 // estimated duration of a frame
+    int64_t frame_size;                     // size of the latest frame poped, in reverse playback
+    int64_t resume_ts;                      // latest frame returned before a sibling seek
     int eof; // set if the latest frame returned was NULL and meant EOF
+    int frame_status;                       // error raised instead of the latest frame returned (0 if none)
+    double playback_rate;                   // see nmd_set_playback_rate()
+    int64_t nb_frames_returned;             // see nmd_get_stats()
+
+    /* Reverse playback windows, in media time (see get_reverse_window_start()) */
+    int64_t reverse_start;                  // start of the window being returned
+    int64_t reverse_prefetch_ts;            // start of the window being decoded ahead (AV_NOPTS_VALUE if none)
+    int64_t reverse_prefetch_pos;           // latest frame of this window moved to the frame cache, in stream time
+    int reverse_prefetch_done;              // the window is entirely in the frame cache
+
+    /* Frame request in progress (see nmd_request_frame_ms()) */
+    enum request_state req_state;
+    int64_t req_t64;                        // requested time
+    int64_t req_vt;                         // requested media time
+    int req_seek;                           // a seek was issued for the request
+    int req_reverse;                        // the request started a reverse playback window
+    AVFrame *req_frame;                     // best candidate so far, or result once done
+    int req_status;                         // status of the request once done
+    struct async_request req_fwd;           // forwarded to the control thread, which decides to seek or not
+    int req_unsent;                         // req_fwd could not be sent yet (control queue full)
+    int req_pending;                        // waiting for the decision of the control thread
 
     int64_t entering_time;
     const char *cur_func_name;
@@ -85,8 +162,33 @@ static const AVOption options[] = {
     { "max_pixels",             NULL, OFFSET(max_pixels),             AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
     { "audio_texture",          NULL, OFFSET(audio_texture),          AV_OPT_TYPE_INT,       {.i64=1},       0, 1 },
     { "vt_pix_fmt",             NULL, OFFSET(vt_pix_fmt),             AV_OPT_TYPE_STRING,    {.str="bgra"},  0, 0 },
+    { "vaapi_pix_fmt",          NULL, OFFSET(vaapi_pix_fmt),          AV_OPT_TYPE_STRING,    {.str=NULL},    0, 0 },
+    { "hw_filters",             NULL, OFFSET(hw_filters),             AV_OPT_TYPE_STRING,    {.str=NULL},    0, 0 },
+    { "drm_prime",              NULL, OFFSET(drm_prime),              AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
     { "stream_idx",             NULL, OFFSET(stream_idx),             AV_OPT_TYPE_INT,       {.i64=-1},     -1, INT_MAX },
     { "use_pkt_duration",       NULL, OFFSET(use_pkt_duration),       AV_OPT_TYPE_INT,       {.i64=1},       0, 1 },
+    { "max_nb_cached_frames",   NULL, OFFSET(max_nb_cached_frames),   AV_OPT_TYPE_INT,       {.i64=0},       0, 10000 },
+    { "max_cached_frames_size", NULL, OFFSET(max_cached_frames_size), AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "max_cached_packets_size", NULL, OFFSET(max_cached_packets_size), AV_OPT_TYPE_INT,     {.i64=0},       0, INT_MAX },
+    { "keyframe_index_file",    NULL, OFFSET(keyframe_index_file),    AV_OPT_TYPE_STRING,    {.str=NULL},    0,       0 },
+    { "adaptive_seek_trigger",  NULL, OFFSET(adaptive_seek_trigger),  AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "shared_pool",            NULL, OFFSET(shared_pool),            AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "lockfree_queues",        NULL, OFFSET(lockfree_queues),        AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "shared_scheduler",       NULL, OFFSET(shared_scheduler),       AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "nb_threads",             NULL, OFFSET(nb_threads),             AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "keyframes_only",         NULL, OFFSET(keyframes_only),         AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "reverse",                NULL, OFFSET(reverse),                AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "io",                     NULL, OFFSET(io),                     AV_OPT_TYPE_INT,       {.i64=NMD_IO_DEFAULT}, 0, NB_NMD_IO_BACKEND-1 },
+    { "io_buffer_size",         NULL, OFFSET(io_buffer_size),         AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "fast_open",              NULL, OFFSET(fast_open),              AV_OPT_TYPE_INT,       {.i64=0},       0, 1 },
+    { "probesize",              NULL, OFFSET(probesize),              AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "analyzeduration",        NULL, OFFSET(analyzeduration),        AV_OPT_TYPE_DOUBLE,    {.dbl=0},       0, DBL_MAX },
+    { "info_cache_dir",         NULL, OFFSET(info_cache_dir),         AV_OPT_TYPE_STRING,    {.str=NULL},    0,       0 },
+    { "max_queued_memory",      NULL, OFFSET(max_queued_memory),      AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "sample_rate",            NULL, OFFSET(sample_rate),            AV_OPT_TYPE_INT,       {.i64=0},       0, INT_MAX },
+    { "waveform_file",          NULL, OFFSET(waveform_file),          AV_OPT_TYPE_STRING,    {.str=NULL},    0,       0 },
+    { "native_rgba",            NULL, OFFSET(native_rgba),            AV_OPT_TYPE_INT,       {.i64=1},       0, 1 },
+    { "export_segments",        NULL, OFFSET(export_segments),        AV_OPT_TYPE_INT,       {.i64=0},       0, 64 },
     { NULL }
 };
 
@@ -162,15 +264,108 @@ static void free_context(struct nmd_ctx *s)
     av_freep(&s);
 }
 
+/*
+ * The user visible frame; the pools are referenced so that the frame can be
+ * released after the context is destroyed.
+ */
+struct frame_container {
+    struct nmd_frame frame;                 // must be the first field
+    struct nmd_drm_frame drm;               // pointed by frame.datap[0] for the DRM PRIME frames
+    struct obj_pool *frame_pool;            // where the AVFrame goes back on release
+    struct obj_pool *pool;                  // where the container goes back on release
+};
+
+static void *alloc_container(void)
+{
+    return av_mallocz(sizeof(struct frame_container));
+}
+
+static void reset_container(void *obj)
+{
+    memset(obj, 0, sizeof(struct frame_container));
+}
+
+static void free_container(void *obj)
+{
+    av_free(obj);
+}
+
+static void free_frame(struct nmd_ctx *s, AVFrame **framep)
+{
+    if (s->frame_pool) {
+        nmdi_obj_pool_put(s->frame_pool, *framep);
+        *framep = NULL;
+    } else {
+        av_frame_free(framep);
+    }
+}
+
+/*
+ * Stop the segmented decoding; the pipeline of the context is not positioned
+ * after the latest frame returned by the export.
+ */
+static void stop_segment_export(struct nmd_ctx *s)
+{
+    if (!s->export_readers)
+        return;
+
+    TRACE(s, "stop segment export");
+    nmdi_segment_export_free(&s->segment_export);
+    for (int i = 0; i < s->nb_export_readers; i++)
+        nmd_freep(&s->export_readers[i]);
+    av_freep(&s->export_readers);
+    s->nb_export_readers = 0;
+    nmd_freep(&s->export_scanner);
+    if (s->last_pushed_frame_ts != AV_NOPTS_VALUE)
+        s->cache_desync = 1;
+}
+
 /* Destroy data allocated by configure_context() */
 static void free_temp_context_data(struct nmd_ctx *s)
 {
     TRACE(s, "free temporary context data");
 
-    av_frame_free(&s->cached_frame);
+    stop_segment_export(s);
+
+    free_frame(s, &s->cached_frame);
+    free_frame(s, &s->req_frame);
+    s->req_state = REQ_NONE;
+    s->req_unsent = s->req_pending = 0;
+    nmdi_frame_cache_free(&s->frame_cache);
+    nmdi_media_pool_release(&s->pool_entry);
+    nmdi_obj_pool_unref(&s->frame_pool);
+    nmdi_obj_pool_unref(&s->container_pool);
+    av_frame_free(&s->image);
+    s->image_lookup = 0;
+    s->image_popped = 0;
+    nmdi_audio_ring_free(&s->audio_ring);
+    s->audio_eof = 0;
+    nmdi_waveform_free(&s->waveform);
+    nmd_freep(&s->waveform_reader);
+
+    /* The audio context relies on the pipeline of its parent */
+    struct nmd_ctx *child = s->audio_ctx;
+    if (child) {
+        free_frame(child, &child->cached_frame);
+        free_frame(child, &child->req_frame);
+        child->req_state = REQ_NONE;
+        child->req_unsent = child->req_pending = 0;
+        nmdi_frame_cache_free(&child->frame_cache);
+        nmdi_media_pool_release(&child->pool_entry);
+        nmdi_obj_pool_unref(&child->frame_pool);
+        nmdi_obj_pool_unref(&child->container_pool);
+        nmdi_audio_ring_free(&child->audio_ring);
+        child->audio_eof = 0;
+        nmdi_waveform_free(&child->waveform);
+        nmd_freep(&child->waveform_reader);
+        child->actx = NULL;
+        child->position_gen = 0;
+        child->context_configured = 0;
+    }
 
     nmdi_async_free(&s->actx);
 
+    s->position_gen = 0;
     s->context_configured = 0;
 }
 
@@ -179,6 +374,57 @@ void nmd_set_log_callback(struct nmd_ctx *s, void *arg, nmd_log_callback_type ca
     nmdi_log_set_callback(s->log_ctx, arg, callback);
 }
 
+int nmd_set_io_callbacks(struct nmd_ctx *s, const struct nmd_io_callbacks *callbacks)
+{
+    if (s->context_configured) {
+        LOG(s, ERROR, "Context is already configured, can not set the I/O callbacks");
+        return AVERROR(EINVAL);
+    }
+    if (!callbacks->open || !callbacks->read || !callbacks->close) {
+        LOG(s, ERROR, "The open, read and close I/O callbacks are mandatory");
+        return AVERROR(EINVAL);
+    }
+    s->opts.io_callbacks = *callbacks;
+    return 0;
+}
+
+void nmd_set_max_threads(int max_threads)
+{
+    nmdi_thread_budget_set(max_threads);
+}
+
+void nmd_set_max_queued_memory(int64_t max_memory)
+{
+    nmdi_mem_budget_set_max(max_memory);
+}
+
+void nmd_set_image_cache_size(int64_t max_size)
+{
+    nmdi_image_cache_set_max_size(max_size);
+}
+
+int nmd_trace_start(const char *filename)
+{
+    return nmdi_trace_start(filename);
+}
+
+int nmd_trace_stop(void)
+{
+    return nmdi_trace_stop();
+}
+
+int nmd_set_playback_rate(struct nmd_ctx *s, double rate)
+{
+    if (!(rate > 0.)) {
+        LOG(s, ERROR, "Invalid playback rate %g", rate);
+        return AVERROR(EINVAL);
+    }
+    s->playback_rate = rate;
+    if (s->actx)
+        nmdi_playback_hint_set_rate(nmdi_async_get_playback_hint(s->actx, s->branch), rate);
+    return 0;
+}
+
 struct nmd_ctx *nmd_create(const char *filename)
 {
     const struct {
@@ -232,6 +478,10 @@ struct nmd_ctx *nmd_create(const char *filename)
     s->first_ts             = AV_NOPTS_VALUE;
     s->last_frame_poped_ts  = AV_NOPTS_VALUE;
     s->last_pushed_frame_ts = AV_NOPTS_VALUE;
+    s->restart_ts           = AV_NOPTS_VALUE;
+    s->resume_ts            = AV_NOPTS_VALUE;
+    s->reverse_prefetch_ts  = AV_NOPTS_VALUE;
+    s->playback_rate        = 1.0;
 
     av_assert0(!s->context_configured);
     return s;
@@ -248,13 +498,48 @@ void nmd_freep(struct nmd_ctx **sp)
     if (!s)
         return;
 
+    /* An audio context is owned by its parent */
+    if (s->parent) {
+        *sp = NULL;
+        return;
+    }
+
     LOG(s, DEBUG, "destroying context");
 
     free_temp_context_data(s);
+    free_context(s->audio_ctx);
     free_context(s);
     *sp = NULL;
 }
 
+struct nmd_ctx *nmd_get_audio_context(struct nmd_ctx *s)
+{
+    if (s->parent || s->context_configured) {
+        LOG(s, ERROR, "An audio context can only be obtained from an unconfigured main context");
+        return NULL;
+    }
+
+    if (s->audio_ctx)
+        return s->audio_ctx;
+
+    struct nmd_ctx *child = nmd_create(s->filename);
+    if (!child)
+        return NULL;
+
+    char *logname = av_asprintf("nope.media:%s:audio", av_basename(s->filename));
+    if (!logname) {
+        free_context(child);
+        return NULL;
+    }
+    av_freep(&child->logname);
+    child->logname = logname;
+
+    child->opts.avselect = NMD_SELECT_AUDIO;
+    child->parent = s;
+    s->audio_ctx = child;
+    return child;
+}
+
 /**
  * Map the timeline time to the media time
  */
@@ -264,7 +549,13 @@ static int64_t get_media_time(const struct nmdi_opts *o, int64_t t)
     return o->end_time64 == AV_NOPTS_VALUE ? mt : FFMIN(mt, o->end_time64);
 }
 
-static int set_context_fields(struct nmd_ctx *s)
+/* Recently decoded frames kept by default in reverse playback; the cache is
+ * grown up to the limits below to hold the windows of a whole GOP */
+#define REVERSE_NB_CACHED_FRAMES 32
+#define REVERSE_MAX_CACHED_FRAMES 1024
+#define REVERSE_CACHED_FRAMES_SIZE (512 << 20)
+
+static int set_context_opts(struct nmd_ctx *s)
 {
     struct nmdi_opts *o = &s->opts;
 
@@ -277,6 +568,14 @@ static int set_context_fields(struct nmd_ctx *s)
         }
     }
 
+    if (o->vaapi_pix_fmt) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(av_get_pix_fmt(o->vaapi_pix_fmt));
+        if (!desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            LOG(s, ERROR, "Invalid VAAPI pixel format '%s' specified", o->vaapi_pix_fmt);
+            return AVERROR(EINVAL);
+        }
+    }
+
     if (o->auto_hwaccel && (o->filters || o->autorotate)) {
         LOG(s, WARNING, "Filters ('%s') or autorotate (%d) settings "
             "are set but hwaccel is enabled, disabling auto_hwaccel so these "
@@ -284,6 +583,19 @@ static int set_context_fields(struct nmd_ctx *s)
         o->auto_hwaccel = 0;
     }
 
+    /* Reverse playback is served by the cache of recently decoded frames */
+    if (o->reverse) {
+        if (o->auto_hwaccel) {
+            LOG(s, WARNING, "Reverse playback is set but hwaccel is enabled, "
+                "disabling auto_hwaccel so the decoded frames can be cached");
+            o->auto_hwaccel = 0;
+        }
+        if (!o->max_nb_cached_frames)
+            o->max_nb_cached_frames = REVERSE_NB_CACHED_FRAMES;
+        if (!o->max_cached_frames_size)
+            o->max_cached_frames_size = REVERSE_CACHED_FRAMES_SIZE;
+    }
+
     LOG(s, INFO, "avselect:%d start_time:%f end_time:%f "
         "dist_time_seek_trigger:%f queues:[%d %d %d] filters:'%s'",
         o->avselect, o->start_time, o->end_time,
@@ -305,14 +617,91 @@ static int set_context_fields(struct nmd_ctx *s)
           PTS2TIMESTR(o->end_time64),
           PTS2TIMESTR(o->dist_time_seek_trigger64));
 
+    if (o->shared_pool) {
+        av_assert0(!s->pool_entry);
+        int ret = nmdi_media_pool_acquire(&s->pool_entry, s->filename, o);
+        if (ret < 0)
+            return ret;
+        ret = nmdi_media_pool_get_frame_cache(s->pool_entry, s->log_ctx, &s->frame_cache);
+        if (ret < 0)
+            return ret;
+    } else if (o->max_nb_cached_frames) {
+        av_assert0(!s->frame_cache);
+        s->frame_cache = nmdi_frame_cache_alloc();
+        if (!s->frame_cache)
+            return AVERROR(ENOMEM);
+        int ret = nmdi_frame_cache_init(s->frame_cache, s->log_ctx,
+                                        o->max_nb_cached_frames,
+                                        o->max_cached_frames_size,
+                                        o->use_pkt_duration);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+static int set_context_pools(struct nmd_ctx *s)
+{
+    av_assert0(!s->frame_pool && !s->container_pool);
+
+    s->frame_pool = nmdi_obj_pool_ref(nmdi_async_get_frame_pool(s->actx, s->branch));
+
+    s->container_pool = nmdi_obj_pool_alloc();
+    if (!s->container_pool)
+        return AVERROR(ENOMEM);
+    int ret = nmdi_obj_pool_init(s->container_pool, alloc_container, reset_container, free_container);
+    if (ret < 0)
+        return ret;
+    return nmdi_obj_pool_prealloc(s->container_pool, s->opts.max_nb_sink);
+}
+
+static int set_context_fields(struct nmd_ctx *s)
+{
+    struct nmd_ctx *child = s->audio_ctx;
+
+    if (child && s->opts.avselect != NMD_SELECT_VIDEO) {
+        LOG(s, ERROR, "The main context must select the video stream when an audio context is used");
+        return AVERROR(EINVAL);
+    }
+
+    int ret = set_context_opts(s);
+    if (ret < 0)
+        return ret;
+
+    if (child) {
+        child->opts.start_time = s->opts.start_time;
+        child->opts.end_time   = s->opts.end_time;
+        ret = set_context_opts(child);
+        if (ret < 0)
+            return ret;
+    }
+
     av_assert0(!s->actx);
     s->actx = nmdi_async_alloc_context();
     if (!s->actx)
         return AVERROR(ENOMEM);
 
-    int ret = nmdi_async_init(s->actx, s->log_ctx, s->filename, &s->opts);
+    ret = nmdi_async_init(s->actx, s->log_ctx, s->filename, &s->opts);
     if (ret < 0)
         return ret;
+    ret = set_context_pools(s);
+    if (ret < 0)
+        return ret;
+    nmdi_playback_hint_set_rate(nmdi_async_get_playback_hint(s->actx, s->branch), s->playback_rate);
+
+    if (child) {
+        ret = nmdi_async_add_branch(s->actx, child->log_ctx, &child->opts);
+        if (ret < 0)
+            return ret;
+        child->branch = ret;
+        child->actx = s->actx;
+        ret = set_context_pools(child);
+        if (ret < 0)
+            return ret;
+        nmdi_playback_hint_set_rate(nmdi_async_get_playback_hint(s->actx, child->branch), child->playback_rate);
+        child->context_configured = 1;
+    }
 
     s->context_configured = 1;
 
@@ -329,6 +718,10 @@ static int configure_context(struct nmd_ctx *s)
     if (s->context_configured)
         return 1;
 
+    /* The pipeline of an audio context is configured along its parent */
+    if (s->parent)
+        return configure_context(s->parent);
+
     TRACE(s, "set context fields");
     int ret = set_context_fields(s);
     if (ret < 0) {
@@ -462,6 +855,34 @@ static int get_nmd_col_trc(int avcol_trc)
 #define MAX_ASYNC_OP_TIME (10/1000.)
 #define MAX_SYNC_OP_TIME  (1/60.)
 
+static int is_hwaccel_frame(const AVFrame *frame)
+{
+    return frame->format == AV_PIX_FMT_VIDEOTOOLBOX ||
+           frame->format == AV_PIX_FMT_VAAPI        ||
+           frame->format == AV_PIX_FMT_DRM_PRIME    ||
+           frame->format == AV_PIX_FMT_MEDIACODEC;
+}
+
+/* Flatten the layers of the DRM descriptor into one entry per plane */
+static void set_drm_frame(struct nmd_drm_frame *dst, const AVDRMFrameDescriptor *desc)
+{
+    dst->nb_planes = 0;
+    for (int i = 0; i < desc->nb_layers; i++) {
+        const AVDRMLayerDescriptor *layer = &desc->layers[i];
+        for (int j = 0; j < layer->nb_planes && dst->nb_planes < NMD_DRM_MAX_PLANES; j++) {
+            const AVDRMPlaneDescriptor *plane = &layer->planes[j];
+            const AVDRMObjectDescriptor *obj = &desc->objects[plane->object_index];
+            dst->planes[dst->nb_planes++] = (struct nmd_drm_plane){
+                .fd       = obj->fd,
+                .format   = layer->format,
+                .offset   = plane->offset,
+                .pitch    = plane->pitch,
+                .modifier = obj->format_modifier,
+            };
+        }
+    }
+}
+
 /* Return the frame only if different from previous one. We do not make a
  * simple pointer check because of the frame reference counting (and thus
  * pointer reuse, depending on many parameters)  */
@@ -471,6 +892,7 @@ static struct nmd_frame *ret_frame(struct nmd_ctx *s, AVFrame *frame, int status
     const struct nmdi_opts *o = &s->opts;
 
     s->eof = !frame && (status == AVERROR_EOF || status == AVERROR_EXIT);
+    s->frame_status = !frame && status < 0 && !s->eof ? status : 0;
 
     if (!frame) {
         LOG(s, DEBUG, "no frame to return");
@@ -488,17 +910,25 @@ static struct nmd_frame *ret_frame(struct nmd_ctx *s, AVFrame *frame, int status
     /* if same frame as previously, do not raise it again */
     if (s->last_pushed_frame_ts == frame_ts) {
         LOG(s, DEBUG, "same frame as previously, return NULL");
-        av_frame_free(&frame);
+        free_frame(s, &frame);
         goto end;
     }
 
-    ret = av_mallocz(sizeof(*ret));
-    if (!ret) {
-        av_frame_free(&frame);
+    /* Synthetic frames may be returned before the pipeline is configured */
+    struct frame_container *c = s->container_pool ? nmdi_obj_pool_get(s->container_pool)
+                                                  : alloc_container();
+    if (!c) {
+        free_frame(s, &frame);
         goto end;
     }
+    if (s->container_pool) {
+        c->pool       = nmdi_obj_pool_ref(s->container_pool);
+        c->frame_pool = nmdi_obj_pool_ref(s->frame_pool);
+    }
+    ret = &c->frame;
 
     s->last_pushed_frame_ts = frame_ts;
+    s->nb_frames_returned++;
 
     ret->internal = frame;
     memcpy(ret->datap, frame->data, sizeof(ret->datap));
@@ -511,9 +941,10 @@ static struct nmd_frame *ret_frame(struct nmd_ctx *s, AVFrame *frame, int status
     ret->color_primaries = get_nmd_col_pri(frame->color_primaries);
     ret->color_trc       = get_nmd_col_trc(frame->color_trc);
     if (o->avselect == NMD_SELECT_VIDEO) {
-        if (frame->format == AV_PIX_FMT_VIDEOTOOLBOX ||
-            frame->format == AV_PIX_FMT_VAAPI        ||
-            frame->format == AV_PIX_FMT_MEDIACODEC) {
+        if (frame->format == AV_PIX_FMT_DRM_PRIME) {
+            set_drm_frame(&c->drm, (const AVDRMFrameDescriptor *)frame->data[0]);
+            ret->datap[0] = (uint8_t *)&c->drm;
+        } else if (is_hwaccel_frame(frame)) {
             ret->datap[0] = frame->data[3];
         }
         ret->width   = frame->width;
@@ -545,9 +976,23 @@ void nmd_frame_releasep(struct nmd_frame **framep)
     if (!frame)
         return;
 
+    struct frame_container *c = (struct frame_container *)frame;
     AVFrame *avframe = frame->internal;
-    av_frame_free(&avframe);
-    av_freep(framep);
+    if (c->frame_pool) {
+        nmdi_obj_pool_put(c->frame_pool, avframe);
+        nmdi_obj_pool_unref(&c->frame_pool);
+    } else {
+        av_frame_free(&avframe);
+    }
+
+    struct obj_pool *pool = c->pool;
+    if (pool) {
+        nmdi_obj_pool_put(pool, c);
+        nmdi_obj_pool_unref(&pool);
+    } else {
+        free_container(c);
+    }
+    *framep = NULL;
 }
 
 int nmd_mc_frame_render_and_releasep(struct nmd_frame **framep)
@@ -568,7 +1013,113 @@ int nmd_mc_frame_render_and_releasep(struct nmd_frame **framep)
 #endif
 }
 
-static int pop_frame(struct nmd_ctx *s, AVFrame **framep)
+/* Every frame poped after this call is not contiguous with the previous ones */
+static void reset_stream_position(struct nmd_ctx *s)
+{
+    if (s->frame_cache)
+        nmdi_frame_cache_break(s->frame_cache);
+    s->restart_ts = AV_NOPTS_VALUE;
+    s->resume_ts = AV_NOPTS_VALUE;
+    s->reverse_prefetch_ts = AV_NOPTS_VALUE;
+    s->cache_desync = 0;
+}
+
+static int async_seek(struct nmd_ctx *s, int64_t ts)
+{
+    reset_stream_position(s);
+    /* Images are not seekable: the cached one doesn't need the media to be opened */
+    if (s->image)
+        return 0;
+    return nmdi_async_seek(s->actx, s->branch, ts);
+}
+
+/*
+ * Whether the frame at ts is the latest one returned or one of the frames
+ * between it and the next one popped from our pipeline, in which case the
+ * pipeline is still positioned around it.
+ */
+static int is_near_pipeline_position(const struct nmd_ctx *s, int64_t ts)
+{
+    if (s->last_pushed_frame_ts == AV_NOPTS_VALUE)
+        return 0;
+    if (ts == s->last_pushed_frame_ts)
+        return 1;
+    return s->cached_frame && ts > s->last_pushed_frame_ts && ts <= s->cached_frame->pts;
+}
+
+/*
+ * Look up the image cache once the context is configured. Return 1 if the
+ * media is an image decoded earlier, in which case the pipeline is never
+ * started.
+ */
+static int lookup_image(struct nmd_ctx *s)
+{
+    if (s->image_lookup)
+        return !!s->image;
+    s->image_lookup = 1;
+
+    if (s->opts.avselect != NMD_SELECT_VIDEO || s->parent || s->audio_ctx)
+        return 0;
+
+    int ret = nmdi_image_cache_get(s->filename, &s->opts, &s->image, &s->image_info);
+    if (ret <= 0)
+        return 0;
+
+    TRACE(s, "image found in the image cache");
+    s->st_timebase = av_make_q(s->image_info.timebase[0], s->image_info.timebase[1]);
+    return 1;
+}
+
+/* Share the image just decoded with the contexts opened on it later */
+static void cache_image(struct nmd_ctx *s, const AVFrame *frame, unsigned flags)
+{
+    struct nmd_info info;
+
+    if (s->image || s->opts.avselect != NMD_SELECT_VIDEO || s->parent || s->audio_ctx ||
+        is_hwaccel_frame(frame) || nmdi_async_fetch_info(s->actx, s->branch, &info, flags) < 0 || !info.is_image)
+        return;
+
+    if (nmdi_image_cache_add(s->filename, &s->opts, frame, &info) <= 0)
+        return;
+
+    /* The image is served from the cache from now on, once per restart */
+    s->image = av_frame_clone(frame);
+    s->image_info = info;
+    s->image_lookup = 1;
+    s->image_popped = 1;
+}
+
+/*
+ * When the demuxer is shared with another context, a seek (or stop) requested
+ * through the other context also moves the stream of this one: the frames
+ * previously queued are lost and the decoding restarts from the position
+ * requested by the sibling.
+ */
+static int sync_stream_position(struct nmd_ctx *s, unsigned flags)
+{
+    if (!s->parent && !s->audio_ctx)
+        return 0;
+
+    int64_t ts;
+    int ret = nmdi_async_get_position_change(s->actx, s->branch, &s->position_gen, &ts, flags);
+    if (ret <= 0)
+        return ret;
+
+    TRACE(s, "stream restarted from %s by the sibling context", PTS2TIMESTR(ts));
+    free_frame(s, &s->cached_frame);
+    if (s->frame_cache)
+        nmdi_frame_cache_break(s->frame_cache);
+    s->resume_ts = s->last_pushed_frame_ts;
+    s->restart_ts = ts;
+    s->last_pushed_frame_ts = AV_NOPTS_VALUE;
+    s->last_frame_poped_ts = AV_NOPTS_VALUE;
+    s->reverse_prefetch_ts = AV_NOPTS_VALUE;
+    s->cache_desync = 0;
+    s->eof = 0;
+    return 0;
+}
+
+static int pop_frame(struct nmd_ctx *s, AVFrame **framep, unsigned flags)
 {
     int ret = 0;
     AVFrame *frame = NULL;
@@ -577,12 +1128,26 @@ static int pop_frame(struct nmd_ctx *s, AVFrame **framep)
         TRACE(s, "we have a cached frame, pop this one");
         frame = s->cached_frame;
         s->cached_frame = NULL;
+    } else if (lookup_image(s)) {
+        if (s->image_popped) {
+            TRACE(s, "image already poped");
+            ret = AVERROR_EOF;
+        } else {
+            TRACE(s, "pop the cached image");
+            frame = av_frame_clone(s->image);
+            ret = frame ? 0 : AVERROR(ENOMEM);
+            s->image_popped = 1;
+        }
     } else {
 
         /* Stream time base is required to interpret the frame PTS */
         if (!s->st_timebase.den) {
             struct nmd_info info;
-            ret = nmdi_async_fetch_info(s->actx, &info);
+            ret = nmdi_async_fetch_info(s->actx, s->branch, &info, flags);
+            if (ret == AVERROR(EAGAIN)) {
+                *framep = NULL;
+                return ret;
+            }
             if (ret < 0) {
                 TRACE(s, "unable to fetch info %s", av_err2str(ret));
             } else {
@@ -590,19 +1155,37 @@ static int pop_frame(struct nmd_ctx *s, AVFrame **framep)
                 LOG(s, DEBUG, "store stream timebase %d/%d",
                     s->st_timebase.num, s->st_timebase.den);
                 av_assert0(s->st_timebase.den);
+                if (s->pool_entry)
+                    nmdi_media_pool_set_timebase(s->pool_entry, s->st_timebase);
             }
         }
 
         if (s->st_timebase.den) {
-            ret = nmdi_async_pop_frame(s->actx, &frame);
+            ret = nmdi_async_pop_frame(s->actx, s->branch, &frame, flags);
+            if (ret == AVERROR(EAGAIN)) {
+                *framep = NULL;
+                return ret;
+            }
             if (ret < 0)
                 TRACE(s, "poped a message raising %s", av_err2str(ret));
+            else if (frame && s->frame_cache && !is_hwaccel_frame(frame))
+                nmdi_frame_cache_add(s->frame_cache, frame);
+            if (frame)
+                cache_image(s, frame, flags);
         }
     }
 
     if (frame) {
         const int64_t ts = frame->pts;
+        s->restart_ts = AV_NOPTS_VALUE;
+        s->resume_ts = AV_NOPTS_VALUE;
         TRACE(s, "poped frame with ts=%s (%"PRId64")", av_ts2timestr(ts, &s->st_timebase), ts);
+        if (s->opts.reverse)
+            s->frame_size = nmdi_get_frame_size(frame);
+        if (frame->pkt_duration > 0)
+            s->frame_duration = frame->pkt_duration;
+        else if (s->last_frame_poped_ts != AV_NOPTS_VALUE && ts > s->last_frame_poped_ts)
+            s->frame_duration = ts - s->last_frame_poped_ts;
         s->last_frame_poped_ts = ts;
     } else {
         TRACE(s, "no frame available");
@@ -620,6 +1203,50 @@ static int pop_frame(struct nmd_ctx *s, AVFrame **framep)
     return ret;
 }
 
+/* The control thread honored the request forwarded to it with a seek */
+static void apply_request_seek(struct nmd_ctx *s)
+{
+    TRACE(s, "request of frame at %s honored with a seek", PTS2TIMESTR(s->req_vt));
+
+    /* The frames to come are past the candidate after a forward seek */
+    if (s->req_fwd.type == ASYNC_REQUEST_FORWARD && s->last_pushed_frame_ts != AV_NOPTS_VALUE)
+        free_frame(s, &s->req_frame);
+    free_frame(s, &s->cached_frame);
+    reset_stream_position(s);
+    s->req_seek = 1;
+}
+
+/*
+ * Drop the frame request in progress: the frames it consumed so far are
+ * contiguous with the latest one returned, unless it issued a seek.
+ */
+static void cancel_frame_request(struct nmd_ctx *s)
+{
+    if (s->req_state == REQ_NONE)
+        return;
+
+    TRACE(s, "cancel request of frame at %s", PTS2TIMESTR(s->req_vt));
+
+    /* Unless the control thread decided already, the stream is assumed to be
+     * moved by the request forwarded to it */
+    if (s->req_pending && nmdi_async_get_request_seek(s->actx, s->branch, AV_THREAD_MESSAGE_NONBLOCK))
+        apply_request_seek(s);
+    s->req_unsent = s->req_pending = 0;
+
+    if (s->req_state == REQ_DONE || s->req_seek) {
+        free_frame(s, &s->req_frame);
+    } else if (s->req_frame) {
+        av_assert0(!s->cached_frame);
+        s->cached_frame = s->req_frame;
+        s->req_frame = NULL;
+    }
+
+    /* The stream is somewhere around the time of the cancelled request */
+    if (s->req_state != REQ_DONE && s->req_seek)
+        s->cache_desync = 1;
+    s->req_state = REQ_NONE;
+}
+
 #define SYNTH_FRAME 0
 
 #if SYNTH_FRAME
@@ -644,15 +1271,20 @@ int nmd_seek(struct nmd_ctx *s, double reqt)
 {
     START_FUNC_T("SEEK", reqt);
 
-    av_frame_free(&s->cached_frame);
+    cancel_frame_request(s);
+    stop_segment_export(s);
+    free_frame(s, &s->cached_frame);
     s->last_pushed_frame_ts = AV_NOPTS_VALUE;
+    if (s->audio_ring)
+        nmdi_audio_ring_reset(s->audio_ring);
+    s->audio_eof = 0;
 
     int ret = configure_context(s);
     if (ret < 0)
         return ret;
 
     const struct nmdi_opts *o = &s->opts;
-    ret = nmdi_async_seek(s->actx, get_media_time(o, TIME2INT64(reqt)));
+    ret = async_seek(s, get_media_time(o, TIME2INT64(reqt)));
     END_FUNC(MAX_ASYNC_OP_TIME);
     return ret;
 }
@@ -661,13 +1293,23 @@ int nmd_stop(struct nmd_ctx *s)
 {
     START_FUNC("STOP");
 
-    av_frame_free(&s->cached_frame);
+    cancel_frame_request(s);
+    stop_segment_export(s);
+    free_frame(s, &s->cached_frame);
     s->last_pushed_frame_ts = AV_NOPTS_VALUE;
+    s->reverse_prefetch_ts = AV_NOPTS_VALUE;
+    s->cache_desync = 0;
+    s->image_popped = 0;
+    if (s->audio_ring)
+        nmdi_audio_ring_reset(s->audio_ring);
+    s->audio_eof = 0;
 
     int ret = configure_context(s);
     if (ret < 0)
         return ret;
 
+    if (s->frame_cache)
+        nmdi_frame_cache_break(s->frame_cache);
     ret = nmdi_async_stop(s->actx);
     END_FUNC(MAX_ASYNC_OP_TIME);
     return ret;
@@ -695,72 +1337,449 @@ static inline int64_t stream_time(const struct nmd_ctx *s, int64_t t)
     return av_rescale_q(t, AV_TIME_BASE_Q, s->st_timebase);
 }
 
-struct nmd_frame *nmd_get_frame_ms(struct nmd_ctx *s, int64_t t64)
+/* Number of frames the frame cache can hold in reverse playback */
+static int get_reverse_max_frames(const struct nmd_ctx *s)
 {
-    int64_t diff;
     const struct nmdi_opts *o = &s->opts;
+    int64_t max_frames = REVERSE_MAX_CACHED_FRAMES;
+    if (o->max_cached_frames_size && s->frame_size > 0)
+        max_frames = FFMIN(max_frames, o->max_cached_frames_size / s->frame_size);
+    return FFMAX(max_frames, o->max_nb_cached_frames);
+}
 
-    START_FUNC_T("GET FRAME", t64 / 1000000.);
-
-#if SYNTH_FRAME
-    return ret_synth_frame(s, t64);
-#endif
+/*
+ * In reverse playback, a backward seek decodes a whole window of frames ending
+ * at the requested time instead of a single frame, so that the following
+ * requests are served by the frame cache. The window starts at the keyframe
+ * preceding the requested time, since the frames from there are decoded
+ * anyway, and the cache grows to hold that GOP along with the window
+ * prefetched before it. If the keyframe is not indexed or the GOP does not fit
+ * in memory, the window is limited to what the cache holds. Return its start
+ * in media time.
+ */
+static int64_t get_reverse_window_start(struct nmd_ctx *s, int64_t vt)
+{
+    const struct nmdi_opts *o = &s->opts;
 
-    int ret = configure_context(s);
-    if (ret < 0)
-        return ret_frame(s, NULL, ret);
+    if (s->frame_duration <= 0)
+        return vt;
+
+    const int64_t stt = stream_time(s, vt);
+    int64_t start = AV_NOPTS_VALUE;
+
+    /* Two windows are cached at once, with some room for the frames around
+     * their boundaries */
+    int64_t kf;
+    nmdi_async_get_prev_keyframe(s->actx, s->branch, stt, stt, &kf);
+    if (kf != AV_NOPTS_VALUE && s->frame_cache) {
+        const int64_t nb_frames = 2 * ((stt - kf) / s->frame_duration + 1) + 2;
+        if (nb_frames <= get_reverse_max_frames(s) &&
+            nmdi_frame_cache_reserve(s->frame_cache, nb_frames) >= 0) {
+            TRACE(s, "reverse window of %"PRId64" frames from keyframe %s", nb_frames / 2 - 1,
+                  av_ts2timestr(kf, &s->st_timebase));
+            start = kf;
+        }
+    }
 
-    if (t64 < 0) {
-        nmd_start(s);
-        return ret_frame(s, NULL, 0);
+    if (start == AV_NOPTS_VALUE) {
+        const int nb_frames = FFMAX(o->max_nb_cached_frames - 2, 1);
+        start = stt - s->frame_duration * nb_frames;
+        nmdi_async_get_prev_keyframe(s->actx, s->branch, start, stt, &kf);
+        if (kf != AV_NOPTS_VALUE && kf > start)
+            start = kf;
     }
 
-    const int64_t vt = get_media_time(o, t64);
-    TRACE(s, "t=%s -> vt=%s", PTS2TIMESTR(t64), PTS2TIMESTR(vt));
+    return av_clip64(av_rescale_q(start, s->st_timebase, AV_TIME_BASE_Q), o->start_time64, vt);
+}
 
-    if (s->last_ts != AV_NOPTS_VALUE && stream_time(s, vt) >= s->last_ts &&
-        s->last_pushed_frame_ts == s->last_ts) {
-        TRACE(s, "requested the last frame again");
-        return ret_frame(s, NULL, 0);
-    }
+/*
+ * Start decoding the window preceding the one just returned, while the user
+ * goes through the latter from the frame cache.
+ */
+static void prefetch_reverse_window(struct nmd_ctx *s)
+{
+    if (s->reverse_start <= s->opts.start_time64)
+        return;
 
-    if (s->first_ts != AV_NOPTS_VALUE && stream_time(s, vt) <= s->first_ts &&
-        s->last_pushed_frame_ts == s->first_ts) {
-        TRACE(s, "requested the first frame again");
-        return ret_frame(s, NULL, 0);
-    }
+    const int64_t ts = get_reverse_window_start(s, s->reverse_start - 1);
+    TRACE(s, "prefetch reverse window starting at %s", PTS2TIMESTR(ts));
 
-    AVFrame *candidate = NULL;
+    /* The stream is moved away from the latest frame returned */
+    free_frame(s, &s->cached_frame);
+    if (async_seek(s, ts) < 0)
+        return;
+    s->reverse_prefetch_ts = ts;
+    s->reverse_prefetch_pos = AV_NOPTS_VALUE;
+    s->reverse_prefetch_done = 0;
+}
 
-    /* If no frame was ever pushed, we need to pop one */
-    if (s->last_pushed_frame_ts == AV_NOPTS_VALUE) {
+/*
+ * Move the frames of the prefetched window to the frame cache as soon as they
+ * are decoded, so that the pipeline keeps decoding the whole window in the
+ * background instead of stalling once its queues are full.
+ */
+static void drain_reverse_window(struct nmd_ctx *s)
+{
+    if (s->reverse_prefetch_ts == AV_NOPTS_VALUE || s->reverse_prefetch_done)
+        return;
 
-        /* If prefetch wasn't done (async not started), and we requested a time
-         * that is beyond the initial start_time, we request an appropriate seek
-         * before we start the decoding process in order to save one seek and
-         * some decoding (a seek for the initial start_time, then another one soon
-         * after to reach the requested time). */
-        if (!nmdi_nmdi_async_started(s->actx) && vt > o->start_time64) {
-            TRACE(s, "no prefetch, but requested time (%s) beyond initial start_time (%s)",
-                  PTS2TIMESTR(vt), PTS2TIMESTR(o->start_time64));
-            nmdi_async_seek(s->actx, vt);
+    const int64_t end = stream_time(s, s->reverse_start);
+    for (;;) {
+        AVFrame *frame;
+        const int ret = pop_frame(s, &frame, AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret == AVERROR(EAGAIN))
+            return;
+        if (!frame) {
+            TRACE(s, "prefetched reverse window ended: %s", av_err2str(ret));
+            s->reverse_prefetch_done = 1;
+            return;
         }
 
-        TRACE(s, "no frame ever pushed yet, pop a candidate");
-        int ret = pop_frame(s, &candidate);
-        if (!candidate || ret < 0) {
-            TRACE(s, "can not get a single frame for this media");
-            return ret_frame(s, NULL, ret);
+        /* The frame is referenced by the frame cache */
+        s->reverse_prefetch_pos = frame->pts;
+        free_frame(s, &frame);
+        if (s->reverse_prefetch_pos >= end) {
+            TRACE(s, "reverse window prefetched from %s", PTS2TIMESTR(s->reverse_prefetch_ts));
+            s->reverse_prefetch_done = 1;
+            return;
         }
+    }
+}
 
-        /* At this point we can assume the stream timebase is known because
-         * pop_frame() was called. */
-        const int64_t stt = stream_time(s, vt);
-        diff = stt - candidate->pts;
+/*
+ * Once the user reaches the prefetched window through the frame cache, it
+ * becomes the window being returned and the one preceding it is prefetched.
+ */
+static void advance_reverse_window(struct nmd_ctx *s, int64_t vt)
+{
+    if (s->reverse_prefetch_ts == AV_NOPTS_VALUE || !s->reverse_prefetch_done ||
+        vt < s->reverse_prefetch_ts || vt >= s->reverse_start)
+        return;
 
-        TRACE(s, "diff with candidate (t=%s): %s [%"PRId64"]",
-              av_ts2timestr(candidate->pts, &s->st_timebase),
-              av_ts2timestr(diff, &s->st_timebase), diff);
+    s->reverse_start = s->reverse_prefetch_ts;
+    s->reverse_prefetch_ts = AV_NOPTS_VALUE;
+    prefetch_reverse_window(s);
+}
+
+static struct async_request get_async_request(const struct nmd_ctx *s, enum async_request_type type,
+                                              int64_t ts, int64_t diff)
+{
+    return (struct async_request){
+        .type           = type,
+        .ts             = ts,
+        .time_base      = s->st_timebase,
+        .target         = type == ASYNC_REQUEST_FORWARD ? stream_time(s, ts) : AV_NOPTS_VALUE,
+        .pos            = FFMAX(s->last_pushed_frame_ts, s->last_frame_poped_ts),
+        .diff           = diff,
+        .frame_duration = s->frame_duration,
+    };
+}
+
+static int send_frame_request(struct nmd_ctx *s, unsigned flags)
+{
+    int ret = nmdi_async_request(s->actx, s->branch, &s->req_fwd, flags);
+    if (ret < 0)
+        return ret;
+    s->req_unsent = 0;
+    s->req_pending = 1;
+    return 0;
+}
+
+/*
+ * Forward the request to the control thread, which decides whether to seek to
+ * ts (see enum async_request_type). Its decision is collected by
+ * get_request_decision() before any frame is consumed.
+ */
+static int post_frame_request(struct nmd_ctx *s, enum async_request_type type, int64_t ts, int64_t diff)
+{
+    s->req_fwd = get_async_request(s, type, ts, diff);
+
+    /* Images are not seekable: the cached one doesn't need the media to be opened */
+    if (s->image) {
+        if (type != ASYNC_REQUEST_FORWARD)
+            apply_request_seek(s);
+        return 0;
+    }
+
+    /* If the control queue is full, the request is sent by the next poll */
+    s->req_unsent = 1;
+    int ret = send_frame_request(s, AV_THREAD_MESSAGE_NONBLOCK);
+    return ret == AVERROR(EAGAIN) ? 0 : ret;
+}
+
+/*
+ * Get the decision of the control thread on the request forwarded to it. With
+ * AV_THREAD_MESSAGE_NONBLOCK, AVERROR(EAGAIN) is returned until it is known.
+ * On error, the request is dropped.
+ */
+static int get_request_decision(struct nmd_ctx *s, unsigned flags)
+{
+    int ret = 0;
+
+    if (s->req_unsent)
+        ret = send_frame_request(s, flags);
+    if (ret >= 0 && s->req_pending) {
+        ret = nmdi_async_get_request_seek(s->actx, s->branch, flags);
+        if (ret >= 0) {
+            s->req_pending = 0;
+            if (ret)
+                apply_request_seek(s);
+        }
+    }
+    if (ret == AVERROR(EAGAIN))
+        return ret;
+    if (ret < 0) {
+        TRACE(s, "unable to get the decision on the request: %s", av_err2str(ret));
+        free_frame(s, &s->req_frame);
+        s->req_unsent = s->req_pending = 0;
+        s->req_state = REQ_NONE;
+        return ret;
+    }
+    return 0;
+}
+
+/*
+ * Seek to the requested time if the stream is not positioned before it.
+ * Otherwise, the control thread decides if the frames in between are worth
+ * decoding.
+ */
+static int seek_if_needed(struct nmd_ctx *s, int64_t diff)
+{
+    int64_t vt = s->req_vt;
+    const int resync = s->cache_desync;
+
+    /* If we never returned a frame and got a candidate, we do not free it
+     * immediately, because after the seek we might not actually get
+     * anything. Typical case: images where we request a random timestamp.
+     *
+     * There is however an exception if the frame is from MediaCodec. Since
+     * the MediaCodec flush command discard both input and output buffers,
+     * we need to release any frame we retain before performing a seek
+     * otherwise the ffmpeg MediaCodec decoder will never send the command
+     * to the codec and will queue input packets until it reaches EOF.
+     */
+    AVFrame *candidate = s->req_frame;
+    const int mediacodec_candidate = candidate && candidate->format == AV_PIX_FMT_MEDIACODEC;
+
+    if (diff > 0 && !resync) {
+        TRACE(s, "diff %s, the control thread decides of a future seek",
+              av_ts2timestr(diff, &s->st_timebase));
+        if (mediacodec_candidate)
+            free_frame(s, &s->req_frame);
+        if (s->cached_frame && s->cached_frame->format == AV_PIX_FMT_MEDIACODEC)
+            free_frame(s, &s->cached_frame);
+        return post_frame_request(s, ASYNC_REQUEST_FORWARD, vt, diff);
+    }
+    if (diff >= 0 && !resync)
+        return 0;
+
+    if (resync)
+        TRACE(s, "latest frame returned from the shared cache, request seek");
+    else
+        TRACE(s, "diff %s [%"PRId64"] < 0 request backward seek",
+              av_ts2timestr(diff, &s->st_timebase), diff);
+
+    if (mediacodec_candidate || (diff > 0 && s->last_pushed_frame_ts != AV_NOPTS_VALUE))
+        free_frame(s, &s->req_frame);
+
+    free_frame(s, &s->cached_frame);
+
+    if (s->opts.reverse && diff < 0) {
+        vt = get_reverse_window_start(s, vt);
+        TRACE(s, "start reverse window at %s", PTS2TIMESTR(vt));
+        s->reverse_start = vt;
+        s->req_reverse = 1;
+    }
+
+    s->req_seek = 1;
+    return post_frame_request(s, ASYNC_REQUEST_SEEK, vt, diff);
+}
+
+/*
+ * Start looking for the frame at t64. If frames need to be consumed from the
+ * pipeline, a positive value is returned and the request is carried on by
+ * run_frame_request(); otherwise the result is set in *framep (or left NULL)
+ * immediately. With AV_THREAD_MESSAGE_NONBLOCK, AVERROR(EAGAIN) is returned
+ * if the stream position changed by a sibling context is not known yet.
+ */
+static int start_frame_request(struct nmd_ctx *s, int64_t t64, unsigned flags, AVFrame **framep)
+{
+    const struct nmdi_opts *o = &s->opts;
+
+    *framep = NULL;
+    cancel_frame_request(s);
+    stop_segment_export(s);
+
+    int ret = configure_context(s);
+    if (ret < 0)
+        return ret;
+
+    if (t64 < 0) {
+        nmd_start(s);
+        return 0;
+    }
+
+    ret = sync_stream_position(s, flags);
+    if (ret < 0)
+        return ret;
+
+    const int64_t vt = get_media_time(o, t64);
+    TRACE(s, "t=%s -> vt=%s", PTS2TIMESTR(t64), PTS2TIMESTR(vt));
+
+    /* Let the pipeline drop the frames displayed before this time */
+    nmdi_playback_hint_set_target(nmdi_async_get_playback_hint(s->actx, s->branch), vt);
+
+    if (s->last_ts != AV_NOPTS_VALUE && stream_time(s, vt) >= s->last_ts &&
+        s->last_pushed_frame_ts == s->last_ts) {
+        TRACE(s, "requested the last frame again");
+        return 0;
+    }
+
+    if (s->first_ts != AV_NOPTS_VALUE && stream_time(s, vt) <= s->first_ts &&
+        s->last_pushed_frame_ts == s->first_ts) {
+        TRACE(s, "requested the first frame again");
+        return 0;
+    }
+
+    /* Knowing the timebase is enough to be served by the frames decoded by
+     * the other contexts, without starting our own pipeline */
+    if (s->pool_entry && !s->st_timebase.den)
+        s->st_timebase = nmdi_media_pool_get_timebase(s->pool_entry);
+
+    drain_reverse_window(s);
+
+    /* Recently decoded frames are looked up first so that going back in time
+     * does not necessarily imply a seek */
+    if (s->frame_cache && s->st_timebase.den) {
+        AVFrame *frame = nmdi_frame_cache_get(s->frame_cache, stream_time(s, vt));
+        if (frame) {
+            TRACE(s, "frame for vt=%s found in cache", PTS2TIMESTR(vt));
+            /* The frame may have been decoded by another context, in which
+             * case our pipeline is not positioned around it */
+            if (s->pool_entry && !is_near_pipeline_position(s, frame->pts))
+                s->cache_desync = 1;
+            advance_reverse_window(s, vt);
+            *framep = frame;
+            return 0;
+        }
+    }
+
+    s->req_t64 = t64;
+    s->req_vt = vt;
+    s->req_seek = 0;
+    s->req_reverse = 0;
+    av_assert0(!s->req_frame);
+
+    /* The stream was moved past the requested time by the sibling context */
+    if (s->restart_ts != AV_NOPTS_VALUE && vt < s->restart_ts) {
+        TRACE(s, "stream restarted at %s, after the requested time", PTS2TIMESTR(s->restart_ts));
+        s->req_seek = 1;
+        ret = post_frame_request(s, ASYNC_REQUEST_SEEK, vt, 0);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* If no frame was ever pushed, we need to pop one */
+    if (s->last_pushed_frame_ts == AV_NOPTS_VALUE) {
+
+        /* If prefetch wasn't done (async not started), and we requested a time
+         * that is beyond the initial start_time, the control thread seeks
+         * before it starts the decoding process in order to save one seek and
+         * some decoding (a seek for the initial start_time, then another one soon
+         * after to reach the requested time). */
+        if (lookup_image(s)) {
+            TRACE(s, "image served by the image cache");
+        } else if (s->req_seek) {
+            TRACE(s, "already seeking to the requested time");
+        } else if (s->cache_desync) {
+            TRACE(s, "stream position unknown, seek to the requested time");
+            s->req_seek = 1;
+            ret = post_frame_request(s, ASYNC_REQUEST_SEEK, vt, 0);
+        } else if (vt > o->start_time64) {
+            TRACE(s, "requested time (%s) beyond initial start_time (%s), seek unless prefetched",
+                  PTS2TIMESTR(vt), PTS2TIMESTR(o->start_time64));
+            ret = post_frame_request(s, ASYNC_REQUEST_START, vt, 0);
+        }
+        if (ret < 0)
+            return ret;
+
+        TRACE(s, "no frame ever pushed yet, pop a candidate");
+        s->req_state = REQ_PROBE;
+        return 1;
+    }
+
+    /* The stream is positioned in the window preceding the one returned, before
+     * the requested time unless the frame was evicted from the cache */
+    if (s->reverse_prefetch_ts != AV_NOPTS_VALUE) {
+        if (vt >= s->reverse_prefetch_ts && vt < s->reverse_start && !s->reverse_prefetch_done &&
+            (s->reverse_prefetch_pos == AV_NOPTS_VALUE || s->reverse_prefetch_pos < stream_time(s, vt))) {
+            TRACE(s, "reverse window prefetched from %s", PTS2TIMESTR(s->reverse_prefetch_ts));
+            s->reverse_start = s->reverse_prefetch_ts;
+            s->reverse_prefetch_ts = AV_NOPTS_VALUE;
+            s->req_seek = 1;
+            s->req_reverse = 1;
+            s->req_state = REQ_CONSUME;
+            return 1;
+        }
+        TRACE(s, "prefetched reverse window left unused");
+        s->reverse_prefetch_ts = AV_NOPTS_VALUE;
+        s->cache_desync = 1;
+    }
+
+    /* At this point we can assume the stream timebase is known because
+     * a frame was already pushed. */
+    const int64_t diff = stream_time(s, vt) - s->last_pushed_frame_ts;
+
+    TRACE(s, "diff with latest frame (t=%s) returned: %s [%"PRId64"]",
+          av_ts2timestr(s->last_pushed_frame_ts, &s->st_timebase),
+          av_ts2timestr(diff, &s->st_timebase),
+          diff);
+
+    if (!diff)
+        return 0;
+
+    ret = seek_if_needed(s, diff);
+    if (ret < 0)
+        return ret;
+
+    s->req_state = REQ_CONSUME;
+    return 1;
+}
+
+/*
+ * Carry on the request started by start_frame_request() until its frame is
+ * known. With AV_THREAD_MESSAGE_NONBLOCK, AVERROR(EAGAIN) is returned as soon
+ * as the pipeline has no frame ready, and the next call resumes from there.
+ */
+static int run_frame_request(struct nmd_ctx *s, unsigned flags, AVFrame **framep)
+{
+    int ret;
+    const int64_t vt = s->req_vt;
+
+    *framep = NULL;
+
+    if (s->req_state == REQ_PROBE) {
+        ret = get_request_decision(s, flags);
+        if (ret < 0)
+            return ret;
+
+        AVFrame *candidate = NULL;
+        ret = pop_frame(s, &candidate, flags);
+        if (ret == AVERROR(EAGAIN))
+            return ret;
+        s->req_state = REQ_NONE;
+        if (!candidate || ret < 0) {
+            TRACE(s, "can not get a single frame for this media");
+            return ret;
+        }
+
+        /* At this point we can assume the stream timebase is known because
+         * pop_frame() was called. */
+        const int64_t diff = stream_time(s, vt) - candidate->pts;
+
+        TRACE(s, "diff with candidate (t=%s): %s [%"PRId64"]",
+              av_ts2timestr(candidate->pts, &s->st_timebase),
+              av_ts2timestr(diff, &s->st_timebase), diff);
 
         /* No frame was ever pushed, but the timestamp of the first frame
          * obtained is past the requested time. This should never happen if a
@@ -771,68 +1790,49 @@ struct nmd_frame *nmd_get_frame_ms(struct nmd_ctx *s, int64_t t64)
         if (diff < 0) {
             /* Warning: we must absolutely NOT save the timestamp of the
              * candidate if the first time requested is not actually 0 */
-            if (t64 == 0)
+            if (s->req_t64 == 0)
                 s->first_ts = candidate->pts;
-            return ret_frame(s, candidate, ret);
+            *framep = candidate;
+            return ret;
         }
 
-    } else {
-        /* At this point we can assume the stream timebase is known because
-         * a frame was already pushed. */
-        const int64_t stt = stream_time(s, vt);
-        diff = stt - s->last_pushed_frame_ts;
-
-        TRACE(s, "diff with latest frame (t=%s) returned: %s [%"PRId64"]",
-              av_ts2timestr(s->last_pushed_frame_ts, &s->st_timebase),
-              av_ts2timestr(diff, &s->st_timebase),
-              diff);
-    }
+        if (!diff) {
+            *framep = candidate;
+            return 0;
+        }
 
-    if (!diff)
-        return ret_frame(s, candidate, 0);
-
-    /* Check if a seek is needed */
-    const int forward_seek = av_compare_ts(diff, s->st_timebase, o->dist_time_seek_trigger64, AV_TIME_BASE_Q) >= 0;
-    if (diff < 0 || forward_seek) {
-        if (diff < 0)
-            TRACE(s, "diff %s [%"PRId64"] < 0 request backward seek",
-                  av_ts2timestr(diff, &s->st_timebase), diff);
-        else
-            TRACE(s, "diff %s > %s request future seek",
-                  av_ts2timestr(diff, &s->st_timebase),
-                  PTS2TIMESTR(o->dist_time_seek_trigger64));
-
-        /* If we never returned a frame and got a candidate, we do not free it
-         * immediately, because after the seek we might not actually get
-         * anything. Typical case: images where we request a random timestamp.
-         *
-         * There is however an exception if the frame is from MediaCodec. Since
-         * the MediaCodec flush command discard both input and output buffers,
-         * we need to release any frame we retain before performing a seek
-         * otherwise the ffmpeg MediaCodec decoder will never send the command
-         * to the codec and will queue input packets until it reaches EOF.
-         */
-        if ((candidate && candidate->format == AV_PIX_FMT_MEDIACODEC) ||
-            (diff > 0 && s->last_pushed_frame_ts != AV_NOPTS_VALUE)) {
-            av_frame_free(&candidate);
-        }
-
-        av_frame_free(&s->cached_frame);
-
-        ret = nmdi_async_seek(s->actx, vt);
+        s->req_frame = candidate;
+        ret = seek_if_needed(s, diff);
         if (ret < 0) {
-            av_frame_free(&candidate);
-            return ret_frame(s, NULL, ret);
+            free_frame(s, &s->req_frame);
+            return ret;
         }
+        s->req_state = REQ_CONSUME;
     }
 
+    av_assert0(s->req_state == REQ_CONSUME);
+
+    /* Whether the control thread seeks must be known before consuming any
+     * frame */
+    ret = get_request_decision(s, flags);
+    if (ret < 0)
+        return ret;
+
+    AVFrame *candidate = s->req_frame;
+    s->req_frame = NULL;
+
     /* Consume frames until we get a frame as accurate as possible */
     for (;;) {
         const int next_is_cached_frame = !!s->cached_frame;
 
         TRACE(s, "grab another frame");
         AVFrame *next = NULL;
-        int ret = pop_frame(s, &next);
+        ret = pop_frame(s, &next, flags);
+        if (ret == AVERROR(EAGAIN)) {
+            TRACE(s, "no frame ready yet");
+            s->req_frame = candidate;
+            return ret;
+        }
         av_assert0(!s->cached_frame);
         if (!next || ret < 0) {
             TRACE(s, "no more frame");
@@ -848,10 +1848,9 @@ struct nmd_frame *nmd_get_frame_ms(struct nmd_ctx *s, int64_t t64)
         if (s->opts.use_pkt_duration && next->pkt_duration > 0 && rescaled_vt >= next->pts) {
             const int64_t next_guessed_pts = next->pts + next->pkt_duration;
             if (rescaled_vt < next_guessed_pts) {
-                av_frame_free(&candidate);
-                av_frame_free(&s->cached_frame);
-                s->cached_frame = NULL;
-                return ret_frame(s, next, 0);
+                free_frame(s, &candidate);
+                candidate = next;
+                break;
             }
         }
 
@@ -867,7 +1866,7 @@ struct nmd_frame *nmd_get_frame_ms(struct nmd_ctx *s, int64_t t64)
             }
             break;
         }
-        av_frame_free(&candidate);
+        free_frame(s, &candidate);
         candidate = next;
         if (candidate->pts == rescaled_vt) {
             TRACE(s, "grabbed exact frame %s", av_ts2timestr(candidate->pts, &s->st_timebase));
@@ -875,7 +1874,90 @@ struct nmd_frame *nmd_get_frame_ms(struct nmd_ctx *s, int64_t t64)
         }
     }
 
-    return ret_frame(s, candidate, ret);
+    s->req_state = REQ_NONE;
+    if (s->req_reverse)
+        prefetch_reverse_window(s);
+    *framep = candidate;
+    return 0;
+}
+
+struct nmd_frame *nmd_get_frame_ms(struct nmd_ctx *s, int64_t t64)
+{
+    START_FUNC_T("GET FRAME", t64 / 1000000.);
+
+#if SYNTH_FRAME
+    return ret_synth_frame(s, t64);
+#endif
+
+    AVFrame *frame;
+    int ret = start_frame_request(s, t64, 0, &frame);
+    if (ret > 0)
+        ret = run_frame_request(s, 0, &frame);
+    return ret_frame(s, frame, ret);
+}
+
+int nmd_request_frame_ms(struct nmd_ctx *s, int64_t t64)
+{
+    START_FUNC_T("REQUEST FRAME", t64 / 1000000.);
+
+    AVFrame *frame;
+    int ret = start_frame_request(s, t64, AV_THREAD_MESSAGE_NONBLOCK, &frame);
+    if (ret == AVERROR(EAGAIN)) {
+        /* Started again by nmd_poll_frame() */
+        s->req_state = REQ_START;
+        s->req_t64 = t64;
+        ret = 0;
+    } else if (ret == 0) {
+        /* Honored already, the result is kept for nmd_poll_frame() */
+        s->req_state  = REQ_DONE;
+        s->req_frame  = frame;
+        s->req_status = 0;
+    } else if (ret < 0) {
+        s->eof = ret == AVERROR_EOF || ret == AVERROR_EXIT;
+    }
+    END_FUNC(MAX_ASYNC_OP_TIME);
+    return FFMIN(ret, 0);
+}
+
+int nmd_request_frame(struct nmd_ctx *s, double t)
+{
+    return nmd_request_frame_ms(s, TIME2INT64(t));
+}
+
+int nmd_poll_frame(struct nmd_ctx *s, struct nmd_frame **framep)
+{
+    AVFrame *frame;
+    int ret;
+
+    *framep = NULL;
+
+    if (s->req_state == REQ_NONE)
+        return AVERROR(EINVAL);
+
+    START_FUNC("POLL FRAME");
+
+    if (s->req_state == REQ_DONE) {
+        frame = s->req_frame;
+        ret = s->req_status;
+        s->req_frame = NULL;
+        s->req_state = REQ_NONE;
+    } else {
+        ret = 1;
+        if (s->req_state == REQ_START) {
+            ret = start_frame_request(s, s->req_t64, AV_THREAD_MESSAGE_NONBLOCK, &frame);
+            if (ret == AVERROR(EAGAIN)) {
+                s->req_state = REQ_START;
+                return 0;
+            }
+        }
+        if (ret > 0)
+            ret = run_frame_request(s, AV_THREAD_MESSAGE_NONBLOCK, &frame);
+        if (ret == AVERROR(EAGAIN))
+            return 0;
+    }
+
+    *framep = ret_frame(s, frame, ret);
+    return ret < 0 && ret != AVERROR_EOF && ret != AVERROR_EXIT ? ret : 1;
 }
 
 struct nmd_frame *nmd_get_frame(struct nmd_ctx *s, double t)
@@ -883,32 +1965,613 @@ struct nmd_frame *nmd_get_frame(struct nmd_ctx *s, double t)
     return nmd_get_frame_ms(s, TIME2INT64(t));
 }
 
+/* Pipeline decoding the segments assigned to one export thread */
+static struct nmd_ctx *create_export_reader(const struct nmd_ctx *s)
+{
+    const struct nmdi_opts *o = &s->opts;
+
+    struct nmd_ctx *r = nmd_create(s->filename);
+    if (!r)
+        return NULL;
+
+    struct nmdi_opts *ro = &r->opts;
+    ro->stream_idx        = o->stream_idx;
+    ro->start_time        = o->start_time;
+    ro->end_time          = o->end_time;
+    ro->sw_pix_fmt        = o->sw_pix_fmt;
+    ro->autorotate        = o->autorotate;
+    ro->max_pixels        = o->max_pixels;
+    ro->use_pkt_duration  = o->use_pkt_duration;
+    ro->native_rgba       = o->native_rgba;
+    ro->nb_threads        = o->nb_threads;
+    ro->thread_stack_size = o->thread_stack_size;
+    ro->io                = o->io;
+    ro->io_buffer_size    = o->io_buffer_size;
+    ro->io_callbacks      = o->io_callbacks;
+
+    /* The frames of a whole segment are buffered, more than the surfaces a
+     * hardware decoder can hold */
+    ro->auto_hwaccel      = 0;
+
+    if ((o->filters && nmd_set_option(r, "filters", o->filters) < 0) ||
+        (o->keyframe_index_file && nmd_set_option(r, "keyframe_index_file", o->keyframe_index_file) < 0))
+        nmd_freep(&r);
+    return r;
+}
+
+/*
+ * Pipeline reading the stream ahead of the export readers to index its
+ * keyframes: only the keyframes are decoded, and the segments can be planned
+ * when the demuxer index is missing or incomplete.
+ */
+static struct nmd_ctx *create_export_scanner(const struct nmd_ctx *s)
+{
+    struct nmd_ctx *r = create_export_reader(s);
+    if (!r)
+        return NULL;
+    r->opts.keyframes_only = 1;
+    return r;
+}
+
+/* Called from the export threads, each one using its own reader */
+static int export_seek(void *opaque, int reader, int64_t ts)
+{
+    const struct nmd_ctx *s = opaque;
+    struct nmd_ctx *r = s->export_readers[reader];
+
+    /* Rounded up so that the keyframe is never fixed up to an earlier time */
+    return async_seek(r, av_rescale_q_rnd(ts, s->st_timebase, AV_TIME_BASE_Q, AV_ROUND_UP));
+}
+
+static int export_read(void *opaque, int reader, AVFrame *dst)
+{
+    const struct nmd_ctx *s = opaque;
+    struct nmd_ctx *r = s->export_readers[reader];
+
+    AVFrame *frame;
+    int ret = pop_frame(r, &frame, 0);
+    if (!frame)
+        return ret < 0 ? ret : AVERROR_EOF;
+
+    av_frame_move_ref(dst, frame);
+    free_frame(r, &frame);
+    return 0;
+}
+
+static int export_next_keyframe(void *opaque, int reader, int64_t ts, int64_t *kf)
+{
+    struct nmd_ctx *s = opaque;
+    struct nmd_ctx *r = s->export_readers[reader];
+
+    /* The index is set up along with the demuxer */
+    struct nmd_info info;
+    int ret = nmdi_async_fetch_info(r->actx, r->branch, &info, 0);
+    if (ret < 0)
+        return ret;
+
+    /* The index is shared by every pipeline of the export */
+    for (;;) {
+        nmdi_async_get_next_keyframe(r->actx, r->branch, ts, kf);
+        if (*kf != AV_NOPTS_VALUE || s->export_scan_eof)
+            return 0;
+
+        struct nmd_ctx *scanner = s->export_scanner;
+        AVFrame *frame;
+        ret = pop_frame(scanner, &frame, 0);
+        if (!frame) {
+            if (ret < 0 && ret != AVERROR_EOF)
+                return ret;
+            TRACE(s, "keyframes indexed up to the end of the stream");
+            s->export_scan_eof = 1;
+            continue;
+        }
+        free_frame(scanner, &frame);
+    }
+}
+
+static int use_segment_export(struct nmd_ctx *s)
+{
+    const struct nmdi_opts *o = &s->opts;
+    return o->export_segments > 1 && o->avselect == NMD_SELECT_VIDEO &&
+           !o->reverse && !o->keyframes_only && !s->parent && !s->audio_ctx &&
+           !lookup_image(s);
+}
+
+/*
+ * Start the segmented decoding right after the latest frame returned, or from
+ * the beginning.
+ */
+static int start_segment_export(struct nmd_ctx *s)
+{
+    const struct nmdi_opts *o = &s->opts;
+    const int nb_readers = o->export_segments;
+
+    s->export_readers = av_calloc(nb_readers, sizeof(*s->export_readers));
+    if (!s->export_readers)
+        return AVERROR(ENOMEM);
+    s->nb_export_readers = nb_readers;
+
+    for (int i = 0; i < nb_readers; i++) {
+        struct nmd_ctx *r = create_export_reader(s);
+        if (!r)
+            return AVERROR(ENOMEM);
+        s->export_readers[i] = r;
+        int ret = configure_context(r);
+        if (ret < 0)
+            return ret;
+        nmdi_async_share_keyframe_index(r->actx, s->actx);
+    }
+
+    s->export_scanner = create_export_scanner(s);
+    if (!s->export_scanner)
+        return AVERROR(ENOMEM);
+    s->export_scan_eof = 0;
+    int ret = configure_context(s->export_scanner);
+    if (ret < 0)
+        return ret;
+    nmdi_async_share_keyframe_index(s->export_scanner->actx, s->actx);
+
+    struct nmd_info info;
+    ret = nmdi_async_fetch_info(s->export_readers[0]->actx, 0, &info, 0);
+    if (ret < 0)
+        return ret;
+    s->st_timebase = av_make_q(info.timebase[0], info.timebase[1]);
+    av_assert0(s->st_timebase.den);
+
+    const int64_t resume_ts = s->last_pushed_frame_ts;
+    const int64_t start = resume_ts != AV_NOPTS_VALUE ? resume_ts : stream_time(s, o->start_time64);
+    const int64_t end = o->end_time64 != AV_NOPTS_VALUE ? stream_time(s, o->end_time64) : AV_NOPTS_VALUE;
+
+    /* The keyframes are located from where the export starts */
+    if (resume_ts != AV_NOPTS_VALUE) {
+        ret = async_seek(s->export_scanner, av_rescale_q(resume_ts, s->st_timebase, AV_TIME_BASE_Q));
+        if (ret < 0)
+            return ret;
+    }
+
+    s->segment_export = nmdi_segment_export_alloc();
+    if (!s->segment_export)
+        return AVERROR(ENOMEM);
+
+    const struct segment_export_callbacks cb = {
+        .opaque        = s,
+        .seek          = export_seek,
+        .read          = export_read,
+        .next_keyframe = export_next_keyframe,
+    };
+    return nmdi_segment_export_init(s->segment_export, s->log_ctx, nb_readers, o->max_queued_memory,
+                                    s->st_timebase, start, end, resume_ts, &cb);
+}
+
+static struct nmd_frame *get_next_exported_frame(struct nmd_ctx *s)
+{
+    /* Restart from the beginning after EOF */
+    if (s->eof) {
+        stop_segment_export(s);
+        s->last_pushed_frame_ts = AV_NOPTS_VALUE;
+    }
+
+    if (!s->segment_export) {
+        free_frame(s, &s->cached_frame);
+        int ret = start_segment_export(s);
+        if (ret < 0) {
+            LOG(s, ERROR, "Unable to start the segment export: %s", av_err2str(ret));
+            stop_segment_export(s);
+            return ret_frame(s, NULL, ret);
+        }
+    }
+
+    AVFrame *frame = nmdi_obj_pool_get(s->frame_pool);
+    if (!frame)
+        return ret_frame(s, NULL, AVERROR(ENOMEM));
+
+    int ret = nmdi_segment_export_read(s->segment_export, frame);
+    if (ret < 0) {
+        free_frame(s, &frame);
+        return ret_frame(s, NULL, ret);
+    }
+    return ret_frame(s, frame, 0);
+}
+
 struct nmd_frame *nmd_get_next_frame(struct nmd_ctx *s)
 {
     START_FUNC("GET NEXT FRAME");
 
+    cancel_frame_request(s);
+
     int ret = configure_context(s);
     if (ret < 0)
         return ret_frame(s, NULL, ret);
 
+    if (use_segment_export(s))
+        return get_next_exported_frame(s);
+
     if (s->eof) {
-        av_frame_free(&s->cached_frame);
+        free_frame(s, &s->cached_frame);
         s->last_pushed_frame_ts = AV_NOPTS_VALUE;
 
         const struct nmdi_opts *o = &s->opts;
-        ret = nmdi_async_seek(s->actx, o->start_time64);
+        ret = async_seek(s, o->start_time64);
         if (ret < 0)
             LOG(s, ERROR, "Failed to seek back to beginning of the file");
     }
 
-    AVFrame *frame = NULL;
-    ret = pop_frame(s, &frame);
-    if (!frame || ret < 0)
+    ret = sync_stream_position(s, 0);
+    if (ret < 0)
         return ret_frame(s, NULL, ret);
 
+    /* Go on from the latest frame returned rather than from the prefetched
+     * reverse window */
+    if (s->reverse_prefetch_ts != AV_NOPTS_VALUE) {
+        s->resume_ts = s->last_pushed_frame_ts;
+        s->reverse_prefetch_ts = AV_NOPTS_VALUE;
+    }
+
+    /* Resume right after the latest frame returned if the sibling context
+     * moved the stream away from it */
+    const int64_t resume_ts = s->resume_ts;
+    if (resume_ts != AV_NOPTS_VALUE) {
+        const int64_t resume_time = av_rescale_q(resume_ts, s->st_timebase, AV_TIME_BASE_Q);
+        if (s->restart_ts > resume_time) {
+            TRACE(s, "stream restarted at %s, seek back to %s",
+                  PTS2TIMESTR(s->restart_ts), PTS2TIMESTR(resume_time));
+            ret = async_seek(s, resume_time);
+            if (ret < 0)
+                return ret_frame(s, NULL, ret);
+        }
+    }
+
+    AVFrame *frame = NULL;
+    for (;;) {
+        ret = pop_frame(s, &frame, 0);
+        if (!frame || ret < 0)
+            return ret_frame(s, NULL, ret);
+        if (resume_ts == AV_NOPTS_VALUE || frame->pts > resume_ts)
+            break;
+        TRACE(s, "drop frame %s already returned",
+              av_ts2timestr(frame->pts, &s->st_timebase));
+        free_frame(s, &frame);
+    }
+
     return ret_frame(s, frame, ret);
 }
 
+struct frame_request {
+    int64_t t64;
+    int idx;
+};
+
+static int cmp_frame_request(const void *a, const void *b)
+{
+    const struct frame_request *ra = a;
+    const struct frame_request *rb = b;
+    if (ra->t64 != rb->t64)
+        return ra->t64 < rb->t64 ? -1 : 1;
+    return ra->idx - rb->idx;
+}
+
+/* Get a new reference to a frame already returned to the user */
+static struct nmd_frame *dup_frame(struct nmd_ctx *s, const struct nmd_frame *src)
+{
+    AVFrame *frame = s->frame_pool ? nmdi_obj_pool_get(s->frame_pool) : av_frame_alloc();
+    if (!frame)
+        return NULL;
+    if (av_frame_ref(frame, src->internal) < 0) {
+        free_frame(s, &frame);
+        return NULL;
+    }
+
+    struct frame_container *c = s->container_pool ? nmdi_obj_pool_get(s->container_pool)
+                                                  : alloc_container();
+    if (!c) {
+        free_frame(s, &frame);
+        return NULL;
+    }
+    c->frame = *src;
+    c->frame.internal = frame;
+    if (s->container_pool) {
+        c->pool       = nmdi_obj_pool_ref(s->container_pool);
+        c->frame_pool = nmdi_obj_pool_ref(s->frame_pool);
+    }
+    return &c->frame;
+}
+
+int nmd_get_frames_ms(struct nmd_ctx *s, const int64_t *ts, int nb_ts, struct nmd_frame **frames)
+{
+    if (nb_ts <= 0)
+        return 0;
+
+    START_FUNC("GET FRAMES");
+
+    /* The timing of the whole call, not of the last frame obtained */
+    const char *func_name = s->cur_func_name;
+    const int64_t entering_time = s->entering_time;
+
+    memset(frames, 0, nb_ts * sizeof(*frames));
+
+    struct frame_request *reqs = av_malloc_array(nb_ts, sizeof(*reqs));
+    if (!reqs)
+        return AVERROR(ENOMEM);
+    for (int i = 0; i < nb_ts; i++)
+        reqs[i] = (struct frame_request){.t64 = ts[i], .idx = i};
+
+    /* Going through the requests in order makes a single forward pass, in
+     * which nmd_get_frame_ms() only seeks when it skips some decoding */
+    qsort(reqs, nb_ts, sizeof(*reqs), cmp_frame_request);
+
+    int ret = 0;
+    struct nmd_frame *prev = NULL;
+    for (int i = 0; i < nb_ts; i++) {
+        const int64_t t64 = FFMAX(reqs[i].t64, 0);
+        struct nmd_frame *frame = nmd_get_frame_ms(s, t64);
+
+        if (!frame && s->frame_status < 0) {
+            ret = s->frame_status;
+            break;
+        } else if (!frame && prev) {
+            /* Same frame as the previous request */
+            frame = dup_frame(s, prev);
+            if (!frame) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+        } else if (!frame && s->last_pushed_frame_ts != AV_NOPTS_VALUE && !s->eof) {
+            /* Same frame as the latest one returned before this call, which
+             * we don't own anymore: get it again from the pipeline */
+            TRACE(s, "frame at %s already returned, get it again", PTS2TIMESTR(t64));
+            free_frame(s, &s->cached_frame);
+            s->last_pushed_frame_ts = AV_NOPTS_VALUE;
+            ret = async_seek(s, get_media_time(&s->opts, t64));
+            if (ret < 0)
+                break;
+            frame = nmd_get_frame_ms(s, t64);
+            if (!frame && s->frame_status < 0) {
+                ret = s->frame_status;
+                break;
+            }
+        }
+
+        frames[reqs[i].idx] = frame;
+        if (frame)
+            prev = frame;
+    }
+
+    av_free(reqs);
+    if (ret < 0) {
+        for (int i = 0; i < nb_ts; i++)
+            nmd_frame_releasep(&frames[i]);
+    }
+
+    s->cur_func_name = func_name;
+    s->entering_time = entering_time;
+    END_FUNC(MAX_SYNC_OP_TIME * nb_ts);
+    return ret;
+}
+
+/* Pop the next frame from the pipeline into the audio ring */
+static int feed_audio_ring(struct nmd_ctx *s)
+{
+    AVFrame *frame;
+    int ret = pop_frame(s, &frame, 0);
+    if (!frame)
+        return ret < 0 ? ret : AVERROR_EOF;
+
+    const int64_t pos = av_rescale_q(frame->pts, s->st_timebase, av_make_q(1, frame->sample_rate));
+    ret = nmdi_audio_ring_push(s->audio_ring, frame, pos);
+    free_frame(s, &frame);
+    return ret;
+}
+
+static int read_audio(struct nmd_ctx *s, int64_t t64, int nb_samples, float *dst)
+{
+    const struct nmdi_opts *o = &s->opts;
+    if (o->avselect != NMD_SELECT_AUDIO || o->audio_texture) {
+        LOG(s, ERROR, "Audio samples can only be read from an audio context without audio_texture");
+        return AVERROR(EINVAL);
+    }
+    if (nb_samples < 0 || nb_samples > INT_MAX / 2) {
+        LOG(s, ERROR, "Invalid number of samples requested (%d)", nb_samples);
+        return AVERROR(EINVAL);
+    }
+
+    if (!s->audio_ring) {
+        s->audio_ring = nmdi_audio_ring_alloc();
+        if (!s->audio_ring)
+            return AVERROR(ENOMEM);
+        int ret = nmdi_audio_ring_init(s->audio_ring, s->log_ctx, 2);
+        if (ret < 0) {
+            nmdi_audio_ring_free(&s->audio_ring);
+            return ret;
+        }
+    }
+    struct audio_ring *r = s->audio_ring;
+
+    int ret = sync_stream_position(s, 0);
+    if (ret < 0)
+        return ret;
+
+    /* The end_time clipping is honored by the pipeline, the samples past it
+     * are zero-filled like the ones past the end of the media */
+    const int64_t vt = o->start_time64 + t64;
+
+    /* The sample rate is only known from the first frame, so the first read
+     * seeks at the requested time right away */
+    if (!nmdi_audio_ring_get_sample_rate(r) && !s->audio_eof) {
+        if (vt > o->start_time64) {
+            TRACE(s, "first read at %s, seek there", PTS2TIMESTR(vt));
+            ret = async_seek(s, vt);
+            if (ret < 0)
+                return ret;
+        }
+        ret = feed_audio_ring(s);
+        if (ret == AVERROR_EOF)
+            s->audio_eof = 1;
+        else if (ret < 0)
+            return ret;
+    }
+
+    const int sample_rate = nmdi_audio_ring_get_sample_rate(r);
+    if (!sample_rate) {
+        TRACE(s, "no audio sample available");
+        memset(dst, 0, nb_samples * 2 * sizeof(*dst));
+        return 0;
+    }
+
+    const int64_t pos = av_rescale(vt, sample_rate, AV_TIME_BASE);
+    const int64_t end = pos + nb_samples;
+
+    /* Keep room for the window and for the one following it */
+    ret = nmdi_audio_ring_reserve(r, 2 * nb_samples);
+    if (ret < 0)
+        return ret;
+
+    /* The stream was moved by the sibling context */
+    if (s->restart_ts != AV_NOPTS_VALUE) {
+        nmdi_audio_ring_seek(r, av_rescale(s->restart_ts, sample_rate, AV_TIME_BASE));
+        s->audio_eof = 0;
+    }
+
+    /* Small shifts are served from the ring or by decoding forward, only the
+     * windows before the ring or far after it need a seek */
+    int64_t ring_start, ring_end;
+    if (!nmdi_audio_ring_get_range(r, &ring_start, &ring_end) || pos < ring_start) {
+        TRACE(s, "samples at %s not reachable from the ring, seek", PTS2TIMESTR(vt));
+        nmdi_audio_ring_seek(r, pos);
+        s->audio_eof = 0;
+        ret = async_seek(s, vt);
+        if (ret < 0)
+            return ret;
+    } else if (pos > ring_end && !s->audio_eof) {
+        /* The control thread decides if decoding up to the samples is
+         * cheaper than seeking */
+        const int64_t ring_stt = stream_time(s, av_rescale(ring_end, AV_TIME_BASE, sample_rate));
+        const struct async_request req = get_async_request(s, ASYNC_REQUEST_FORWARD, vt,
+                                                           stream_time(s, vt) - ring_stt);
+        ret = nmdi_async_request(s->actx, s->branch, &req, 0);
+        if (ret >= 0)
+            ret = nmdi_async_get_request_seek(s->actx, s->branch, 0);
+        if (ret < 0)
+            return ret;
+        if (ret) {
+            TRACE(s, "samples at %s reached with a seek", PTS2TIMESTR(vt));
+            nmdi_audio_ring_seek(r, pos);
+            s->audio_eof = 0;
+            reset_stream_position(s);
+        }
+    }
+
+    while (!s->audio_eof && (!nmdi_audio_ring_get_range(r, &ring_start, &ring_end) || ring_end < end)) {
+        ret = feed_audio_ring(s);
+        if (ret == AVERROR_EOF) {
+            TRACE(s, "reached EOF while reading the samples");
+            s->audio_eof = 1;
+        } else if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return nmdi_audio_ring_read(r, pos, nb_samples, dst);
+}
+
+int nmd_read_audio(struct nmd_ctx *s, double t, int nb_samples, float *dst)
+{
+    START_FUNC_T("READ AUDIO", t);
+
+    cancel_frame_request(s);
+
+    int ret = configure_context(s);
+    if (ret < 0)
+        return ret;
+
+    ret = read_audio(s, TIME2INT64(t), nb_samples, dst);
+    END_FUNC(MAX_SYNC_OP_TIME);
+    return ret;
+}
+
+/* Called from the waveform thread */
+static int read_waveform_frame(void *opaque, AVFrame *dst)
+{
+    struct nmd_ctx *s = opaque;
+
+    AVFrame *frame;
+    int ret = pop_frame(s, &frame, 0);
+    if (!frame)
+        return ret < 0 ? ret : AVERROR_EOF;
+
+    av_frame_move_ref(dst, frame);
+    free_frame(s, &frame);
+    dst->pts = av_rescale_q(dst->pts, s->st_timebase, av_make_q(1, dst->sample_rate));
+    return 0;
+}
+
+/* Audio pipeline of the overview, running on its own at full speed */
+static struct nmd_ctx *create_waveform_reader(const struct nmd_ctx *s)
+{
+    const struct nmdi_opts *o = &s->opts;
+
+    struct nmd_ctx *r = nmd_create(s->filename);
+    if (!r)
+        return NULL;
+
+    struct nmdi_opts *ro = &r->opts;
+    ro->avselect          = NMD_SELECT_AUDIO;
+    ro->audio_texture     = 0;
+    ro->stream_idx        = o->avselect == NMD_SELECT_AUDIO ? o->stream_idx : -1;
+    ro->start_time        = o->start_time;
+    ro->end_time          = o->end_time;
+    ro->sample_rate       = o->sample_rate;
+    ro->thread_stack_size = o->thread_stack_size;
+    ro->io                = o->io;
+    ro->io_buffer_size    = o->io_buffer_size;
+    ro->io_callbacks      = o->io_callbacks;
+
+    /* Keep the decoder busy while the peaks are computed */
+    ro->max_nb_frames     = 8;
+    ro->max_nb_sink       = 8;
+    return r;
+}
+
+int nmd_get_waveform(struct nmd_ctx *s, double start, double end, int nb_peaks, struct nmd_audio_peak *peaks)
+{
+    START_FUNC_T("GET WAVEFORM", start);
+
+    int ret = configure_context(s);
+    if (ret < 0)
+        return ret;
+
+    if (nb_peaks <= 0 || end <= start) {
+        LOG(s, ERROR, "Invalid waveform request: %d peaks between %g and %g", nb_peaks, start, end);
+        return AVERROR(EINVAL);
+    }
+
+    if (!s->waveform) {
+        s->waveform_reader = create_waveform_reader(s);
+        s->waveform = nmdi_waveform_alloc();
+        if (!s->waveform_reader || !s->waveform) {
+            nmdi_waveform_free(&s->waveform);
+            nmd_freep(&s->waveform_reader);
+            return AVERROR(ENOMEM);
+        }
+
+        /* The reader is only used by the waveform thread from now on */
+        ret = configure_context(s->waveform_reader);
+        if (ret >= 0)
+            ret = nmdi_waveform_init(s->waveform, s->log_ctx, s->filename, &s->waveform_reader->opts,
+                                     s->opts.waveform_file, read_waveform_frame, s->waveform_reader);
+        if (ret < 0) {
+            nmdi_waveform_free(&s->waveform);
+            nmd_freep(&s->waveform_reader);
+            return ret;
+        }
+    }
+
+    const struct nmdi_opts *o = &s->opts;
+    ret = nmdi_waveform_get(s->waveform, o->start_time64 + TIME2INT64(start),
+                            o->start_time64 + TIME2INT64(end), nb_peaks, peaks);
+    END_FUNC(MAX_SYNC_OP_TIME);
+    return ret;
+}
+
 int nmd_get_info(struct nmd_ctx *s, struct nmd_info *info)
 {
     START_FUNC("GET INFO");
@@ -916,9 +2579,14 @@ int nmd_get_info(struct nmd_ctx *s, struct nmd_info *info)
     int ret = configure_context(s);
     if (ret < 0)
         goto end;
-    ret = nmdi_async_fetch_info(s->actx, info);
-    if (ret < 0)
-        goto end;
+    if (lookup_image(s)) {
+        *info = s->image_info;
+        ret = 0;
+    } else {
+        ret = nmdi_async_fetch_info(s->actx, s->branch, info, 0);
+        if (ret < 0)
+            goto end;
+    }
     TRACE(s, "media info: %dx%d %f tb:%d/%d",
           info->width, info->height, info->duration,
           info->timebase[0], info->timebase[1]);
@@ -928,6 +2596,24 @@ end:
     return ret;
 }
 
+int nmd_get_stats(struct nmd_ctx *s, struct nmd_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (s->actx)
+        nmdi_async_get_stats(s->actx, s->branch, stats);
+
+    /* Each segment of an export is decoded after a seek of its reader */
+    for (int i = 0; i < s->nb_export_readers; i++) {
+        struct nmd_stats reader_stats = {0};
+        nmdi_async_get_stats(s->export_readers[i]->actx, 0, &reader_stats);
+        stats->nb_seeks          += reader_stats.nb_seeks;
+        stats->nb_frames_decoded += reader_stats.nb_frames_decoded;
+        stats->nb_frames_dropped += reader_stats.nb_frames_dropped;
+    }
+    stats->nb_frames_returned = s->nb_frames_returned;
+    return 0;
+}
+
 int nmd_get_duration(struct nmd_ctx *s, double *duration)
 {
     START_FUNC("GET DURATION");
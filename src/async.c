@@ -23,7 +23,6 @@
 #include <libavutil/avassert.h>
 #include <libavutil/avstring.h>
 #include <libavutil/opt.h>
-#include <libavutil/threadmessage.h>
 #include <libavutil/time.h>
 #include <libavutil/timestamp.h>
 
@@ -32,9 +31,19 @@
 #include "log.h"
 #include "pthread_compat.h"
 
+#include "info_cache.h"
+#include "keyframe_index.h"
+#include "mem_budget.h"
 #include "mod_demuxing.h"
 #include "mod_decoding.h"
 #include "mod_filtering.h"
+#include "msg_queue.h"
+#include "obj_pool.h"
+#include "playback_hint.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "seek_cost.h"
+#include "trace.h"
 
 struct info_message {
     int width, height;
@@ -43,114 +52,282 @@ struct info_message {
     AVRational timebase;
 };
 
-struct async_context {
+#define MAX_BRANCHES NMDI_DEMUXING_MAX_OUTPUTS
+
+struct seek_request {
+    int64_t ts;
+    int branch;                             // branch on behalf of which the seek is made
+};
+
+struct request_message {
+    struct async_request req;
+    int branch;
+};
+
+/* Decoding and filtering of one of the demuxed streams */
+struct async_branch {
     void *log_ctx;
-    const char *filename;
     const struct nmdi_opts *o;
 
-    struct demuxing_ctx  *demuxer;
+    struct seek_cost *cost;                 // persists across modules restarts
+    struct playback_hint *hint;             // persists across modules restarts
+    struct stats *stats;                    // persists across modules restarts
+    struct mem_budget *mem_budget;          // persists across modules restarts
+    struct obj_pool *frame_pool;            // frames recycled from the decoder down to the user
+
     struct decoding_ctx  *decoder;
     struct filtering_ctx *filterer;
 
-    pthread_t demuxer_tid;
     pthread_t decoder_tid;
     pthread_t filterer_tid;
-    pthread_t control_tid;
 
-    int demuxer_started;
+    struct sched_task *decoder_task;        // set if the modules run on the shared scheduler
+    struct sched_task *filterer_task;
+
     int decoder_started;
     int filterer_started;
+
+    struct msg_queue *pkt_queue;            // demuxer  <-> decoder
+    struct msg_queue *frames_queue;         // decoder  <-> filterer
+    struct msg_queue *sink_queue;           // filterer <-> user
+
+    int64_t seek_start_time;                // time of the latest seek honored while playing
+
+    /* Changes of the stream position not requested through this branch */
+    int position_gen;
+    int64_t position_ts;
+
+    int request_seek;                       // the latest frame request was honored with a seek
+
+    struct info_message info;
+};
+
+struct async_context {
+    void *log_ctx;
+    const char *filename;
+    const struct nmdi_opts *o;
+
+    struct keyframe_index *index;           // persists across modules restarts
+    struct info_cache *info_cache;          // set if the stream information is cached
+    struct stats *demux_stats;              // persists across modules restarts
+
+    struct demuxing_ctx  *demuxer;
+
+    pthread_t demuxer_tid;
+    pthread_t control_tid;
+
+    struct sched_task *demuxer_task;        // set if the modules run on the shared scheduler
+    int sched_ref;
+
+    int demuxer_started;
     int control_started;
 
-    AVThreadMessageQueue *src_queue;        // user     <-> demuxer
-    AVThreadMessageQueue *pkt_queue;        // demuxer  <-> decoder
-    AVThreadMessageQueue *frames_queue;     // decoder  <-> filterer
-    AVThreadMessageQueue *sink_queue;       // filterer <-> user
+    struct msg_queue *src_queue;            // user     <-> demuxer
+
+    struct async_branch branches[MAX_BRANCHES];
+    int nb_branches;
 
-    AVThreadMessageQueue *ctl_in_queue;
-    AVThreadMessageQueue *ctl_out_queue;
+    struct msg_queue *ctl_in_queue;
+    struct msg_queue *ctl_out_queue;
 
     int thread_stack_size;
 
     int64_t request_seek;
 
-    struct info_message info;
     int has_info;
+    int info_sent;                          // an information request is not answered yet
 
     int modules_initialized;
 
-    int need_sync;
+    int ctl_err;                            // error of an operation honored without the control thread
+    int need_sync;                          // operations were sent since the latest sync
+    int sync_sent;                          // a sync was sent and is not acknowledged yet
 
     int playing;
 };
 
-/* Send a message to the control input and fetch from the output until we get
- * it back */
-static int send_wait_ctl_message(struct async_context *actx,
-                                 struct message *msg)
+static int ctl_post(struct async_context *actx, struct message *msg, unsigned flags);
+static int ctl_send(struct async_context *actx, struct message *msg, unsigned flags);
+static int start_inline(struct async_context *actx);
+
+static void set_mod_info(struct async_context *actx, struct message *msg)
+{
+    av_assert0(msg->type == MSG_INFO);
+    const struct info_message *info = msg->data;
+    for (int i = 0; i < actx->nb_branches; i++) {
+        struct async_branch *b = &actx->branches[i];
+        memcpy(&b->info, &info[i], sizeof(b->info));
+        TRACE(b, "info fetched: %dx%d duration=%s",
+              b->info.width, b->info.height,
+              PTS2TIMESTR(b->info.duration));
+    }
+    nmdi_msg_free_data(msg);
+    actx->has_info = 1;
+    actx->info_sent = 0;
+}
+
+/* Fetch one of the replies of the control thread to the sync and
+ * information requests */
+static int recv_ctl_reply(struct async_context *actx, unsigned flags)
 {
-    const int message_type = msg->type;
-    const char *msg_type_str = nmdi_async_get_msg_type_string(message_type);
-    TRACE(actx, "--> send %s", msg_type_str);
-    int ret = av_thread_message_queue_send(actx->ctl_in_queue, msg, 0);
+    struct message msg;
+    int ret = nmdi_msg_queue_recv(actx->ctl_out_queue, &msg, flags);
     if (ret < 0) {
-        TRACE(actx, "couldn't send %s: %s", msg_type_str, av_err2str(ret));
+        if (ret != AVERROR(EAGAIN))
+            TRACE(actx, "couldn't get control reply: %s", av_err2str(ret));
         return ret;
     }
-    TRACE(actx, "wait %s", msg_type_str);
-    memset(msg, 0, sizeof(*msg));
-    for (;;) {
-        ret = av_thread_message_queue_recv(actx->ctl_out_queue, msg, 0);
-        if (ret < 0 || msg->type == message_type)
-            break;
-        nmdi_msg_free_data(msg);
+    if (msg.type == MSG_SYNC) {
+        TRACE(actx, "got sync");
+        av_assert0(!msg.data);
+        actx->sync_sent = 0;
+    } else {
+        TRACE(actx, "got info");
+        set_mod_info(actx, &msg);
     }
-    if (ret < 0)
-        TRACE(actx, "couldn't get %s: %s", msg_type_str, av_err2str(ret));
-    else
-        TRACE(actx, "got %s", msg_type_str);
-    return ret;
+    return 0;
 }
 
 /* There might be some actions still processing in the control thread, so we
- * send a sync message to make sure every actions have been processed */
-static int sync_control_thread(struct async_context *actx)
+ * send a sync message to make sure every actions have been processed. With
+ * AV_THREAD_MESSAGE_NONBLOCK, AVERROR(EAGAIN) is returned if the control
+ * thread is not done yet, and the sync is completed by a later call. */
+static int sync_control_thread_flags(struct async_context *actx, unsigned flags)
 {
-    if (actx->need_sync) {
+    for (;;) {
+        while (actx->sync_sent) {
+            int ret = recv_ctl_reply(actx, flags);
+            if (ret < 0)
+                return ret;
+        }
+
+        if (!actx->need_sync) {
+            TRACE(actx, "no need to sync");
+            return 0;
+        }
+
         TRACE(actx, "need sync");
         struct message sync_msg = { .type = MSG_SYNC };
-        int ret = send_wait_ctl_message(actx, &sync_msg);
-        if (ret < 0)
+        int ret = nmdi_msg_queue_send(actx->ctl_in_queue, &sync_msg, flags);
+        if (ret < 0) {
+            if (ret != AVERROR(EAGAIN))
+                TRACE(actx, "couldn't send sync: %s", av_err2str(ret));
             return ret;
-        av_assert0(!sync_msg.data);
+        }
         actx->need_sync = 0;
-    } else {
-        TRACE(actx, "no need to sync");
+        actx->sync_sent = 1;
     }
-    return 0;
 }
 
-static int fetch_mod_info(struct async_context *actx)
+static int sync_control_thread(struct async_context *actx)
+{
+    return sync_control_thread_flags(actx, 0);
+}
+
+static void set_info(struct async_context *actx, struct info_message *info,
+                     int width, int height, AVRational timebase,
+                     int64_t probe_duration, int is_image)
+{
+    const struct nmdi_opts *o = actx->o;
+    int64_t end_time = o->end_time64 >= 0 ? o->end_time64 : AV_NOPTS_VALUE;
+
+    av_assert0(AV_NOPTS_VALUE < 0);
+    if (probe_duration != AV_NOPTS_VALUE && (end_time <= 0 || probe_duration < end_time)) {
+        LOG(actx, INFO, "fix end_time from %f to %f",
+            end_time       * av_q2d(AV_TIME_BASE_Q),
+            probe_duration * av_q2d(AV_TIME_BASE_Q));
+        end_time = probe_duration;
+    }
+    if (end_time == AV_NOPTS_VALUE)
+        end_time = 0;
+
+    *info = (struct info_message){
+        .width    = width,
+        .height   = height,
+        .duration = end_time,
+        .is_image = is_image,
+        .timebase = timebase,
+    };
+
+    if (!info->timebase.num || !info->timebase.den) {
+        LOG(actx, WARNING, "Invalid timebase %d/%d, assuming 1/1",
+            info->timebase.num, info->timebase.den);
+        info->timebase = av_make_q(1, 1);
+    }
+}
+
+/* Get the information from the cache, without waiting for the control thread
+ * to open the media. Return 1 if every branch could be served. */
+static int fetch_cached_info(struct async_context *actx)
+{
+    struct info_message info[MAX_BRANCHES];
+    int64_t probe_duration = AV_NOPTS_VALUE;
+
+    if (!actx->info_cache || !nmdi_info_cache_is_loaded(actx->info_cache))
+        return 0;
+
+    for (int i = 0; i < actx->nb_branches; i++) {
+        struct async_branch *b = &actx->branches[i];
+        const enum AVMediaType media_type = nmdi_demuxing_get_media_type(b->o);
+        const int stream_idx = nmdi_info_cache_find_best_stream(actx->info_cache, media_type, b->o->stream_idx);
+        int width, height, is_image;
+        AVRational timebase;
+        int64_t duration;
+        if (stream_idx < 0 ||
+            nmdi_info_cache_get_stream_info(actx->info_cache, stream_idx, &width, &height,
+                                            &timebase, &duration, &is_image) < 0 ||
+            (i && is_image))
+            return 0;
+
+        /* The duration is probed on the primary stream */
+        if (!i)
+            probe_duration = duration;
+        set_info(actx, &info[i], width, height, timebase, probe_duration, is_image);
+    }
+
+    for (int i = 0; i < actx->nb_branches; i++) {
+        struct async_branch *b = &actx->branches[i];
+        b->info = info[i];
+        TRACE(b, "info from cache: %dx%d duration=%s",
+              b->info.width, b->info.height,
+              PTS2TIMESTR(b->info.duration));
+    }
+    return 1;
+}
+
+static int fetch_mod_info(struct async_context *actx, unsigned flags)
 {
     TRACE(actx, "fetch module info");
     if (actx->has_info)
         return 0;
 
-    int ret = sync_control_thread(actx);
-    if (ret < 0)
-        return ret;
+    if (fetch_cached_info(actx)) {
+        actx->has_info = 1;
+        return 0;
+    }
 
-    struct message msg = { .type = MSG_INFO };
-    ret = send_wait_ctl_message(actx, &msg);
-    if (ret < 0)
-        return ret;
-    av_assert0(msg.type == MSG_INFO);
-    memcpy(&actx->info, msg.data, sizeof(actx->info));
-    TRACE(actx, "info fetched: %dx%d duration=%s",
-          actx->info.width, actx->info.height,
-          PTS2TIMESTR(actx->info.duration));
-    nmdi_msg_free_data(&msg);
-    actx->has_info = 1;
+    if (!actx->info_sent) {
+        /* Opening the media in the calling thread is only acceptable if it
+         * waits for the reply anyway */
+        struct message msg = { .type = MSG_INFO };
+        int ret = flags ? ctl_post(actx, &msg, flags) : ctl_send(actx, &msg, flags);
+        if (ret < 0) {
+            TRACE(actx, "couldn't send info: %s", av_err2str(ret));
+            return ret;
+        }
+        if (ret > 0) {
+            TRACE(actx, "info honored without the control thread");
+            set_mod_info(actx, &msg);
+            return 0;
+        }
+        actx->info_sent = 1;
+    }
+
+    while (actx->info_sent) {
+        int ret = recv_ctl_reply(actx, flags);
+        if (ret < 0)
+            return ret;
+    }
     return 0;
 }
 
@@ -162,55 +339,149 @@ struct async_context *nmdi_async_alloc_context(void)
     return actx;
 }
 
-int nmdi_async_fetch_info(struct async_context *actx, struct nmd_info *info)
+int nmdi_async_fetch_info(struct async_context *actx, int branch, struct nmd_info *info, unsigned flags)
 {
-    int ret = fetch_mod_info(actx);
+    int ret = fetch_mod_info(actx, flags);
     if (ret < 0)
         return ret;
-    info->width    = actx->info.width;
-    info->height   = actx->info.height;
-    info->duration = actx->info.duration * av_q2d(AV_TIME_BASE_Q);
-    info->is_image = actx->info.is_image;
-    info->timebase[0] = actx->info.timebase.num;
-    info->timebase[1] = actx->info.timebase.den;
+    const struct info_message *b_info = &actx->branches[branch].info;
+    info->width    = b_info->width;
+    info->height   = b_info->height;
+    info->duration = b_info->duration * av_q2d(AV_TIME_BASE_Q);
+    info->is_image = b_info->is_image;
+    info->timebase[0] = b_info->timebase.num;
+    info->timebase[1] = b_info->timebase.den;
     return 0;
 }
 
-int nmdi_async_pop_frame(struct async_context *actx, AVFrame **framep)
+int nmdi_async_pop_frame(struct async_context *actx, int branch, AVFrame **framep, unsigned flags)
 {
+    struct async_branch *b = &actx->branches[branch];
     int ret;
 
     *framep = NULL;
 
-    ret = sync_control_thread(actx);
+    ret = sync_control_thread_flags(actx, flags);
     if (ret < 0)
         return ret;
 
     if (!actx->playing) {
         TRACE(actx, "not playing, start modules");
-        ret = nmdi_async_start(actx);
+        ret = flags ? 1 : start_inline(actx);
+        if (ret > 0)
+            ret = nmdi_async_start(actx);
         if (ret < 0)
             return ret;
-        ret = sync_control_thread(actx);
+        ret = sync_control_thread_flags(actx, flags);
         if (ret < 0)
             return ret;
     }
 
-    TRACE(actx, "fetching a frame from the sink");
+    TRACE(b, "fetching a frame from the sink");
     struct message msg;
-    ret = av_thread_message_queue_recv(actx->sink_queue, &msg, 0);
+    const int64_t wait_start = av_gettime_relative();
+    TRACE_BEGIN(b, "sink pop");
+    ret = nmdi_msg_queue_recv(b->sink_queue, &msg, flags);
+    TRACE_END(b, "sink pop");
+    TRACE_COUNTER(b, "sink_queue", nmdi_msg_queue_nb_elems(b->sink_queue));
+    if (ret == AVERROR(EAGAIN)) {
+        TRACE(b, "no frame ready in the sink");
+        return ret;
+    }
     if (ret < 0) {
-        TRACE(actx, "couldn't fetch frame from sink because %s", av_err2str(ret));
-        av_thread_message_queue_set_err_send(actx->sink_queue, ret);
+        TRACE(b, "couldn't fetch frame from sink because %s", av_err2str(ret));
+        nmdi_msg_queue_set_err_send(b->sink_queue, ret);
         return ret;
     }
     av_assert0(msg.type == MSG_FRAME);
     *framep = msg.data;
+    nmdi_mem_budget_touch(b->mem_budget);
+
+    const int64_t now = av_gettime_relative();
+    if (!flags)
+        nmdi_stats_add_time(b->stats, STATS_TIMING_SINK_WAIT, now - wait_start);
+
+    /* The control thread is synced so the seek start time is stable here */
+    if (b->seek_start_time != AV_NOPTS_VALUE) {
+        nmdi_seek_cost_add_seek(b->cost, now - b->seek_start_time);
+        nmdi_stats_add_time(b->stats, STATS_TIMING_SEEK, now - b->seek_start_time);
+        b->seek_start_time = AV_NOPTS_VALUE;
+    }
     return 0;
 }
 
+int nmdi_async_get_prev_keyframe(struct async_context *actx, int branch,
+                                 int64_t from, int64_t to, int64_t *kf)
+{
+    /* Only the stream of the first branch is indexed */
+    if (branch) {
+        *kf = AV_NOPTS_VALUE;
+        return 0;
+    }
+    return nmdi_keyframe_index_get_prev(actx->index, from, to, kf);
+}
+
+int nmdi_async_get_next_keyframe(struct async_context *actx, int branch, int64_t from, int64_t *kf)
+{
+    if (branch) {
+        *kf = AV_NOPTS_VALUE;
+        return 0;
+    }
+    return nmdi_keyframe_index_get_next(actx->index, from, kf);
+}
+
+void nmdi_async_share_keyframe_index(struct async_context *actx, struct async_context *src)
+{
+    av_assert0(!actx->modules_initialized);
+    nmdi_keyframe_index_unref(&actx->index);
+    actx->index = nmdi_keyframe_index_ref(src->index);
+}
+
+struct obj_pool *nmdi_async_get_frame_pool(struct async_context *actx, int branch)
+{
+    return actx->branches[branch].frame_pool;
+}
+
+struct playback_hint *nmdi_async_get_playback_hint(struct async_context *actx, int branch)
+{
+    return actx->branches[branch].hint;
+}
+
+void nmdi_async_get_stats(struct async_context *actx, int branch, struct nmd_stats *stats)
+{
+    struct async_branch *b = &actx->branches[branch];
+
+    stats->nb_seeks          = nmdi_stats_get_counter(b->stats, STATS_COUNTER_SEEKS);
+    stats->nb_frames_decoded = nmdi_stats_get_counter(b->stats, STATS_COUNTER_FRAMES_DECODED);
+    stats->nb_frames_dropped = nmdi_stats_get_counter(b->stats, STATS_COUNTER_FRAMES_DROPPED);
+    nmdi_stats_get_timing(b->stats, STATS_TIMING_SEEK,       &stats->seek_latency);
+    nmdi_stats_get_timing(b->stats, STATS_TIMING_DECODE,     &stats->decode);
+    nmdi_stats_get_timing(b->stats, STATS_TIMING_FILTER,     &stats->filter);
+    nmdi_stats_get_timing(b->stats, STATS_TIMING_SINK_WAIT,  &stats->sink_wait);
+    nmdi_stats_get_timing(actx->demux_stats, STATS_TIMING_DEMUX, &stats->demux);
+
+    /* The queues are flushed but kept while the pipeline is stopped */
+    stats->pkt_queue_fill    = nmdi_msg_queue_nb_elems(b->pkt_queue);
+    stats->frames_queue_fill = nmdi_msg_queue_nb_elems(b->frames_queue);
+    stats->sink_queue_fill   = nmdi_msg_queue_nb_elems(b->sink_queue);
+}
+
+int nmdi_async_get_position_change(struct async_context *actx, int branch, int *gen, int64_t *ts, unsigned flags)
+{
+    int ret = sync_control_thread_flags(actx, flags);
+    if (ret < 0)
+        return ret;
+    const struct async_branch *b = &actx->branches[branch];
+    if (b->position_gen == *gen)
+        return 0;
+    *gen = b->position_gen;
+    *ts = b->position_ts;
+    return 1;
+}
+
 static int create_seek_msg(struct message *msg, int64_t ts)
 {
+    msg->pool = NULL;
     msg->type = MSG_SEEK,
     msg->data = av_malloc(sizeof(ts));
     if (!msg->data)
@@ -219,20 +490,23 @@ static int create_seek_msg(struct message *msg, int64_t ts)
     return 0;
 }
 
-int nmdi_async_seek(struct async_context *actx, int64_t ts)
+int nmdi_async_seek(struct async_context *actx, int branch, int64_t ts)
 {
     TRACE(actx, "--> send seek msg @ %s", PTS2TIMESTR(ts));
-    struct message msg;
-    int ret = create_seek_msg(&msg, ts);
-    if (ret < 0)
-        return ret;
-    ret = av_thread_message_queue_send(actx->ctl_in_queue, &msg, 0);
+    const struct seek_request req = {.ts = ts, .branch = branch};
+    struct message msg = {
+        .type = MSG_SEEK,
+        .data = av_memdup(&req, sizeof(req)),
+    };
+    if (!msg.data)
+        return AVERROR(ENOMEM);
+    int ret = ctl_send(actx, &msg, 0);
     if (ret < 0) {
-        av_thread_message_queue_set_err_recv(actx->ctl_in_queue, ret);
+        nmdi_msg_queue_set_err_recv(actx->ctl_in_queue, ret);
         av_freep(&msg.data);
         return ret;
     }
-    actx->need_sync = 1;
+    actx->need_sync |= !ret;
     return 0;
 }
 
@@ -240,12 +514,12 @@ int nmdi_async_start(struct async_context *actx)
 {
     TRACE(actx, "--> send start msg");
     struct message msg = { .type = MSG_START };
-    int ret = av_thread_message_queue_send(actx->ctl_in_queue, &msg, 0);
+    int ret = ctl_send(actx, &msg, 0);
     if (ret < 0) {
-        av_thread_message_queue_set_err_recv(actx->ctl_in_queue, ret);
+        nmdi_msg_queue_set_err_recv(actx->ctl_in_queue, ret);
         return ret;
     }
-    actx->need_sync = 1;
+    actx->need_sync |= !ret;
     return 0;
 }
 
@@ -253,15 +527,48 @@ int nmdi_async_stop(struct async_context *actx)
 {
     TRACE(actx, "--> send stop msg");
     struct message msg = { .type = MSG_STOP };
-    int ret = av_thread_message_queue_send(actx->ctl_in_queue, &msg, 0);
+    int ret = ctl_send(actx, &msg, 0);
+    if (ret < 0) {
+        nmdi_msg_queue_set_err_recv(actx->ctl_in_queue, ret);
+        return ret;
+    }
+    actx->need_sync |= !ret;
+    return 0;
+}
+
+int nmdi_async_request(struct async_context *actx, int branch, const struct async_request *req, unsigned flags)
+{
+    TRACE(actx, "--> send request msg @ %s", PTS2TIMESTR(req->ts));
+    const struct request_message rmsg = {.req = *req, .branch = branch};
+    struct message msg = {
+        .type = MSG_REQUEST,
+        .data = av_memdup(&rmsg, sizeof(rmsg)),
+    };
+    if (!msg.data)
+        return AVERROR(ENOMEM);
+    int ret = ctl_send(actx, &msg, flags);
+    if (ret == AVERROR(EAGAIN)) {
+        TRACE(actx, "control queue full, request delayed");
+        av_freep(&msg.data);
+        return ret;
+    }
     if (ret < 0) {
-        av_thread_message_queue_set_err_recv(actx->ctl_in_queue, ret);
+        nmdi_msg_queue_set_err_recv(actx->ctl_in_queue, ret);
+        av_freep(&msg.data);
         return ret;
     }
-    actx->need_sync = 1;
+    actx->need_sync |= !ret;
     return 0;
 }
 
+int nmdi_async_get_request_seek(struct async_context *actx, int branch, unsigned flags)
+{
+    int ret = sync_control_thread_flags(actx, flags);
+    if (ret < 0)
+        return ret;
+    return actx->branches[branch].request_seek;
+}
+
 static int initialize_modules_once(struct async_context *actx,
                                    const struct nmdi_opts *opts)
 {
@@ -270,60 +577,82 @@ static int initialize_modules_once(struct async_context *actx,
     if (actx->modules_initialized)
         return 0;
 
-    av_assert0(!actx->demuxer && !actx->decoder && !actx->filterer);
+    av_assert0(!actx->demuxer);
 
     TRACE(actx, "alloc modules");
-    actx->demuxer  = nmdi_demuxing_alloc();
-    actx->decoder  = nmdi_decoding_alloc();
-    actx->filterer = nmdi_filtering_alloc();
-    if (!actx->demuxer || !actx->decoder || !actx->filterer)
+    actx->demuxer = nmdi_demuxing_alloc();
+    if (!actx->demuxer)
         return AVERROR(ENOMEM);
+    for (int i = 0; i < actx->nb_branches; i++) {
+        struct async_branch *b = &actx->branches[i];
+        av_assert0(!b->decoder && !b->filterer);
+        b->decoder  = nmdi_decoding_alloc();
+        b->filterer = nmdi_filtering_alloc();
+        if (!b->decoder || !b->filterer)
+            return AVERROR(ENOMEM);
+    }
 
     TRACE(actx, "initialize modules");
 
-    if ((ret = nmdi_demuxing_init(actx->log_ctx,
-                                  actx->demuxer,
-                                  actx->src_queue, actx->pkt_queue,
-                                  actx->filename, opts)) < 0 ||
-        (ret = nmdi_decoding_init(actx->log_ctx,
-                                  actx->decoder,
-                                  actx->pkt_queue, actx->frames_queue,
-                                  nmdi_demuxing_is_image(actx->demuxer),
-                                  nmdi_demuxing_get_stream(actx->demuxer), opts)) < 0 ||
-        (ret = nmdi_filtering_init(actx->log_ctx,
-                                   actx->filterer,
-                                   actx->frames_queue, actx->sink_queue,
-                                   nmdi_demuxing_get_stream(actx->demuxer),
-                                   nmdi_decoding_get_avctx(actx->decoder),
-                                   nmdi_demuxing_probe_rotation(actx->demuxer), opts)) < 0)
+    ret = nmdi_demuxing_init(actx->log_ctx,
+                             actx->demuxer,
+                             actx->src_queue, actx->branches[0].pkt_queue,
+                             actx->index, actx->info_cache, actx->demux_stats,
+                             actx->filename, opts);
+    if (ret < 0)
         return ret;
 
+    for (int i = 1; i < actx->nb_branches; i++) {
+        ret = nmdi_demuxing_add_output(actx->demuxer, actx->branches[i].pkt_queue, actx->branches[i].o);
+        if (ret < 0)
+            return ret;
+        av_assert0(ret == i);
+    }
+
+    for (int i = 0; i < actx->nb_branches; i++) {
+        struct async_branch *b = &actx->branches[i];
+        const AVStream *st = nmdi_demuxing_get_stream(actx->demuxer, i);
+        if ((ret = nmdi_decoding_init(b->log_ctx,
+                                      b->decoder,
+                                      b->pkt_queue, b->frames_queue,
+                                      b->cost, b->hint, b->stats, b->mem_budget, b->frame_pool,
+                                      nmdi_demuxing_is_image(actx->demuxer),
+                                      st, b->o)) < 0 ||
+            (ret = nmdi_filtering_init(b->log_ctx,
+                                       b->filterer,
+                                       b->frames_queue, b->sink_queue,
+                                       b->frame_pool, b->hint, b->stats, b->mem_budget, st,
+                                       nmdi_decoding_get_avctx(b->decoder),
+                                       nmdi_demuxing_probe_rotation(actx->demuxer, i), b->o)) < 0)
+            return ret;
+    }
+
     actx->modules_initialized = 1;
     return 0;
 }
 
-static int alloc_msg_queue(AVThreadMessageQueue **q, int n)
+/* The pipeline queues have a single producer thread and can use a lock-free
+ * ring; the control queues are fed from the user threads */
+static int alloc_msg_queue(struct msg_queue **q, int n, int lockfree)
 {
-    int ret = av_thread_message_queue_alloc(q, n, sizeof(struct message));
-    if (ret < 0)
-        return ret;
-    av_thread_message_queue_set_free_func(*q, nmdi_msg_free_data);
-    return 0;
+    return nmdi_msg_queue_alloc(q, n, lockfree ? MSG_QUEUE_SPSC : MSG_QUEUE_LOCKED);
 }
 
-#define MODULE_THREAD_FUNC(name, action)                                        \
+#define MODULE_THREAD_FUNC(name, action, owner)                                 \
 static void *name##_thread(void *arg)                                           \
 {                                                                               \
-    struct async_context *actx = arg;                                           \
+    struct owner *c = arg;                                                      \
     nmdi_set_thread_name("nmd/" AV_STRINGIFY(name));                            \
-    TRACE(actx, "[>] " AV_STRINGIFY(action) " thread starting");                \
-    nmdi_##action##_run(actx->name);                                            \
-    TRACE(actx, "[<] " AV_STRINGIFY(action) " thread ending");                  \
+    TRACE(c, "[>] " AV_STRINGIFY(action) " thread starting");                   \
+    nmdi_##action##_run(c->name);                                               \
+    TRACE(c, "[<] " AV_STRINGIFY(action) " thread ending");                     \
     return NULL;                                                                \
 }
 
-#define START_MODULE_THREAD(name) do {                                          \
-    if (actx->name##_started) {                                                 \
+/* The thread of a module is started on behalf of c, which is either the async
+ * context itself or one of its branches */
+#define START_MODULE_THREAD(c, name) do {                                       \
+    if ((c)->name##_started) {                                                  \
         TRACE(actx, "not starting " AV_STRINGIFY(name)                          \
               " thread: already running");                                      \
     } else {                                                                    \
@@ -344,7 +673,7 @@ static void *name##_thread(void *arg)
             }                                                                   \
             attrp = &attr;                                                      \
         }                                                                       \
-        int ret = pthread_create(&actx->name##_tid, attrp, name##_thread, actx);\
+        int ret = pthread_create(&(c)->name##_tid, attrp, name##_thread, (c));  \
         if (attrp)                                                              \
             pthread_attr_destroy(attrp);                                        \
         if (ret) {                                                              \
@@ -352,33 +681,121 @@ static void *name##_thread(void *arg)
             LOG(actx, ERROR, "Unable to start " AV_STRINGIFY(name)              \
                 " thread: %s", av_err2str(err));                                \
         } else                                                                  \
-            actx->name##_started = 1;                                           \
+            (c)->name##_started = 1;                                            \
     }                                                                           \
 } while (0)
 
-#define JOIN_MODULE_THREAD(name) do {                                           \
-    if (!actx->name##_started) {                                                \
+#define JOIN_MODULE_THREAD(c, name) do {                                        \
+    if (!(c)->name##_started) {                                                 \
         TRACE(actx, "not joining " AV_STRINGIFY(name) " thread: not running");  \
     } else {                                                                    \
         TRACE(actx, "joining " AV_STRINGIFY(name) " thread");                   \
-        int ret = pthread_join(actx->name##_tid, NULL);                         \
+        int ret = pthread_join((c)->name##_tid, NULL);                          \
         if (ret)                                                                \
             LOG(actx, ERROR, "Unable to join " AV_STRINGIFY(name) ": %s",       \
                 av_err2str(AVERROR(ret)));                                      \
         TRACE(actx, AV_STRINGIFY(name) " thread joined");                       \
-        actx->name##_started = 0;                                               \
+        (c)->name##_started = 0;                                                \
     }                                                                           \
 } while (0)
 
-MODULE_THREAD_FUNC(demuxer,  demuxing)
-MODULE_THREAD_FUNC(decoder,  decoding)
-MODULE_THREAD_FUNC(filterer, filtering)
+/* With the shared scheduler, the modules run as tasks of its workers instead
+ * of their own threads */
+#define START_MODULE(c, name) do {                                              \
+    if ((c)->name##_task) {                                                     \
+        if (!(c)->name##_started) {                                             \
+            TRACE(actx, "scheduling " AV_STRINGIFY(name) " task");              \
+            nmdi_sched_task_start((c)->name##_task);                            \
+            (c)->name##_started = 1;                                            \
+        }                                                                       \
+    } else {                                                                    \
+        START_MODULE_THREAD(c, name);                                           \
+    }                                                                           \
+} while (0)
+
+#define JOIN_MODULE(c, name) do {                                               \
+    if ((c)->name##_task) {                                                     \
+        if ((c)->name##_started) {                                              \
+            TRACE(actx, "waiting for " AV_STRINGIFY(name) " task");             \
+            nmdi_sched_task_join((c)->name##_task);                             \
+            (c)->name##_started = 0;                                            \
+        }                                                                       \
+    } else {                                                                    \
+        JOIN_MODULE_THREAD(c, name);                                            \
+    }                                                                           \
+} while (0)
+
+#define MODULE_STEP_FUNC(name, action, owner)                                   \
+static int name##_step(void *arg)                                               \
+{                                                                               \
+    struct owner *c = arg;                                                      \
+    return nmdi_##action##_step(c->name);                                       \
+}
+
+MODULE_THREAD_FUNC(demuxer,  demuxing,  async_context)
+MODULE_THREAD_FUNC(decoder,  decoding,  async_branch)
+MODULE_THREAD_FUNC(filterer, filtering, async_branch)
+
+MODULE_STEP_FUNC(demuxer,  demuxing,  async_context)
+MODULE_STEP_FUNC(decoder,  decoding,  async_branch)
+MODULE_STEP_FUNC(filterer, filtering, async_branch)
+
+/* The workers favor the branches whose sink is about to run dry */
+static int get_branch_priority(void *arg)
+{
+    struct async_branch *b = arg;
+    return nmdi_msg_queue_nb_elems(b->sink_queue) * 100 / FFMAX(b->o->max_nb_sink, 1);
+}
+
+static int get_demuxer_priority(void *arg)
+{
+    struct async_context *actx = arg;
+    int prio = INT_MAX;
+    for (int i = 0; i < actx->nb_branches; i++)
+        prio = FFMIN(prio, get_branch_priority(&actx->branches[i]));
+    return prio;
+}
 
 static int is_seek_possible(const struct async_context *actx)
 {
     return nmdi_demuxing_probe_duration(actx->demuxer) != AV_NOPTS_VALUE;
 }
 
+/* Wait for a seek request to come back on every branch sink */
+static int wait_seek_return(struct async_context *actx)
+{
+    for (int i = 0; i < actx->nb_branches; i++) {
+        struct async_branch *b = &actx->branches[i];
+        struct message msg = {0};
+        do {
+            int ret = nmdi_msg_queue_recv(b->sink_queue, &msg, 0);
+            if (ret < 0) {
+                nmdi_msg_queue_set_err_send(b->sink_queue, ret);
+                return ret;
+            }
+            nmdi_msg_free_data(&msg);
+        } while (msg.type != MSG_SEEK);
+    }
+    return 0;
+}
+
+/* Notify the branches (except the requesting one) that their stream is going
+ * to restart from ts; this only matters when several branches share the
+ * demuxer */
+static void notify_position_change(struct async_context *actx, int requester, int64_t ts)
+{
+    if (actx->nb_branches < 2)
+        return;
+    for (int i = 0; i < actx->nb_branches; i++) {
+        struct async_branch *b = &actx->branches[i];
+        if (i == requester)
+            continue;
+        TRACE(b, "stream position changed to %s", PTS2TIMESTR(ts));
+        b->position_gen++;
+        b->position_ts = ts;
+    }
+}
+
 static int op_start(struct async_context *actx)
 {
     struct message msg;
@@ -402,7 +819,12 @@ static int op_start(struct async_context *actx)
     }
 
     if (seek_to != AV_NOPTS_VALUE && !is_seek_possible(actx)) {
-        LOG(actx, ERROR, "can not seek into media, ignoring seek");
+        /* The seeks memorized before the media was opened are not checked
+         * yet (see op_seek()), which is expected for images */
+        if (actx->request_seek != AV_NOPTS_VALUE)
+            TRACE(actx, "can not seek into media, ignoring seek");
+        else
+            LOG(actx, ERROR, "can not seek into media, ignoring seek");
         seek_to = AV_NOPTS_VALUE;
     }
 
@@ -414,10 +836,10 @@ static int op_start(struct async_context *actx)
             return ret;
 
         // Queue a seek request which we will pull out after the demuxer is started
-        ret = av_thread_message_queue_send(actx->src_queue, &msg, 0);
+        ret = nmdi_msg_queue_send(actx->src_queue, &msg, 0);
         if (ret < 0) {
             LOG(actx, ERROR, "Unable to queue a seek message to the demuxer, shouldn't happen!");
-            av_thread_message_queue_set_err_recv(actx->src_queue, ret);
+            nmdi_msg_queue_set_err_recv(actx->src_queue, ret);
             nmdi_msg_free_data(&msg);
             return ret;
         }
@@ -425,27 +847,24 @@ static int op_start(struct async_context *actx)
 
     actx->request_seek = AV_NOPTS_VALUE;
 
-    START_MODULE_THREAD(demuxer);
-    START_MODULE_THREAD(decoder);
-    START_MODULE_THREAD(filterer);
-    if (!actx->demuxer_started ||
-        !actx->decoder_started ||
-        !actx->filterer_started)
+    START_MODULE(actx, demuxer);
+    if (!actx->demuxer_started)
         return AVERROR(ENOMEM);
+    for (int i = 0; i < actx->nb_branches; i++) {
+        struct async_branch *b = &actx->branches[i];
+        START_MODULE(b, decoder);
+        START_MODULE(b, filterer);
+        if (!b->decoder_started || !b->filterer_started)
+            return AVERROR(ENOMEM);
+    }
 
     actx->playing = 1;
 
     if (seek_to != AV_NOPTS_VALUE) {
         TRACE(actx, "wait for seek (to %s) to come back", PTS2TIMESTR(seek_to));
-        memset(&msg, 0, sizeof(msg));
-        do {
-            ret = av_thread_message_queue_recv(actx->sink_queue, &msg, 0);
-            if (ret < 0) {
-                av_thread_message_queue_set_err_send(actx->sink_queue, ret);
-                return ret;
-            }
-            nmdi_msg_free_data(&msg);
-        } while (msg.type != MSG_SEEK);
+        ret = wait_seek_return(actx);
+        if (ret < 0)
+            return ret;
     }
 
     return 0;
@@ -462,35 +881,17 @@ static int op_info(struct async_context *actx, struct message *msg)
         return ret;
     }
 
-    int64_t end_time = o->end_time64 >= 0 ? o->end_time64 : AV_NOPTS_VALUE;
     const int64_t probe_duration = nmdi_demuxing_probe_duration(actx->demuxer);
 
-    av_assert0(AV_NOPTS_VALUE < 0);
-    if (probe_duration != AV_NOPTS_VALUE && (end_time <= 0 || probe_duration < end_time)) {
-        LOG(actx, INFO, "fix end_time from %f to %f",
-            end_time       * av_q2d(AV_TIME_BASE_Q),
-            probe_duration * av_q2d(AV_TIME_BASE_Q));
-        end_time = probe_duration;
-    }
-    if (end_time == AV_NOPTS_VALUE)
-        end_time = 0;
-    const AVStream *st = nmdi_demuxing_get_stream(actx->demuxer);
+    struct info_message info[MAX_BRANCHES];
     const int is_image = nmdi_demuxing_is_image(actx->demuxer);
-    struct info_message info = {
-        .width    = st->codecpar->width,
-        .height   = st->codecpar->height,
-        .duration = end_time,
-        .is_image = is_image,
-        .timebase = st->time_base,
-    };
-
-    if (!info.timebase.num || !info.timebase.den) {
-        LOG(actx, WARNING, "Invalid timebase %d/%d, assuming 1/1",
-            info.timebase.num, info.timebase.den);
-        info.timebase = av_make_q(1, 1);
+    for (int i = 0; i < actx->nb_branches; i++) {
+        const AVStream *st = nmdi_demuxing_get_stream(actx->demuxer, i);
+        set_info(actx, &info[i], st->codecpar->width, st->codecpar->height,
+                 st->time_base, probe_duration, is_image);
     }
 
-    msg->data = av_memdup(&info, sizeof(info));
+    msg->data = av_memdup(info, actx->nb_branches * sizeof(*info));
     if (!msg->data)
         return AVERROR(ENOMEM);
 
@@ -499,38 +900,41 @@ static int op_info(struct async_context *actx, struct message *msg)
 
 static void kill_join_reset_workers(struct async_context *actx)
 {
+    struct msg_queue *queues[1 + 3 * MAX_BRANCHES];
+    int nb_queues = 0;
+
+    queues[nb_queues++] = actx->src_queue;
+    for (int i = 0; i < actx->nb_branches; i++) {
+        queues[nb_queues++] = actx->branches[i].pkt_queue;
+        queues[nb_queues++] = actx->branches[i].frames_queue;
+        queues[nb_queues++] = actx->branches[i].sink_queue;
+    }
+
     TRACE(actx, "prevent modules from feeding and reading from the queues");
-    av_thread_message_queue_set_err_send(actx->src_queue,    AVERROR_EXIT);
-    av_thread_message_queue_set_err_send(actx->pkt_queue,    AVERROR_EXIT);
-    av_thread_message_queue_set_err_send(actx->frames_queue, AVERROR_EXIT);
-    av_thread_message_queue_set_err_send(actx->sink_queue,   AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->src_queue,    AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->pkt_queue,    AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->frames_queue, AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->sink_queue,   AVERROR_EXIT);
+    for (int i = 0; i < nb_queues; i++)
+        nmdi_msg_queue_set_err_send(queues[i], AVERROR_EXIT);
+    for (int i = 0; i < nb_queues; i++)
+        nmdi_msg_queue_set_err_recv(queues[i], AVERROR_EXIT);
 
     // they won't fill the queues anymore, so we can empty them
-    av_thread_message_flush(actx->src_queue);
-    av_thread_message_flush(actx->pkt_queue);
-    av_thread_message_flush(actx->frames_queue);
-    av_thread_message_flush(actx->sink_queue);
+    for (int i = 0; i < nb_queues; i++)
+        nmdi_msg_queue_flush(queues[i]);
 
     // now that we are sure the threads modules will stop by themselves, we can
     // join them
     TRACE(actx, "waiting for modules to end");
-    JOIN_MODULE_THREAD(filterer);
-    JOIN_MODULE_THREAD(decoder);
-    JOIN_MODULE_THREAD(demuxer);
+    for (int i = 0; i < actx->nb_branches; i++) {
+        struct async_branch *b = &actx->branches[i];
+        JOIN_MODULE(b, filterer);
+        JOIN_MODULE(b, decoder);
+    }
+    JOIN_MODULE(actx, demuxer);
 
     // every worker ended, reset queues states
-    av_thread_message_queue_set_err_send(actx->src_queue,    0);
-    av_thread_message_queue_set_err_send(actx->pkt_queue,    0);
-    av_thread_message_queue_set_err_send(actx->frames_queue, 0);
-    av_thread_message_queue_set_err_send(actx->sink_queue,   0);
-    av_thread_message_queue_set_err_recv(actx->src_queue,    0);
-    av_thread_message_queue_set_err_recv(actx->pkt_queue,    0);
-    av_thread_message_queue_set_err_recv(actx->frames_queue, 0);
-    av_thread_message_queue_set_err_recv(actx->sink_queue,   0);
+    for (int i = 0; i < nb_queues; i++)
+        nmdi_msg_queue_set_err_send(queues[i], 0);
+    for (int i = 0; i < nb_queues; i++)
+        nmdi_msg_queue_set_err_recv(queues[i], 0);
 }
 
 /* Forward the message to the modules if they are running, otherwise memorize
@@ -541,6 +945,24 @@ static int op_seek(struct async_context *actx, struct message *seek_msg)
 
     TRACE(actx, "exec");
 
+    /* The modules of an image decoded without their threads are released
+     * right away (see run_image_pipeline()), and images are not seekable */
+    if (actx->playing && !actx->modules_initialized) {
+        TRACE(actx, "image already decoded, ignoring seek");
+        nmdi_msg_free_data(seek_msg);
+        return 0;
+    }
+
+    /* Without the control thread, opening the media would block the caller:
+     * the seek is only memorized, op_start() checks if it is possible */
+    if (!actx->control_started && !actx->modules_initialized) {
+        const struct seek_request req = *(const struct seek_request *)seek_msg->data;
+        nmdi_msg_free_data(seek_msg);
+        actx->request_seek = req.ts;
+        nmdi_stats_count(actx->branches[req.branch].stats, STATS_COUNTER_SEEKS, 1);
+        return 0;
+    }
+
     // We need the demuxer to be initialized to be able to call demuxing_*()
     int ret = initialize_modules_once(actx, o);
     if (ret < 0) {
@@ -555,14 +977,26 @@ static int op_seek(struct async_context *actx, struct message *seek_msg)
         return 0;
     }
 
-    actx->request_seek = *(int64_t *)seek_msg->data;
+    const struct seek_request req = *(const struct seek_request *)seek_msg->data;
+    nmdi_msg_free_data(seek_msg);
 
-    if (!actx->playing) {
-        nmdi_msg_free_data(seek_msg);
+    actx->request_seek = req.ts;
+    notify_position_change(actx, req.branch, req.ts);
+    nmdi_stats_count(actx->branches[req.branch].stats, STATS_COUNTER_SEEKS, 1);
+
+    if (!actx->playing)
         return 0;
-    }
 
-    ret = av_thread_message_queue_send(actx->src_queue, seek_msg, 0);
+    /* Seeks restarting the modules are not representative of a seek cost */
+    struct async_branch *b = &actx->branches[req.branch];
+    b->seek_start_time = AV_NOPTS_VALUE;
+    const int64_t seek_start_time = av_gettime_relative();
+
+    ret = create_seek_msg(seek_msg, req.ts);
+    if (ret < 0)
+        return ret;
+
+    ret = nmdi_msg_queue_send(actx->src_queue, seek_msg, 0);
     if (ret < 0) {
         /* If this errors out, it means the modules ended by themselves (no
          * stop requested by the user), so we delay the seek, reset the workers
@@ -573,38 +1007,254 @@ static int op_seek(struct async_context *actx, struct message *seek_msg)
     }
 
     // We were able to send a seek request, now we wait for it to return
+    TRACE(actx, "seek request sent, wait for its return");
     memset(seek_msg, 0, sizeof(*seek_msg));
-    for (;;) {
-        TRACE(actx, "seek request sent, wait for its return");
-        ret = av_thread_message_queue_recv(actx->sink_queue, seek_msg, 0);
-        if (ret < 0) {
-            TRACE(actx, "unable to get request seek back");
-            kill_join_reset_workers(actx);
-            return op_start(actx);
-        }
-        nmdi_msg_free_data(seek_msg);
-        if (seek_msg->type == MSG_SEEK)
-            break;
+    ret = wait_seek_return(actx);
+    if (ret < 0) {
+        TRACE(actx, "unable to get request seek back");
+        kill_join_reset_workers(actx);
+        return op_start(actx);
     }
 
+    /* The seek cost is measured up to the first frame the user obtains */
+    b->seek_start_time = seek_start_time;
     return 0;
 }
 
+/*
+ * Decide if reaching the requested time, located diff after the latest frame
+ * returned, is cheaper with a seek than by decoding every frame in between.
+ */
+static int need_forward_seek(struct async_context *actx, int branch, const struct async_request *req)
+{
+    struct async_branch *b = &actx->branches[branch];
+    const struct nmdi_opts *o = b->o;
+    AVRational tb = req->time_base;
+
+    /* In adaptive mode, the trigger is the media time the decoder can go
+     * through in the time of a seek (including the decoding of the frames
+     * preceding the target) */
+    int64_t seek_trigger = o->dist_time_seek_trigger64;
+    int64_t seek_overhead = 0;
+    int64_t overhead, preroll;
+    if (o->adaptive_seek_trigger && nmdi_seek_cost_get(b->cost, &overhead, &preroll)) {
+        seek_trigger = overhead + preroll;
+        seek_overhead = av_rescale_q(overhead, AV_TIME_BASE_Q, tb);
+        TRACE(b, "adaptive seek trigger: %s (seek overhead: %s, preroll: %s)",
+              PTS2TIMESTR(seek_trigger), PTS2TIMESTR(overhead), PTS2TIMESTR(preroll));
+    }
+
+    /* Decoding resumes from the latest frame poped, not the latest returned */
+    if (req->pos != AV_NOPTS_VALUE && req->pos < req->target) {
+        int64_t kf;
+        const int complete = nmdi_async_get_prev_keyframe(actx, branch, req->pos, req->target, &kf);
+
+        /* Frames already queued in the pipeline are decoded anyway, so
+         * seeking is only worth it if it skips more than these (and more
+         * than the seek itself costs) */
+        const int64_t margin = req->frame_duration * (o->max_nb_packets + o->max_nb_frames + o->max_nb_sink)
+                             + seek_overhead;
+
+        if (kf != AV_NOPTS_VALUE && kf > req->pos + margin) {
+            TRACE(b, "keyframe at %s, seeking saves the decoding from %s",
+                  av_ts2timestr(kf, &tb), av_ts2timestr(req->pos, &tb));
+            return 1;
+        }
+        if (complete) {
+            TRACE(b, "no keyframe worth seeking to between %s and %s",
+                  av_ts2timestr(req->pos, &tb), av_ts2timestr(req->target, &tb));
+            return 0;
+        }
+    }
+
+    return av_compare_ts(req->diff, tb, seek_trigger, AV_TIME_BASE_Q) >= 0;
+}
+
+/* Decide whether a frame request is honored with a seek, or by decoding the
+ * frames up to the requested time */
+static int op_request(struct async_context *actx, struct message *msg)
+{
+    const struct request_message rmsg = *(const struct request_message *)msg->data;
+    const struct async_request *req = &rmsg.req;
+    struct async_branch *b = &actx->branches[rmsg.branch];
+
+    TRACE(actx, "exec");
+    nmdi_msg_free_data(msg);
+
+    switch (req->type) {
+    case ASYNC_REQUEST_SEEK:
+        b->request_seek = 1;
+        break;
+    case ASYNC_REQUEST_START:
+        /* Seeking before starting the modules saves a seek to the start time
+         * followed by another one to the requested time */
+        b->request_seek = !actx->playing && req->ts > b->o->start_time64;
+        break;
+    case ASYNC_REQUEST_FORWARD:
+        b->request_seek = need_forward_seek(actx, rmsg.branch, req);
+        break;
+    default:
+        av_assert0(0);
+    }
+
+    TRACE(b, "request of frame at %s honored %s", PTS2TIMESTR(req->ts),
+          b->request_seek ? "with a seek" : "by decoding up to it");
+    if (!b->request_seek)
+        return 0;
+
+    const struct seek_request seek_req = {.ts = req->ts, .branch = rmsg.branch};
+    struct message seek_msg = {
+        .type = MSG_SEEK,
+        .data = av_memdup(&seek_req, sizeof(seek_req)),
+    };
+    if (!seek_msg.data)
+        return AVERROR(ENOMEM);
+    return op_seek(actx, &seek_msg);
+}
+
 static void op_stop(struct async_context *actx)
 {
     TRACE(actx, "exec");
 
     kill_join_reset_workers(actx);
 
+    nmdi_keyframe_index_save(actx->index);
+
     nmdi_demuxing_free(&actx->demuxer);
-    nmdi_decoding_free(&actx->decoder);
-    nmdi_filtering_free(&actx->filterer);
+    for (int i = 0; i < actx->nb_branches; i++) {
+        struct async_branch *b = &actx->branches[i];
+        nmdi_decoding_free(&b->decoder);
+        nmdi_filtering_free(&b->filterer);
+        b->seek_start_time = AV_NOPTS_VALUE;
+    }
+
+    if (actx->playing)
+        notify_position_change(actx, -1, actx->o->start_time64);
 
     actx->modules_initialized = 0;
     actx->playing = 0;
     actx->request_seek = AV_NOPTS_VALUE;
 }
 
+/*
+ * Decode the image in the calling thread by stepping the modules in turn
+ * until they all end, then release them: only the frame waiting in the sink
+ * is kept, as if the modules threads had ended by themselves.
+ */
+static void run_image_pipeline(struct async_context *actx)
+{
+    struct async_branch *b = &actx->branches[0];
+    struct {
+        int (*step)(void *arg);
+        void *arg;
+        int ret;
+    } modules[] = {
+        {demuxer_step,  actx, 0},
+        {decoder_step,  b,    0},
+        {filterer_step, b,    0},
+    };
+
+    TRACE(actx, "decode the image without the modules threads");
+
+    for (;;) {
+        int nb_running = 0, progress = 0;
+        for (int i = 0; i < FF_ARRAY_ELEMS(modules); i++) {
+            if (modules[i].ret < 0 && modules[i].ret != AVERROR(EAGAIN))
+                continue;
+            modules[i].ret = modules[i].step(modules[i].arg);
+            progress |= modules[i].ret != AVERROR(EAGAIN);
+            nb_running += modules[i].ret >= 0 || modules[i].ret == AVERROR(EAGAIN);
+        }
+        if (!nb_running)
+            break;
+
+        /* Nobody consumes the sink while we are stepping the modules, so the
+         * frames that do not fit in it can not be kept: the modules are
+         * stopped, but the frames already in the sink remain available */
+        if (!progress) {
+            LOG(actx, WARNING, "the image filters output more frames than the sink can hold, "
+                "dropping the remaining ones");
+            struct msg_queue *queues[] = {actx->src_queue, b->pkt_queue, b->frames_queue};
+            for (int i = 0; i < FF_ARRAY_ELEMS(queues); i++) {
+                nmdi_msg_queue_set_err_send(queues[i], AVERROR_EXIT);
+                nmdi_msg_queue_set_err_recv(queues[i], AVERROR_EXIT);
+            }
+            nmdi_msg_queue_set_err_send(b->sink_queue, AVERROR_EXIT);
+        }
+    }
+
+    nmdi_demuxing_free(&actx->demuxer);
+    nmdi_decoding_free(&b->decoder);
+    nmdi_filtering_free(&b->filterer);
+    actx->modules_initialized = 0;
+    actx->playing = 1;
+}
+
+/*
+ * Called by a blocking frame pop before the control thread is started: still
+ * images are decoded right away in the calling thread, which is waiting for
+ * the frame anyway. Return 1 if the modules need to run in the background,
+ * in which case the control thread has to be started.
+ */
+static int start_inline(struct async_context *actx)
+{
+    if (actx->control_started || actx->nb_branches != 1)
+        return 1;
+
+    int ret = initialize_modules_once(actx, actx->o);
+    if (ret < 0) {
+        LOG(actx, ERROR, "initializing modules failed with %s", av_err2str(ret));
+        op_stop(actx);
+        actx->ctl_err = ret;
+        return ret;
+    }
+
+    /* Images are never seekable nor demuxed into multiple streams */
+    if (!nmdi_demuxing_is_image(actx->demuxer) || actx->demuxer_task)
+        return 1;
+
+    run_image_pipeline(actx);
+    return 0;
+}
+
+static int handle_op(struct async_context *actx, struct message *msg)
+{
+    int ret = 0;
+    const enum msg_type type = msg->type;
+
+    TRACE(actx, "--- handling OP %s", nmdi_async_get_msg_type_string(type));
+    TRACE_BEGIN(actx, nmdi_async_get_msg_type_string(type));
+
+    switch (type) {
+    case MSG_SEEK:
+        ret = op_seek(actx, msg);
+        break;
+    case MSG_START:
+        // XXX: fetch info first?
+        if (!actx->playing)
+            ret = op_start(actx);
+        break;
+    case MSG_STOP:
+        if (actx->playing)
+            op_stop(actx);
+        break;
+    case MSG_INFO:
+        ret = op_info(actx, msg);
+        break;
+    case MSG_SYNC:
+        break;
+    case MSG_REQUEST:
+        ret = op_request(actx, msg);
+        break;
+    default:
+        av_assert0(0);
+    }
+
+    TRACE_END(actx, nmdi_async_get_msg_type_string(type));
+    TRACE(actx, "<-- OP %s processed", nmdi_async_get_msg_type_string(type));
+    return ret;
+}
+
 static void *control_thread(void *arg)
 {
     int ret = 0;
@@ -616,7 +1266,7 @@ static void *control_thread(void *arg)
 
     for (;;) {
         struct message msg;
-        ret = av_thread_message_queue_recv(actx->ctl_in_queue, &msg, 0);
+        ret = nmdi_msg_queue_recv(actx->ctl_in_queue, &msg, 0);
         if (ret < 0) {
             if (ret != AVERROR_EXIT) {
                 LOG(actx, ERROR, "Unable to pull a message "
@@ -627,32 +1277,7 @@ static void *control_thread(void *arg)
         }
 
         enum msg_type type = msg.type;
-        TRACE(actx, "--- handling OP %s", nmdi_async_get_msg_type_string(type));
-
-        switch (type) {
-        case MSG_SEEK:
-            ret = op_seek(actx, &msg);
-            break;
-        case MSG_START:
-            // XXX: fetch info first?
-            if (!actx->playing)
-                ret = op_start(actx);
-            break;
-        case MSG_STOP:
-            if (actx->playing)
-                op_stop(actx);
-            break;
-        case MSG_INFO:
-            ret = op_info(actx, &msg);
-            break;
-        case MSG_SYNC:
-            break;
-        default:
-            av_assert0(0);
-        }
-
-        TRACE(actx, "<-- OP %s processed", nmdi_async_get_msg_type_string(type));
-
+        ret = handle_op(actx, &msg);
         if (ret < 0) {
             LOG(actx, ERROR, "Unable to honor %s message: %s",
                 nmdi_async_get_msg_type_string(type), av_err2str(ret));
@@ -665,7 +1290,7 @@ static void *control_thread(void *arg)
         if (type == MSG_INFO || type == MSG_SYNC) {
             TRACE(actx, "forward %s to control out queue",
                   nmdi_async_get_msg_type_string(type));
-            ret = av_thread_message_queue_send(actx->ctl_out_queue, &msg, 0);
+            ret = nmdi_msg_queue_send(actx->ctl_out_queue, &msg, 0);
             if (ret < 0) {
                 // shouldn't happen
                 LOG(actx, ERROR, "Unable to forward %s message to the output async queue: %s",
@@ -676,8 +1301,8 @@ static void *control_thread(void *arg)
     }
 
     if (ret < 0) {
-        av_thread_message_queue_set_err_send(actx->ctl_in_queue, ret);
-        av_thread_message_queue_set_err_recv(actx->ctl_out_queue, ret);
+        nmdi_msg_queue_set_err_send(actx->ctl_in_queue, ret);
+        nmdi_msg_queue_set_err_recv(actx->ctl_out_queue, ret);
     }
     TRACE(actx, "control thread ending");
     op_stop(actx);
@@ -685,6 +1310,143 @@ static void *control_thread(void *arg)
     return NULL;
 }
 
+/* Send a message to the control thread, starting it if needed */
+static int ctl_post(struct async_context *actx, struct message *msg, unsigned flags)
+{
+    if (actx->ctl_err < 0) {
+        nmdi_msg_free_data(msg);
+        return actx->ctl_err;
+    }
+
+    if (!actx->control_started) {
+        START_MODULE_THREAD(actx, control);
+        if (!actx->control_started)
+            return AVERROR(ENOMEM);
+    }
+
+    return nmdi_msg_queue_send(actx->ctl_in_queue, msg, flags);
+}
+
+/*
+ * Until the modules need to run in the background, the operations are
+ * honored in the calling thread instead of the control thread, so that still
+ * images are decoded without starting any thread (see start_inline()). A
+ * start always runs the modules in the background, so it starts the control
+ * thread, and seeks (including the ones decided for a frame request) are
+ * only memorized; the information request waits for the media to be opened
+ * anyway. This is only done with a single branch since the contexts of the
+ * other branches may be used from other threads. Return 1 if the operation
+ * was honored, 0 if it was sent to the control thread.
+ */
+static int ctl_send(struct async_context *actx, struct message *msg, unsigned flags)
+{
+    if (actx->ctl_err < 0) {
+        nmdi_msg_free_data(msg);
+        return actx->ctl_err;
+    }
+
+    if (!actx->control_started && actx->nb_branches == 1 && msg->type != MSG_START) {
+        const int ret = handle_op(actx, msg);
+        if (ret < 0) {
+            const enum msg_type type = msg->type;
+            LOG(actx, ERROR, "Unable to honor %s message: %s",
+                nmdi_async_get_msg_type_string(type), av_err2str(ret));
+            nmdi_msg_free_data(msg);
+            op_stop(actx);
+            actx->ctl_err = ret;
+            return ret;
+        }
+        return 1;
+    }
+
+    return ctl_post(actx, msg, flags);
+}
+
+static int init_branch(struct async_branch *b, void *log_ctx, const struct nmdi_opts *o)
+{
+    int ret;
+
+    b->log_ctx = log_ctx;
+    b->o = o;
+    b->seek_start_time = AV_NOPTS_VALUE;
+    b->position_ts = AV_NOPTS_VALUE;
+
+    b->cost = nmdi_seek_cost_alloc();
+    if (!b->cost)
+        return AVERROR(ENOMEM);
+    ret = nmdi_seek_cost_init(b->cost, log_ctx);
+    if (ret < 0)
+        return ret;
+
+    b->hint = nmdi_playback_hint_alloc();
+    if (!b->hint)
+        return AVERROR(ENOMEM);
+    ret = nmdi_playback_hint_init(b->hint, log_ctx);
+    if (ret < 0)
+        return ret;
+
+    b->stats = nmdi_stats_alloc();
+    if (!b->stats)
+        return AVERROR(ENOMEM);
+    ret = nmdi_stats_init(b->stats);
+    if (ret < 0)
+        return ret;
+
+    /* Enough frames to fill the queues, with a few more held by the modules
+     * and the user */
+    b->frame_pool = nmdi_obj_pool_alloc();
+    if (!b->frame_pool)
+        return AVERROR(ENOMEM);
+    if ((ret = nmdi_obj_pool_init_frames(b->frame_pool)) < 0 ||
+        (ret = nmdi_obj_pool_prealloc(b->frame_pool, o->max_nb_frames + o->max_nb_sink + 4)) < 0)
+        return ret;
+
+    TRACE(b, "alloc modules queues");
+    if ((ret = alloc_msg_queue(&b->pkt_queue,    o->max_nb_packets, o->lockfree_queues)) < 0 ||
+        (ret = alloc_msg_queue(&b->frames_queue, o->max_nb_frames,  o->lockfree_queues)) < 0 ||
+        (ret = alloc_msg_queue(&b->sink_queue,   o->max_nb_sink,    o->lockfree_queues)) < 0)
+        return ret;
+
+    b->mem_budget = nmdi_mem_budget_alloc();
+    if (!b->mem_budget)
+        return AVERROR(ENOMEM);
+    ret = nmdi_mem_budget_init(b->mem_budget, log_ctx, o->max_queued_memory);
+    if (ret < 0)
+        return ret;
+    nmdi_mem_budget_set_queue(b->mem_budget, MEM_BUDGET_FRAMES, b->frames_queue, o->max_nb_frames);
+    nmdi_mem_budget_set_queue(b->mem_budget, MEM_BUDGET_SINK,   b->sink_queue,   o->max_nb_sink);
+
+    return 0;
+}
+
+/* Create the tasks of the branch modules and let the queues wake them up */
+static int init_branch_tasks(struct async_context *actx, struct async_branch *b)
+{
+    b->decoder_task  = nmdi_sched_task_alloc(decoder_step,  get_branch_priority, b);
+    b->filterer_task = nmdi_sched_task_alloc(filterer_step, get_branch_priority, b);
+    if (!b->decoder_task || !b->filterer_task)
+        return AVERROR(ENOMEM);
+
+    nmdi_msg_queue_set_tasks(b->pkt_queue,    b->decoder_task,  actx->demuxer_task);
+    nmdi_msg_queue_set_tasks(b->frames_queue, b->filterer_task, b->decoder_task);
+    nmdi_msg_queue_set_tasks(b->sink_queue,   NULL,             b->filterer_task);
+    return 0;
+}
+
+static void free_branch(struct async_branch *b)
+{
+    nmdi_mem_budget_free(&b->mem_budget);
+    nmdi_msg_queue_free(&b->pkt_queue);
+    nmdi_msg_queue_free(&b->frames_queue);
+    nmdi_msg_queue_free(&b->sink_queue);
+    nmdi_sched_task_free(&b->decoder_task);
+    nmdi_sched_task_free(&b->filterer_task);
+    nmdi_seek_cost_free(&b->cost);
+    nmdi_playback_hint_free(&b->hint);
+    nmdi_stats_free(&b->stats);
+    nmdi_obj_pool_unref(&b->frame_pool);
+}
+
 int nmdi_async_init(struct async_context *actx, void *log_ctx,
                     const char *filename, const struct nmdi_opts *o)
 {
@@ -698,58 +1460,119 @@ int nmdi_async_init(struct async_context *actx, void *log_ctx,
     actx->thread_stack_size = o->thread_stack_size;
     actx->request_seek = AV_NOPTS_VALUE;
 
-    TRACE(actx, "alloc modules queues");
-    if ((ret = alloc_msg_queue(&actx->src_queue,    1))                 < 0 ||
-        (ret = alloc_msg_queue(&actx->pkt_queue,    o->max_nb_packets)) < 0 ||
-        (ret = alloc_msg_queue(&actx->frames_queue, o->max_nb_frames))  < 0 ||
-        (ret = alloc_msg_queue(&actx->sink_queue,   o->max_nb_sink))    < 0)
+    actx->index = nmdi_keyframe_index_alloc();
+    if (!actx->index)
+        return AVERROR(ENOMEM);
+    ret = nmdi_keyframe_index_init(actx->index, log_ctx);
+    if (ret < 0)
+        return ret;
+
+    actx->demux_stats = nmdi_stats_alloc();
+    if (!actx->demux_stats)
+        return AVERROR(ENOMEM);
+    ret = nmdi_stats_init(actx->demux_stats);
+    if (ret < 0)
+        return ret;
+
+    if (o->info_cache_dir) {
+        actx->info_cache = nmdi_info_cache_alloc();
+        if (!actx->info_cache)
+            return AVERROR(ENOMEM);
+        ret = nmdi_info_cache_init(actx->info_cache, log_ctx, o->info_cache_dir, filename);
+        if (ret < 0)
+            return ret;
+    }
+
+    actx->nb_branches = 1;
+    ret = init_branch(&actx->branches[0], log_ctx, o);
+    if (ret < 0)
+        return ret;
+
+    if ((ret = alloc_msg_queue(&actx->src_queue, 1, o->lockfree_queues)) < 0)
         return ret;
 
     TRACE(actx, "allocate async queues");
-    if ((ret = alloc_msg_queue(&actx->ctl_in_queue,  5)) < 0 ||
-        (ret = alloc_msg_queue(&actx->ctl_out_queue, 5)) < 0)
+    if ((ret = alloc_msg_queue(&actx->ctl_in_queue,  5, 0)) < 0 ||
+        (ret = alloc_msg_queue(&actx->ctl_out_queue, 5, 0)) < 0)
         return ret;
 
-    START_MODULE_THREAD(control);
-    if (!actx->control_started)
-        return AVERROR(ENOMEM); // XXX
+    if (o->shared_scheduler) {
+        TRACE(actx, "run the modules on the shared scheduler");
+        ret = nmdi_sched_ref();
+        if (ret < 0)
+            return ret;
+        actx->sched_ref = 1;
+
+        actx->demuxer_task = nmdi_sched_task_alloc(demuxer_step, get_demuxer_priority, actx);
+        if (!actx->demuxer_task)
+            return AVERROR(ENOMEM);
+        nmdi_msg_queue_set_tasks(actx->src_queue, actx->demuxer_task, NULL);
 
+        ret = init_branch_tasks(actx, &actx->branches[0]);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* The control thread is started along the first operation requiring
+     * it (see ctl_send()) */
     return 0;
 }
 
+int nmdi_async_add_branch(struct async_context *actx, void *log_ctx, const struct nmdi_opts *o)
+{
+    if (actx->nb_branches >= MAX_BRANCHES)
+        return AVERROR(ENOSPC);
+
+    /* The modules are only initialized by the control thread once it
+     * receives its first operation, so the new branch is picked up then */
+    int ret = sync_control_thread(actx);
+    if (ret < 0)
+        return ret;
+    av_assert0(!actx->modules_initialized);
+
+    const int branch = actx->nb_branches;
+    ret = init_branch(&actx->branches[branch], log_ctx, o);
+    if (ret >= 0 && actx->demuxer_task)
+        ret = init_branch_tasks(actx, &actx->branches[branch]);
+    if (ret < 0) {
+        free_branch(&actx->branches[branch]);
+        return ret;
+    }
+    actx->nb_branches++;
+    return branch;
+}
+
 const char *nmdi_async_get_msg_type_string(enum msg_type type)
 {
     static const char * const s[NB_MSG] = {
-        [MSG_FRAME]  = "frame",
-        [MSG_PACKET] = "packet",
-        [MSG_SEEK]   = "seek",
-        [MSG_INFO]   = "info",
-        [MSG_START]  = "start",
-        [MSG_STOP]   = "stop",
-        [MSG_SYNC]   = "sync",
+        [MSG_FRAME]   = "frame",
+        [MSG_PACKET]  = "packet",
+        [MSG_SEEK]    = "seek",
+        [MSG_INFO]    = "info",
+        [MSG_START]   = "start",
+        [MSG_STOP]    = "stop",
+        [MSG_SYNC]    = "sync",
+        [MSG_REQUEST] = "request",
     };
     return s[type];
 }
 
 static void control_quit(struct async_context *actx)
 {
+    if (!actx->control_started) {
+        op_stop(actx);
+        return;
+    }
+
     nmdi_async_stop(actx);
     sync_control_thread(actx);
-    av_thread_message_queue_set_err_send(actx->ctl_in_queue,  AVERROR_EXIT);
-    av_thread_message_queue_set_err_send(actx->ctl_out_queue, AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->ctl_in_queue,  AVERROR_EXIT);
-    av_thread_message_queue_set_err_recv(actx->ctl_out_queue, AVERROR_EXIT);
-    av_thread_message_flush(actx->ctl_in_queue);
-    av_thread_message_flush(actx->ctl_out_queue);
-    JOIN_MODULE_THREAD(control);
-}
-
-int nmdi_nmdi_async_started(struct async_context *actx)
-{
-    int ret = sync_control_thread(actx);
-    if (ret < 0)
-        return ret;
-    return actx->playing;
+    nmdi_msg_queue_set_err_send(actx->ctl_in_queue,  AVERROR_EXIT);
+    nmdi_msg_queue_set_err_send(actx->ctl_out_queue, AVERROR_EXIT);
+    nmdi_msg_queue_set_err_recv(actx->ctl_in_queue,  AVERROR_EXIT);
+    nmdi_msg_queue_set_err_recv(actx->ctl_out_queue, AVERROR_EXIT);
+    nmdi_msg_queue_flush(actx->ctl_in_queue);
+    nmdi_msg_queue_flush(actx->ctl_out_queue);
+    JOIN_MODULE_THREAD(actx, control);
 }
 
 void nmdi_async_free(struct async_context **actxp)
@@ -761,13 +1584,20 @@ void nmdi_async_free(struct async_context **actxp)
 
     control_quit(actx);
 
-    av_thread_message_queue_free(&actx->src_queue);
-    av_thread_message_queue_free(&actx->pkt_queue);
-    av_thread_message_queue_free(&actx->frames_queue);
-    av_thread_message_queue_free(&actx->sink_queue);
+    nmdi_msg_queue_free(&actx->src_queue);
+    for (int i = 0; i < actx->nb_branches; i++)
+        free_branch(&actx->branches[i]);
+
+    nmdi_msg_queue_free(&actx->ctl_in_queue);
+    nmdi_msg_queue_free(&actx->ctl_out_queue);
+
+    nmdi_sched_task_free(&actx->demuxer_task);
+    if (actx->sched_ref)
+        nmdi_sched_unref();
 
-    av_thread_message_queue_free(&actx->ctl_in_queue);
-    av_thread_message_queue_free(&actx->ctl_out_queue);
+    nmdi_keyframe_index_unref(&actx->index);
+    nmdi_info_cache_free(&actx->info_cache);
+    nmdi_stats_free(&actx->demux_stats);
 
     TRACE(actx, "free done");
 
@@ -25,7 +25,9 @@
 #include <libavutil/frame.h>
 
 #include "nopemd.h"
+#include "obj_pool.h"
 #include "opts.h"
+#include "playback_hint.h"
 #include "msg.h"
 
 const char *nmdi_async_get_msg_type_string(enum msg_type type);
@@ -37,17 +39,77 @@ struct async_context *nmdi_async_alloc_context(void);
 int nmdi_async_init(struct async_context *actx, void *log_ctx,
                     const char *filename, const struct nmdi_opts *o);
 
+int nmdi_async_add_branch(struct async_context *actx, void *log_ctx, const struct nmdi_opts *o);
+
 int nmdi_async_start(struct async_context *actx);
 
-int nmdi_async_fetch_info(struct async_context *actx, struct nmd_info *info);
+/**
+ * With AV_THREAD_MESSAGE_NONBLOCK in flags, AVERROR(EAGAIN) is returned
+ * until the control thread has opened the media.
+ */
+int nmdi_async_fetch_info(struct async_context *actx, int branch, struct nmd_info *info, unsigned flags);
+
+int nmdi_async_seek(struct async_context *actx, int branch, int64_t ts);
 
-int nmdi_async_seek(struct async_context *actx, int64_t ts);
+enum async_request_type {
+    ASYNC_REQUEST_SEEK,                     // seek unconditionally
+    ASYNC_REQUEST_START,                    // no frame returned yet: seek unless the modules are running
+    ASYNC_REQUEST_FORWARD,                  // seek if cheaper than decoding up to the requested time
+};
 
-int nmdi_async_pop_frame(struct async_context *actx, AVFrame **framep);
+/* Frame request forwarded to the control thread, which decides whether the
+ * requested time is reached by seeking or by decoding the frames in between */
+struct async_request {
+    enum async_request_type type;
+    int64_t ts;                             // media time to seek to
+    AVRational time_base;                   // time base of the following fields
+    int64_t target;                         // requested time
+    int64_t pos;                            // latest frame poped by the user
+    int64_t diff;                           // distance from the latest frame returned to the target
+    int64_t frame_duration;
+};
 
-int nmdi_async_stop(struct async_context *actx);
+/**
+ * Forward a frame request to the control thread. With
+ * AV_THREAD_MESSAGE_NONBLOCK in flags, AVERROR(EAGAIN) is returned if the
+ * control thread can not take it yet.
+ */
+int nmdi_async_request(struct async_context *actx, int branch, const struct async_request *req, unsigned flags);
+
+/**
+ * Return 1 if the latest request of the branch was honored with a seek, 0 if
+ * the frames up to the requested time are decoded instead. With
+ * AV_THREAD_MESSAGE_NONBLOCK in flags, AVERROR(EAGAIN) is returned until the
+ * control thread has taken its decision.
+ */
+int nmdi_async_get_request_seek(struct async_context *actx, int branch, unsigned flags);
 
-int nmdi_nmdi_async_started(struct async_context *actx);
+/**
+ * With AV_THREAD_MESSAGE_NONBLOCK in flags, AVERROR(EAGAIN) is returned
+ * instead of waiting for the control thread or for a frame to be available.
+ */
+int nmdi_async_pop_frame(struct async_context *actx, int branch, AVFrame **framep, unsigned flags);
+
+int nmdi_async_get_prev_keyframe(struct async_context *actx, int branch, int64_t from, int64_t to, int64_t *kf);
+int nmdi_async_get_next_keyframe(struct async_context *actx, int branch, int64_t from, int64_t *kf);
+
+/**
+ * Use the keyframe index of src instead of the own one of actx, so that the
+ * keyframes located by either pipeline benefit the other. Must be called
+ * before the pipeline of actx is started.
+ */
+void nmdi_async_share_keyframe_index(struct async_context *actx, struct async_context *src);
+struct obj_pool *nmdi_async_get_frame_pool(struct async_context *actx, int branch);
+struct playback_hint *nmdi_async_get_playback_hint(struct async_context *actx, int branch);
+
+/**
+ * Fill the statistics of the branch, except the ones only known by the API
+ * layer (nb_frames_returned).
+ */
+void nmdi_async_get_stats(struct async_context *actx, int branch, struct nmd_stats *stats);
+int nmdi_async_get_position_change(struct async_context *actx, int branch, int *gen, int64_t *ts, unsigned flags);
+
+int nmdi_async_stop(struct async_context *actx);
 
 void nmdi_async_free(struct async_context **actxp);
 
@@ -0,0 +1,236 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <string.h>
+
+#include <libavutil/avassert.h>
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+#include <libavutil/samplefmt.h>
+
+#include "audio_ring.h"
+#include "internal.h"
+#include "log.h"
+
+struct audio_ring {
+    void *log_ctx;
+    int nb_channels;
+    int sample_rate;                        // rate of the samples (0 until the first push)
+
+    float *samples;                         // interleaved samples, capacity*nb_channels floats
+    int capacity;                           // maximum number of samples held
+    int first;                              // index of the oldest sample
+    int nb_samples;
+    int64_t start;                          // position of the oldest sample (AV_NOPTS_VALUE if not positioned)
+};
+
+struct audio_ring *nmdi_audio_ring_alloc(void)
+{
+    struct audio_ring *r = av_mallocz(sizeof(*r));
+    if (!r)
+        return NULL;
+    r->start = AV_NOPTS_VALUE;
+    return r;
+}
+
+int nmdi_audio_ring_init(struct audio_ring *r, void *log_ctx, int nb_channels)
+{
+    av_assert0(nb_channels > 0);
+    r->log_ctx = log_ctx;
+    r->nb_channels = nb_channels;
+    return 0;
+}
+
+int nmdi_audio_ring_reserve(struct audio_ring *r, int nb_samples)
+{
+    if (nb_samples <= r->capacity)
+        return 0;
+
+    const size_t sample_size = r->nb_channels * sizeof(*r->samples);
+    float *samples = av_malloc_array(nb_samples, sample_size);
+    if (!samples)
+        return AVERROR(ENOMEM);
+
+    /* Move the current samples to the start of the new buffer */
+    const int n1 = FFMIN(r->nb_samples, r->capacity - r->first);
+    if (n1)
+        memcpy(samples, r->samples + r->first * r->nb_channels, n1 * sample_size);
+    if (r->nb_samples > n1)
+        memcpy(samples + n1 * r->nb_channels, r->samples, (r->nb_samples - n1) * sample_size);
+
+    TRACE(r, "ring capacity grown from %d to %d samples", r->capacity, nb_samples);
+    av_free(r->samples);
+    r->samples = samples;
+    r->capacity = nb_samples;
+    r->first = 0;
+    return 0;
+}
+
+/* Append n samples (silence if src is NULL), dropping the oldest ones if needed */
+static void append_samples(struct audio_ring *r, const float *src, int n)
+{
+    const int nb_channels = r->nb_channels;
+
+    if (n >= r->capacity) {
+        const int skip = n - r->capacity;
+        if (src)
+            src += skip * nb_channels;
+        r->start += r->nb_samples + skip;
+        r->first = 0;
+        r->nb_samples = 0;
+        n = r->capacity;
+    } else {
+        const int overflow = r->nb_samples + n - r->capacity;
+        if (overflow > 0) {
+            r->first = (r->first + overflow) % r->capacity;
+            r->nb_samples -= overflow;
+            r->start += overflow;
+        }
+    }
+
+    int idx = (r->first + r->nb_samples) % r->capacity;
+    r->nb_samples += n;
+    while (n) {
+        const int len = FFMIN(n, r->capacity - idx);
+        float *dst = r->samples + idx * nb_channels;
+        if (src) {
+            memcpy(dst, src, len * nb_channels * sizeof(*dst));
+            src += len * nb_channels;
+        } else {
+            memset(dst, 0, len * nb_channels * sizeof(*dst));
+        }
+        idx = 0;
+        n -= len;
+    }
+}
+
+int nmdi_audio_ring_push(struct audio_ring *r, const AVFrame *frame, int64_t pos)
+{
+    av_assert0(frame->format == AV_SAMPLE_FMT_FLT);
+
+    if (frame->sample_rate != r->sample_rate) {
+        TRACE(r, "sample rate changed from %d to %d", r->sample_rate, frame->sample_rate);
+        nmdi_audio_ring_reset(r);
+        r->sample_rate = frame->sample_rate;
+    }
+
+    /* Hold at least a second of audio so that small shifts backward from the
+     * latest read are still served */
+    int ret = nmdi_audio_ring_reserve(r, FFMAX(r->sample_rate, frame->nb_samples));
+    if (ret < 0)
+        return ret;
+
+    /* Timestamps rounded in the stream timebase are tolerated */
+    const int64_t tolerance = FFMAX(r->sample_rate / 500, 1);
+
+    if (r->start == AV_NOPTS_VALUE) {
+        r->start = pos;
+    } else {
+        const int64_t end = r->start + r->nb_samples;
+        if (!r->nb_samples && pos < end) {
+            /* The first frame after a seek starts before the seek position */
+            r->start = pos;
+        } else if (FFABS(pos - end) <= tolerance) {
+            /* Contiguous with the latest samples */
+        } else if (pos > end && pos - end < r->capacity) {
+            TRACE(r, "fill a gap of %"PRId64" samples with silence", pos - end);
+            append_samples(r, NULL, pos - end);
+        } else {
+            TRACE(r, "discontinuity from %"PRId64" to %"PRId64", restart the ring", end, pos);
+            r->first = 0;
+            r->nb_samples = 0;
+            r->start = pos;
+        }
+    }
+
+    append_samples(r, (const float *)frame->data[0], frame->nb_samples);
+    return 0;
+}
+
+void nmdi_audio_ring_seek(struct audio_ring *r, int64_t pos)
+{
+    r->first = 0;
+    r->nb_samples = 0;
+    r->start = pos;
+}
+
+void nmdi_audio_ring_reset(struct audio_ring *r)
+{
+    nmdi_audio_ring_seek(r, AV_NOPTS_VALUE);
+    r->sample_rate = 0;
+}
+
+int nmdi_audio_ring_get_sample_rate(const struct audio_ring *r)
+{
+    return r->sample_rate;
+}
+
+int nmdi_audio_ring_get_range(const struct audio_ring *r, int64_t *start, int64_t *end)
+{
+    if (r->start == AV_NOPTS_VALUE)
+        return 0;
+    *start = r->start;
+    *end = r->start + r->nb_samples;
+    return 1;
+}
+
+int nmdi_audio_ring_read(const struct audio_ring *r, int64_t pos, int nb_samples, float *dst)
+{
+    const int nb_channels = r->nb_channels;
+    const int64_t end = pos + nb_samples;
+
+    int64_t ring_start, ring_end;
+    if (!nmdi_audio_ring_get_range(r, &ring_start, &ring_end) || ring_end <= pos || ring_start >= end) {
+        memset(dst, 0, nb_samples * nb_channels * sizeof(*dst));
+        return 0;
+    }
+
+    const int64_t copy_start = FFMAX(pos, ring_start);
+    const int64_t copy_end = FFMIN(end, ring_end);
+    const int nb_before = copy_start - pos;
+    const int nb_after = end - copy_end;
+    int n = copy_end - copy_start;
+    const int nb_copied = n;
+
+    memset(dst, 0, nb_before * nb_channels * sizeof(*dst));
+    dst += nb_before * nb_channels;
+
+    int idx = (r->first + (copy_start - ring_start)) % r->capacity;
+    while (n) {
+        const int len = FFMIN(n, r->capacity - idx);
+        memcpy(dst, r->samples + idx * nb_channels, len * nb_channels * sizeof(*dst));
+        dst += len * nb_channels;
+        idx = 0;
+        n -= len;
+    }
+
+    memset(dst, 0, nb_after * nb_channels * sizeof(*dst));
+    return nb_copied;
+}
+
+void nmdi_audio_ring_free(struct audio_ring **rp)
+{
+    struct audio_ring *r = *rp;
+    if (!r)
+        return;
+    av_freep(&r->samples);
+    av_freep(rp);
+}
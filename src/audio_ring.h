@@ -0,0 +1,82 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef AUDIO_RING_H
+#define AUDIO_RING_H
+
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+/*
+ * Ring of the latest interleaved float samples obtained from the pipeline,
+ * addressed by their absolute position (in samples since the start of the
+ * stream), so that arbitrary windows can be read without the frame
+ * granularity.
+ */
+struct audio_ring *nmdi_audio_ring_alloc(void);
+
+int nmdi_audio_ring_init(struct audio_ring *r, void *log_ctx, int nb_channels);
+
+/**
+ * Make sure at least nb_samples samples can be held, keeping the current
+ * ones.
+ */
+int nmdi_audio_ring_reserve(struct audio_ring *r, int nb_samples);
+
+/**
+ * Append the samples of the frame located at pos. A frame contiguous with the
+ * latest samples (up to a rounding error of the timestamps) is appended after
+ * them, a small gap is filled with silence, any other discontinuity restarts
+ * the ring at pos.
+ */
+int nmdi_audio_ring_push(struct audio_ring *r, const AVFrame *frame, int64_t pos);
+
+/**
+ * Drop the samples and expect the next ones at pos (typically after a seek).
+ */
+void nmdi_audio_ring_seek(struct audio_ring *r, int64_t pos);
+
+/**
+ * Drop the samples, the next ones define a new position and sample rate.
+ */
+void nmdi_audio_ring_reset(struct audio_ring *r);
+
+/**
+ * Return the sample rate of the samples, or 0 if none was pushed since the
+ * latest reset.
+ */
+int nmdi_audio_ring_get_sample_rate(const struct audio_ring *r);
+
+/**
+ * Get the position of the first sample and the position following the latest
+ * one. Return 0 if the ring is not positioned yet.
+ */
+int nmdi_audio_ring_get_range(const struct audio_ring *r, int64_t *start, int64_t *end);
+
+/**
+ * Copy the nb_samples samples starting at pos into dst, zero-filling the ones
+ * not held by the ring. Return the number of samples copied from the ring.
+ */
+int nmdi_audio_ring_read(const struct audio_ring *r, int64_t pos, int nb_samples, float *dst);
+
+void nmdi_audio_ring_free(struct audio_ring **rp);
+
+#endif
@@ -342,12 +342,38 @@ static int init_vaapi(struct decoder_ctx *ctx, const struct nmdi_opts *opts)
 }
 #endif
 
+/*
+ * Get the lowest decoding resolution of the codec still larger than the
+ * max_pixels dimensions, so that the filtergraph only has to complete the
+ * downscaling
+ */
+static int get_lowres(struct decoder_ctx *ctx, const AVCodec *codec, const struct nmdi_opts *opts)
+{
+    const AVCodecContext *avctx = ctx->avctx;
+    int lowres = 0;
+
+    if (!codec || !opts->max_pixels || avctx->codec_type != AVMEDIA_TYPE_VIDEO)
+        return 0;
+
+    int w = avctx->width, h = avctx->height;
+    nmdi_update_dimensions(&w, &h, opts->max_pixels);
+    while (lowres < codec->max_lowres &&
+           avctx->width  >> (lowres + 1) >= w &&
+           avctx->height >> (lowres + 1) >= h)
+        lowres++;
+
+    if (lowres)
+        TRACE(ctx, "decoding at 1/%d of the resolution for a target of %dx%d", 1 << lowres, w, h);
+    return lowres;
+}
+
 static int ffdec_init_sw(struct decoder_ctx *ctx, const struct nmdi_opts *opts)
 {
     AVCodecContext *avctx = ctx->avctx;
-    avctx->thread_count = 0;
+    avctx->thread_count = ctx->nb_threads;
 
     const AVCodec *codec = avcodec_find_decoder(avctx->codec_id);
+    avctx->lowres = get_lowres(ctx, codec, opts);
     return avcodec_open2(avctx, codec, NULL);
 }
 
@@ -368,6 +394,7 @@ static int ffdec_push_packet(struct decoder_ctx *ctx, const AVPacket *pkt)
     const int pkt_size = pkt ? pkt->size : 0;
     const int flush = !pkt_size;
     AVCodecContext *avctx = ctx->avctx;
+    AVFrame *dec_frame = NULL;              // kept from one unsuccessful receive to the next
 
     av_assert0(avctx->codec_type == AVMEDIA_TYPE_VIDEO ||
                avctx->codec_type == AVMEDIA_TYPE_AUDIO);
@@ -382,6 +409,7 @@ static int ffdec_push_packet(struct decoder_ctx *ctx, const AVPacket *pkt)
             LOG(ctx, ERROR, "Error sending packet to %s decoder: %s",
                 av_get_media_type_string(avctx->codec_type),
                 av_err2str(ret));
+            nmdi_decoding_free_frame(ctx->decoding_ctx, &dec_frame);
             return ret;
         } else {
             pkt_consumed = 1;
@@ -390,17 +418,18 @@ static int ffdec_push_packet(struct decoder_ctx *ctx, const AVPacket *pkt)
         const int draining = flush && pkt_consumed;
         int64_t next_pts = AV_NOPTS_VALUE;
         while (ret >= 0 || (draining && ret == AVERROR(EAGAIN))) {
-            AVFrame *dec_frame = av_frame_alloc();
-
-            if (!dec_frame)
-                return AVERROR(ENOMEM);
+            if (!dec_frame) {
+                dec_frame = nmdi_decoding_alloc_frame(ctx->decoding_ctx);
+                if (!dec_frame)
+                    return AVERROR(ENOMEM);
+            }
 
             ret = avcodec_receive_frame(avctx, dec_frame);
             if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
                 LOG(ctx, ERROR, "Error receiving frame from %s decoder: %s",
                     av_get_media_type_string(avctx->codec_type),
                     av_err2str(ret));
-                    av_frame_free(&dec_frame);
+                    nmdi_decoding_free_frame(ctx->decoding_ctx, &dec_frame);
                 return ret;
             }
 
@@ -421,14 +450,14 @@ static int ffdec_push_packet(struct decoder_ctx *ctx, const AVPacket *pkt)
                 ret = nmdi_decoding_queue_frame(ctx->decoding_ctx, dec_frame);
                 if (ret < 0) {
                     TRACE(ctx, "Could not queue frame: %s", av_err2str(ret));
-                    av_frame_free(&dec_frame);
+                    nmdi_decoding_free_frame(ctx->decoding_ctx, &dec_frame);
                     return ret;
                 }
-            } else {
-                av_frame_free(&dec_frame);
+                dec_frame = NULL;
             }
         }
     }
+    nmdi_decoding_free_frame(ctx->decoding_ctx, &dec_frame);
 
     if (ret == AVERROR(EAGAIN))
         ret = 0;
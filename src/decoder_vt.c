@@ -200,7 +200,7 @@ static int push_async_frame(struct decoder_ctx *dec_ctx,
     int ret;
     const AVCodecContext *avctx = dec_ctx->avctx;
     const struct vtdec_context *vt = dec_ctx->priv_data;
-    AVFrame *frame = av_frame_alloc();
+    AVFrame *frame = nmdi_decoding_alloc_frame(dec_ctx->decoding_ctx);
     if (!frame)
         return AVERROR(ENOMEM);
 
@@ -219,13 +219,13 @@ static int push_async_frame(struct decoder_ctx *dec_ctx,
                                       NULL,
                                       AV_BUFFER_FLAG_READONLY);
     if (!frame->buf[0]) {
-        av_frame_free(&frame);
+        nmdi_decoding_free_frame(dec_ctx->decoding_ctx, &frame);
         return AVERROR(ENOMEM);
     }
     TRACE(dec_ctx, "push frame pts=%"PRId64, frame->pts);
     ret = nmdi_decoding_queue_frame(dec_ctx->decoding_ctx, frame);
     if (ret < 0)
-        av_frame_free(&frame);
+        nmdi_decoding_free_frame(dec_ctx->decoding_ctx, &frame);
     return ret;
 }
 
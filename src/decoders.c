@@ -64,6 +64,11 @@ int nmdi_decoder_init(void *log_ctx,
     if (HAVE_MEDIACODEC_HWACCEL && !strcmp(dec->name, "ffmpeg_hw"))
         ctx->avctx->pkt_timebase = stream->time_base;
 
+    // The demuxer already filters the packets out, but some keyframes are not
+    // flagged as such by the demuxers
+    if (opts->keyframes_only && stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        ctx->avctx->skip_frame = AVDISCARD_NONKEY;
+
     ret = dec->init(ctx, opts);
     if (ret < 0) {
         if (dec->uninit)
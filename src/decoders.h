@@ -35,6 +35,7 @@ struct decoder_ctx {
     void *priv_data;
     struct decoding_ctx *decoding_ctx;
     void *opaque;
+    int nb_threads;                         // threads of the software decoder (0 lets FFmpeg pick)
 };
 
 struct decoder {
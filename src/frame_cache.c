@@ -0,0 +1,290 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libavutil/avassert.h>
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+
+#include "frame_cache.h"
+#include "internal.h"
+#include "log.h"
+#include "pthread_compat.h"
+
+struct cache_entry {
+    AVFrame *frame;
+    int64_t end_pts;                        // pts at which the frame stops being displayed (or AV_NOPTS_VALUE if unknown)
+    int64_t size;                           // size of the frame buffers in bytes
+};
+
+/* Frames shared by all the handles of a cache */
+struct frame_store {
+    pthread_mutex_t lock;
+    int refcount;
+
+    int max_nb_frames;
+    int64_t max_size;
+    int use_pkt_duration;
+
+    struct cache_entry *entries;            // ring buffer of entries, ordered by insertion
+    int first;                              // index of the oldest entry
+    int nb_entries;
+    int64_t size;                           // total size of the cached frames in bytes
+};
+
+struct frame_cache {
+    void *log_ctx;
+    struct frame_store *store;
+    int64_t last_pts;                       // pts of the latest frame added through this handle (AV_NOPTS_VALUE after a discontinuity)
+};
+
+struct frame_cache *nmdi_frame_cache_alloc(void)
+{
+    struct frame_cache *fc = av_mallocz(sizeof(*fc));
+    if (!fc)
+        return NULL;
+    fc->last_pts = AV_NOPTS_VALUE;
+    return fc;
+}
+
+int nmdi_frame_cache_init(struct frame_cache *fc, void *log_ctx,
+                          int max_nb_frames, int64_t max_size,
+                          int use_pkt_duration)
+{
+    av_assert0(max_nb_frames > 0);
+    av_assert0(!fc->store);
+
+    fc->log_ctx = log_ctx;
+
+    struct frame_store *store = av_mallocz(sizeof(*store));
+    if (!store)
+        return AVERROR(ENOMEM);
+    fc->store = store;
+
+    pthread_mutex_init(&store->lock, NULL);
+    store->refcount = 1;
+    store->max_nb_frames = max_nb_frames;
+    store->max_size = max_size;
+    store->use_pkt_duration = use_pkt_duration;
+
+    store->entries = av_calloc(max_nb_frames, sizeof(*store->entries));
+    if (!store->entries)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+struct frame_cache *nmdi_frame_cache_share(struct frame_cache *fc, void *log_ctx)
+{
+    struct frame_cache *ref = nmdi_frame_cache_alloc();
+    if (!ref)
+        return NULL;
+    ref->log_ctx = log_ctx;
+    ref->store = fc->store;
+    pthread_mutex_lock(&ref->store->lock);
+    ref->store->refcount++;
+    pthread_mutex_unlock(&ref->store->lock);
+    return ref;
+}
+
+static struct cache_entry *get_entry(struct frame_store *store, int i)
+{
+    return &store->entries[(store->first + i) % store->max_nb_frames];
+}
+
+static void drop_oldest_entry(struct frame_store *store)
+{
+    struct cache_entry *entry = get_entry(store, 0);
+
+    av_assert0(store->nb_entries > 0);
+
+    store->size -= entry->size;
+    av_frame_free(&entry->frame);
+    memset(entry, 0, sizeof(*entry));
+
+    store->first = (store->first + 1) % store->max_nb_frames;
+    store->nb_entries--;
+}
+
+static struct cache_entry *find_exact_entry(struct frame_store *store, int64_t pts)
+{
+    for (int i = 0; i < store->nb_entries; i++) {
+        struct cache_entry *entry = get_entry(store, i);
+        if (entry->frame->pts == pts)
+            return entry;
+    }
+    return NULL;
+}
+
+static struct cache_entry *find_entry(struct frame_store *store, int64_t ts)
+{
+    struct cache_entry *entry = find_exact_entry(store, ts);
+    if (entry)
+        return entry;
+    for (int i = 0; i < store->nb_entries; i++) {
+        entry = get_entry(store, i);
+        const int64_t pts = entry->frame->pts;
+        if (pts < ts && entry->end_pts != AV_NOPTS_VALUE && ts < entry->end_pts)
+            return entry;
+    }
+    return NULL;
+}
+
+int nmdi_frame_cache_add(struct frame_cache *fc, const AVFrame *frame)
+{
+    struct frame_store *store = fc->store;
+    const int64_t pts = frame->pts;
+    int ret = 0;
+
+    if (pts == AV_NOPTS_VALUE)
+        return 0;
+
+    pthread_mutex_lock(&store->lock);
+
+    /* The previous frame is displayed until this one shows up */
+    if (fc->last_pts != AV_NOPTS_VALUE && fc->last_pts < pts) {
+        struct cache_entry *prev = find_exact_entry(store, fc->last_pts);
+        if (prev)
+            prev->end_pts = pts;
+    }
+    fc->last_pts = pts;
+
+    /* The frame may already be there if we are decoding a range that was
+     * previously visited (typically after a backward seek, or by another
+     * handle) */
+    if (find_exact_entry(store, pts))
+        goto end;
+
+    const int64_t size = nmdi_get_frame_size(frame);
+    if (store->max_size && size > store->max_size) {
+        fc->last_pts = AV_NOPTS_VALUE;
+        goto end;
+    }
+
+    while (store->nb_entries == store->max_nb_frames ||
+           (store->max_size && store->nb_entries && store->size + size > store->max_size)) {
+        TRACE(fc, "drop cached frame with pts=%"PRId64, get_entry(store, 0)->frame->pts);
+        drop_oldest_entry(store);
+    }
+
+    struct cache_entry *entry = get_entry(store, store->nb_entries);
+    entry->frame = av_frame_clone(frame);
+    if (!entry->frame) {
+        fc->last_pts = AV_NOPTS_VALUE;
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    entry->end_pts = store->use_pkt_duration && frame->pkt_duration > 0 ? pts + frame->pkt_duration
+                                                                       : AV_NOPTS_VALUE;
+    entry->size = size;
+
+    store->nb_entries++;
+    store->size += size;
+
+    TRACE(fc, "cached frame with pts=%"PRId64" (%d frames, %"PRId64" bytes)",
+          pts, store->nb_entries, store->size);
+
+end:
+    pthread_mutex_unlock(&store->lock);
+    return ret;
+}
+
+int nmdi_frame_cache_reserve(struct frame_cache *fc, int nb_frames)
+{
+    struct frame_store *store = fc->store;
+    int ret = 0;
+
+    pthread_mutex_lock(&store->lock);
+    if (nb_frames <= store->max_nb_frames)
+        goto end;
+
+    struct cache_entry *entries = av_calloc(nb_frames, sizeof(*entries));
+    if (!entries) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (int i = 0; i < store->nb_entries; i++)
+        entries[i] = *get_entry(store, i);
+    av_free(store->entries);
+    store->entries = entries;
+    store->first = 0;
+    store->max_nb_frames = nb_frames;
+    TRACE(fc, "cache grown to %d frames", nb_frames);
+
+end:
+    pthread_mutex_unlock(&store->lock);
+    return ret;
+}
+
+AVFrame *nmdi_frame_cache_get(struct frame_cache *fc, int64_t ts)
+{
+    struct frame_store *store = fc->store;
+    AVFrame *frame = NULL;
+
+    pthread_mutex_lock(&store->lock);
+    const struct cache_entry *entry = find_entry(store, ts);
+    if (entry) {
+        TRACE(fc, "found frame with pts=%"PRId64" for ts=%"PRId64, entry->frame->pts, ts);
+        frame = av_frame_clone(entry->frame);
+    }
+    pthread_mutex_unlock(&store->lock);
+    return frame;
+}
+
+void nmdi_frame_cache_break(struct frame_cache *fc)
+{
+    fc->last_pts = AV_NOPTS_VALUE;
+}
+
+static void flush_store(struct frame_store *store)
+{
+    while (store->nb_entries)
+        drop_oldest_entry(store);
+    store->first = 0;
+}
+
+void nmdi_frame_cache_flush(struct frame_cache *fc)
+{
+    pthread_mutex_lock(&fc->store->lock);
+    flush_store(fc->store);
+    pthread_mutex_unlock(&fc->store->lock);
+    fc->last_pts = AV_NOPTS_VALUE;
+}
+
+void nmdi_frame_cache_free(struct frame_cache **fcp)
+{
+    struct frame_cache *fc = *fcp;
+    if (!fc)
+        return;
+
+    struct frame_store *store = fc->store;
+    if (store) {
+        pthread_mutex_lock(&store->lock);
+        const int refcount = --store->refcount;
+        pthread_mutex_unlock(&store->lock);
+        if (!refcount) {
+            if (store->entries)
+                flush_store(store);
+            pthread_mutex_destroy(&store->lock);
+            av_freep(&store->entries);
+            av_freep(&fc->store);
+        }
+    }
+    av_freep(fcp);
+}
@@ -0,0 +1,70 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+struct frame_cache *nmdi_frame_cache_alloc(void);
+
+int nmdi_frame_cache_init(struct frame_cache *fc, void *log_ctx,
+                          int max_nb_frames, int64_t max_size,
+                          int use_pkt_duration);
+
+/**
+ * Create another handle on the frames of fc, typically to be used by another
+ * context on the same media. Frames added through any handle are visible from
+ * all of them, while the contiguity of the added frames is tracked per handle.
+ * The frames are released along with the last handle.
+ *
+ * Return NULL on error.
+ */
+struct frame_cache *nmdi_frame_cache_share(struct frame_cache *fc, void *log_ctx);
+
+/**
+ * Keep a reference to the frame. The frame is considered contiguous with the
+ * previously added one unless nmdi_frame_cache_break() was called in between.
+ */
+int nmdi_frame_cache_add(struct frame_cache *fc, const AVFrame *frame);
+
+/**
+ * Make room for at least nb_frames frames, within the size limit of the
+ * cache. The capacity is never reduced.
+ */
+int nmdi_frame_cache_reserve(struct frame_cache *fc, int nb_frames);
+
+/**
+ * Return a new reference to the cached frame displayed at ts (expressed in
+ * the frame timebase), or NULL if there is none.
+ */
+AVFrame *nmdi_frame_cache_get(struct frame_cache *fc, int64_t ts);
+
+/**
+ * Signal a discontinuity in the added frames (typically after a seek).
+ */
+void nmdi_frame_cache_break(struct frame_cache *fc);
+
+void nmdi_frame_cache_flush(struct frame_cache *fc);
+
+void nmdi_frame_cache_free(struct frame_cache **fcp);
+
+#endif
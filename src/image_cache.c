@@ -0,0 +1,213 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/mem.h>
+
+#include "image_cache.h"
+#include "internal.h"
+#include "pthread_compat.h"
+
+struct image_key {
+    char *filename;
+    int64_t file_size;
+    int64_t mtime;
+    int stream_idx;
+    int sw_pix_fmt;
+    int max_pixels;
+    int autorotate;
+    char *filters;
+};
+
+struct image_entry {
+    struct image_entry *next;               // less recently used image
+    struct image_key key;
+    AVFrame *frame;
+    int64_t size;
+    struct nmd_info info;
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct image_entry *images;          // most recently used first
+static int64_t max_cache_size;
+static int64_t cache_size;
+
+static int same_str(const char *a, const char *b)
+{
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+/* The key doesn't own its strings, so it must not outlive the options */
+static int get_key(struct image_key *key, const char *filename, const struct nmdi_opts *o)
+{
+    /* The images read through the user callbacks can not be identified */
+    struct stat st;
+    if (o->io_callbacks.open || stat(filename, &st) < 0 || !S_ISREG(st.st_mode))
+        return 0;
+
+    *key = (struct image_key){
+        .filename   = (char *)filename,
+        .file_size  = st.st_size,
+        .mtime      = st.st_mtime,
+        .stream_idx = o->stream_idx,
+        .sw_pix_fmt = o->sw_pix_fmt,
+        .max_pixels = o->max_pixels,
+        .autorotate = o->autorotate,
+        .filters    = o->filters,
+    };
+    return 1;
+}
+
+static int same_key(const struct image_key *a, const struct image_key *b)
+{
+    return !strcmp(a->filename, b->filename) &&
+           a->file_size  == b->file_size &&
+           a->mtime      == b->mtime &&
+           a->stream_idx == b->stream_idx &&
+           a->sw_pix_fmt == b->sw_pix_fmt &&
+           a->max_pixels == b->max_pixels &&
+           a->autorotate == b->autorotate &&
+           same_str(a->filters, b->filters);
+}
+
+static void free_entry(struct image_entry **entryp)
+{
+    struct image_entry *entry = *entryp;
+    if (!entry)
+        return;
+    av_frame_free(&entry->frame);
+    av_freep(&entry->key.filename);
+    av_freep(&entry->key.filters);
+    av_freep(entryp);
+}
+
+/* Drop the least recently used images until the cache fits in its limit */
+static void evict_images(void)
+{
+    while (cache_size > max_cache_size) {
+        struct image_entry **lastp = &images;
+        while ((*lastp)->next)
+            lastp = &(*lastp)->next;
+        cache_size -= (*lastp)->size;
+        free_entry(lastp);
+    }
+}
+
+void nmdi_image_cache_set_max_size(int64_t max_size)
+{
+    pthread_mutex_lock(&cache_lock);
+    max_cache_size = FFMAX(max_size, 0);
+    evict_images();
+    pthread_mutex_unlock(&cache_lock);
+}
+
+int nmdi_image_cache_get(const char *filename, const struct nmdi_opts *o,
+                         AVFrame **framep, struct nmd_info *info)
+{
+    int ret = 0;
+    struct image_key key;
+
+    *framep = NULL;
+    if (!get_key(&key, filename, o))
+        return 0;
+
+    pthread_mutex_lock(&cache_lock);
+
+    struct image_entry **entryp = &images;
+    while (*entryp && !same_key(&(*entryp)->key, &key))
+        entryp = &(*entryp)->next;
+
+    struct image_entry *entry = *entryp;
+    if (entry) {
+        *framep = av_frame_clone(entry->frame);
+        if (!*framep) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        *info = entry->info;
+
+        /* Move the image to the head of the list */
+        *entryp = entry->next;
+        entry->next = images;
+        images = entry;
+        ret = 1;
+    }
+
+end:
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+int nmdi_image_cache_add(const char *filename, const struct nmdi_opts *o,
+                         const AVFrame *frame, const struct nmd_info *info)
+{
+    int ret = 0;
+    struct image_key key;
+
+    if (!get_key(&key, filename, o))
+        return 0;
+
+    const int64_t size = nmdi_get_frame_size(frame);
+
+    pthread_mutex_lock(&cache_lock);
+
+    /* Another context may have cached the same image in the meantime */
+    struct image_entry *entry;
+    for (entry = images; entry; entry = entry->next) {
+        if (same_key(&entry->key, &key)) {
+            ret = 1;
+            goto end;
+        }
+    }
+
+    if (size > max_cache_size)
+        goto end;
+
+    entry = av_mallocz(sizeof(*entry));
+    if (!entry) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    entry->key = key;
+    entry->key.filename = av_strdup(filename);
+    entry->key.filters = o->filters ? av_strdup(o->filters) : NULL;
+    entry->frame = av_frame_clone(frame);
+    if (!entry->key.filename || (o->filters && !entry->key.filters) || !entry->frame) {
+        free_entry(&entry);
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    entry->size = size;
+    entry->info = *info;
+
+    entry->next = images;
+    images = entry;
+    cache_size += size;
+    evict_images();
+    ret = 1;
+
+end:
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
@@ -0,0 +1,63 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+#include "nopemd.h"
+#include "opts.h"
+
+/*
+ * Process-wide cache of the decoded and filtered still images (see
+ * nmd_set_image_cache_size()). The images are identified by their filename,
+ * modification time and the options affecting the output frames, so that the
+ * contexts opened on the same picture share a single frame buffer instead of
+ * decoding it again. The least recently used images are dropped from the
+ * cache when their total size exceeds the limit; the contexts holding them
+ * keep their own reference.
+ *
+ * All the functions are thread-safe.
+ */
+
+/**
+ * Set the maximum size in bytes of the cached images (0 disables the cache).
+ */
+void nmdi_image_cache_set_max_size(int64_t max_size);
+
+/**
+ * Look up the image. Return 1 and set *framep to a new reference to the
+ * frame and *info to the media information if it is cached, 0 otherwise.
+ */
+int nmdi_image_cache_get(const char *filename, const struct nmdi_opts *o,
+                         AVFrame **framep, struct nmd_info *info);
+
+/**
+ * Add a reference to the frame of the image to the cache. Return 1 if the
+ * image is cached, 0 if it can not be (cache disabled or too small, or media
+ * not identifiable).
+ */
+int nmdi_image_cache_add(const char *filename, const struct nmdi_opts *o,
+                         const AVFrame *frame, const struct nmd_info *info);
+
+#endif
@@ -0,0 +1,425 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/mem.h>
+
+#include "info_cache.h"
+#include "internal.h"
+#include "log.h"
+
+#define CACHE_MAGIC   "nmd-info-cache"
+#define CACHE_VERSION 1
+
+/* Parameters filled by avformat_find_stream_info() */
+struct cached_stream {
+    int codec_type;
+    int codec_id;
+    AVRational time_base;
+    int64_t start_time;
+    int64_t duration;
+    AVRational avg_frame_rate;
+    AVRational r_frame_rate;
+    AVRational sample_aspect_ratio;
+    int format;
+    int width, height;
+    int profile, level;
+    int color_range, color_space, color_primaries, color_trc;
+    int chroma_location;
+    int field_order;
+    int video_delay;
+    int bits_per_raw_sample;
+    int sample_rate;
+    int frame_size;
+    int nb_channels;
+    int extradata_size;
+    int64_t bit_rate;
+};
+
+struct info_cache {
+    void *log_ctx;
+    char *path;                             // cache entry file (NULL if the media can't be identified)
+    int64_t file_size;
+    int64_t mtime;
+
+    int loaded;
+    int saved;                              // only accessed by the demuxer
+    int is_image;
+    int64_t start_time;
+    int64_t duration;
+    int64_t bit_rate;
+    int best_streams[2];                    // best video and audio streams
+    struct cached_stream *streams;
+    int nb_streams;
+};
+
+struct info_cache *nmdi_info_cache_alloc(void)
+{
+    struct info_cache *ic = av_mallocz(sizeof(*ic));
+    if (!ic)
+        return NULL;
+    return ic;
+}
+
+static int get_nb_channels(const AVCodecParameters *par)
+{
+#if LIBAVUTIL_VERSION_INT < AV_VERSION_INT(57, 24, 100)
+    return par->channels;
+#else
+    return par->ch_layout.nb_channels;
+#endif
+}
+
+/* FNV-1a, only used to derive the name of the entry from the media path */
+static uint64_t hash_str(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; *s; s++)
+        h = (h ^ (uint8_t)*s) * 0x100000001b3ULL;
+    return h;
+}
+
+static int read_stream(FILE *fp, struct cached_stream *st)
+{
+    return fscanf(fp, " %d %d %d/%d %"SCNd64" %"SCNd64" %d/%d %d/%d %d/%d"
+                  " %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %"SCNd64,
+                  &st->codec_type, &st->codec_id, &st->time_base.num, &st->time_base.den,
+                  &st->start_time, &st->duration,
+                  &st->avg_frame_rate.num, &st->avg_frame_rate.den,
+                  &st->r_frame_rate.num, &st->r_frame_rate.den,
+                  &st->sample_aspect_ratio.num, &st->sample_aspect_ratio.den,
+                  &st->format, &st->width, &st->height, &st->profile, &st->level,
+                  &st->color_range, &st->color_space, &st->color_primaries, &st->color_trc,
+                  &st->chroma_location, &st->field_order, &st->video_delay,
+                  &st->bits_per_raw_sample, &st->sample_rate, &st->frame_size,
+                  &st->nb_channels, &st->extradata_size, &st->bit_rate) == 30 ? 0 : AVERROR_INVALIDDATA;
+}
+
+static void write_stream(FILE *fp, const struct cached_stream *st)
+{
+    fprintf(fp, "%d %d %d/%d %"PRId64" %"PRId64" %d/%d %d/%d %d/%d"
+            " %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %"PRId64"\n",
+            st->codec_type, st->codec_id, st->time_base.num, st->time_base.den,
+            st->start_time, st->duration,
+            st->avg_frame_rate.num, st->avg_frame_rate.den,
+            st->r_frame_rate.num, st->r_frame_rate.den,
+            st->sample_aspect_ratio.num, st->sample_aspect_ratio.den,
+            st->format, st->width, st->height, st->profile, st->level,
+            st->color_range, st->color_space, st->color_primaries, st->color_trc,
+            st->chroma_location, st->field_order, st->video_delay,
+            st->bits_per_raw_sample, st->sample_rate, st->frame_size,
+            st->nb_channels, st->extradata_size, st->bit_rate);
+}
+
+/* The best streams are saved as returned by av_find_best_stream() */
+static int check_best_stream(const struct info_cache *ic, int stream_idx, enum AVMediaType type)
+{
+    if (stream_idx == AVERROR_STREAM_NOT_FOUND)
+        return 0;
+    if (stream_idx < 0 || stream_idx >= ic->nb_streams || ic->streams[stream_idx].codec_type != type)
+        return AVERROR_INVALIDDATA;
+    return 0;
+}
+
+static int load_entry(struct info_cache *ic)
+{
+    char magic[32];
+    int version, nb_streams;
+    int64_t file_size, mtime;
+    int ret = 0;
+
+    FILE *fp = fopen(ic->path, "r");
+    if (!fp) {
+        TRACE(ic, "no info cache entry found at %s", ic->path);
+        return 0;
+    }
+
+    if (fscanf(fp, "%31s %d", magic, &version) != 2 ||
+        strcmp(magic, CACHE_MAGIC) || version != CACHE_VERSION ||
+        fscanf(fp, " media %"SCNd64" %"SCNd64, &file_size, &mtime) != 2) {
+        LOG(ic, WARNING, "Ignoring invalid info cache entry %s", ic->path);
+        goto end;
+    }
+
+    if (file_size != ic->file_size || mtime != ic->mtime) {
+        LOG(ic, INFO, "Media changed since the info cache entry %s was saved, ignoring it", ic->path);
+        goto end;
+    }
+
+    if (fscanf(fp, " format %d %"SCNd64" %"SCNd64" %"SCNd64, &ic->is_image,
+               &ic->start_time, &ic->duration, &ic->bit_rate) != 4 ||
+        fscanf(fp, " best %d %d", &ic->best_streams[0], &ic->best_streams[1]) != 2 ||
+        fscanf(fp, " streams %d", &nb_streams) != 1 || nb_streams <= 0 || nb_streams > INT_MAX / sizeof(*ic->streams))
+        goto invalid;
+
+    ic->streams = av_calloc(nb_streams, sizeof(*ic->streams));
+    if (!ic->streams) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (int i = 0; i < nb_streams; i++)
+        if (read_stream(fp, &ic->streams[i]) < 0)
+            goto invalid;
+    ic->nb_streams = nb_streams;
+    if (check_best_stream(ic, ic->best_streams[0], AVMEDIA_TYPE_VIDEO) < 0 ||
+        check_best_stream(ic, ic->best_streams[1], AVMEDIA_TYPE_AUDIO) < 0) {
+        ic->nb_streams = 0;
+        goto invalid;
+    }
+
+    LOG(ic, INFO, "Loaded the information of %d streams from %s", ic->nb_streams, ic->path);
+    ic->loaded = 1;
+    goto end;
+
+invalid:
+    LOG(ic, WARNING, "Info cache entry %s is corrupted, ignoring it", ic->path);
+    av_freep(&ic->streams);
+end:
+    fclose(fp);
+    return ret;
+}
+
+int nmdi_info_cache_init(struct info_cache *ic, void *log_ctx, const char *dir, const char *filename)
+{
+    ic->log_ctx = log_ctx;
+
+    av_strstart(filename, "file:", &filename);
+
+    struct stat st;
+    if (stat(filename, &st) < 0 || !S_ISREG(st.st_mode)) {
+        LOG(ic, INFO, "'%s' is not a local file, its information won't be cached", filename);
+        return 0;
+    }
+    ic->file_size = st.st_size;
+    ic->mtime = st.st_mtime;
+
+    ic->path = av_asprintf("%s/%016"PRIx64".nmd-info", dir, hash_str(filename));
+    if (!ic->path)
+        return AVERROR(ENOMEM);
+
+    return load_entry(ic);
+}
+
+int nmdi_info_cache_is_loaded(const struct info_cache *ic)
+{
+    return ic->loaded;
+}
+
+int nmdi_info_cache_apply(const struct info_cache *ic, AVFormatContext *fmt_ctx)
+{
+    if (!ic->loaded || fmt_ctx->nb_streams != ic->nb_streams)
+        return 0;
+
+    /* The codecs and their global headers must be known from the header
+     * alone, otherwise the probing is still required */
+    for (int i = 0; i < ic->nb_streams; i++) {
+        const struct cached_stream *cst = &ic->streams[i];
+        const AVCodecParameters *par = fmt_ctx->streams[i]->codecpar;
+        if (par->codec_type != cst->codec_type || par->codec_id != cst->codec_id ||
+            (cst->extradata_size && !par->extradata_size) ||
+            get_nb_channels(par) != cst->nb_channels) {
+            LOG(ic, INFO, "Stream %d doesn't match the info cache entry, probing the media", i);
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < ic->nb_streams; i++) {
+        const struct cached_stream *cst = &ic->streams[i];
+        AVStream *st = fmt_ctx->streams[i];
+        AVCodecParameters *par = st->codecpar;
+
+        st->start_time          = cst->start_time;
+        st->duration            = cst->duration;
+        st->avg_frame_rate      = cst->avg_frame_rate;
+        st->r_frame_rate        = cst->r_frame_rate;
+        st->sample_aspect_ratio = cst->sample_aspect_ratio;
+
+        par->format              = cst->format;
+        par->width               = cst->width;
+        par->height              = cst->height;
+        par->profile             = cst->profile;
+        par->level               = cst->level;
+        par->color_range         = cst->color_range;
+        par->color_space         = cst->color_space;
+        par->color_primaries     = cst->color_primaries;
+        par->color_trc           = cst->color_trc;
+        par->chroma_location     = cst->chroma_location;
+        par->field_order         = cst->field_order;
+        par->video_delay         = cst->video_delay;
+        par->bits_per_raw_sample = cst->bits_per_raw_sample;
+        par->sample_rate         = cst->sample_rate;
+        par->frame_size          = cst->frame_size;
+        par->bit_rate            = cst->bit_rate;
+    }
+    fmt_ctx->start_time = ic->start_time;
+    fmt_ctx->duration   = ic->duration;
+    fmt_ctx->bit_rate   = ic->bit_rate;
+
+    TRACE(ic, "stream information restored from %s", ic->path);
+    return 1;
+}
+
+int nmdi_info_cache_find_best_stream(const struct info_cache *ic, enum AVMediaType type, int wanted_stream_nb)
+{
+    if (wanted_stream_nb >= 0) {
+        if (wanted_stream_nb < ic->nb_streams && ic->streams[wanted_stream_nb].codec_type == type)
+            return wanted_stream_nb;
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+
+    int ret = AVERROR_STREAM_NOT_FOUND;
+    if (type == AVMEDIA_TYPE_VIDEO)
+        ret = ic->best_streams[0];
+    else if (type == AVMEDIA_TYPE_AUDIO)
+        ret = ic->best_streams[1];
+    return ret;
+}
+
+int nmdi_info_cache_get_stream_info(const struct info_cache *ic, int stream_idx,
+                                    int *width, int *height, AVRational *time_base,
+                                    int64_t *duration, int *is_image)
+{
+    if (!ic->loaded || stream_idx < 0 || stream_idx >= ic->nb_streams)
+        return AVERROR(EINVAL);
+
+    const struct cached_stream *cst = &ic->streams[stream_idx];
+    *width     = cst->width;
+    *height    = cst->height;
+    *time_base = cst->time_base;
+    *is_image  = ic->is_image;
+
+    /* Same logic as nmdi_demuxing_probe_duration() */
+    *duration = AV_NOPTS_VALUE;
+    if (!ic->is_image) {
+        if (ic->duration != AV_NOPTS_VALUE)
+            *duration = ic->duration;
+        else if (cst->duration != AV_NOPTS_VALUE && cst->time_base.den)
+            *duration = av_rescale_q_rnd(cst->duration, cst->time_base, AV_TIME_BASE_Q, 0);
+    }
+    return 0;
+}
+
+int nmdi_info_cache_save(struct info_cache *ic, AVFormatContext *fmt_ctx, int is_image)
+{
+    int ret = 0;
+    char *tmp = NULL;
+    FILE *fp = NULL;
+
+    if (!ic->path || ic->loaded || ic->saved || !fmt_ctx->nb_streams)
+        return 0;
+
+    tmp = av_asprintf("%s.tmp", ic->path);
+    if (!tmp)
+        return AVERROR(ENOMEM);
+
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        ret = AVERROR(errno);
+        LOG(ic, ERROR, "Unable to open %s for writing: %s", tmp, av_err2str(ret));
+        goto end;
+    }
+
+    fprintf(fp, "%s %d\n", CACHE_MAGIC, CACHE_VERSION);
+    fprintf(fp, "media %"PRId64" %"PRId64"\n", ic->file_size, ic->mtime);
+    fprintf(fp, "format %d %"PRId64" %"PRId64" %"PRId64"\n", is_image,
+            fmt_ctx->start_time, fmt_ctx->duration, fmt_ctx->bit_rate);
+    fprintf(fp, "best %d %d\n",
+            av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0),
+            av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0));
+    fprintf(fp, "streams %d\n", fmt_ctx->nb_streams);
+    for (int i = 0; i < fmt_ctx->nb_streams; i++) {
+        const AVStream *st = fmt_ctx->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        const struct cached_stream cst = {
+            .codec_type          = par->codec_type,
+            .codec_id            = par->codec_id,
+            .time_base           = st->time_base,
+            .start_time          = st->start_time,
+            .duration            = st->duration,
+            .avg_frame_rate      = st->avg_frame_rate,
+            .r_frame_rate        = st->r_frame_rate,
+            .sample_aspect_ratio = st->sample_aspect_ratio,
+            .format              = par->format,
+            .width               = par->width,
+            .height              = par->height,
+            .profile             = par->profile,
+            .level               = par->level,
+            .color_range         = par->color_range,
+            .color_space         = par->color_space,
+            .color_primaries     = par->color_primaries,
+            .color_trc           = par->color_trc,
+            .chroma_location     = par->chroma_location,
+            .field_order         = par->field_order,
+            .video_delay         = par->video_delay,
+            .bits_per_raw_sample = par->bits_per_raw_sample,
+            .sample_rate         = par->sample_rate,
+            .frame_size          = par->frame_size,
+            .nb_channels         = get_nb_channels(par),
+            .extradata_size      = par->extradata_size,
+            .bit_rate            = par->bit_rate,
+        };
+        write_stream(fp, &cst);
+    }
+
+    if (fclose(fp)) {
+        fp = NULL;
+        ret = AVERROR(EIO);
+        goto end;
+    }
+    fp = NULL;
+
+    if (rename(tmp, ic->path)) {
+        /* rename() does not replace an existing file on Windows */
+        remove(ic->path);
+        if (rename(tmp, ic->path)) {
+            ret = AVERROR(errno);
+            LOG(ic, ERROR, "Unable to write the info cache entry %s: %s", ic->path, av_err2str(ret));
+            goto end;
+        }
+    }
+
+    LOG(ic, INFO, "Saved the information of %d streams to %s", fmt_ctx->nb_streams, ic->path);
+    ic->saved = 1;
+
+end:
+    if (fp)
+        fclose(fp);
+    if (ret < 0)
+        remove(tmp);
+    av_free(tmp);
+    return ret;
+}
+
+void nmdi_info_cache_free(struct info_cache **icp)
+{
+    struct info_cache *ic = *icp;
+    if (!ic)
+        return;
+    av_freep(&ic->streams);
+    av_freep(&ic->path);
+    av_freep(icp);
+}
@@ -0,0 +1,81 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef INFO_CACHE_H
+#define INFO_CACHE_H
+
+#include <stdint.h>
+#include <libavformat/avformat.h>
+
+/*
+ * On-disk cache of the stream information probed from a media, keyed by the
+ * identity of the file (path, size and modification time), so that reopening
+ * a known media doesn't need to probe it again (see the info_cache_dir
+ * option).
+ *
+ * The entry is loaded once at init and never modified afterward, so the
+ * getters can be used from any thread. Saving only writes the cache file.
+ */
+
+struct info_cache *nmdi_info_cache_alloc(void);
+
+/**
+ * Identify the media and load its entry from the cache directory, if any.
+ * A media that can not be identified (not a local file) is never cached.
+ */
+int nmdi_info_cache_init(struct info_cache *ic, void *log_ctx, const char *dir, const char *filename);
+
+/**
+ * Return 1 if an entry matching the media was loaded, 0 otherwise.
+ */
+int nmdi_info_cache_is_loaded(const struct info_cache *ic);
+
+/**
+ * Restore the cached stream parameters in a freshly opened format context, in
+ * place of avformat_find_stream_info(). Nothing is changed if the streams
+ * found in the header don't match the entry.
+ *
+ * Return 1 if the parameters were restored, 0 otherwise.
+ */
+int nmdi_info_cache_apply(const struct info_cache *ic, AVFormatContext *fmt_ctx);
+
+/**
+ * Counterpart of av_find_best_stream() returning the stream selected when the
+ * entry was saved.
+ */
+int nmdi_info_cache_find_best_stream(const struct info_cache *ic, enum AVMediaType type, int wanted_stream_nb);
+
+/**
+ * Get the information of a stream of the entry, as reported by the demuxer
+ * when the entry was saved. The duration is the one reported by
+ * nmdi_demuxing_probe_duration() with that stream selected.
+ */
+int nmdi_info_cache_get_stream_info(const struct info_cache *ic, int stream_idx,
+                                    int *width, int *height, AVRational *time_base,
+                                    int64_t *duration, int *is_image);
+
+/**
+ * Save the information probed in fmt_ctx to the cache directory.
+ */
+int nmdi_info_cache_save(struct info_cache *ic, AVFormatContext *fmt_ctx, int is_image);
+
+void nmdi_info_cache_free(struct info_cache **icp);
+
+#endif
@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <libavcodec/version.h>
+#include <libavutil/frame.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/rational.h>
 #include <libavutil/samplefmt.h>
@@ -46,6 +47,9 @@ enum nmd_pixel_format nmdi_smp_fmts_ff2nmd(enum AVSampleFormat smp_fmt);
 void nmdi_set_thread_name(const char *name);
 void nmdi_update_dimensions(int *width, int *height, int max_pixels);
 
+/* Size in bytes of the buffers referenced by the frame */
+int64_t nmdi_get_frame_size(const AVFrame *frame);
+
 #define TIME2INT64(d) llrint((d) * av_q2d(av_inv_q(AV_TIME_BASE_Q)))
 #define PTS2TIMESTR(t64) av_ts2timestr(t64, &AV_TIME_BASE_Q)
 
@@ -0,0 +1,273 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _POSIX_C_SOURCE 200809L // mmap, fstat
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <libavformat/avformat.h>
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "io.h"
+#include "log.h"
+
+#define DEFAULT_READAHEAD_BUFFER_SIZE (4 << 20)
+#define DEFAULT_BUFFER_SIZE           (32 << 10)
+
+enum io_type {
+    IO_TYPE_MMAP,
+    IO_TYPE_READAHEAD,
+    IO_TYPE_USER,
+};
+
+struct io_ctx {
+    void *log_ctx;
+    enum io_type type;
+
+    /* Memory-mapped file */
+    uint8_t *map;
+    int64_t map_size;
+    int64_t pos;
+
+    /* Read-ahead over the libavformat protocols */
+    AVIOContext *inner;
+
+    /* User callbacks */
+    struct nmd_io_callbacks cb;
+    void *handle;
+};
+
+static int mmap_read(void *opaque, uint8_t *buf, int size)
+{
+    struct io_ctx *io = opaque;
+    const int64_t left = io->map_size - io->pos;
+    if (left <= 0)
+        return AVERROR_EOF;
+    size = FFMIN(size, left);
+    memcpy(buf, io->map + io->pos, size);
+    io->pos += size;
+    return size;
+}
+
+static int64_t mmap_seek(void *opaque, int64_t offset, int whence)
+{
+    struct io_ctx *io = opaque;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE: return io->map_size;
+    case SEEK_SET:                          break;
+    case SEEK_CUR:    offset += io->pos;      break;
+    case SEEK_END:    offset += io->map_size; break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (offset < 0)
+        return AVERROR(EINVAL);
+    io->pos = offset;
+    return offset;
+}
+
+static int mmap_open(struct io_ctx *io, const char *filename)
+{
+#ifdef _WIN32
+    LOG(io, ERROR, "The mmap I/O backend is not supported on this platform");
+    return AVERROR(ENOSYS);
+#else
+    av_strstart(filename, "file:", &filename);
+
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        const int ret = AVERROR(errno);
+        LOG(io, ERROR, "Unable to open '%s'", filename);
+        return ret;
+    }
+
+    struct stat st;
+    void *map;
+    int ret = fstat(fd, &st);
+    if (ret < 0) {
+        ret = AVERROR(errno);
+        goto end;
+    }
+    if (!S_ISREG(st.st_mode) || !st.st_size) {
+        LOG(io, ERROR, "'%s' is not a regular non-empty file, it can not be mapped", filename);
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        ret = AVERROR(errno);
+        LOG(io, ERROR, "Unable to map '%s' in memory", filename);
+        goto end;
+    }
+    io->map = map;
+    io->map_size = st.st_size;
+    TRACE(io, "mapped %s (%" PRId64 " bytes)", filename, io->map_size);
+
+end:
+    close(fd);
+    return ret;
+#endif
+}
+
+static int readahead_read(void *opaque, uint8_t *buf, int size)
+{
+    struct io_ctx *io = opaque;
+    const int ret = avio_read(io->inner, buf, size);
+    return ret ? ret : AVERROR_EOF;
+}
+
+static int64_t readahead_seek(void *opaque, int64_t offset, int whence)
+{
+    struct io_ctx *io = opaque;
+    if (whence == AVSEEK_SIZE)
+        return avio_size(io->inner);
+    return avio_seek(io->inner, offset, whence);
+}
+
+static int user_read(void *opaque, uint8_t *buf, int size)
+{
+    struct io_ctx *io = opaque;
+    const int ret = io->cb.read(io->handle, buf, size);
+    if (ret < 0)
+        return AVERROR(EIO);
+    return ret ? ret : AVERROR_EOF;
+}
+
+static int64_t user_seek(void *opaque, int64_t offset, int whence)
+{
+    struct io_ctx *io = opaque;
+    int64_t ret;
+
+    if (whence == AVSEEK_SIZE) {
+        ret = io->cb.size ? io->cb.size(io->handle) : -1;
+        return ret < 0 ? AVERROR(ENOSYS) : ret;
+    }
+    ret = io->cb.seek(io->handle, offset, whence & ~AVSEEK_FORCE);
+    return ret < 0 ? AVERROR(EIO) : ret;
+}
+
+static void close_io(struct io_ctx *io)
+{
+    switch (io->type) {
+    case IO_TYPE_MMAP:
+#ifndef _WIN32
+        if (io->map)
+            munmap(io->map, io->map_size);
+#endif
+        break;
+    case IO_TYPE_READAHEAD:
+        avio_closep(&io->inner);
+        break;
+    case IO_TYPE_USER:
+        if (io->handle)
+            io->cb.close(io->handle);
+        break;
+    }
+    av_free(io);
+}
+
+int nmdi_io_open(void *log_ctx, AVIOContext **pbp, const char *filename,
+                 const struct nmdi_opts *opts)
+{
+    int (*read_packet)(void *opaque, uint8_t *buf, int buf_size);
+    int64_t (*seek)(void *opaque, int64_t offset, int whence);
+    int buffer_size = opts->io_buffer_size;
+    int ret;
+
+    *pbp = NULL;
+    if (!opts->io_callbacks.read && opts->io == NMD_IO_DEFAULT)
+        return 0;
+
+    struct io_ctx *io = av_mallocz(sizeof(*io));
+    if (!io)
+        return AVERROR(ENOMEM);
+    io->log_ctx = log_ctx;
+
+    if (opts->io_callbacks.read) {
+        io->type = IO_TYPE_USER;
+        io->cb = opts->io_callbacks;
+        io->handle = io->cb.open(io->cb.opaque, filename);
+        if (!io->handle) {
+            LOG(io, ERROR, "Unable to open '%s' with the user I/O callbacks", filename);
+            ret = AVERROR(EIO);
+            goto fail;
+        }
+        read_packet = user_read;
+        seek = io->cb.seek ? user_seek : NULL;
+        if (!buffer_size)
+            buffer_size = DEFAULT_BUFFER_SIZE;
+    } else if (opts->io == NMD_IO_MMAP) {
+        io->type = IO_TYPE_MMAP;
+        ret = mmap_open(io, filename);
+        if (ret < 0)
+            goto fail;
+        read_packet = mmap_read;
+        seek = mmap_seek;
+        buffer_size = DEFAULT_BUFFER_SIZE;
+    } else {
+        io->type = IO_TYPE_READAHEAD;
+        ret = avio_open2(&io->inner, filename, AVIO_FLAG_READ, NULL, NULL);
+        if (ret < 0) {
+            LOG(io, ERROR, "Unable to open input file '%s'", filename);
+            goto fail;
+        }
+        read_packet = readahead_read;
+        seek = io->inner->seekable ? readahead_seek : NULL;
+        if (!buffer_size)
+            buffer_size = DEFAULT_READAHEAD_BUFFER_SIZE;
+    }
+
+    uint8_t *buffer = av_malloc(buffer_size);
+    if (!buffer) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    *pbp = avio_alloc_context(buffer, buffer_size, 0, io, read_packet, NULL, seek);
+    if (!*pbp) {
+        av_free(buffer);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    close_io(io);
+    return ret;
+}
+
+void nmdi_io_closep(AVIOContext **pbp)
+{
+    AVIOContext *pb = *pbp;
+    if (!pb)
+        return;
+    close_io(pb->opaque);
+    av_freep(&pb->buffer);
+    avio_context_free(pbp);
+}
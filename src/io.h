@@ -0,0 +1,48 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef IO_H
+#define IO_H
+
+#include <libavformat/avformat.h>
+
+#include "opts.h"
+
+/*
+ * Alternative I/O backends for the demuxer (see the io option and
+ * nmd_set_io_callbacks()).
+ */
+
+/**
+ * Open the I/O context to read filename from, according to the options.
+ *
+ * Return 0 with *pbp set to NULL when libavformat must open the file itself,
+ * or a negative error code.
+ */
+int nmdi_io_open(void *log_ctx, AVIOContext **pbp, const char *filename,
+                 const struct nmdi_opts *opts);
+
+/**
+ * Close an I/O context opened by nmdi_io_open(), after the demuxer using it
+ * has been closed.
+ */
+void nmdi_io_closep(AVIOContext **pbp);
+
+#endif
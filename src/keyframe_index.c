@@ -0,0 +1,454 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavutil/avassert.h>
+#include <libavutil/avstring.h>
+#include <libavutil/mem.h>
+
+#include "keyframe_index.h"
+#include "internal.h"
+#include "log.h"
+#include "pthread_compat.h"
+
+#define SIDECAR_MAGIC   "nmd-keyframe-index"
+#define SIDECAR_VERSION 1
+
+struct time_range {
+    int64_t start, end;
+};
+
+struct keyframe_index {
+    void *log_ctx;
+    pthread_mutex_t lock;
+    int refcount;
+
+    int configured;
+    int stream_idx;
+    AVRational time_base;
+    enum AVCodecID codec_id;
+    int64_t file_size;
+    char *sidecar;
+
+    int64_t *keyframes;                     // sorted keyframes timestamps
+    int nb_keyframes;
+    unsigned keyframes_size;
+
+    struct time_range *ranges;              // sorted and disjoint ranges entirely read
+    int nb_ranges;
+    unsigned ranges_size;
+    int dirty;                              // the index changed since it was loaded
+};
+
+struct keyframe_index *nmdi_keyframe_index_alloc(void)
+{
+    struct keyframe_index *idx = av_mallocz(sizeof(*idx));
+    if (!idx)
+        return NULL;
+    return idx;
+}
+
+int nmdi_keyframe_index_init(struct keyframe_index *idx, void *log_ctx)
+{
+    idx->log_ctx = log_ctx;
+    idx->refcount = 1;
+    pthread_mutex_init(&idx->lock, NULL);
+    return 0;
+}
+
+/* Index of the first keyframe greater or equal to ts */
+static int lower_bound(const struct keyframe_index *idx, int64_t ts)
+{
+    int lo = 0, hi = idx->nb_keyframes;
+    while (lo < hi) {
+        const int mid = (lo + hi) >> 1;
+        if (idx->keyframes[mid] < ts)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int add_keyframe(struct keyframe_index *idx, int64_t ts)
+{
+    const int pos = lower_bound(idx, ts);
+    if (pos < idx->nb_keyframes && idx->keyframes[pos] == ts)
+        return 0;
+
+    int64_t *keyframes = av_fast_realloc(idx->keyframes, &idx->keyframes_size,
+                                         (idx->nb_keyframes + 1) * sizeof(*keyframes));
+    if (!keyframes)
+        return AVERROR(ENOMEM);
+    idx->keyframes = keyframes;
+
+    memmove(keyframes + pos + 1, keyframes + pos, (idx->nb_keyframes - pos) * sizeof(*keyframes));
+    keyframes[pos] = ts;
+    idx->nb_keyframes++;
+    idx->dirty = 1;
+    return 0;
+}
+
+static int add_range(struct keyframe_index *idx, int64_t start, int64_t end)
+{
+    int i = 0;
+    while (i < idx->nb_ranges && idx->ranges[i].end < start)
+        i++;
+
+    if (i < idx->nb_ranges && idx->ranges[i].start <= start && idx->ranges[i].end >= end)
+        return 0;
+
+    /* Merge every range overlapping with the new one */
+    int j = i;
+    while (j < idx->nb_ranges && idx->ranges[j].start <= end) {
+        start = FFMIN(start, idx->ranges[j].start);
+        end   = FFMAX(end,   idx->ranges[j].end);
+        j++;
+    }
+
+    if (i == j) {
+        struct time_range *ranges = av_fast_realloc(idx->ranges, &idx->ranges_size,
+                                                    (idx->nb_ranges + 1) * sizeof(*ranges));
+        if (!ranges)
+            return AVERROR(ENOMEM);
+        idx->ranges = ranges;
+        memmove(ranges + i + 1, ranges + i, (idx->nb_ranges - i) * sizeof(*ranges));
+        idx->nb_ranges++;
+    } else if (j - i > 1) {
+        memmove(idx->ranges + i + 1, idx->ranges + j, (idx->nb_ranges - j) * sizeof(*idx->ranges));
+        idx->nb_ranges -= j - i - 1;
+    }
+
+    idx->ranges[i].start = start;
+    idx->ranges[i].end   = end;
+    idx->dirty = 1;
+    return 0;
+}
+
+static int load_sidecar(struct keyframe_index *idx)
+{
+    char magic[32];
+    int version, stream_idx, tb_num, tb_den, codec_id, nb_ranges, nb_keyframes;
+    int64_t file_size;
+    int ret = 0;
+
+    FILE *fp = fopen(idx->sidecar, "r");
+    if (!fp) {
+        TRACE(idx, "no keyframe index sidecar found at %s", idx->sidecar);
+        return 0;
+    }
+
+    if (fscanf(fp, "%31s %d", magic, &version) != 2 ||
+        strcmp(magic, SIDECAR_MAGIC) || version != SIDECAR_VERSION ||
+        fscanf(fp, " stream %d %d/%d %d %"SCNd64, &stream_idx, &tb_num, &tb_den,
+               &codec_id, &file_size) != 5) {
+        LOG(idx, WARNING, "Ignoring invalid keyframe index sidecar %s", idx->sidecar);
+        goto end;
+    }
+
+    if (stream_idx != idx->stream_idx || codec_id != idx->codec_id || file_size != idx->file_size ||
+        av_cmp_q(av_make_q(tb_num, tb_den), idx->time_base)) {
+        LOG(idx, WARNING, "Keyframe index sidecar %s does not match the media, ignoring it", idx->sidecar);
+        goto end;
+    }
+
+    if (fscanf(fp, " ranges %d", &nb_ranges) != 1 || nb_ranges < 0)
+        goto invalid;
+    for (int i = 0; i < nb_ranges; i++) {
+        int64_t start, end;
+        if (fscanf(fp, " %"SCNd64" %"SCNd64, &start, &end) != 2 || start > end)
+            goto invalid;
+        if ((ret = add_range(idx, start, end)) < 0)
+            goto end;
+    }
+
+    if (fscanf(fp, " keyframes %d", &nb_keyframes) != 1 || nb_keyframes < 0)
+        goto invalid;
+    for (int i = 0; i < nb_keyframes; i++) {
+        int64_t ts;
+        if (fscanf(fp, " %"SCNd64, &ts) != 1)
+            goto invalid;
+        if ((ret = add_keyframe(idx, ts)) < 0)
+            goto end;
+    }
+
+    LOG(idx, INFO, "Loaded %d keyframes from %s", idx->nb_keyframes, idx->sidecar);
+    goto end;
+
+invalid:
+    /* Partially loaded information can not be trusted */
+    LOG(idx, WARNING, "Keyframe index sidecar %s is corrupted, ignoring it", idx->sidecar);
+    idx->nb_ranges = 0;
+    idx->nb_keyframes = 0;
+end:
+    fclose(fp);
+    return ret;
+}
+
+/* Seed the index with the demuxer one. Its timestamps are decode timestamps
+ * for some formats, so we only trust them when there is no frame reordering. */
+static int load_demuxer_index(struct keyframe_index *idx, AVFormatContext *fmt_ctx, AVStream *st)
+{
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+    const int nb_entries = avformat_index_get_entries_count(st);
+#else
+    const int nb_entries = st->nb_index_entries;
+#endif
+    int64_t first = AV_NOPTS_VALUE, last = AV_NOPTS_VALUE;
+
+    if (!nb_entries || st->codecpar->video_delay)
+        return 0;
+
+    for (int i = 0; i < nb_entries; i++) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+        const AVIndexEntry *entry = avformat_index_get_entry(st, i);
+#else
+        const AVIndexEntry *entry = &st->index_entries[i];
+#endif
+        if (!entry || entry->timestamp == AV_NOPTS_VALUE)
+            continue;
+        if (first == AV_NOPTS_VALUE)
+            first = entry->timestamp;
+        last = entry->timestamp;
+        if (entry->flags & AVINDEX_KEYFRAME) {
+            int ret = add_keyframe(idx, entry->timestamp);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    /* The MOV demuxer indexes every sample, which means the keyframe list is
+     * exhaustive, while most other demuxers only index a subset of them */
+    if (first != AV_NOPTS_VALUE && strstr(fmt_ctx->iformat->name, "mov"))
+        return add_range(idx, first, last);
+    return 0;
+}
+
+int nmdi_keyframe_index_setup(struct keyframe_index *idx, AVFormatContext *fmt_ctx,
+                              const AVStream *st, const char *sidecar)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&idx->lock);
+
+    const int64_t file_size = fmt_ctx->pb ? avio_size(fmt_ctx->pb) : -1;
+    if (idx->configured) {
+        if (idx->stream_idx != st->index || idx->file_size != file_size) {
+            LOG(idx, WARNING, "Media changed, resetting the keyframe index");
+            idx->nb_keyframes = 0;
+            idx->nb_ranges = 0;
+            idx->configured = 0;
+        } else {
+            goto end;
+        }
+    }
+
+    idx->stream_idx = st->index;
+    idx->time_base  = st->time_base;
+    idx->codec_id   = st->codecpar->codec_id;
+    idx->file_size  = file_size;
+    av_freep(&idx->sidecar);
+    if (sidecar) {
+        idx->sidecar = av_strdup(sidecar);
+        if (!idx->sidecar) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if ((ret = load_sidecar(idx)) < 0)
+            goto end;
+    }
+
+    if ((ret = load_demuxer_index(idx, fmt_ctx, (AVStream *)st)) < 0)
+        goto end;
+
+    TRACE(idx, "keyframe index ready with %d keyframes and %d complete ranges",
+          idx->nb_keyframes, idx->nb_ranges);
+    idx->dirty = 0;
+    idx->configured = 1;
+
+end:
+    pthread_mutex_unlock(&idx->lock);
+    return ret;
+}
+
+void nmdi_keyframe_index_add_packet(struct keyframe_index *idx, struct keyframe_run *run,
+                                    const AVPacket *pkt)
+{
+    const int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+
+    if (ts == AV_NOPTS_VALUE)
+        return;
+
+    pthread_mutex_lock(&idx->lock);
+    if (pkt->flags & AV_PKT_FLAG_KEY)
+        add_keyframe(idx, ts);
+    if (run->start == AV_NOPTS_VALUE) {
+        run->start = run->end = ts;
+    } else {
+        run->start = FFMIN(run->start, ts);
+        run->end   = FFMAX(run->end,   ts);
+        add_range(idx, run->start, run->end);
+    }
+    pthread_mutex_unlock(&idx->lock);
+}
+
+void nmdi_keyframe_index_break(struct keyframe_run *run)
+{
+    run->start = run->end = AV_NOPTS_VALUE;
+}
+
+int nmdi_keyframe_index_get_prev(struct keyframe_index *idx, int64_t from, int64_t to, int64_t *kf)
+{
+    int complete = 0;
+
+    pthread_mutex_lock(&idx->lock);
+
+    const int pos = lower_bound(idx, to + 1);
+    *kf = pos > 0 ? idx->keyframes[pos - 1] : AV_NOPTS_VALUE;
+
+    for (int i = 0; i < idx->nb_ranges; i++) {
+        if (idx->ranges[i].start <= from && to <= idx->ranges[i].end) {
+            complete = 1;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&idx->lock);
+    return complete;
+}
+
+int nmdi_keyframe_index_get_next(struct keyframe_index *idx, int64_t from, int64_t *kf)
+{
+    int complete = 0;
+
+    pthread_mutex_lock(&idx->lock);
+
+    const int pos = lower_bound(idx, from + 1);
+    *kf = pos < idx->nb_keyframes ? idx->keyframes[pos] : AV_NOPTS_VALUE;
+
+    if (*kf != AV_NOPTS_VALUE) {
+        for (int i = 0; i < idx->nb_ranges; i++) {
+            if (idx->ranges[i].start <= from && *kf <= idx->ranges[i].end) {
+                complete = 1;
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&idx->lock);
+    return complete;
+}
+
+int nmdi_keyframe_index_save(struct keyframe_index *idx)
+{
+    int ret = 0;
+    char *tmp = NULL;
+    FILE *fp = NULL;
+
+    pthread_mutex_lock(&idx->lock);
+
+    if (!idx->sidecar || !idx->configured || !idx->dirty)
+        goto end;
+
+    tmp = av_asprintf("%s.tmp", idx->sidecar);
+    if (!tmp) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        ret = AVERROR(errno);
+        LOG(idx, ERROR, "Unable to open %s for writing: %s", tmp, av_err2str(ret));
+        goto end;
+    }
+
+    fprintf(fp, "%s %d\n", SIDECAR_MAGIC, SIDECAR_VERSION);
+    fprintf(fp, "stream %d %d/%d %d %"PRId64"\n", idx->stream_idx,
+            idx->time_base.num, idx->time_base.den, idx->codec_id, idx->file_size);
+    fprintf(fp, "ranges %d\n", idx->nb_ranges);
+    for (int i = 0; i < idx->nb_ranges; i++)
+        fprintf(fp, "%"PRId64" %"PRId64"\n", idx->ranges[i].start, idx->ranges[i].end);
+    fprintf(fp, "keyframes %d\n", idx->nb_keyframes);
+    for (int i = 0; i < idx->nb_keyframes; i++)
+        fprintf(fp, "%"PRId64"\n", idx->keyframes[i]);
+
+    if (fclose(fp)) {
+        fp = NULL;
+        ret = AVERROR(EIO);
+        goto end;
+    }
+    fp = NULL;
+
+    if (rename(tmp, idx->sidecar)) {
+        /* rename() does not replace an existing file on Windows */
+        remove(idx->sidecar);
+        if (rename(tmp, idx->sidecar)) {
+            ret = AVERROR(errno);
+            LOG(idx, ERROR, "Unable to write keyframe index to %s: %s", idx->sidecar, av_err2str(ret));
+            goto end;
+        }
+    }
+
+    LOG(idx, INFO, "Saved %d keyframes to %s", idx->nb_keyframes, idx->sidecar);
+    idx->dirty = 0;
+
+end:
+    if (fp)
+        fclose(fp);
+    if (ret < 0 && tmp)
+        remove(tmp);
+    av_free(tmp);
+    pthread_mutex_unlock(&idx->lock);
+    return ret;
+}
+
+struct keyframe_index *nmdi_keyframe_index_ref(struct keyframe_index *idx)
+{
+    pthread_mutex_lock(&idx->lock);
+    idx->refcount++;
+    pthread_mutex_unlock(&idx->lock);
+    return idx;
+}
+
+void nmdi_keyframe_index_unref(struct keyframe_index **idxp)
+{
+    struct keyframe_index *idx = *idxp;
+    if (!idx)
+        return;
+
+    pthread_mutex_lock(&idx->lock);
+    const int refcount = --idx->refcount;
+    pthread_mutex_unlock(&idx->lock);
+    *idxp = NULL;
+    if (refcount)
+        return;
+
+    nmdi_keyframe_index_save(idx);
+    pthread_mutex_destroy(&idx->lock);
+    av_freep(&idx->sidecar);
+    av_freep(&idx->keyframes);
+    av_freep(&idx->ranges);
+    av_free(idx);
+}
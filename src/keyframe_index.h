@@ -0,0 +1,96 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef KEYFRAME_INDEX_H
+#define KEYFRAME_INDEX_H
+
+#include <stdint.h>
+#include <libavformat/avformat.h>
+
+/*
+ * Index of the keyframes of a stream, filled by the demuxer and queried by the
+ * user thread. Along with the keyframes, the index keeps track of the time
+ * ranges that have been entirely read: within these ranges, the keyframe
+ * positions are known to be exhaustive.
+ *
+ * The index is refcounted so that the pipelines reading the same stream can
+ * share it, each demuxer tracking the range it read with its own run.
+ *
+ * All the timestamps are expressed in the stream timebase.
+ */
+
+/* Range read by one demuxer since its latest discontinuity */
+struct keyframe_run {
+    int64_t start, end;
+};
+
+struct keyframe_index *nmdi_keyframe_index_alloc(void);
+
+int nmdi_keyframe_index_init(struct keyframe_index *idx, void *log_ctx);
+
+/**
+ * Bind the index to a given stream. The first call loads the keyframes from
+ * the sidecar file (if any) and from the demuxer index; later calls are
+ * no-op as long as the stream stays the same.
+ */
+int nmdi_keyframe_index_setup(struct keyframe_index *idx, AVFormatContext *fmt_ctx,
+                              const AVStream *st, const char *sidecar);
+
+/**
+ * Register a packet of the indexed stream read by the demuxer owning run.
+ * Packets must be registered in their demuxing order; a discontinuity
+ * (typically a seek) must be signaled with nmdi_keyframe_index_break().
+ */
+void nmdi_keyframe_index_add_packet(struct keyframe_index *idx, struct keyframe_run *run,
+                                    const AVPacket *pkt);
+
+void nmdi_keyframe_index_break(struct keyframe_run *run);
+
+/**
+ * Get the latest keyframe at or before the timestamp "to".
+ *
+ * Return 1 if the range [from,to] is entirely indexed (*kf is set to
+ * AV_NOPTS_VALUE if there is no keyframe before "to"), 0 if the information
+ * is not available.
+ */
+int nmdi_keyframe_index_get_prev(struct keyframe_index *idx, int64_t from, int64_t to, int64_t *kf);
+
+/**
+ * Get the first keyframe after the timestamp "from".
+ *
+ * Return 1 if it is known and no other keyframe can be located in between (the
+ * range is entirely indexed), 0 otherwise.
+ */
+int nmdi_keyframe_index_get_next(struct keyframe_index *idx, int64_t from, int64_t *kf);
+
+/**
+ * Write the index to the sidecar file if it changed since it was loaded.
+ */
+int nmdi_keyframe_index_save(struct keyframe_index *idx);
+
+struct keyframe_index *nmdi_keyframe_index_ref(struct keyframe_index *idx);
+
+/**
+ * Drop a reference to the index; the last one saves it to the sidecar file
+ * (if any) and destroys it.
+ */
+void nmdi_keyframe_index_unref(struct keyframe_index **idxp);
+
+#endif
@@ -28,6 +28,7 @@
 #include "pthread_compat.h"
 
 struct log_ctx {
+    int id;                                 // unique identifier of the context (see nmdi_log_get_id())
     int64_t last_time;
     pthread_mutex_t lock;
     void *avlog;
@@ -104,13 +105,30 @@ static void default_callback(void *arg, int level, const char *filename, int ln,
     va_end(vl_copy);
 }
 
+static pthread_mutex_t id_lock = PTHREAD_MUTEX_INITIALIZER;
+static int last_id;
+
 int nmdi_log_init(struct log_ctx *ctx, void *avlog)
 {
+    pthread_mutex_lock(&id_lock);
+    ctx->id = ++last_id;
+    pthread_mutex_unlock(&id_lock);
     ctx->avlog = avlog;
     nmdi_log_set_callback(ctx, ctx, default_callback);
     return AVERROR(pthread_mutex_init(&ctx->lock, NULL));
 }
 
+int nmdi_log_get_id(const struct log_ctx *ctx)
+{
+    return ctx->id;
+}
+
+const char *nmdi_log_get_name(const struct log_ctx *ctx)
+{
+    const AVClass *avclass = *(const AVClass **)ctx->avlog;
+    return avclass->item_name(ctx->avlog);
+}
+
 void nmdi_log_free(struct log_ctx **ctxp)
 {
     struct log_ctx *ctx = *ctxp;
@@ -61,6 +61,11 @@ int nmdi_log_init(struct log_ctx *ctx, void *avlog);
 void nmdi_log_set_callback(struct log_ctx *ctx, void *arg,
                            nmd_log_callback_type callback);
 
+/* Identifier unique to each context, and name of the context (as displayed in
+ * the FFmpeg logs), both used to label the trace events */
+int nmdi_log_get_id(const struct log_ctx *ctx);
+const char *nmdi_log_get_name(const struct log_ctx *ctx);
+
 void nmdi_log_print(void *log_ctx, int log_level, const char *filename,
                     int ln, const char *fn, const char *fmt, ...) av_printf_format(6, 7);
 
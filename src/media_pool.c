@@ -0,0 +1,192 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <string.h>
+#include <libavutil/mem.h>
+
+#include "media_pool.h"
+#include "pthread_compat.h"
+
+struct media_pool_entry {
+    struct media_pool_entry *next;
+    int refcount;
+
+    char *filename;
+    struct nmdi_opts opts;                  // options affecting the output frames
+
+    struct frame_cache *frame_cache;        // never used directly, only to create handles
+    AVRational timebase;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct media_pool_entry *pool;
+
+static int same_str(const char *a, const char *b)
+{
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+/* Whether the contexts would obtain the same frames */
+static int same_output(const struct nmdi_opts *a, const struct nmdi_opts *b)
+{
+    return a->avselect               == b->avselect &&
+           a->stream_idx             == b->stream_idx &&
+           a->sw_pix_fmt             == b->sw_pix_fmt &&
+           a->autorotate             == b->autorotate &&
+           a->auto_hwaccel           == b->auto_hwaccel &&
+           a->max_pixels             == b->max_pixels &&
+           a->audio_texture          == b->audio_texture &&
+           a->sample_rate            == b->sample_rate &&
+           a->native_rgba            == b->native_rgba &&
+           a->use_pkt_duration       == b->use_pkt_duration &&
+           a->keyframes_only         == b->keyframes_only &&
+           a->max_nb_cached_frames   == b->max_nb_cached_frames &&
+           a->max_cached_frames_size == b->max_cached_frames_size &&
+           same_str(a->filters, b->filters);
+}
+
+static void free_entry(struct media_pool_entry **entryp)
+{
+    struct media_pool_entry *entry = *entryp;
+    if (!entry)
+        return;
+    nmdi_frame_cache_free(&entry->frame_cache);
+    av_freep(&entry->opts.filters);
+    av_freep(&entry->filename);
+    av_freep(entryp);
+}
+
+static int create_entry(struct media_pool_entry **entryp, const char *filename,
+                        const struct nmdi_opts *o)
+{
+    struct media_pool_entry *entry = av_mallocz(sizeof(*entry));
+    if (!entry)
+        return AVERROR(ENOMEM);
+
+    /* Only the plain values are kept from the options */
+    entry->opts = *o;
+    entry->opts.filters = NULL;
+    entry->opts.vt_pix_fmt = NULL;
+    entry->opts.keyframe_index_file = NULL;
+    entry->opts.waveform_file = NULL;
+    entry->opts.opaque = NULL;
+
+    entry->filename = av_strdup(filename);
+    if (!entry->filename)
+        goto fail;
+    if (o->filters) {
+        entry->opts.filters = av_strdup(o->filters);
+        if (!entry->opts.filters)
+            goto fail;
+    }
+
+    if (o->max_nb_cached_frames) {
+        /* There is no log context since the entry may outlive the context
+         * creating it; the handles created from it log on their own */
+        entry->frame_cache = nmdi_frame_cache_alloc();
+        if (!entry->frame_cache ||
+            nmdi_frame_cache_init(entry->frame_cache, NULL,
+                                  o->max_nb_cached_frames,
+                                  o->max_cached_frames_size,
+                                  o->use_pkt_duration) < 0)
+            goto fail;
+    }
+
+    entry->refcount = 1;
+    *entryp = entry;
+    return 0;
+
+fail:
+    free_entry(&entry);
+    return AVERROR(ENOMEM);
+}
+
+int nmdi_media_pool_acquire(struct media_pool_entry **entryp, const char *filename,
+                            const struct nmdi_opts *o)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&pool_lock);
+
+    struct media_pool_entry *entry;
+    for (entry = pool; entry; entry = entry->next)
+        if (!strcmp(entry->filename, filename) && same_output(&entry->opts, o))
+            break;
+
+    if (entry) {
+        entry->refcount++;
+    } else {
+        ret = create_entry(&entry, filename, o);
+        if (ret < 0)
+            goto end;
+        entry->next = pool;
+        pool = entry;
+    }
+    *entryp = entry;
+
+end:
+    pthread_mutex_unlock(&pool_lock);
+    return ret;
+}
+
+int nmdi_media_pool_get_frame_cache(struct media_pool_entry *entry, void *log_ctx,
+                                    struct frame_cache **fcp)
+{
+    *fcp = NULL;
+    if (!entry->frame_cache)
+        return 0;
+    *fcp = nmdi_frame_cache_share(entry->frame_cache, log_ctx);
+    return *fcp ? 0 : AVERROR(ENOMEM);
+}
+
+void nmdi_media_pool_set_timebase(struct media_pool_entry *entry, AVRational timebase)
+{
+    pthread_mutex_lock(&pool_lock);
+    entry->timebase = timebase;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+AVRational nmdi_media_pool_get_timebase(struct media_pool_entry *entry)
+{
+    pthread_mutex_lock(&pool_lock);
+    const AVRational timebase = entry->timebase;
+    pthread_mutex_unlock(&pool_lock);
+    return timebase;
+}
+
+void nmdi_media_pool_release(struct media_pool_entry **entryp)
+{
+    struct media_pool_entry *entry = *entryp;
+    if (!entry)
+        return;
+
+    pthread_mutex_lock(&pool_lock);
+    if (!--entry->refcount) {
+        struct media_pool_entry **prevp = &pool;
+        while (*prevp != entry)
+            prevp = &(*prevp)->next;
+        *prevp = entry->next;
+        free_entry(&entry);
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    *entryp = NULL;
+}
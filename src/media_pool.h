@@ -0,0 +1,65 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef MEDIA_POOL_H
+#define MEDIA_POOL_H
+
+#include <libavutil/rational.h>
+
+#include "frame_cache.h"
+#include "opts.h"
+
+/*
+ * Process-wide registry of the media opened by the contexts with the
+ * shared_pool option. Contexts opened on the same file with options leading
+ * to identical output frames share an entry, through which they share the
+ * frames they decode: a context can then be served by frames decoded by
+ * another one, without ever starting its own pipeline if their access
+ * windows overlap.
+ *
+ * All the functions are thread-safe.
+ */
+
+struct media_pool_entry;
+
+/**
+ * Get a reference to the entry matching the filename and options, creating
+ * it if needed.
+ */
+int nmdi_media_pool_acquire(struct media_pool_entry **entryp, const char *filename,
+                            const struct nmdi_opts *o);
+
+/**
+ * Get a new handle on the frame cache of the entry. *fcp is set to NULL if
+ * the frame cache is disabled.
+ */
+int nmdi_media_pool_get_frame_cache(struct media_pool_entry *entry, void *log_ctx,
+                                    struct frame_cache **fcp);
+
+/**
+ * Publish or get the stream timebase of the media (0/0 if still unknown).
+ */
+void nmdi_media_pool_set_timebase(struct media_pool_entry *entry, AVRational timebase);
+AVRational nmdi_media_pool_get_timebase(struct media_pool_entry *entry);
+
+void nmdi_media_pool_release(struct media_pool_entry **entryp);
+
+#endif
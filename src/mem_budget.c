@@ -0,0 +1,238 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <inttypes.h>
+
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+#include "internal.h"
+#include "log.h"
+#include "mem_budget.h"
+#include "pthread_compat.h"
+
+/* A context not popping any frame for this long is considered idle */
+#define IDLE_DELAY (AV_TIME_BASE)
+
+/* Minimum interval between two updates triggered by the frame pops */
+#define UPDATE_INTERVAL (AV_TIME_BASE / 4)
+
+struct mem_budget {
+    void *log_ctx;
+    struct mem_budget *next;                // next budget registered in the process-wide list
+    int registered;
+
+    int64_t max_memory;                     // limit of the context (0 for none)
+    struct msg_queue *queues[NB_MEM_BUDGET_QUEUE];
+    void (*set_depth[NB_MEM_BUDGET_QUEUE])(void *opaque, int depth);
+    void *opaque[NB_MEM_BUDGET_QUEUE];
+    int max_depth[NB_MEM_BUDGET_QUEUE];
+    int depth[NB_MEM_BUDGET_QUEUE];         // depth currently applied
+    int64_t frame_size[NB_MEM_BUDGET_QUEUE];
+
+    int64_t last_use;                       // time of the latest frame pop (AV_NOPTS_VALUE if none)
+    int idle;
+    int64_t allowance;                      // bytes granted by the latest update
+};
+
+static const char * const queue_names[NB_MEM_BUDGET_QUEUE] = {
+    [MEM_BUDGET_FRAMES] = "frames",
+    [MEM_BUDGET_SINK]   = "sink",
+    [MEM_BUDGET_EXPORT] = "export",
+};
+
+static pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mem_budget *budgets;
+static int64_t max_total;
+static int64_t last_update;
+
+/* Memory needed to fill the queues up to their maximum depth */
+static int64_t get_demand(const struct mem_budget *mb)
+{
+    int64_t demand = 0;
+    for (int i = 0; i < NB_MEM_BUDGET_QUEUE; i++)
+        demand += mb->frame_size[i] * mb->max_depth[i];
+    return demand;
+}
+
+/* Memory needed with a single frame per queue */
+static int64_t get_minimum(const struct mem_budget *mb)
+{
+    int64_t minimum = 0;
+    for (int i = 0; i < NB_MEM_BUDGET_QUEUE; i++)
+        minimum += mb->frame_size[i];
+    return minimum;
+}
+
+/* Scale the depths of the queues so their frames fit in the allowance */
+static void apply_allowance(struct mem_budget *mb)
+{
+    const int64_t demand = get_demand(mb);
+    for (int i = 0; i < NB_MEM_BUDGET_QUEUE; i++) {
+        if (!mb->queues[i] && !mb->set_depth[i])
+            continue;
+        int depth = mb->max_depth[i];
+        if (demand && mb->allowance < demand)
+            depth = av_clip(mb->max_depth[i] * mb->allowance / demand, 1, mb->max_depth[i]);
+        if (depth != mb->depth[i]) {
+            LOG(mb, DEBUG, "%s queue depth: %d -> %d", queue_names[i], mb->depth[i], depth);
+            if (mb->set_depth[i])
+                mb->set_depth[i](mb->opaque[i], depth);
+            else
+                nmdi_msg_queue_set_capacity(mb->queues[i], depth);
+            mb->depth[i] = depth;
+        }
+    }
+}
+
+/* Split the budget between the contexts; must be called with the lock held */
+static void update_depths(int64_t now)
+{
+    int64_t total = 0;
+    for (struct mem_budget *mb = budgets; mb; mb = mb->next) {
+        mb->idle = mb->last_use != AV_NOPTS_VALUE && now - mb->last_use > IDLE_DELAY;
+        mb->allowance = get_demand(mb);
+        if (mb->max_memory)
+            mb->allowance = FFMIN(mb->allowance, mb->max_memory);
+        total += mb->allowance;
+    }
+
+    if (max_total && total > max_total) {
+        /* The idle contexts are shrunk first */
+        int64_t active_total = 0, idle_total = 0;
+        for (struct mem_budget *mb = budgets; mb; mb = mb->next) {
+            if (mb->idle) {
+                mb->allowance = FFMIN(mb->allowance, get_minimum(mb));
+                idle_total += mb->allowance;
+            } else {
+                active_total += mb->allowance;
+            }
+        }
+
+        const int64_t remaining = max_total - idle_total;
+        if (active_total > remaining) {
+            for (struct mem_budget *mb = budgets; mb; mb = mb->next) {
+                if (mb->idle)
+                    continue;
+                const int64_t share = remaining > 0 ? (int64_t)((double)mb->allowance * remaining / active_total) : 0;
+                mb->allowance = FFMAX(share, get_minimum(mb));
+            }
+        }
+    }
+
+    for (struct mem_budget *mb = budgets; mb; mb = mb->next)
+        apply_allowance(mb);
+    last_update = now;
+}
+
+struct mem_budget *nmdi_mem_budget_alloc(void)
+{
+    struct mem_budget *mb = av_mallocz(sizeof(*mb));
+    if (!mb)
+        return NULL;
+    return mb;
+}
+
+int nmdi_mem_budget_init(struct mem_budget *mb, void *log_ctx, int64_t max_memory)
+{
+    mb->log_ctx = log_ctx;
+    mb->max_memory = max_memory;
+    mb->last_use = AV_NOPTS_VALUE;
+
+    pthread_mutex_lock(&budget_lock);
+    mb->next = budgets;
+    budgets = mb;
+    mb->registered = 1;
+    pthread_mutex_unlock(&budget_lock);
+    return 0;
+}
+
+void nmdi_mem_budget_set_queue(struct mem_budget *mb, enum mem_budget_queue queue,
+                               struct msg_queue *q, int max_depth)
+{
+    pthread_mutex_lock(&budget_lock);
+    mb->queues[queue] = q;
+    mb->max_depth[queue] = max_depth;
+    mb->depth[queue] = max_depth;
+    pthread_mutex_unlock(&budget_lock);
+}
+
+void nmdi_mem_budget_set_queue_cb(struct mem_budget *mb, enum mem_budget_queue queue,
+                                  void (*set_depth)(void *opaque, int depth), void *opaque,
+                                  int max_depth)
+{
+    pthread_mutex_lock(&budget_lock);
+    mb->set_depth[queue] = set_depth;
+    mb->opaque[queue] = opaque;
+    mb->max_depth[queue] = max_depth;
+    mb->depth[queue] = max_depth;
+    pthread_mutex_unlock(&budget_lock);
+}
+
+void nmdi_mem_budget_set_frame_size(struct mem_budget *mb, enum mem_budget_queue queue, int64_t size)
+{
+    pthread_mutex_lock(&budget_lock);
+    if (size != mb->frame_size[queue]) {
+        TRACE(mb, "%s frames size: %"PRId64, queue_names[queue], size);
+        mb->frame_size[queue] = size;
+        if (max_total || mb->max_memory)
+            update_depths(av_gettime_relative());
+    }
+    pthread_mutex_unlock(&budget_lock);
+}
+
+void nmdi_mem_budget_touch(struct mem_budget *mb)
+{
+    const int64_t now = av_gettime_relative();
+    pthread_mutex_lock(&budget_lock);
+    mb->last_use = now;
+    if (max_total && (mb->idle || now - last_update >= UPDATE_INTERVAL))
+        update_depths(now);
+    pthread_mutex_unlock(&budget_lock);
+}
+
+void nmdi_mem_budget_set_max(int64_t max_memory)
+{
+    pthread_mutex_lock(&budget_lock);
+    max_total = FFMAX(max_memory, 0);
+    update_depths(av_gettime_relative());
+    pthread_mutex_unlock(&budget_lock);
+}
+
+void nmdi_mem_budget_free(struct mem_budget **mbp)
+{
+    struct mem_budget *mb = *mbp;
+    if (!mb)
+        return;
+
+    pthread_mutex_lock(&budget_lock);
+    if (mb->registered) {
+        struct mem_budget **p = &budgets;
+        while (*p != mb)
+            p = &(*p)->next;
+        *p = mb->next;
+        if (max_total)
+            update_depths(av_gettime_relative());
+    }
+    pthread_mutex_unlock(&budget_lock);
+    av_freep(mbp);
+}
@@ -0,0 +1,94 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include <stdint.h>
+
+#include "msg_queue.h"
+
+/*
+ * Memory budget of the decoded frames waiting in the queues of a branch,
+ * expressed in bytes: the depth of the frames and sink queues is lowered
+ * from their configured maximum (max_nb_frames and max_nb_sink) so that the
+ * frames they hold fit within the limit of the context (max_queued_memory
+ * option) and within the process-wide limit shared by all the contexts (see
+ * nmd_set_max_queued_memory()).
+ *
+ * Other holders of decoded frames (see segment_export.h) are charged to the
+ * budget the same way through a callback applying the depth.
+ *
+ * When the process-wide limit is exceeded, the contexts which didn't pop any
+ * frame recently (paused or in the background) are shrunk to a single frame
+ * per queue first, and the remaining budget is split between the others in
+ * proportion to their needs. The queues never go below one frame, so the
+ * limits can be exceeded with very large frames.
+ *
+ * All the functions are thread-safe.
+ */
+
+enum mem_budget_queue {
+    MEM_BUDGET_FRAMES,                      // decoder  -> filterer
+    MEM_BUDGET_SINK,                        // filterer -> user
+    MEM_BUDGET_EXPORT,                      // segments decoded ahead of the user
+    NB_MEM_BUDGET_QUEUE
+};
+
+struct mem_budget *nmdi_mem_budget_alloc(void);
+
+int nmdi_mem_budget_init(struct mem_budget *mb, void *log_ctx, int64_t max_memory);
+
+/**
+ * Queue whose depth is controlled by the budget, up to max_depth messages.
+ */
+void nmdi_mem_budget_set_queue(struct mem_budget *mb, enum mem_budget_queue queue,
+                               struct msg_queue *q, int max_depth);
+
+/**
+ * Same as nmdi_mem_budget_set_queue() for a queue of another kind, whose
+ * depth is applied with set_depth(). The callback is called with the
+ * budget lock held, from any thread.
+ */
+void nmdi_mem_budget_set_queue_cb(struct mem_budget *mb, enum mem_budget_queue queue,
+                                  void (*set_depth)(void *opaque, int depth), void *opaque,
+                                  int max_depth);
+
+/**
+ * Report the size in bytes of the frames sent to a queue. The depths of all
+ * the contexts may be updated, so it should only be called when the size
+ * changes.
+ */
+void nmdi_mem_budget_set_frame_size(struct mem_budget *mb, enum mem_budget_queue queue, int64_t size);
+
+/**
+ * Mark the context as being in use (a frame was popped from its sink).
+ */
+void nmdi_mem_budget_touch(struct mem_budget *mb);
+
+/**
+ * Set the process-wide limit in bytes (0 for no limit).
+ */
+void nmdi_mem_budget_set_max(int64_t max_memory);
+
+void nmdi_mem_budget_free(struct mem_budget **mbp);
+
+#endif
@@ -18,15 +18,24 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <string.h>
+
 #include <libavutil/pixdesc.h>
 #include <libavutil/opt.h>
 #include <libavutil/channel_layout.h>
+#include <libavutil/time.h>
 
 #include "mod_decoding.h"
 #include "decoders.h"
 #include "internal.h"
 #include "msg.h"
 #include "log.h"
+#include "obj_pool.h"
+#include "playback_hint.h"
+#include "pthread_compat.h"
+#include "seek_cost.h"
+#include "thread_budget.h"
+#include "trace.h"
 
 static void nmi_channel_layout_describe(const AVCodecParameters *par, char *buf, size_t buf_size)
 {
@@ -51,19 +60,58 @@ static const struct decoder *decoder_def_hwaccel = &nmdi_decoder_ffmpeg_hw;
 struct decoding_ctx {
     void *log_ctx;
 
-    AVThreadMessageQueue *pkt_queue;
-    AVThreadMessageQueue *frames_queue;
+    struct msg_queue *pkt_queue;
+    struct msg_queue *frames_queue;
 
     int is_image;
     int frame_count;
 
     struct decoder_ctx *decoder;
+    struct obj_pool *frame_pool;            // frames recycled by the later modules
+    int nb_threads;                         // threads reserved in the budget for the decoder
+    int has_threads;
+
+    int running;                            // between the first step and the end of the run
+    int nonblock;                           // never wait on the queues (scheduled steps)
+    int draining;                           // the end of the packets is reached
+    int end_ret;                            // status to end with once the pending messages are sent
+
+    /* Messages waiting for room in the frames queue; the lock is needed
+     * because some decoders output their frames from their own thread */
+    pthread_mutex_t pending_lock;
+    struct message *pending;
+    int nb_pending;
+    unsigned pending_size;
 
     AVRational st_timebase;
     AVFrame *tmp_frame;
     int64_t seek_request;
+    int use_pkt_duration;                   // the packet durations can be trusted to end the preroll
+    int can_skip_frames;                    // the decoder honors skip_frame (FFmpeg video decoders)
+    int preroll_skip;                       // the non-reference frames before the seek target are discarded
+
+    struct seek_cost *cost;
+    int64_t busy_time;                      // time spent decoding since the last cost report
+    int64_t blocked_time;                   // time spent waiting on the frames queue
+    int64_t decoded_duration;               // media time decoded since the last cost report
+    int64_t prev_decoded_ts;                // timestamp of the previously decoded frame
+    int64_t preroll_start;                  // timestamp of the first frame decoded after a seek
+
+    struct playback_hint *hint;             // NULL if the frames can not be skipped
+    int skip_nonref;                        // the non-reference frames are discarded (fast-forward)
+
+    struct stats *stats;
+
+    struct mem_budget *mem_budget;
+    int64_t frame_size;                     // size of the frames reported to the memory budget
 };
 
+/* Playback rate from which the non-reference frames are not decoded */
+#define SKIP_NONREF_RATE 2.0
+
+/* Minimum amount of decoded media between two decode cost reports */
+#define COST_REPORT_DURATION (AV_TIME_BASE / 5)
+
 struct decoding_ctx *nmdi_decoding_alloc(void)
 {
     struct decoding_ctx *ctx = av_mallocz(sizeof(*ctx));
@@ -74,9 +122,18 @@ struct decoding_ctx *nmdi_decoding_alloc(void)
         av_freep(&ctx);
         return NULL;
     }
+    pthread_mutex_init(&ctx->pending_lock, NULL);
     return ctx;
 }
 
+static void release_threads(struct decoding_ctx *ctx)
+{
+    if (!ctx->has_threads)
+        return;
+    nmdi_thread_budget_release(ctx->nb_threads);
+    ctx->has_threads = 0;
+}
+
 const AVCodecContext *nmdi_decoding_get_avctx(struct decoding_ctx *ctx)
 {
     return ctx->decoder->avctx;
@@ -84,8 +141,13 @@ const AVCodecContext *nmdi_decoding_get_avctx(struct decoding_ctx *ctx)
 
 int nmdi_decoding_init(void *log_ctx,
                        struct decoding_ctx *ctx,
-                       AVThreadMessageQueue *pkt_queue,
-                       AVThreadMessageQueue *frames_queue,
+                       struct msg_queue *pkt_queue,
+                       struct msg_queue *frames_queue,
+                       struct seek_cost *cost,
+                       struct playback_hint *hint,
+                       struct stats *stats,
+                       struct mem_budget *mem_budget,
+                       struct obj_pool *frame_pool,
                        int is_image,
                        const AVStream *stream,
                        const struct nmdi_opts *opts)
@@ -101,6 +163,17 @@ int nmdi_decoding_init(void *log_ctx,
     ctx->pkt_queue = pkt_queue;
     ctx->frames_queue = frames_queue;
     ctx->is_image = is_image;
+    /* Decoding only the keyframes is not representative of the seek costs */
+    ctx->cost = is_image || opts->keyframes_only ? NULL : cost;
+    ctx->hint = is_image || opts->keyframes_only || stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO ? NULL : hint;
+    /* The keyframes only mode already discards all the other frames (see
+     * nmdi_decoder_init()) */
+    ctx->can_skip_frames = !is_image && !opts->keyframes_only &&
+                           stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
+    ctx->use_pkt_duration = opts->use_pkt_duration;
+    ctx->stats = stats;
+    ctx->mem_budget = mem_budget;
+    ctx->frame_pool = frame_pool;
 
     if (opts->auto_hwaccel && decoder_def_hwaccel) {
         dec_def          = decoder_def_hwaccel;
@@ -130,6 +203,10 @@ int nmdi_decoding_init(void *log_ctx,
 
     DUMP_INFO(stream->codecpar, "original");
 
+    ctx->nb_threads = nmdi_thread_budget_acquire(opts->nb_threads);
+    ctx->has_threads = 1;
+    ctx->decoder->nb_threads = ctx->nb_threads;
+
     ret = nmdi_decoder_init(log_ctx, ctx->decoder, dec_def, stream, ctx, opts);
     if (ret < 0 && dec_def_fallback) {
         TRACE(ctx, "unable to init %s decoder, fallback on %s decoder",
@@ -141,6 +218,18 @@ int nmdi_decoding_init(void *log_ctx,
     if (ret < 0)
         return ret;
 
+    /* Only the FFmpeg decoders honor the skip_frame setting */
+    if (ctx->decoder->dec != decoder_def_software && ctx->decoder->dec != &nmdi_decoder_ffmpeg_hw) {
+        ctx->hint = NULL;
+        ctx->can_skip_frames = 0;
+    }
+
+    /* The hardware decoders manage their own threads */
+    if (ctx->decoder->dec != decoder_def_software)
+        release_threads(ctx);
+    else
+        TRACE(ctx, "decoding with %d threads", ctx->nb_threads);
+
     avcodec_parameters_from_context(par, ctx->decoder->avctx);
     DUMP_INFO(par, "initialized");
 
@@ -151,18 +240,82 @@ int nmdi_decoding_init(void *log_ctx,
     return 0;
 }
 
+AVFrame *nmdi_decoding_alloc_frame(struct decoding_ctx *ctx)
+{
+    return nmdi_obj_pool_get(ctx->frame_pool);
+}
+
+void nmdi_decoding_free_frame(struct decoding_ctx *ctx, AVFrame **framep)
+{
+    nmdi_obj_pool_put(ctx->frame_pool, *framep);
+    *framep = NULL;
+}
+
 static int64_t get_best_effort_ts(const AVFrame *f)
 {
     const int64_t t = f->best_effort_timestamp;
     return t != AV_NOPTS_VALUE ? t : f->pts;
 }
 
+/* Send a message to the frames queue, or keep it for the next step if the
+ * queue is full and we are not allowed to wait */
+static int send_msg(struct decoding_ctx *ctx, struct message *msg)
+{
+    if (!ctx->nonblock)
+        return nmdi_msg_queue_send(ctx->frames_queue, msg, 0);
+
+    int ret = 0;
+    pthread_mutex_lock(&ctx->pending_lock);
+    if (!ctx->nb_pending)
+        ret = nmdi_msg_queue_send(ctx->frames_queue, msg, AV_THREAD_MESSAGE_NONBLOCK);
+    if (ctx->nb_pending || ret == AVERROR(EAGAIN)) {
+        struct message *pending = av_fast_realloc(ctx->pending, &ctx->pending_size,
+                                                  (ctx->nb_pending + 1) * sizeof(*pending));
+        if (pending) {
+            ctx->pending = pending;
+            ctx->pending[ctx->nb_pending++] = *msg;
+            ret = 0;
+        } else {
+            ret = AVERROR(ENOMEM);
+        }
+    }
+    pthread_mutex_unlock(&ctx->pending_lock);
+    return ret;
+}
+
+static int send_pending(struct decoding_ctx *ctx)
+{
+    int ret = 0, nb_sent = 0;
+
+    pthread_mutex_lock(&ctx->pending_lock);
+    while (nb_sent < ctx->nb_pending) {
+        ret = nmdi_msg_queue_send(ctx->frames_queue, &ctx->pending[nb_sent], AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret < 0)
+            break;
+        nb_sent++;
+    }
+    ctx->nb_pending -= nb_sent;
+    memmove(ctx->pending, ctx->pending + nb_sent, ctx->nb_pending * sizeof(*ctx->pending));
+    pthread_mutex_unlock(&ctx->pending_lock);
+    return ret;
+}
+
+static void drop_pending(struct decoding_ctx *ctx)
+{
+    pthread_mutex_lock(&ctx->pending_lock);
+    for (int i = 0; i < ctx->nb_pending; i++)
+        nmdi_msg_free_data(&ctx->pending[i]);
+    ctx->nb_pending = 0;
+    pthread_mutex_unlock(&ctx->pending_lock);
+}
+
 static int queue_frame(struct decoding_ctx *ctx, AVFrame *frame)
 {
     int ret;
     struct message msg = {
         .type = MSG_FRAME,
         .data = frame,
+        .pool = ctx->frame_pool,
     };
 
     if (ctx->is_image && ctx->frame_count++ > 0)
@@ -170,11 +323,22 @@ static int queue_frame(struct decoding_ctx *ctx, AVFrame *frame)
 
     TRACE(ctx, "queue frame with ts=%s", av_ts2timestr(frame->pts, &ctx->st_timebase));
 
-    ret = av_thread_message_queue_send(ctx->frames_queue, &msg, 0);
+    const int64_t frame_size = nmdi_get_frame_size(frame);
+    if (frame_size != ctx->frame_size) {
+        ctx->frame_size = frame_size;
+        nmdi_mem_budget_set_frame_size(ctx->mem_budget, MEM_BUDGET_FRAMES, frame_size);
+    }
+
+    const int64_t t0 = av_gettime_relative();
+    TRACE_BEGIN(ctx, "frame push");
+    ret = send_msg(ctx, &msg);
+    TRACE_END(ctx, "frame push");
+    ctx->blocked_time += av_gettime_relative() - t0;
+    TRACE_COUNTER(ctx, "frames_queue", nmdi_msg_queue_nb_elems(ctx->frames_queue));
     if (ret < 0) {
         if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
             LOG(ctx, ERROR, "Unable to push frame: %s", av_err2str(ret));
-        av_thread_message_queue_set_err_recv(ctx->frames_queue, ret);
+        nmdi_msg_queue_set_err_recv(ctx->frames_queue, ret);
     }
     return ret;
 }
@@ -189,7 +353,7 @@ static int queue_cached_frame(struct decoding_ctx *ctx)
     prev_frame->pts = cached_ts;
     ret = queue_frame(ctx, prev_frame);
     if (ret < 0) {
-        av_frame_free(&prev_frame);
+        nmdi_decoding_free_frame(ctx, &prev_frame);
         return ret;
     }
     return 0;
@@ -211,21 +375,55 @@ int nmdi_decoding_queue_frame(struct decoding_ctx *ctx, AVFrame *frame)
 
     const int64_t ts = get_best_effort_ts(frame);
     TRACE(ctx, "processing frame with ts=%s", av_ts2timestr(ts, &ctx->st_timebase));
+    nmdi_stats_count(ctx->stats, STATS_COUNTER_FRAMES_DECODED, 1);
+
+    if (ctx->cost && !ctx->skip_nonref && ts != AV_NOPTS_VALUE) {
+        /* Large gaps are not representative of the decoding work, and
+         * neither is a preroll skipping frames */
+        if (ctx->prev_decoded_ts != AV_NOPTS_VALUE && ts > ctx->prev_decoded_ts && !ctx->preroll_skip) {
+            const int64_t delta = av_rescale_q(ts - ctx->prev_decoded_ts, ctx->st_timebase, AV_TIME_BASE_Q);
+            if (delta < AV_TIME_BASE)
+                ctx->decoded_duration += delta;
+        }
+        ctx->prev_decoded_ts = ts;
+        if (ctx->seek_request != AV_NOPTS_VALUE && ctx->preroll_start == AV_NOPTS_VALUE)
+            ctx->preroll_start = ts;
+    }
 
     if (ctx->seek_request != AV_NOPTS_VALUE && ts < ctx->seek_request) {
-        TRACE(ctx, "frame ts:%s (%"PRId64"), skipping because before %s (%"PRId64")",
-              av_ts2timestr(ts, &ctx->st_timebase), ts,
-              av_ts2timestr(ctx->seek_request, &ctx->st_timebase), ctx->seek_request);
-        av_frame_free(&ctx->tmp_frame);
-        ctx->tmp_frame = frame;
-        return 0;
+        /* A frame lasting until after the seek target is the one to return,
+         * without waiting for the decoder to output the next one */
+        if (ctx->use_pkt_duration && frame->pkt_duration > 0 && ts + frame->pkt_duration > ctx->seek_request) {
+            TRACE(ctx, "frame ts:%s (%"PRId64") covers %s (%"PRId64"), ending preroll",
+                  av_ts2timestr(ts, &ctx->st_timebase), ts,
+                  av_ts2timestr(ctx->seek_request, &ctx->st_timebase), ctx->seek_request);
+            if (ctx->tmp_frame)
+                nmdi_stats_count(ctx->stats, STATS_COUNTER_FRAMES_DROPPED, 1);
+            nmdi_decoding_free_frame(ctx, &ctx->tmp_frame);
+        } else {
+            TRACE(ctx, "frame ts:%s (%"PRId64"), skipping because before %s (%"PRId64")",
+                  av_ts2timestr(ts, &ctx->st_timebase), ts,
+                  av_ts2timestr(ctx->seek_request, &ctx->st_timebase), ctx->seek_request);
+            if (ctx->tmp_frame)
+                nmdi_stats_count(ctx->stats, STATS_COUNTER_FRAMES_DROPPED, 1);
+            nmdi_decoding_free_frame(ctx, &ctx->tmp_frame);
+            ctx->tmp_frame = frame;
+            return 0;
+        }
     }
 
     frame->pts = ts;
 
+    if (ctx->cost && ctx->seek_request != AV_NOPTS_VALUE && ctx->preroll_start != AV_NOPTS_VALUE) {
+        nmdi_seek_cost_add_preroll(ctx->cost, av_rescale_q(ctx->seek_request - ctx->preroll_start,
+                                                           ctx->st_timebase, AV_TIME_BASE_Q));
+        ctx->preroll_start = AV_NOPTS_VALUE;
+    }
+
     if (ctx->tmp_frame) {
         if (ctx->seek_request != AV_NOPTS_VALUE && ts == ctx->seek_request) {
-            av_frame_free(&ctx->tmp_frame);
+            nmdi_stats_count(ctx->stats, STATS_COUNTER_FRAMES_DROPPED, 1);
+            nmdi_decoding_free_frame(ctx, &ctx->tmp_frame);
         } else {
             ret = queue_cached_frame(ctx);
             if (ret < 0)
@@ -244,79 +442,98 @@ int nmdi_decoding_queue_frame(struct decoding_ctx *ctx, AVFrame *frame)
     return queue_frame(ctx, frame);
 }
 
-void nmdi_decoding_run(struct decoding_ctx *ctx)
+static int push_packet_timed(struct decoding_ctx *ctx, const AVPacket *pkt)
 {
-    int ret;
-    int in_err, out_err;
-
-    TRACE(ctx, "decoding packets from %p into %p", ctx->pkt_queue, ctx->frames_queue);
-
-    ctx->seek_request = AV_NOPTS_VALUE;
-
-    for (;;) {
-        AVPacket *pkt;
-        struct message msg;
-
-        TRACE(ctx, "fetching a packet");
-        ret = av_thread_message_queue_recv(ctx->pkt_queue, &msg, 0);
-        if (ret < 0)
-            break;
-
-        if (msg.type == MSG_SEEK) {
-            const int64_t seek_ts = *(int64_t *)msg.data;
+    /* Only account for the time the decoder is actually working, not for the
+     * time spent waiting for the filterer to make room in the queue */
+    const int64_t t0 = av_gettime_relative();
+    ctx->blocked_time = 0;
+    TRACE_BEGIN(ctx, "decode");
+    const int ret = nmdi_decoder_push_packet(ctx->decoder, pkt);
+    TRACE_END(ctx, "decode");
+    const int64_t busy_time = FFMAX(av_gettime_relative() - t0 - ctx->blocked_time, 0);
+    if (!ctx->preroll_skip)
+        ctx->busy_time += busy_time;
+    nmdi_stats_add_time(ctx->stats, STATS_TIMING_DECODE, busy_time);
+
+    if (ctx->cost && ctx->decoded_duration >= COST_REPORT_DURATION) {
+        nmdi_seek_cost_add_decode(ctx->cost, ctx->decoded_duration, ctx->busy_time);
+        ctx->decoded_duration = 0;
+        ctx->busy_time = 0;
+    }
 
-            TRACE(ctx, "got a seek message (to %s) in the pkt queue",
-                  PTS2TIMESTR(seek_ts));
+    return ret;
+}
 
-            /* Make sure the decoder has no packet remaining to consume and
-             * pushed (or dropped) all its cached frames. After this flush, we
-             * can assume that the decoder will not called async_queue_frame()
-             * until a new packet is pushed. */
-            nmdi_decoder_flush(ctx->decoder);
+static void reset_cost_measures(struct decoding_ctx *ctx)
+{
+    ctx->busy_time = 0;
+    ctx->decoded_duration = 0;
+    ctx->prev_decoded_ts = AV_NOPTS_VALUE;
+    ctx->preroll_start = AV_NOPTS_VALUE;
+}
 
-            av_frame_free(&ctx->tmp_frame);
+/*
+ * Whether the packet is a frame ending before the seek target: not being
+ * displayed, it only needs to be decoded if other frames refer to it.
+ */
+static int is_preroll_packet(const struct decoding_ctx *ctx, const AVPacket *pkt)
+{
+    return ctx->can_skip_frames && ctx->use_pkt_duration &&
+           ctx->seek_request != AV_NOPTS_VALUE &&
+           pkt->pts != AV_NOPTS_VALUE && pkt->duration > 0 &&
+           pkt->pts + pkt->duration <= ctx->seek_request;
+}
 
-            /* Let's save some little time by dropping frames in the queue so
-             * the user don't get a shit ton of false positives before the
-             * frames he requested. */
-            av_thread_message_flush(ctx->frames_queue);
+/* Follow the playback rate hint and the seek target between two packets */
+static void update_skip_frame(struct decoding_ctx *ctx, const AVPacket *pkt)
+{
+    if (ctx->hint) {
+        const int skip_nonref = nmdi_playback_hint_get_rate(ctx->hint) >= SKIP_NONREF_RATE;
+        if (skip_nonref != ctx->skip_nonref) {
+            TRACE(ctx, "%s the non-reference frames", skip_nonref ? "skip" : "decode");
+            ctx->skip_nonref = skip_nonref;
+
+            /* The decoding speed measured while skipping frames is not representative */
+            reset_cost_measures(ctx);
+        }
+    }
 
-            /* Mark the seek request so async_queue_frame() can do its
-             * "filtering" work. */
-            ctx->seek_request = av_rescale_q(seek_ts, AV_TIME_BASE_Q, ctx->st_timebase);
+    const int preroll_skip = is_preroll_packet(ctx, pkt);
+    if (preroll_skip != ctx->preroll_skip) {
+        TRACE(ctx, "%s the non-reference frames of the preroll", preroll_skip ? "skip" : "decode");
+        ctx->preroll_skip = preroll_skip;
+    }
 
-            /* Forward seek message */
-            ret = av_thread_message_queue_send(ctx->frames_queue, &msg, 0);
-            if (ret < 0) {
-                nmdi_msg_free_data(&msg);
-                break;
-            }
+    if (ctx->can_skip_frames)
+        ctx->decoder->avctx->skip_frame = ctx->skip_nonref || ctx->preroll_skip ? AVDISCARD_NONREF
+                                                                                : AVDISCARD_DEFAULT;
+}
 
-            continue;
-        }
+static void start_run(struct decoding_ctx *ctx, int nonblock)
+{
+    TRACE(ctx, "decoding packets from %p into %p", ctx->pkt_queue, ctx->frames_queue);
 
-        pkt = msg.data;
-        TRACE(ctx, "got a packet of size %d, push it to decoder", pkt->size);
-        ret = nmdi_decoder_push_packet(ctx->decoder, pkt);
-        av_packet_unref(pkt);
-        av_freep(&pkt);
-        if (ret < 0)
-            break;
-    }
+    ctx->running = 1;
+    ctx->nonblock = nonblock;
+    ctx->draining = 0;
+    ctx->end_ret = 0;
+    ctx->seek_request = AV_NOPTS_VALUE;
+    ctx->preroll_skip = 0;
+    reset_cost_measures(ctx);
+}
 
-    /* Fetch remaining frames */
-    if (ret == AVERROR_EOF) {
-        TRACE(ctx, "flush cached frames");
-        do {
-            ret = nmdi_decoder_push_packet(ctx->decoder, NULL);
-        } while (ret == 0 || ret == AVERROR(EAGAIN));
-    }
+static void end_run(struct decoding_ctx *ctx, int ret)
+{
+    int in_err, out_err;
 
     /* We pushed everything we could to the decoder, now we make sure frame
      * queuing callback won't be called anymore */
     nmdi_decoder_flush(ctx->decoder);
 
-    av_frame_free(&ctx->tmp_frame);
+    nmdi_decoding_free_frame(ctx, &ctx->tmp_frame);
+    drop_pending(ctx);
+    ctx->running = 0;
 
     if (ret < 0 && ret != AVERROR_EOF) {
         in_err = out_err = ret;
@@ -326,9 +543,117 @@ void nmdi_decoding_run(struct decoding_ctx *ctx)
     }
     TRACE(ctx, "notify demuxer with %s and frames queue with %s",
           av_err2str(in_err), av_err2str(out_err));
-    av_thread_message_queue_set_err_send(ctx->pkt_queue,    in_err);
-    av_thread_message_flush(ctx->pkt_queue);
-    av_thread_message_queue_set_err_recv(ctx->frames_queue, out_err);
+    nmdi_msg_queue_set_err_send(ctx->pkt_queue,    in_err);
+    nmdi_msg_queue_flush(ctx->pkt_queue);
+    nmdi_msg_queue_set_err_recv(ctx->frames_queue, out_err);
+}
+
+/*
+ * Process at most one message from the packets queue. Return 0 if progress
+ * was made, AVERROR(EAGAIN) if waiting on a queue (only in non-blocking
+ * mode), or the status to end the run with.
+ */
+static int decoding_step(struct decoding_ctx *ctx)
+{
+    int ret;
+    AVPacket *pkt;
+    struct message msg;
+
+    if (ctx->nonblock) {
+        ret = send_pending(ctx);
+        if (ret < 0)
+            return ret;
+    }
+    if (ctx->end_ret)
+        return ctx->end_ret;
+
+    /* Fetch remaining frames */
+    if (ctx->draining) {
+        ret = nmdi_decoder_push_packet(ctx->decoder, NULL);
+        if (ret == 0 || ret == AVERROR(EAGAIN))
+            return 0;
+        ctx->end_ret = ret < 0 ? ret : AVERROR_EOF;
+        return 0;
+    }
+
+    TRACE(ctx, "fetching a packet");
+    ret = nmdi_msg_queue_recv(ctx->pkt_queue, &msg, ctx->nonblock ? AV_THREAD_MESSAGE_NONBLOCK : 0);
+    if (ret == AVERROR(EAGAIN))
+        return ret;
+    if (ret == AVERROR_EOF) {
+        TRACE(ctx, "flush cached frames");
+        ctx->draining = 1;
+        return 0;
+    }
+    if (ret < 0)
+        return ret;
+    TRACE_COUNTER(ctx, "pkt_queue", nmdi_msg_queue_nb_elems(ctx->pkt_queue));
+
+    if (msg.type == MSG_SEEK) {
+        const int64_t seek_ts = *(int64_t *)msg.data;
+
+        TRACE(ctx, "got a seek message (to %s) in the pkt queue",
+              PTS2TIMESTR(seek_ts));
+
+        /* Make sure the decoder has no packet remaining to consume and
+         * pushed (or dropped) all its cached frames. After this flush, we
+         * can assume that the decoder will not called async_queue_frame()
+         * until a new packet is pushed. */
+        nmdi_decoder_flush(ctx->decoder);
+
+        nmdi_decoding_free_frame(ctx, &ctx->tmp_frame);
+
+        /* Let's save some little time by dropping frames in the queue so
+         * the user don't get a shit ton of false positives before the
+         * frames he requested. */
+        nmdi_msg_queue_flush(ctx->frames_queue);
+        drop_pending(ctx);
+
+        /* Mark the seek request so async_queue_frame() can do its
+         * "filtering" work. */
+        ctx->seek_request = av_rescale_q(seek_ts, AV_TIME_BASE_Q, ctx->st_timebase);
+        reset_cost_measures(ctx);
+
+        /* Forward seek message */
+        ret = send_msg(ctx, &msg);
+        if (ret < 0) {
+            nmdi_msg_free_data(&msg);
+            return ret;
+        }
+
+        return 0;
+    }
+
+    pkt = msg.data;
+    update_skip_frame(ctx, pkt);
+
+    TRACE(ctx, "got a packet of size %d, push it to decoder", pkt->size);
+    ret = push_packet_timed(ctx, pkt);
+    nmdi_msg_free_data(&msg);
+    if (ret < 0)
+        return ret == AVERROR(EAGAIN) ? AVERROR_BUG : ret;
+    return 0;
+}
+
+void nmdi_decoding_run(struct decoding_ctx *ctx)
+{
+    int ret;
+
+    start_run(ctx, 0);
+    do {
+        ret = decoding_step(ctx);
+    } while (ret >= 0);
+    end_run(ctx, ret);
+}
+
+int nmdi_decoding_step(struct decoding_ctx *ctx)
+{
+    if (!ctx->running)
+        start_run(ctx, 1);
+    const int ret = decoding_step(ctx);
+    if (ret < 0 && ret != AVERROR(EAGAIN))
+        end_run(ctx, ret);
+    return ret;
 }
 
 void nmdi_decoding_free(struct decoding_ctx **ctxp)
@@ -337,5 +662,9 @@ void nmdi_decoding_free(struct decoding_ctx **ctxp)
     if (!ctx)
         return;
     nmdi_decoder_free(&ctx->decoder);
+    release_threads(ctx);
+    drop_pending(ctx);
+    av_freep(&ctx->pending);
+    pthread_mutex_destroy(&ctx->pending_lock);
     av_freep(ctxp);
 }
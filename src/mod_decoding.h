@@ -24,26 +24,50 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/frame.h>
-#include <libavutil/threadmessage.h>
 
+#include "mem_budget.h"
+#include "msg_queue.h"
+#include "obj_pool.h"
 #include "opts.h"
+#include "playback_hint.h"
+#include "seek_cost.h"
+#include "stats.h"
 
 struct decoding_ctx *nmdi_decoding_alloc(void);
 
 int nmdi_decoding_init(void *log_ctx,
                        struct decoding_ctx *ctx,
-                       AVThreadMessageQueue *pkt_queue,
-                       AVThreadMessageQueue *frames_queue,
+                       struct msg_queue *pkt_queue,
+                       struct msg_queue *frames_queue,
+                       struct seek_cost *cost,
+                       struct playback_hint *hint,
+                       struct stats *stats,
+                       struct mem_budget *mem_budget,
+                       struct obj_pool *frame_pool,
                        int is_image,
                        const AVStream *stream,
                        const struct nmdi_opts *opts);
 
 const AVCodecContext *nmdi_decoding_get_avctx(struct decoding_ctx *ctx);
 
+/**
+ * Get or release a frame container for the decoders; the frames are recycled
+ * along the pipeline.
+ */
+AVFrame *nmdi_decoding_alloc_frame(struct decoding_ctx *ctx);
+void nmdi_decoding_free_frame(struct decoding_ctx *ctx, AVFrame **framep);
+
 int nmdi_decoding_queue_frame(struct decoding_ctx *ctx, AVFrame *frame);
 
 void nmdi_decoding_run(struct decoding_ctx *ctx);
 
+/**
+ * Non-blocking alternative to nmdi_decoding_run() for the scheduler (see
+ * scheduler.h): the run ends when the returned status is neither 0 nor
+ * AVERROR(EAGAIN).
+ */
+int nmdi_decoding_step(struct decoding_ctx *ctx);
+
 void nmdi_decoding_free(struct decoding_ctx **ctxp);
 
 #endif
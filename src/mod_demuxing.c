@@ -22,20 +22,68 @@
 #include <libavutil/avassert.h>
 #include <libavutil/display.h>
 #include <libavutil/eval.h>
+#include <libavutil/time.h>
+#include <libavutil/timestamp.h>
 
 #include "mod_demuxing.h"
 #include "internal.h"
+#include "io.h"
 #include "log.h"
 #include "msg.h"
+#include "obj_pool.h"
+#include "packet_cache.h"
+#include "trace.h"
+
+/* Maximum number of packets held by the demuxer for an output whose queue is
+ * full, before they get dropped */
+#define MAX_PENDING_PACKETS 256
+
+/* Maximum time to sleep when waiting for room in the outputs queues */
+#define MAX_POLL_DELAY 10000
+
+/* Probing limits of the fast_open option: enough to decode the first
+ * keyframe of most media */
+#define FAST_OPEN_PROBESIZE       (1 << 20)
+#define FAST_OPEN_ANALYZEDURATION 500000
+
+struct demuxing_output {
+    AVStream *stream;
+    struct msg_queue *pkt_queue;
+    AVPacket **pending;                     // ring buffer of packets waiting for room in the queue
+    int pending_first;
+    int nb_pending;
+    int wait_keyframe;                      // packets were dropped, skip until the next keyframe
+    int dead;                               // the receiving end is not listening anymore
+};
 
 struct demuxing_ctx {
     void *log_ctx;
     AVFormatContext *fmt_ctx;
+    AVIOContext *pb;                        // custom I/O context (NULL with the default backend)
     AVStream *stream;
     int stream_idx;
     int is_image;
-    AVThreadMessageQueue *src_queue;
-    AVThreadMessageQueue *pkt_queue;
+    struct msg_queue *src_queue;
+    struct msg_queue *pkt_queue;
+    struct keyframe_index *index;           // keyframe index of the selected stream (NULL if not indexed)
+    struct keyframe_run index_run;          // range indexed since the latest seek
+    struct packet_cache *packet_cache;      // latest packets of the selected stream (NULL if disabled)
+    struct info_cache *info_cache;          // set if the stream information was restored from the cache
+    struct stats *stats;
+    struct obj_pool *pkt_pool;              // packets recycled by the consumers
+    int nb_prealloc_packets;
+
+    struct demuxing_output outputs[NMDI_DEMUXING_MAX_OUTPUTS];
+    int nb_outputs;
+
+    int keyframes_only;                     // only forward the keyframes of the selected stream
+    int64_t next_keyframe;                  // indexed keyframe to jump to before reading further
+
+    /* State of the non-blocking demuxing */
+    int running;                            // between the first step and the end of the run
+    AVPacket *pkt;                          // packet pulled and not yet dispatched
+    struct demuxing_output *pkt_out;
+    int eof;
 };
 
 struct demuxing_ctx *nmdi_demuxing_alloc(void)
@@ -65,9 +113,9 @@ int64_t nmdi_demuxing_probe_duration(const struct demuxing_ctx *ctx)
     return AV_NOPTS_VALUE;
 }
 
-double nmdi_demuxing_probe_rotation(const struct demuxing_ctx *ctx)
+double nmdi_demuxing_probe_rotation(const struct demuxing_ctx *ctx, int output)
 {
-    AVStream *st = (AVStream *)ctx->stream; // XXX: Fix FFmpeg.
+    AVStream *st = (AVStream *)ctx->outputs[output].stream; // XXX: Fix FFmpeg.
     AVDictionaryEntry *rotate_tag = av_dict_get(st->metadata, "rotate", NULL, 0);
     const uint8_t *displaymatrix = av_stream_get_side_data(st, AV_PKT_DATA_DISPLAYMATRIX, NULL);
     double theta = 0;
@@ -84,9 +132,10 @@ double nmdi_demuxing_probe_rotation(const struct demuxing_ctx *ctx)
     return theta;
 }
 
-const AVStream *nmdi_demuxing_get_stream(const struct demuxing_ctx *ctx)
+const AVStream *nmdi_demuxing_get_stream(const struct demuxing_ctx *ctx, int output)
 {
-    return ctx->stream;
+    av_assert0(output >= 0 && output < ctx->nb_outputs);
+    return ctx->outputs[output].stream;
 }
 
 int nmdi_demuxing_is_image(const struct demuxing_ctx *ctx)
@@ -94,10 +143,23 @@ int nmdi_demuxing_is_image(const struct demuxing_ctx *ctx)
     return ctx->is_image;
 }
 
+enum AVMediaType nmdi_demuxing_get_media_type(const struct nmdi_opts *opts)
+{
+    switch (opts->avselect) {
+    case NMD_SELECT_VIDEO: return AVMEDIA_TYPE_VIDEO;
+    case NMD_SELECT_AUDIO: return AVMEDIA_TYPE_AUDIO;
+    default:
+        av_assert0(0);
+    }
+}
+
 int nmdi_demuxing_init(void *log_ctx,
                        struct demuxing_ctx *ctx,
-                       AVThreadMessageQueue *src_queue,
-                       AVThreadMessageQueue *pkt_queue,
+                       struct msg_queue *src_queue,
+                       struct msg_queue *pkt_queue,
+                       struct keyframe_index *index,
+                       struct info_cache *info_cache,
+                       struct stats *stats,
                        const char *filename,
                        const struct nmdi_opts *opts)
 {
@@ -107,30 +169,69 @@ int nmdi_demuxing_init(void *log_ctx,
 
     ctx->src_queue = src_queue;
     ctx->pkt_queue = pkt_queue;
+    ctx->stats = stats;
+    ctx->next_keyframe = AV_NOPTS_VALUE;
+    nmdi_keyframe_index_break(&ctx->index_run);
+
+    media_type = nmdi_demuxing_get_media_type(opts);
+
+    /* Enough packets to fill the queue while the decoder holds one and the
+     * demuxer reads another */
+    ctx->pkt_pool = nmdi_obj_pool_alloc();
+    if (!ctx->pkt_pool)
+        return AVERROR(ENOMEM);
+    ctx->nb_prealloc_packets = opts->max_nb_packets + 2;
+    int ret = nmdi_obj_pool_init_packets(ctx->pkt_pool);
+    if (ret < 0 || (ret = nmdi_obj_pool_prealloc(ctx->pkt_pool, ctx->nb_prealloc_packets)) < 0)
+        return ret;
 
-    switch (opts->avselect) {
-    case NMD_SELECT_VIDEO: media_type = AVMEDIA_TYPE_VIDEO; break;
-    case NMD_SELECT_AUDIO: media_type = AVMEDIA_TYPE_AUDIO; break;
-    default:
-        av_assert0(0);
+    TRACE(ctx, "opening %s", filename);
+    ret = nmdi_io_open(ctx->log_ctx, &ctx->pb, filename, opts);
+    if (ret < 0)
+        return ret;
+    if (ctx->pb) {
+        ctx->fmt_ctx = avformat_alloc_context();
+        if (!ctx->fmt_ctx)
+            return AVERROR(ENOMEM);
+        ctx->fmt_ctx->pb = ctx->pb;
     }
 
-    TRACE(ctx, "opening %s", filename);
-    int ret = avformat_open_input(&ctx->fmt_ctx, filename, NULL, NULL);
+    AVDictionary *fmt_opts = NULL;
+    int64_t probesize = opts->probesize;
+    int64_t analyzeduration = opts->analyzeduration * AV_TIME_BASE;
+    if (opts->fast_open) {
+        if (!probesize)
+            probesize = FAST_OPEN_PROBESIZE;
+        if (!analyzeduration)
+            analyzeduration = FAST_OPEN_ANALYZEDURATION;
+    }
+    if (probesize)
+        av_dict_set_int(&fmt_opts, "probesize", probesize, 0);
+    if (analyzeduration)
+        av_dict_set_int(&fmt_opts, "analyzeduration", analyzeduration, 0);
+    ret = avformat_open_input(&ctx->fmt_ctx, filename, NULL, &fmt_opts);
+    av_dict_free(&fmt_opts);
     if (ret < 0) {
         LOG(ctx, ERROR, "Unable to open input file '%s'", filename);
         return ret;
     }
 
-    TRACE(ctx, "find stream info");
-    ret = avformat_find_stream_info(ctx->fmt_ctx, NULL);
-    if (ret < 0) {
-        LOG(ctx, ERROR, "Unable to find input stream information");
-        return ret;
+    if (info_cache && nmdi_info_cache_apply(info_cache, ctx->fmt_ctx)) {
+        ctx->info_cache = info_cache;
+    } else {
+        TRACE(ctx, "find stream info");
+        ret = avformat_find_stream_info(ctx->fmt_ctx, NULL);
+        if (ret < 0) {
+            LOG(ctx, ERROR, "Unable to find input stream information");
+            return ret;
+        }
     }
 
     TRACE(ctx, "find best stream");
-    ret = av_find_best_stream(ctx->fmt_ctx, media_type, opts->stream_idx, -1, NULL, 0);
+    if (ctx->info_cache)
+        ret = nmdi_info_cache_find_best_stream(ctx->info_cache, media_type, opts->stream_idx);
+    else
+        ret = av_find_best_stream(ctx->fmt_ctx, media_type, opts->stream_idx, -1, NULL, 0);
     if (ret < 0) {
         LOG(ctx, ERROR, "Unable to find a %s stream in the input file",
             av_get_media_type_string(media_type));
@@ -143,35 +244,185 @@ int nmdi_demuxing_init(void *log_ctx,
     LOG(ctx, INFO, "Selected %s stream %d",
         av_get_media_type_string(media_type), ctx->stream_idx);
 
+    ctx->outputs[0].stream = ctx->stream;
+    ctx->outputs[0].pkt_queue = pkt_queue;
+    ctx->nb_outputs = 1;
+
     /* Automatically discard all the other streams so we don't have to filter
      * them out most of the time */
     for (int i = 0; i < ctx->fmt_ctx->nb_streams; i++)
         if (i != ctx->stream_idx)
             ctx->fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
 
-    av_dump_format(ctx->fmt_ctx, 0, filename, 0);
+    if (!opts->fast_open || av_log_get_level() >= AV_LOG_DEBUG)
+        av_dump_format(ctx->fmt_ctx, 0, filename, 0);
+
+    if (info_cache && !ctx->info_cache) {
+        ret = nmdi_info_cache_save(info_cache, ctx->fmt_ctx, ctx->is_image);
+        if (ret < 0)
+            LOG(ctx, WARNING, "Unable to save the stream information: %s", av_err2str(ret));
+    }
+
+    /* Only the video streams are indexed since this is where the GOP
+     * structure matters when deciding to seek or not */
+    if (index && media_type == AVMEDIA_TYPE_VIDEO && !ctx->is_image) {
+        ret = nmdi_keyframe_index_setup(index, ctx->fmt_ctx, ctx->stream,
+                                        opts->keyframe_index_file);
+        if (ret < 0)
+            return ret;
+        ctx->index = index;
+    }
+
+    ctx->keyframes_only = opts->keyframes_only && media_type == AVMEDIA_TYPE_VIDEO && !ctx->is_image;
+
+    if (opts->max_cached_packets_size && !ctx->is_image) {
+        ctx->packet_cache = nmdi_packet_cache_alloc();
+        if (!ctx->packet_cache)
+            return AVERROR(ENOMEM);
+        ret = nmdi_packet_cache_init(ctx->packet_cache, ctx->log_ctx, opts->max_cached_packets_size);
+        if (ret < 0)
+            return ret;
+    }
 
     return 0;
 }
 
+int nmdi_demuxing_add_output(struct demuxing_ctx *ctx,
+                             struct msg_queue *pkt_queue,
+                             const struct nmdi_opts *opts)
+{
+    const enum AVMediaType media_type = nmdi_demuxing_get_media_type(opts);
+
+    if (ctx->nb_outputs == NMDI_DEMUXING_MAX_OUTPUTS)
+        return AVERROR(ENOMEM);
+
+    if (ctx->is_image) {
+        LOG(ctx, ERROR, "Images can not be demuxed into multiple streams");
+        return AVERROR(EINVAL);
+    }
+
+    int ret = ctx->info_cache ? nmdi_info_cache_find_best_stream(ctx->info_cache, media_type, opts->stream_idx)
+                              : av_find_best_stream(ctx->fmt_ctx, media_type, opts->stream_idx, -1, NULL, 0);
+    if (ret < 0) {
+        LOG(ctx, ERROR, "Unable to find a %s stream in the input file",
+            av_get_media_type_string(media_type));
+        return ret;
+    }
+    const int stream_idx = ret;
+
+    for (int i = 0; i < ctx->nb_outputs; i++) {
+        if (ctx->outputs[i].stream->index == stream_idx) {
+            LOG(ctx, ERROR, "Stream %d is already selected", stream_idx);
+            return AVERROR(EINVAL);
+        }
+    }
+
+    struct demuxing_output *out = &ctx->outputs[ctx->nb_outputs];
+    out->pending = av_calloc(MAX_PENDING_PACKETS, sizeof(*out->pending));
+    if (!out->pending)
+        return AVERROR(ENOMEM);
+    if (!ctx->outputs[0].pending) {
+        ctx->outputs[0].pending = av_calloc(MAX_PENDING_PACKETS, sizeof(*ctx->outputs[0].pending));
+        if (!ctx->outputs[0].pending)
+            return AVERROR(ENOMEM);
+    }
+
+    ctx->nb_prealloc_packets += opts->max_nb_packets + 2;
+    ret = nmdi_obj_pool_prealloc(ctx->pkt_pool, ctx->nb_prealloc_packets);
+    if (ret < 0)
+        return ret;
+
+    out->stream = ctx->fmt_ctx->streams[stream_idx];
+    out->stream->discard = AVDISCARD_DEFAULT;
+    out->pkt_queue = pkt_queue;
+    LOG(ctx, INFO, "Selected %s stream %d as output #%d",
+        av_get_media_type_string(media_type), stream_idx, ctx->nb_outputs);
+
+    return ctx->nb_outputs++;
+}
+
+static struct demuxing_output *find_output(struct demuxing_ctx *ctx, int stream_index)
+{
+    for (int i = 0; i < ctx->nb_outputs; i++)
+        if (ctx->outputs[i].stream->index == stream_index)
+            return &ctx->outputs[i];
+    return NULL;
+}
+
+static void index_packet(struct demuxing_ctx *ctx, const AVPacket *pkt)
+{
+    if (ctx->index && pkt->stream_index == ctx->stream->index)
+        nmdi_keyframe_index_add_packet(ctx->index, &ctx->index_run, pkt);
+}
+
+/* The replayed packets must be the only ones the outputs need */
+static int use_packet_cache(const struct demuxing_ctx *ctx)
+{
+    return ctx->packet_cache && ctx->nb_outputs == 1;
+}
+
+/*
+ * In keyframes only mode, jump over the packets separating two keyframes
+ * when the index knows where the next one is. This is only done with a
+ * single output since the other streams need their packets.
+ */
+static void skip_to_next_keyframe(struct demuxing_ctx *ctx)
+{
+    const int64_t kf = ctx->next_keyframe;
+
+    ctx->next_keyframe = AV_NOPTS_VALUE;
+    if (kf == AV_NOPTS_VALUE)
+        return;
+
+    TRACE(ctx, "jump to next keyframe at %s", av_ts2timestr(kf, &ctx->stream->time_base));
+    const int ret = avformat_seek_file(ctx->fmt_ctx, ctx->stream->index, kf, kf, kf, 0);
+    if (ret < 0) {
+        TRACE(ctx, "unable to jump to the next keyframe: %s", av_err2str(ret));
+        return;
+    }
+    if (ctx->index)
+        nmdi_keyframe_index_break(&ctx->index_run);
+    if (ctx->packet_cache)
+        nmdi_packet_cache_break(ctx->packet_cache);
+}
+
 static int pull_packet(struct demuxing_ctx *ctx, AVPacket *pkt)
 {
     int ret;
     AVFormatContext *fmt_ctx = ctx->fmt_ctx;
-    const int target_stream_idx = ctx->stream->index;
+
+    skip_to_next_keyframe(ctx);
 
     for (;;) {
+        const int64_t t0 = av_gettime_relative();
+        TRACE_BEGIN(ctx, "packet read");
         ret = av_read_frame(fmt_ctx, pkt);
+        TRACE_END(ctx, "packet read");
         if (ret < 0)
             break;
+        nmdi_stats_add_time(ctx->stats, STATS_TIMING_DEMUX, av_gettime_relative() - t0);
 
-        if (pkt->stream_index != target_stream_idx) {
-            TRACE(ctx, "pkt->idx=%d vs %d",
-                  pkt->stream_index, target_stream_idx);
+        if (!find_output(ctx, pkt->stream_index)) {
+            TRACE(ctx, "pkt->idx=%d is not selected", pkt->stream_index);
             av_packet_unref(pkt);
             continue;
         }
 
+        if (ctx->keyframes_only && pkt->stream_index == ctx->stream->index) {
+            if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+                TRACE(ctx, "skip non-key packet");
+                index_packet(ctx, pkt);
+                av_packet_unref(pkt);
+                continue;
+            }
+
+            int64_t kf;
+            const int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            if (ctx->index && ctx->nb_outputs == 1 && ts != AV_NOPTS_VALUE &&
+                nmdi_keyframe_index_get_next(ctx->index, ts, &kf))
+                ctx->next_keyframe = kf;
+        }
+
         break;
     }
 
@@ -179,18 +430,71 @@ static int pull_packet(struct demuxing_ctx *ctx, AVPacket *pkt)
     return ret;
 }
 
-void nmdi_demuxing_run(struct demuxing_ctx *ctx)
+/* Get the next packet, replayed from the packet cache after a seek into it */
+static int next_packet(struct demuxing_ctx *ctx, AVPacket *pkt)
 {
     int ret;
-    int in_err, out_err;
 
-    TRACE(ctx, "demuxing packets in queue %p", ctx->pkt_queue);
+    if (ctx->packet_cache) {
+        ret = nmdi_packet_cache_replay(ctx->packet_cache, pkt);
+        if (ret)
+            return FFMIN(ret, 0);
+    }
+
+    ret = pull_packet(ctx, pkt);
+    if (ret < 0)
+        return ret;
+
+    index_packet(ctx, pkt);
+
+    if (use_packet_cache(ctx)) {
+        ret = nmdi_packet_cache_add(ctx->packet_cache, pkt);
+        if (ret < 0) {
+            av_packet_unref(pkt);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static int seek_media(struct demuxing_ctx *ctx, int64_t seek_to)
+{
+    /* The packets read since the latest keyframe before the requested time
+     * are still around: the reading from the media resumes after them */
+    if (use_packet_cache(ctx)) {
+        const int64_t ts = av_rescale_q(seek_to, AV_TIME_BASE_Q, ctx->stream->time_base);
+        if (nmdi_packet_cache_seek(ctx->packet_cache, ts)) {
+            LOG(ctx, INFO, "Seek at ts=%s served by the packet cache", PTS2TIMESTR(seek_to));
+            ctx->next_keyframe = AV_NOPTS_VALUE;
+            return 0;
+        }
+    }
+
+    /* do actual seek so the following packet that will be pulled in
+     * this current thread will be at the (approximate) requested time */
+    LOG(ctx, INFO, "Seek in media at ts=%s", PTS2TIMESTR(seek_to));
+    TRACE_BEGIN(ctx, "seek");
+    int ret = avformat_seek_file(ctx->fmt_ctx, -1, INT64_MIN, seek_to, seek_to, 0);
+    TRACE_END(ctx, "seek");
+    if (ret < 0)
+        return ret;
+
+    ctx->next_keyframe = AV_NOPTS_VALUE;
+    if (ctx->index)
+        nmdi_keyframe_index_break(&ctx->index_run);
+    if (ctx->packet_cache)
+        nmdi_packet_cache_break(ctx->packet_cache);
+    return 0;
+}
+
+static int run_single_output(struct demuxing_ctx *ctx)
+{
+    int ret;
 
     for (;;) {
-        AVPacket pkt;
         struct message msg;
 
-        ret = av_thread_message_queue_recv(ctx->src_queue, &msg, AV_THREAD_MESSAGE_NONBLOCK);
+        ret = nmdi_msg_queue_recv(ctx->src_queue, &msg, AV_THREAD_MESSAGE_NONBLOCK);
         if (ret != AVERROR(EAGAIN)) {
             if (ret < 0)
                 break;
@@ -199,13 +503,9 @@ void nmdi_demuxing_run(struct demuxing_ctx *ctx)
                 av_assert0(!ctx->is_image);
 
                 /* Make later modules stop working ASAP */
-                av_thread_message_flush(ctx->pkt_queue);
+                nmdi_msg_queue_flush(ctx->pkt_queue);
 
-                /* do actual seek so the following packet that will be pulled in
-                 * this current thread will be at the (approximate) requested time */
-                const int64_t seek_to = *(int64_t *)msg.data;
-                LOG(ctx, INFO, "Seek in media at ts=%s", PTS2TIMESTR(seek_to));
-                ret = avformat_seek_file(ctx->fmt_ctx, -1, INT64_MIN, seek_to, seek_to, 0);
+                ret = seek_media(ctx, *(int64_t *)msg.data);
                 if (ret < 0) {
                     nmdi_msg_free_data(&msg);
                     break;
@@ -213,41 +513,291 @@ void nmdi_demuxing_run(struct demuxing_ctx *ctx)
             }
 
             /* Forward the message */
-            ret = av_thread_message_queue_send(ctx->pkt_queue, &msg, 0);
+            ret = nmdi_msg_queue_send(ctx->pkt_queue, &msg, 0);
             if (ret < 0) {
                 nmdi_msg_free_data(&msg);
                 break;
             }
         }
 
-        msg.type = MSG_PACKET;
-
-        ret = pull_packet(ctx, &pkt);
-        if (ret < 0)
+        AVPacket *pkt = nmdi_obj_pool_get(ctx->pkt_pool);
+        if (!pkt) {
+            ret = AVERROR(ENOMEM);
             break;
+        }
 
-        TRACE(ctx, "pulled a packet of size %d, sending to decoder", pkt.size);
-
-        msg.data = av_memdup(&pkt, sizeof(pkt));
-        if (!msg.data) {
-            av_packet_unref(&pkt);
+        ret = next_packet(ctx, pkt);
+        if (ret < 0) {
+            nmdi_obj_pool_put(ctx->pkt_pool, pkt);
             break;
         }
 
-        ret = av_thread_message_queue_send(ctx->pkt_queue, &msg, 0);
+        TRACE(ctx, "pulled a packet of size %d, sending to decoder", pkt->size);
+
+        msg = (struct message){
+            .type = MSG_PACKET,
+            .data = pkt,
+            .pool = ctx->pkt_pool,
+        };
+        ret = nmdi_msg_queue_send(ctx->pkt_queue, &msg, 0);
         TRACE(ctx, "sent packet to decoder, ret=%s", av_err2str(ret));
 
         if (ret < 0) {
-            av_packet_unref(&pkt);
-            av_freep(&msg.data);
+            nmdi_msg_free_data(&msg);
             if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
                 LOG(ctx, ERROR, "Unable to send packet to decoder: %s", av_err2str(ret));
             TRACE(ctx, "can't send pkt to decoder: %s", av_err2str(ret));
-            av_thread_message_queue_set_err_recv(ctx->pkt_queue, ret);
+            nmdi_msg_queue_set_err_recv(ctx->pkt_queue, ret);
             break;
         }
     }
 
+    return ret;
+}
+
+/*
+ * With multiple outputs, the demuxer must never block on the queue of an
+ * output: its consumer may be idle while another one is waiting for packets
+ * located further in the file. Packets for a full queue are held in a pending
+ * list instead, and dropped if it overflows while another output is starving.
+ */
+
+static void free_packet(struct demuxing_ctx *ctx, AVPacket **pktp)
+{
+    nmdi_obj_pool_put(ctx->pkt_pool, *pktp);
+    *pktp = NULL;
+}
+
+static void drop_pending(struct demuxing_ctx *ctx, struct demuxing_output *out)
+{
+    while (out->nb_pending) {
+        free_packet(ctx, &out->pending[out->pending_first]);
+        out->pending_first = (out->pending_first + 1) % MAX_PENDING_PACKETS;
+        out->nb_pending--;
+    }
+    out->pending_first = 0;
+}
+
+static void push_pending(struct demuxing_output *out, AVPacket *pkt)
+{
+    av_assert0(out->nb_pending < MAX_PENDING_PACKETS);
+    out->pending[(out->pending_first + out->nb_pending++) % MAX_PENDING_PACKETS] = pkt;
+}
+
+static void set_output_dead(struct demuxing_ctx *ctx, struct demuxing_output *out, int err)
+{
+    if (err != AVERROR_EOF && err != AVERROR_EXIT)
+        LOG(ctx, ERROR, "Unable to send packet to decoder: %s", av_err2str(err));
+    TRACE(ctx, "stream %d is not consumed anymore: %s", out->stream->index, av_err2str(err));
+    out->dead = 1;
+    drop_pending(ctx, out);
+    nmdi_msg_queue_set_err_recv(out->pkt_queue, err);
+}
+
+static int send_packet(struct demuxing_ctx *ctx, struct demuxing_output *out, AVPacket *pkt)
+{
+    struct message msg = {
+        .type = MSG_PACKET,
+        .data = pkt,
+        .pool = ctx->pkt_pool,
+    };
+    int ret = nmdi_msg_queue_send(out->pkt_queue, &msg, AV_THREAD_MESSAGE_NONBLOCK);
+    if (ret < 0 && ret != AVERROR(EAGAIN)) {
+        free_packet(ctx, &pkt);
+        set_output_dead(ctx, out, ret);
+    }
+    return ret;
+}
+
+static int flush_pending(struct demuxing_ctx *ctx)
+{
+    int nb_sent = 0;
+    for (int i = 0; i < ctx->nb_outputs; i++) {
+        struct demuxing_output *out = &ctx->outputs[i];
+        while (out->nb_pending) {
+            AVPacket *pkt = out->pending[out->pending_first];
+            const int ret = send_packet(ctx, out, pkt);
+            if (ret == AVERROR(EAGAIN) || out->dead)
+                break;
+            out->pending_first = (out->pending_first + 1) % MAX_PENDING_PACKETS;
+            out->nb_pending--;
+            nb_sent++;
+        }
+    }
+    return nb_sent;
+}
+
+static int forward_seek_message(struct demuxing_ctx *ctx, struct message *msg)
+{
+    av_assert0(msg->type == MSG_SEEK);
+
+    int ret = 0;
+    for (int i = 0; i < ctx->nb_outputs; i++) {
+        struct demuxing_output *out = &ctx->outputs[i];
+        if (out->dead)
+            continue;
+        struct message out_msg = {
+            .type = MSG_SEEK,
+            .data = av_memdup(msg->data, sizeof(int64_t)),
+        };
+        if (!out_msg.data) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        /* The queue has just been flushed so this is not blocking */
+        const int err = nmdi_msg_queue_send(out->pkt_queue, &out_msg, 0);
+        if (err < 0) {
+            nmdi_msg_free_data(&out_msg);
+            set_output_dead(ctx, out, err);
+        }
+    }
+    nmdi_msg_free_data(msg);
+    return ret;
+}
+
+static int is_starving(struct demuxing_output *out)
+{
+    return !out->dead && !out->nb_pending && !nmdi_msg_queue_nb_elems(out->pkt_queue);
+}
+
+/*
+ * Return 1 if packets were sent, 0 if some other progress was made,
+ * AVERROR(EAGAIN) if nothing can progress until a consumer makes room in its
+ * queue, or the status to end the run with.
+ */
+static int multi_outputs_step(struct demuxing_ctx *ctx)
+{
+    int ret;
+    struct message msg;
+
+    ret = nmdi_msg_queue_recv(ctx->src_queue, &msg, AV_THREAD_MESSAGE_NONBLOCK);
+    if (ret != AVERROR(EAGAIN)) {
+        if (ret < 0)
+            return ret;
+
+        if (msg.type == MSG_SEEK) {
+            /* Make later modules stop working ASAP */
+            for (int i = 0; i < ctx->nb_outputs; i++) {
+                nmdi_msg_queue_flush(ctx->outputs[i].pkt_queue);
+                drop_pending(ctx, &ctx->outputs[i]);
+                ctx->outputs[i].wait_keyframe = 0;
+            }
+            free_packet(ctx, &ctx->pkt);
+            ctx->eof = 0;
+
+            ret = seek_media(ctx, *(int64_t *)msg.data);
+            if (ret < 0) {
+                nmdi_msg_free_data(&msg);
+                return ret;
+            }
+        }
+
+        ret = forward_seek_message(ctx, &msg);
+        if (ret < 0)
+            return ret;
+    }
+
+    const int sent = flush_pending(ctx) > 0;
+
+    int nb_alive = 0, has_pending = 0;
+    for (int i = 0; i < ctx->nb_outputs; i++) {
+        nb_alive    += !ctx->outputs[i].dead;
+        has_pending |= ctx->outputs[i].nb_pending > 0;
+    }
+    if (!nb_alive)
+        return AVERROR_EXIT;
+
+    if (!ctx->pkt && !ctx->eof) {
+        AVPacket *pkt = nmdi_obj_pool_get(ctx->pkt_pool);
+        if (!pkt)
+            return AVERROR(ENOMEM);
+        ret = next_packet(ctx, pkt);
+        if (ret < 0) {
+            free_packet(ctx, &pkt);
+            if (ret == AVERROR_EOF) {
+                ctx->eof = 1;
+                return sent;
+            }
+            return ret;
+        }
+
+        struct demuxing_output *pkt_out = find_output(ctx, pkt->stream_index);
+        if (pkt_out->wait_keyframe && (pkt->flags & AV_PKT_FLAG_KEY))
+            pkt_out->wait_keyframe = 0;
+        if (pkt_out->dead || pkt_out->wait_keyframe) {
+            free_packet(ctx, &pkt);
+            return sent;
+        }
+        ctx->pkt = pkt;
+        ctx->pkt_out = pkt_out;
+    }
+
+    if (ctx->pkt) {
+        struct demuxing_output *pkt_out = ctx->pkt_out;
+
+        if (!pkt_out->nb_pending) {
+            ret = send_packet(ctx, pkt_out, ctx->pkt);
+            if (ret != AVERROR(EAGAIN)) {
+                ctx->pkt = NULL;
+                return 1;
+            }
+        }
+
+        if (pkt_out->nb_pending < MAX_PENDING_PACKETS) {
+            push_pending(pkt_out, ctx->pkt);
+            ctx->pkt = NULL;
+            return sent;
+        }
+
+        int starving = 0;
+        for (int i = 0; i < ctx->nb_outputs; i++)
+            starving |= &ctx->outputs[i] != pkt_out && is_starving(&ctx->outputs[i]);
+        if (starving) {
+            LOG(ctx, WARNING, "Stream %d is not consumed, dropping %d packets",
+                pkt_out->stream->index, pkt_out->nb_pending + 1);
+            drop_pending(ctx, pkt_out);
+            free_packet(ctx, &ctx->pkt);
+            pkt_out->wait_keyframe = pkt_out->stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
+            return sent;
+        }
+    } else if (ctx->eof && !has_pending) {
+        return AVERROR_EOF;
+    }
+
+    return sent ? 1 : AVERROR(EAGAIN);
+}
+
+static int run_multi_outputs(struct demuxing_ctx *ctx)
+{
+    int ret;
+    int poll_delay = 0;
+
+    for (;;) {
+        ret = multi_outputs_step(ctx);
+        if (ret > 0) {
+            poll_delay = 0;
+        } else if (ret == AVERROR(EAGAIN)) {
+            /* Nothing can progress until a consumer makes room in its queue */
+            av_usleep(poll_delay);
+            poll_delay = FFMIN(FFMAX(poll_delay * 2, 500), MAX_POLL_DELAY);
+        } else if (ret < 0) {
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static void end_run(struct demuxing_ctx *ctx, int ret)
+{
+    int in_err, out_err;
+
+    free_packet(ctx, &ctx->pkt);
+    for (int i = 0; i < ctx->nb_outputs; i++)
+        drop_pending(ctx, &ctx->outputs[i]);
+    ctx->eof = 0;
+    ctx->running = 0;
+
     if (ret < 0 && ret != AVERROR_EOF) {
         in_err = out_err = ret;
     } else {
@@ -256,9 +806,52 @@ void nmdi_demuxing_run(struct demuxing_ctx *ctx)
     }
     TRACE(ctx, "notify user with %s and decoder with %s",
           av_err2str(in_err), av_err2str(out_err));
-    av_thread_message_queue_set_err_send(ctx->src_queue, in_err);
-    av_thread_message_flush(ctx->src_queue);
-    av_thread_message_queue_set_err_recv(ctx->pkt_queue, out_err);
+    nmdi_msg_queue_set_err_send(ctx->src_queue, in_err);
+    nmdi_msg_queue_flush(ctx->src_queue);
+    for (int i = 0; i < ctx->nb_outputs; i++)
+        nmdi_msg_queue_set_err_recv(ctx->outputs[i].pkt_queue, out_err);
+}
+
+void nmdi_demuxing_run(struct demuxing_ctx *ctx)
+{
+    int ret;
+
+    TRACE(ctx, "demuxing packets in %d queue(s)", ctx->nb_outputs);
+
+    if (ctx->nb_outputs > 1)
+        ret = run_multi_outputs(ctx);
+    else
+        ret = run_single_output(ctx);
+
+    end_run(ctx, ret);
+}
+
+int nmdi_demuxing_step(struct demuxing_ctx *ctx)
+{
+    int ret;
+
+    if (!ctx->running) {
+        TRACE(ctx, "demuxing packets in %d queue(s) step by step", ctx->nb_outputs);
+        ctx->running = 1;
+
+        /* The multiple outputs logic never blocks, even with a single output */
+        struct demuxing_output *out = &ctx->outputs[0];
+        if (!out->pending) {
+            out->pending = av_calloc(MAX_PENDING_PACKETS, sizeof(*out->pending));
+            if (!out->pending) {
+                ret = AVERROR(ENOMEM);
+                end_run(ctx, ret);
+                return ret;
+            }
+        }
+    }
+
+    ret = multi_outputs_step(ctx);
+    if (ret > 0)
+        ret = 0;
+    else if (ret < 0 && ret != AVERROR(EAGAIN))
+        end_run(ctx, ret);
+    return ret;
 }
 
 void nmdi_demuxing_free(struct demuxing_ctx **ctxp)
@@ -266,6 +859,11 @@ void nmdi_demuxing_free(struct demuxing_ctx **ctxp)
     struct demuxing_ctx *ctx = *ctxp;
     if (!ctx)
         return;
+    for (int i = 0; i < ctx->nb_outputs; i++)
+        av_freep(&ctx->outputs[i].pending);
+    nmdi_packet_cache_free(&ctx->packet_cache);
     avformat_close_input(&ctx->fmt_ctx);
+    nmdi_io_closep(&ctx->pb);
+    nmdi_obj_pool_unref(&ctx->pkt_pool);
     av_freep(ctxp);
 }
@@ -23,26 +23,53 @@
 
 #include <stdint.h>
 #include <libavformat/avformat.h>
-#include <libavutil/threadmessage.h>
 
+#include "info_cache.h"
+#include "keyframe_index.h"
+#include "msg_queue.h"
 #include "opts.h"
+#include "stats.h"
+
+#define NMDI_DEMUXING_MAX_OUTPUTS 2
 
 struct demuxing_ctx *nmdi_demuxing_alloc(void);
 
 int nmdi_demuxing_init(void *log_ctx,
                        struct demuxing_ctx *ctx,
-                       AVThreadMessageQueue *src_queue,
-                       AVThreadMessageQueue *pkt_queue,
+                       struct msg_queue *src_queue,
+                       struct msg_queue *pkt_queue,
+                       struct keyframe_index *index,
+                       struct info_cache *info_cache,
+                       struct stats *stats,
                        const char *filename,
                        const struct nmdi_opts *opts);
 
+/**
+ * Select an additional stream to demux into its own packet queue, so that a
+ * single demuxer can feed several decoders. Must be called after
+ * nmdi_demuxing_init(), which sets up the output 0.
+ *
+ * Return the index of the new output, or a negative error code.
+ */
+int nmdi_demuxing_add_output(struct demuxing_ctx *ctx,
+                             struct msg_queue *pkt_queue,
+                             const struct nmdi_opts *opts);
+
 int64_t nmdi_demuxing_probe_duration(const struct demuxing_ctx *ctx);
-double nmdi_demuxing_probe_rotation(const struct demuxing_ctx *ctx);
-const AVStream *nmdi_demuxing_get_stream(const struct demuxing_ctx *ctx);
+double nmdi_demuxing_probe_rotation(const struct demuxing_ctx *ctx, int output);
+const AVStream *nmdi_demuxing_get_stream(const struct demuxing_ctx *ctx, int output);
 int nmdi_demuxing_is_image(const struct demuxing_ctx *ctx);
+enum AVMediaType nmdi_demuxing_get_media_type(const struct nmdi_opts *opts);
 
 void nmdi_demuxing_run(struct demuxing_ctx *ctx);
 
+/**
+ * Non-blocking alternative to nmdi_demuxing_run() for the scheduler (see
+ * scheduler.h): the run ends when the returned status is neither 0 nor
+ * AVERROR(EAGAIN).
+ */
+int nmdi_demuxing_step(struct demuxing_ctx *ctx);
+
 void nmdi_demuxing_free(struct demuxing_ctx **ctxp);
 
 #endif
@@ -18,15 +18,18 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
-#include <libavcodec/avfft.h>
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
 #include <libavformat/avformat.h>
+#include <libavutil/avassert.h>
 #include <libavutil/avstring.h>
+#include <libavutil/cpu.h>
 #include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
 #include <libavutil/timestamp.h>
 
 #include "nopemd.h"
@@ -34,32 +37,82 @@
 #include "mod_filtering.h"
 #include "log.h"
 #include "msg.h"
+#include "obj_pool.h"
+#include "playback_hint.h"
+#include "thread_budget.h"
+#include "trace.h"
+#include "yuv_rgba.h"
 
 #define AUDIO_NBITS      10
 #define AUDIO_NBSAMPLES  (1<<(AUDIO_NBITS))
 #define AUDIO_NBCHANNELS 2
 
+/* av_tx real transforms replace the deprecated avfft API */
+#define USE_TX_RDFT (LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(58, 0, 100))
+
+#if USE_TX_RDFT
+#include <libavutil/tx.h>
+#else
+#include <libavcodec/avfft.h>
+#endif
+
 struct filtering_ctx {
     void *log_ctx;
 
-    AVThreadMessageQueue *in_queue;
-    AVThreadMessageQueue *out_queue;
+    struct msg_queue *in_queue;
+    struct msg_queue *out_queue;
+    struct obj_pool *frame_pool;            // frames recycled along the pipeline
 
     AVCodecParameters *codecpar;
     char *filters;
+    char *hw_filters;                       // user filters applied to the VAAPI frames on the GPU
     int64_t max_pts;
     int sw_pix_fmt;
+    enum AVPixelFormat vaapi_pix_fmt;       // format of the VAAPI surfaces (AV_PIX_FMT_NONE to keep the decoded one)
+    int hw_filtering_disabled;              // the GPU filtergraph couldn't be built, the frames pass through
+    int drm_prime;                          // export the VAAPI frames as DRM PRIME descriptors
     int max_pixels;
+    int out_width, out_height;              // output dimensions honoring max_pixels (video only)
     int audio_texture;
+    int sample_rate;                        // output sample rate (0 to keep the decoded one)
     AVRational st_timebase;
+    int nb_threads;                         // threads reserved in the budget for the filtergraph or converter (video only)
+    int auto_threads;                       // no nb_threads set by the user
+    struct playback_hint *hint;             // set for video only
+    int64_t prev_pts;                       // pts of the previous frame received since the latest seek
+    struct stats *stats;
+
+    struct mem_budget *mem_budget;
+    int64_t frame_size;                     // size of the frames reported to the memory budget
+    int64_t filter_time;                    // time spent in the filtergraph for the current frame
+
+    int running;                            // between the first step and the end of the run
+    int nonblock;                           // never wait on the queues (scheduled steps)
+    int flushing;                           // the filtergraph is being drained
+    struct message pending;                 // message waiting for room in the out queue
+    int has_pending;
+
+    int native_rgba;                        // convert to RGBA/BGRA without a filtergraph when possible
+    struct yuv_rgba *yuv_rgba;              // built-in converter, created on first use
+    enum AVPixelFormat yuv_rgba_fmt;        // output format of the converter (AV_PIX_FMT_NONE if not used)
 
     AVFilterGraph *filter_graph;
+    int graph_reusable;                     // the graph can be kept across seeks
     enum AVPixelFormat last_frame_format;
     AVFilterContext *buffersink_ctx;        // sink of the graph (from where we pull)
     AVFilterContext *buffersrc_ctx;         // source of the graph (where we push)
     float *window_func_lut;                 // audio window function lookup table
+#if USE_TX_RDFT
+    AVTXContext *tx;                        // real discrete fourier transform context
+    av_tx_fn tx_fn;
+    float *tx_in;                           // windowed samples
+    AVComplexFloat *tx_out;                 // frequency bins
+#else
     RDFTContext *rdft;                      // real discrete fourier transform context
-    FFTSample *rdft_data[AUDIO_NBCHANNELS]; // real discrete fourier transform data for each channel
+    FFTSample *rdft_data;                   // real discrete fourier transform data
+#endif
+    float *fft_levels;                      // magnitudes of the bins and their downscaled versions
+    AVBufferPool *texture_pool;             // buffers of the audio textures
 };
 
 struct filtering_ctx *nmdi_filtering_alloc(void)
@@ -75,6 +128,68 @@ struct filtering_ctx *nmdi_filtering_alloc(void)
     return ctx;
 }
 
+/* Map the samples from [-1;1] to [0;1] */
+static void copy_waves(float * restrict dst, const float * restrict src, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = (src[i] + 1.f) / 2.f;
+}
+
+static void apply_window(float * restrict dst, const float * restrict src,
+                         const float * restrict window, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = src[i] * window[i];
+}
+
+/* Halve the number of values by averaging them by pairs */
+static void average_pairs(float * restrict dst, const float * restrict src, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = (src[2*i] + src[2*i + 1]) / 2.f;
+}
+
+/* Write each value n times in a row */
+static void repeat_values(float * restrict dst, const float * restrict src, int nb_values, int n)
+{
+    for (int i = 0; i < nb_values; i++)
+        for (int x = 0; x < n; x++)
+            dst[i*n + x] = src[i];
+}
+
+/*
+ * Window the samples and get the magnitude of their width first frequency
+ * bins (the highest frequency one is skipped since we only have space for N
+ * samples in the texture)
+ */
+static void get_magnitudes(struct filtering_ctx *ctx, float *dst, const float *samples,
+                           int nb_samples, int width, float scale)
+{
+#if USE_TX_RDFT
+    const AVComplexFloat *bins = ctx->tx_out;
+
+    apply_window(ctx->tx_in, samples, ctx->window_func_lut, nb_samples);
+    ctx->tx_fn(ctx->tx, ctx->tx_out, ctx->tx_in, sizeof(float));
+
+    for (int i = 0; i < width; i++)
+        dst[i] = sqrtf(bins[i].re * bins[i].re + bins[i].im * bins[i].im) * scale;
+#else
+    float *bins = ctx->rdft_data;
+
+    apply_window(bins, samples, ctx->window_func_lut, nb_samples);
+
+    /* After av_rdft_calc(), the bins is an array of successive real and
+     * imaginary floats, except for the first two bins which are respectively
+     * the real corresponding to the lower frequency and the real for the
+     * higher frequency (their imaginary parts are always 0). */
+    av_rdft_calc(ctx->rdft, bins);
+
+    dst[0] = fabsf(bins[0]) * scale;
+    for (int i = 1; i < width; i++)
+        dst[i] = sqrtf(bins[2*i] * bins[2*i] + bins[2*i + 1] * bins[2*i + 1]) * scale;
+#endif
+}
+
 /**
  * Convert an audio frame (PCM data) to a textured video frame with waves and
  * FFT lines
@@ -85,6 +200,8 @@ static void audio_frame_to_sound_texture(struct filtering_ctx *ctx, AVFrame *dst
     const int nb_samples = audio_src->nb_samples;
     const int width = nb_samples / 2;
     const float scale = 1.f / sqrt(AUDIO_NBSAMPLES/2 + 1);
+    const int lz = dst_video->linesize[0];
+    uint8_t *data = dst_video->data[0];
 
     TRACE(ctx, "transform audio filtered frame in %s @ ts=%s into an audio texture",
           av_get_sample_fmt_name(audio_src->format),
@@ -92,77 +209,117 @@ static void audio_frame_to_sound_texture(struct filtering_ctx *ctx, AVFrame *dst
 
     dst_video->pts = audio_src->pts;
 
-    memset(dst_video->data[0], 0, dst_video->height * dst_video->linesize[0]);
+    /* Every line is entirely written unless the frame is short */
+    if (width < dst_video->width)
+        memset(data, 0, dst_video->height * lz);
 
-    /* Copy waves */
     for (int ch = 0; ch < AUDIO_NBCHANNELS; ch++) {
-        const int lz = dst_video->linesize[0];
-        float *samples_dst = (float *)(dst_video->data[0] + ch * lz);
         const float *samples_src = (const float *)audio_src->extended_data[ch];
 
-        for (int i = 0; i < width; i++)
-            samples_dst[i] = (samples_src[width/2 + i] + 1.f) / 2.f;
-    }
+        /* Copy waves */
+        copy_waves((float *)(data + ch * lz), samples_src + width/2, width);
 
-    /* Fourier transform */
-    for (int ch = 0; ch < AUDIO_NBCHANNELS; ch++) {
-        const int lz = dst_video->linesize[0];
-        float *fft_dst = (float *)(dst_video->data[0] + (AUDIO_NBCHANNELS + ch) * lz);
-        const float *samples_src = (const float *)audio_src->extended_data[ch];
-        float *bins = ctx->rdft_data[ch];
-
-        /* Apply window function to input samples */
-        for (int i = 0; i < nb_samples; i++)
-            bins[i] = samples_src[i] * ctx->window_func_lut[i];
-
-        /* Run transform.
-         *
-         * After av_rdft_calc(), the bins is an array of successive real and
-         * imaginary floats, except for the first two bins which are
-         * respectively the real corresponding to the lower frequency and the
-         * real for the higher frequency.
-         *
-         * The imaginary parts for these two frequencies are always 0 so they
-         * are assumed as such. This trick allowed an in-place processing for
-         * the N samples into N+1 complex.
-         */
-        av_rdft_calc(ctx->rdft, bins);
-
-        /* Get magnitude of frequency bins and copy result into texture
-         *
-         * Note: since we only have space for N samples in the texture, we skip
-         * the last complex (highest frequency one).
-         */
-#define MAGNITUDE(re, im) (hypotf(re, im) * scale)
-        fft_dst[0] = MAGNITUDE(bins[0], 0); // lowest frequency
-        for (int i = 1; i < width; i++)
-            fft_dst[i] = MAGNITUDE(bins[2*i], bins[2*i + 1]);
-    }
-
-    /* Downscaled versions of the FFT */
-    for (int i = 0; i < AUDIO_NBITS-1; i++) {
-        for (int ch = 0; ch < AUDIO_NBCHANNELS; ch++) {
-            const int lz = dst_video->linesize[0];
-            const int source_line = (i + 1)*AUDIO_NBCHANNELS + ch;
-            float *fft_src = (float *)(dst_video->data[0] +  source_line                     * lz);
-            float *fft_dst = (float *)(dst_video->data[0] + (source_line + AUDIO_NBCHANNELS) * lz);
-
-            const int source_step = 1 << i;
-            const int nb_identical_values = source_step << 1;
+        /* Fourier transform */
+        float *fft = ctx->fft_levels;
+        get_magnitudes(ctx, fft, samples_src, nb_samples, width, scale);
+        memcpy(data + (AUDIO_NBCHANNELS + ch) * lz, fft, width * sizeof(*fft));
+
+        /* Downscaled versions of the FFT: each level is computed from the
+         * previous one and its values are repeated to span the line */
+        for (int i = 0; i < AUDIO_NBITS-1; i++) {
+            const int dst_line = (i + 2)*AUDIO_NBCHANNELS + ch;
+            const int nb_identical_values = 2 << i;
             const int nb_dest_pixels = width / nb_identical_values;
+            float *level = fft + (width >> i);
 
-            TRACE(ctx, "line %2d->%2d: %3d different pixels (copied %3dx) as destination, step source: %d",
-                  source_line, source_line + AUDIO_NBCHANNELS, nb_dest_pixels, nb_identical_values, source_step);
+            average_pairs(level, fft, nb_dest_pixels);
+            repeat_values((float *)(data + dst_line * lz), level, nb_dest_pixels, nb_identical_values);
+            fft = level;
+        }
+    }
+}
 
-            for (int j = 0; j < nb_dest_pixels; j++) {
-                const float avg = (fft_src[ j*2      * source_step] +
-                                   fft_src[(j*2 + 1) * source_step]) / 2.f;
+/* Filters keeping no state from one frame to the next */
+static const char * const stateless_filters[] = {
+    "buffer", "buffersink", "copy", "crop", "eq", "format", "hflip", "hue",
+    "lut", "lutrgb", "lutyuv", "negate", "null", "pad", "scale", "scale_vaapi",
+    "setdar", "setsar", "settb", "transpose", "vflip",
+};
 
-                for (int x = 0; x < nb_identical_values; x++)
-                    fft_dst[j*nb_identical_values + x] = avg;
-            }
+static int is_stateless_graph(const AVFilterGraph *graph)
+{
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        const char *name = graph->filters[i]->filter->name;
+        int found = 0;
+        for (size_t j = 0; j < FF_ARRAY_ELEMS(stateless_filters) && !found; j++)
+            found = !strcmp(name, stateless_filters[j]);
+        if (!found)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Whether the dimensions of the frames exceed max_pixels, or their format
+ * differs from vaapi_pix_fmt, in which case scale_vaapi is inserted.
+ */
+static int need_hw_scaling(const struct filtering_ctx *ctx, const AVFrame *frame)
+{
+    const AVHWFramesContext *fctx = (const AVHWFramesContext *)frame->hw_frames_ctx->data;
+    return frame->width > ctx->out_width || frame->height > ctx->out_height ||
+           (ctx->vaapi_pix_fmt != AV_PIX_FMT_NONE && ctx->vaapi_pix_fmt != fctx->sw_format);
+}
+
+/*
+ * Whether the hardware frames go through a filtergraph running on the GPU.
+ * Only the VAAPI frames can: the VideoToolbox decoder scales and converts its
+ * frames itself (see max_pixels and vt_pix_fmt), and libavfilter has no
+ * filter able to process the MediaCodec ones.
+ */
+static int need_hw_filtering(const struct filtering_ctx *ctx, const AVFrame *frame)
+{
+    if (!HAVE_VAAPI_HWACCEL || frame->format != AV_PIX_FMT_VAAPI || !frame->hw_frames_ctx ||
+        ctx->hw_filtering_disabled)
+        return 0;
+    return ctx->hw_filters || need_hw_scaling(ctx, frame);
+}
+
+/*
+ * Whether the only work left to the filtergraph would be the conversion to
+ * the RGBA or BGRA output, which the built-in converter then does instead.
+ */
+static enum AVPixelFormat get_yuv_rgba_fmt(const struct filtering_ctx *ctx, const AVFrame *frame)
+{
+    if (!ctx->native_rgba || ctx->codecpar->codec_type != AVMEDIA_TYPE_VIDEO ||
+        ctx->filters || ctx->max_pixels ||
+        (ctx->sw_pix_fmt != NMD_PIXFMT_RGBA && ctx->sw_pix_fmt != NMD_PIXFMT_BGRA))
+        return AV_PIX_FMT_NONE;
+    const enum AVPixelFormat fmt = nmdi_pix_fmts_nmd2ff(ctx->sw_pix_fmt);
+    return nmdi_yuv_rgba_supported(frame, fmt) ? fmt : AV_PIX_FMT_NONE;
+}
+
+static int setup_yuv_rgba(struct filtering_ctx *ctx, enum AVPixelFormat fmt)
+{
+    if (!ctx->yuv_rgba) {
+        /* Unlike the filtergraph, the converter is sliced over one thread
+         * per core by default, within the budget */
+        if (ctx->auto_threads) {
+            nmdi_thread_budget_release(ctx->nb_threads);
+            ctx->nb_threads = nmdi_thread_budget_acquire(av_cpu_count());
+        }
+        ctx->yuv_rgba = nmdi_yuv_rgba_alloc();
+        if (!ctx->yuv_rgba)
+            return AVERROR(ENOMEM);
+        int ret = nmdi_yuv_rgba_init(ctx->yuv_rgba, ctx->log_ctx, ctx->nb_threads);
+        if (ret < 0) {
+            nmdi_yuv_rgba_free(&ctx->yuv_rgba);
+            return ret;
         }
     }
+    TRACE(ctx, "convert %s frames to %s without filtergraph",
+          av_get_pix_fmt_name(ctx->last_frame_format), av_get_pix_fmt_name(fmt));
+    ctx->yuv_rgba_fmt = fmt;
+    return 0;
 }
 
 /**
@@ -170,7 +327,7 @@ static void audio_frame_to_sound_texture(struct filtering_ctx *ctx, AVFrame *dst
  * request a pixel format we want, and let libavfilter insert the necessary
  * scaling filter (typically, an automatic conversion from yuv420p to rgb32).
  */
-static int setup_filtergraph(struct filtering_ctx *ctx)
+static int setup_filtergraph(struct filtering_ctx *ctx, const AVFrame *frame)
 {
     int ret = 0;
     char args[512];
@@ -181,10 +338,17 @@ static int setup_filtergraph(struct filtering_ctx *ctx)
     const AVRational time_base = ctx->st_timebase;
 
     avfilter_graph_free(&ctx->filter_graph);
+    ctx->graph_reusable = 0;
+    ctx->yuv_rgba_fmt = AV_PIX_FMT_NONE;
 
-    if (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)
+    const int hw_filtering = need_hw_filtering(ctx, frame);
+    if ((desc->flags & AV_PIX_FMT_FLAG_HWACCEL) && !hw_filtering)
         return 0;
 
+    const enum AVPixelFormat yuv_rgba_fmt = get_yuv_rgba_fmt(ctx, frame);
+    if (yuv_rgba_fmt != AV_PIX_FMT_NONE)
+        return setup_yuv_rgba(ctx, yuv_rgba_fmt);
+
     outputs = avfilter_inout_alloc();
     inputs  = avfilter_inout_alloc();
 
@@ -198,7 +362,7 @@ static int setup_filtergraph(struct filtering_ctx *ctx)
         goto end;
     }
 
-    av_opt_set_int(ctx->filter_graph, "threads", 1, 0);
+    av_opt_set_int(ctx->filter_graph, "threads", FFMAX(ctx->nb_threads, 1), 0);
 
     inputs->name  = av_strdup("out");
     outputs->name = av_strdup("in");
@@ -239,6 +403,19 @@ static int setup_filtergraph(struct filtering_ctx *ctx)
         goto end;
     }
 
+    if (hw_filtering) {
+        AVBufferSrcParameters *par = av_buffersrc_parameters_alloc();
+        if (!par) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        par->hw_frames_ctx = frame->hw_frames_ctx;
+        ret = av_buffersrc_parameters_set(ctx->buffersrc_ctx, par);
+        av_free(par);
+        if (ret < 0)
+            goto end;
+    }
+
     /* create buffer filter sink (where we pull the frame) */
     ret = avfilter_graph_create_filter(&ctx->buffersink_ctx, buffersink,
                                        inputs->name, NULL, NULL, ctx->filter_graph);
@@ -251,7 +428,17 @@ static int setup_filtergraph(struct filtering_ctx *ctx)
 
     /* define the output of the graph */
     snprintf(args, sizeof(args), "sws_flags=+full_chroma_int;%s", ctx->filters ? ctx->filters : "");
-    if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+    if (hw_filtering) {
+        /* The frames stay on the GPU: the software filters and pixel format
+         * are replaced by their hardware counterparts */
+        snprintf(args, sizeof(args), "%s", ctx->hw_filters ? ctx->hw_filters : "");
+        if (need_hw_scaling(ctx, frame)) {
+            av_strlcatf(args, sizeof(args), "%sscale_vaapi=w=%d:h=%d", SEP(args), ctx->out_width, ctx->out_height);
+            if (ctx->vaapi_pix_fmt != AV_PIX_FMT_NONE)
+                av_strlcatf(args, sizeof(args), ":format=%s", av_get_pix_fmt_name(ctx->vaapi_pix_fmt));
+        }
+        av_strlcatf(args, sizeof(args), "%ssettb=tb=%d/%d", SEP(args), time_base.num, time_base.den);
+    } else if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
         const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(ctx->last_frame_format);
         enum AVPixelFormat sw_pix_fmt = nmdi_pix_fmts_nmd2ff(ctx->sw_pix_fmt);
         if (ctx->sw_pix_fmt == NMD_PIXFMT_AUTO) {
@@ -267,21 +454,21 @@ static int setup_filtergraph(struct filtering_ctx *ctx)
         const enum AVPixelFormat pix_fmt = !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL) ? sw_pix_fmt : ctx->last_frame_format;
 
         if (ctx->max_pixels) {
-            int w = codecpar->width, h = codecpar->height;
-            nmdi_update_dimensions(&w, &h, ctx->max_pixels);
             av_strlcatf(args, sizeof(args),
                         "%sscale=%d:%d:force_original_aspect_ratio=decrease",
-                        SEP(args), w, h);
+                        SEP(args), ctx->out_width, ctx->out_height);
         }
 
         av_strlcatf(args, sizeof(args), "%sformat=%s, settb=tb=%d/%d", SEP(args), av_get_pix_fmt_name(pix_fmt),
                     time_base.num, time_base.den);
-    } else if (ctx->audio_texture) {
-        av_strlcatf(args, sizeof(args), "%saformat=sample_fmts=fltp:channel_layouts=stereo, asetnsamples=%d, asettb=tb=%d/%d",
-                    SEP(args), AUDIO_NBSAMPLES, time_base.num, time_base.den);
     } else {
-        av_strlcatf(args, sizeof(args), "%saformat=sample_fmts=flt:channel_layouts=stereo, asettb=tb=%d/%d",
-                    SEP(args), time_base.num, time_base.den);
+        av_strlcatf(args, sizeof(args), "%saformat=sample_fmts=%s:channel_layouts=stereo",
+                    SEP(args), ctx->audio_texture ? "fltp" : "flt");
+        if (ctx->sample_rate)
+            av_strlcatf(args, sizeof(args), ":sample_rates=%d", ctx->sample_rate);
+        if (ctx->audio_texture)
+            av_strlcatf(args, sizeof(args), ", asetnsamples=%d", AUDIO_NBSAMPLES);
+        av_strlcatf(args, sizeof(args), ", asettb=tb=%d/%d", time_base.num, time_base.den);
     }
 
     TRACE(ctx, "graph buffer sink args: %s", args);
@@ -298,18 +485,29 @@ static int setup_filtergraph(struct filtering_ctx *ctx)
     if (ret < 0)
         goto end;
 
+    /* Audio graphs are not kept since they buffer samples (asetnsamples) */
+    ctx->graph_reusable = codecpar->codec_type == AVMEDIA_TYPE_VIDEO && is_stateless_graph(ctx->filter_graph);
+    TRACE(ctx, "filtergraph %s be kept across seeks", ctx->graph_reusable ? "can" : "can not");
+
 end:
     avfilter_inout_free(&inputs);
     avfilter_inout_free(&outputs);
+
+    /* The GPU filters depend on the driver: if they are not available, the
+     * hardware frames are returned unfiltered as if no graph was needed */
+    if (ret < 0 && hw_filtering) {
+        LOG(ctx, WARNING, "Unable to filter the hardware frames on the GPU (%s), "
+            "passing them through", av_err2str(ret));
+        avfilter_graph_free(&ctx->filter_graph);
+        ctx->graph_reusable = 0;
+        ctx->hw_filtering_disabled = 1;
+        ret = 0;
+    }
     return ret;
 }
 
-static AVFrame *get_audio_frame(void)
+static int get_audio_frame(struct filtering_ctx *ctx, AVFrame *frame)
 {
-    AVFrame *frame = av_frame_alloc();
-    if (!frame)
-        return NULL;
-
     frame->format = AV_PIX_FMT_RGB32;
 
     frame->width  = AUDIO_NBSAMPLES/2;      // samples are float (32 bits), pix fmt is rgb32 (32 bits as well)
@@ -319,14 +517,15 @@ static AVFrame *get_audio_frame(void)
      * + AUDIO_NBITS-1 AUDIO_NBCHANNELS (fft lines downscaled) */
     frame->height = (1 + AUDIO_NBITS) * AUDIO_NBCHANNELS;
 
-    if (av_frame_get_buffer(frame, 16) < 0) {
-        av_frame_free(&frame);
-        return NULL;
-    }
-
-    memset(frame->data[0], 0, frame->height * frame->linesize[0]);
+    /* The buffers (never written to by the user) are recycled from one
+     * texture to the next */
+    frame->buf[0] = av_buffer_pool_get(ctx->texture_pool);
+    if (!frame->buf[0])
+        return AVERROR(ENOMEM);
+    frame->data[0] = frame->buf[0]->data;
+    frame->linesize[0] = frame->width * 4;
 
-    return frame;
+    return 0;
 }
 
 static char *update_filters_str(char *filters, const char *append)
@@ -344,8 +543,12 @@ static char *update_filters_str(char *filters, const char *append)
 
 int nmdi_filtering_init(void *log_ctx,
                         struct filtering_ctx *ctx,
-                        AVThreadMessageQueue *in_queue,
-                        AVThreadMessageQueue *out_queue,
+                        struct msg_queue *in_queue,
+                        struct msg_queue *out_queue,
+                        struct obj_pool *frame_pool,
+                        struct playback_hint *hint,
+                        struct stats *stats,
+                        struct mem_budget *mem_budget,
                         const AVStream *stream,
                         const AVCodecContext *avctx,
                         double media_rotation,
@@ -354,9 +557,17 @@ int nmdi_filtering_init(void *log_ctx,
     ctx->log_ctx = log_ctx;
     ctx->in_queue  = in_queue;
     ctx->out_queue = out_queue;
+    ctx->frame_pool = frame_pool;
+    ctx->stats = stats;
+    ctx->mem_budget = mem_budget;
     ctx->sw_pix_fmt = o->sw_pix_fmt;
+    ctx->vaapi_pix_fmt = o->vaapi_pix_fmt ? av_get_pix_fmt(o->vaapi_pix_fmt) : AV_PIX_FMT_NONE;
+    ctx->drm_prime = o->drm_prime;
     ctx->max_pixels = o->max_pixels;
     ctx->audio_texture = o->audio_texture;
+    ctx->sample_rate = o->sample_rate;
+    ctx->native_rgba = o->native_rgba;
+    ctx->yuv_rgba_fmt = AV_PIX_FMT_NONE;
     ctx->st_timebase = stream->time_base;
     ctx->max_pts = o->end_time64 > 0 ? av_rescale_q(o->end_time64, AV_TIME_BASE_Q, ctx->st_timebase) : AV_NOPTS_VALUE;
 
@@ -364,6 +575,19 @@ int nmdi_filtering_init(void *log_ctx,
     if (ret < 0)
         return ret;
 
+    /* The decoder may already output reduced frames (see max_pixels), so the
+     * target dimensions are derived from the stream ones */
+    ctx->out_width  = stream->codecpar->width;
+    ctx->out_height = stream->codecpar->height;
+    nmdi_update_dimensions(&ctx->out_width, &ctx->out_height, ctx->max_pixels);
+
+    /* Slice threading of the video filters, scaling in particular */
+    if (ctx->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        ctx->nb_threads = nmdi_thread_budget_acquire(o->nb_threads ? o->nb_threads : 1);
+        ctx->auto_threads = !o->nb_threads;
+        ctx->hint = hint;
+    }
+
     if (ctx->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && ctx->audio_texture) {
         /* Pre-calc windowing function */
         ctx->window_func_lut = av_malloc_array(AUDIO_NBSAMPLES, sizeof(*ctx->window_func_lut));
@@ -373,15 +597,37 @@ int nmdi_filtering_init(void *log_ctx,
             ctx->window_func_lut[i] = .5f * (1 - cos(2*M_PI*i / (AUDIO_NBSAMPLES-1)));
 
         /* Real Discrete Fourier Transform context (Real to Complex) */
+#if USE_TX_RDFT
+        const float tx_scale = 1.f;
+        ret = av_tx_init(&ctx->tx, &ctx->tx_fn, AV_TX_FLOAT_RDFT, 0, AUDIO_NBSAMPLES, &tx_scale, 0);
+        if (ret < 0) {
+            LOG(ctx, ERROR, "Unable to init RDFT context with N=%d", AUDIO_NBSAMPLES);
+            return ret;
+        }
+
+        ctx->tx_in  = av_calloc(AUDIO_NBSAMPLES, sizeof(*ctx->tx_in));
+        ctx->tx_out = av_calloc(AUDIO_NBSAMPLES/2 + 1, sizeof(*ctx->tx_out));
+        if (!ctx->tx_in || !ctx->tx_out)
+            return AVERROR(ENOMEM);
+#else
         ctx->rdft = av_rdft_init(AUDIO_NBITS, DFT_R2C);
         if (!ctx->rdft) {
             LOG(ctx, ERROR, "Unable to init RDFT context with N=%d", AUDIO_NBITS);
             return AVERROR(ENOMEM);
         }
 
-        ctx->rdft_data[0] = av_calloc(AUDIO_NBSAMPLES, sizeof(*ctx->rdft_data[0]));
-        ctx->rdft_data[1] = av_calloc(AUDIO_NBSAMPLES, sizeof(*ctx->rdft_data[1]));
-        if (!ctx->rdft_data[0] || !ctx->rdft_data[1])
+        ctx->rdft_data = av_calloc(AUDIO_NBSAMPLES, sizeof(*ctx->rdft_data));
+        if (!ctx->rdft_data)
+            return AVERROR(ENOMEM);
+#endif
+
+        ctx->fft_levels = av_calloc(AUDIO_NBSAMPLES, sizeof(*ctx->fft_levels));
+        if (!ctx->fft_levels)
+            return AVERROR(ENOMEM);
+
+        const int texture_height = (1 + AUDIO_NBITS) * AUDIO_NBCHANNELS;
+        ctx->texture_pool = av_buffer_pool_init(AUDIO_NBSAMPLES/2 * 4 * texture_height, NULL);
+        if (!ctx->texture_pool)
             return AVERROR(ENOMEM);
     }
 
@@ -391,6 +637,12 @@ int nmdi_filtering_init(void *log_ctx,
             return AVERROR(ENOMEM);
     }
 
+    if (o->hw_filters) {
+        ctx->hw_filters = av_strdup(o->hw_filters);
+        if (!ctx->hw_filters)
+            return AVERROR(ENOMEM);
+    }
+
     if (ctx->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && o->autorotate) {
         if (fabs(media_rotation - 90) < 1.0)
             ctx->filters = update_filters_str(ctx->filters, "transpose=clock");
@@ -404,16 +656,83 @@ int nmdi_filtering_init(void *log_ctx,
     return 0;
 }
 
+static void free_frame(struct filtering_ctx *ctx, AVFrame **framep)
+{
+    nmdi_obj_pool_put(ctx->frame_pool, *framep);
+    *framep = NULL;
+}
+
+/* Send a message to the out queue, or keep it for the next step if the queue
+ * is full and we are not allowed to wait */
+static int send_msg(struct filtering_ctx *ctx, struct message *msg)
+{
+    av_assert0(!ctx->has_pending);
+    const int ret = nmdi_msg_queue_send(ctx->out_queue, msg, ctx->nonblock ? AV_THREAD_MESSAGE_NONBLOCK : 0);
+    TRACE_COUNTER(ctx, "sink_queue", nmdi_msg_queue_nb_elems(ctx->out_queue));
+    if (ret == AVERROR(EAGAIN)) {
+        ctx->pending = *msg;
+        ctx->has_pending = 1;
+        return 0;
+    }
+    return ret;
+}
+
+static void drop_pending(struct filtering_ctx *ctx)
+{
+    if (!ctx->has_pending)
+        return;
+    nmdi_msg_free_data(&ctx->pending);
+    ctx->has_pending = 0;
+}
+
+/*
+ * Replace the VAAPI frame with its DRM PRIME mapping. The mapped frame holds a
+ * reference to the surface, which is thus kept alive until the user releases
+ * the frame, and the exported DMA-BUF are closed along with it.
+ */
+static int map_drm_prime(struct filtering_ctx *ctx, AVFrame *frame)
+{
+    AVFrame *mapped = av_frame_alloc();
+    if (!mapped)
+        return AVERROR(ENOMEM);
+
+    mapped->format = AV_PIX_FMT_DRM_PRIME;
+    int ret = av_hwframe_map(mapped, frame, AV_HWFRAME_MAP_READ);
+    if (ret < 0) {
+        LOG(ctx, ERROR, "unable to export the VAAPI surface as DMA-BUF: %s", av_err2str(ret));
+        av_frame_free(&mapped);
+        return ret;
+    }
+
+    av_frame_unref(frame);
+    av_frame_move_ref(frame, mapped);
+    av_frame_free(&mapped);
+    return 0;
+}
+
 static int send_frame(struct filtering_ctx *ctx, AVFrame *frame)
 {
     int ret;
     struct message msg = {
         .type = MSG_FRAME,
         .data = frame,
+        .pool = ctx->frame_pool,
     };
 
+    if (HAVE_VAAPI_HWACCEL && ctx->drm_prime && frame->format == AV_PIX_FMT_VAAPI) {
+        ret = map_drm_prime(ctx, frame);
+        if (ret < 0)
+            return ret;
+    }
+
+    const int64_t frame_size = nmdi_get_frame_size(frame);
+    if (frame_size != ctx->frame_size) {
+        ctx->frame_size = frame_size;
+        nmdi_mem_budget_set_frame_size(ctx->mem_budget, MEM_BUDGET_SINK, frame_size);
+    }
+
     TRACE(ctx, "sending filtered frame to the sink");
-    ret = av_thread_message_queue_send(ctx->out_queue, &msg, 0);
+    ret = send_msg(ctx, &msg);
     if (ret < 0) {
         if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
             LOG(ctx, ERROR, "unable to send frame: %s", av_err2str(ret));
@@ -428,7 +747,11 @@ static int push_frame(struct filtering_ctx *ctx, AVFrame *inframe)
 
     TRACE(ctx, "pushing frame %p into filtergraph", inframe);
 
+    const int64_t t0 = av_gettime_relative();
+    TRACE_BEGIN(ctx, "filter push");
     ret = av_buffersrc_write_frame(ctx->buffersrc_ctx, inframe);
+    TRACE_END(ctx, "filter push");
+    ctx->filter_time = av_gettime_relative() - t0;
     if (ret < 0) {
         LOG(ctx, ERROR, "unable to push frame into filtergraph: %s", av_err2str(ret));
         return ret;
@@ -437,6 +760,32 @@ static int push_frame(struct filtering_ctx *ctx, AVFrame *inframe)
     return 0;
 }
 
+static int convert_send_frame(struct filtering_ctx *ctx, AVFrame *inframe)
+{
+    AVFrame *converted = nmdi_obj_pool_get(ctx->frame_pool);
+    if (!converted)
+        return AVERROR(ENOMEM);
+
+    const int64_t t0 = av_gettime_relative();
+    TRACE_BEGIN(ctx, "yuv to rgba");
+    int ret = nmdi_yuv_rgba_convert(ctx->yuv_rgba, converted, inframe, ctx->yuv_rgba_fmt);
+    TRACE_END(ctx, "yuv to rgba");
+    ctx->filter_time = av_gettime_relative() - t0;
+    if (ret < 0) {
+        LOG(ctx, ERROR, "unable to convert frame to %s: %s",
+            av_get_pix_fmt_name(ctx->yuv_rgba_fmt), av_err2str(ret));
+        free_frame(ctx, &converted);
+        return ret;
+    }
+
+    ret = send_frame(ctx, converted);
+    if (ret < 0) {
+        free_frame(ctx, &converted);
+        return ret;
+    }
+    return 0;
+}
+
 static int pull_frame(struct filtering_ctx *ctx, AVFrame *outframe)
 {
     int ret;
@@ -446,7 +795,7 @@ static int pull_frame(struct filtering_ctx *ctx, AVFrame *outframe)
     TRACE(ctx, "pulling frame from filtergraph");
 
     if (do_audio_texture) {
-        filtered_frame = av_frame_alloc();
+        filtered_frame = nmdi_obj_pool_get(ctx->frame_pool);
         if (!filtered_frame)
             return AVERROR(ENOMEM);
     }
@@ -454,7 +803,7 @@ static int pull_frame(struct filtering_ctx *ctx, AVFrame *outframe)
     ret = av_buffersink_get_frame(ctx->buffersink_ctx, filtered_frame);
     if (ret < 0) {
         if (do_audio_texture)
-            av_frame_free(&filtered_frame);
+            free_frame(ctx, &filtered_frame);
         if (ret != AVERROR_EOF && ret != AVERROR(EAGAIN))
             LOG(ctx, ERROR, "unable to pull frame from filtergraph: %s", av_err2str(ret));
         return ret;
@@ -467,11 +816,13 @@ static int pull_frame(struct filtering_ctx *ctx, AVFrame *outframe)
           av_ts2timestr(filtered_frame->pts, &ctx->st_timebase));
 
     if (do_audio_texture) {
-        AVFrame *audio_texture_frame = get_audio_frame();
-        audio_frame_to_sound_texture(ctx, audio_texture_frame, filtered_frame);
-        av_frame_free(&filtered_frame);
-        av_frame_move_ref(outframe, audio_texture_frame);
-        av_free(audio_texture_frame);
+        ret = get_audio_frame(ctx, outframe);
+        if (ret < 0) {
+            free_frame(ctx, &filtered_frame);
+            return ret;
+        }
+        audio_frame_to_sound_texture(ctx, outframe, filtered_frame);
+        free_frame(ctx, &filtered_frame);
     }
 
     return 0;
@@ -481,145 +832,261 @@ static int pull_send_frame(struct filtering_ctx *ctx)
 {
     int ret;
 
-    AVFrame *filtered_frame = av_frame_alloc();
+    AVFrame *filtered_frame = nmdi_obj_pool_get(ctx->frame_pool);
     if (!filtered_frame)
         return AVERROR(ENOMEM);
 
+    const int64_t t0 = av_gettime_relative();
+    TRACE_BEGIN(ctx, "filter pull");
     ret = pull_frame(ctx, filtered_frame);
+    TRACE_END(ctx, "filter pull");
+    ctx->filter_time += av_gettime_relative() - t0;
 
     if (ret < 0) {
-        av_frame_free(&filtered_frame);
+        free_frame(ctx, &filtered_frame);
         return ret;
     }
 
     ret = send_frame(ctx, filtered_frame);
     if (ret < 0) {
-        av_frame_free(&filtered_frame);
+        free_frame(ctx, &filtered_frame);
         return ret;
     }
 
     return 0;
 }
 
-static int flush_frames(struct filtering_ctx *ctx)
+/*
+ * Get the filtergraph ready for frames following a discontinuity: a stateless
+ * graph is only emptied from the frames it could still hold, any other one is
+ * rebuilt with the next frame.
+ */
+static void reset_filtergraph(struct filtering_ctx *ctx)
 {
-    int ret;
+    if (ctx->filter_graph && ctx->graph_reusable) {
+        AVFrame *frame = nmdi_obj_pool_get(ctx->frame_pool);
+        if (frame) {
+            TRACE(ctx, "keep filtergraph, discarding its buffered frames");
+            while (av_buffersink_get_frame(ctx->buffersink_ctx, frame) >= 0)
+                av_frame_unref(frame);
+            free_frame(ctx, &frame);
+            return;
+        }
+    }
 
-    if (!ctx->filter_graph)
+    // we want to force the reconstruction of the filtergraph
+    avfilter_graph_free(&ctx->filter_graph);
+    ctx->graph_reusable = 0;
+    ctx->last_frame_format = AV_PIX_FMT_NONE;
+}
+
+/*
+ * When playing fast-forward, a frame whose display ends before the latest time
+ * requested by the user will never be returned: the user either gets the
+ * following frames or seeks away.
+ */
+static int is_obsolete_frame(struct filtering_ctx *ctx, const AVFrame *frame)
+{
+    const int64_t prev_pts = ctx->prev_pts;
+    ctx->prev_pts = frame->pts;
+
+    /* Dropping frames would change the output of a stateful filtergraph */
+    if (!ctx->hint || (ctx->filter_graph && !ctx->graph_reusable))
         return 0;
 
-    TRACE(ctx, "push null frame into %s filtergraph to trigger flushing",
-          av_get_media_type_string(ctx->codecpar->codec_type));
+    const int64_t target = nmdi_playback_hint_get_ff_target(ctx->hint);
+    if (target == AV_NOPTS_VALUE)
+        return 0;
 
-    ret = push_frame(ctx, NULL);
-    if (ret < 0)
-        return ret;
+    /* The frames following a skipped one are displayed longer than their
+     * packet duration */
+    int64_t duration = frame->pkt_duration;
+    if (prev_pts != AV_NOPTS_VALUE && frame->pts > prev_pts)
+        duration = FFMAX(duration, frame->pts - prev_pts);
+    if (duration <= 0)
+        return 0;
 
-    do {
-        ret = pull_send_frame(ctx);
-    } while (ret >= 0);
+    return frame->pts + duration <= av_rescale_q(target, AV_TIME_BASE_Q, ctx->st_timebase);
+}
 
-    return ret;
+static void start_run(struct filtering_ctx *ctx, int nonblock)
+{
+    TRACE(ctx, "filtering packets from %p into %p", ctx->in_queue, ctx->out_queue);
+
+    ctx->running = 1;
+    ctx->nonblock = nonblock;
+    ctx->flushing = 0;
+    ctx->prev_pts = AV_NOPTS_VALUE;
+
+    reset_filtergraph(ctx);
 }
 
-void nmdi_filtering_run(struct filtering_ctx *ctx)
+static void end_run(struct filtering_ctx *ctx, int ret)
 {
-    int ret;
     int in_err, out_err;
 
-    TRACE(ctx, "filtering packets from %p into %p", ctx->in_queue, ctx->out_queue);
+    drop_pending(ctx);
+    ctx->running = 0;
 
-    // we want to force the reconstruction of the filtergraph
-    ctx->last_frame_format = AV_PIX_FMT_NONE;
+    if (ret < 0 && ret != AVERROR_EOF) {
+        in_err = out_err = ret;
+    } else {
+        in_err = AVERROR_EXIT;
+        out_err = AVERROR_EOF;
+    }
+    TRACE(ctx, "notify decoder with %s and sink with %s",
+          av_err2str(in_err), av_err2str(out_err));
+    nmdi_msg_queue_set_err_send(ctx->in_queue,  in_err);
+    nmdi_msg_queue_flush(ctx->in_queue);
+    nmdi_msg_queue_set_err_recv(ctx->out_queue, out_err);
+}
 
-    for (;;) {
-        AVFrame *frame;
-        struct message msg;
+/*
+ * Process at most one message from the in queue, producing at most one
+ * message for the out queue. Return 0 if progress was made, AVERROR(EAGAIN)
+ * if waiting on a queue (only in non-blocking mode), or the status to end the
+ * run with.
+ */
+static int filtering_step(struct filtering_ctx *ctx)
+{
+    int ret;
+    AVFrame *frame;
+    struct message msg;
 
-        TRACE(ctx, "fetching a frame from the inqueue");
-        ret = av_thread_message_queue_recv(ctx->in_queue, &msg, 0);
+    if (ctx->has_pending) {
+        ret = nmdi_msg_queue_send(ctx->out_queue, &ctx->pending, AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret == AVERROR(EAGAIN))
+            return ret;
         if (ret < 0) {
-            if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
-                LOG(ctx, ERROR, "unable to fetch a frame from the inqueue: %s", av_err2str(ret));
-            break;
+            drop_pending(ctx);
+            return ret;
         }
+        ctx->has_pending = 0;
+    }
 
-        if (msg.type == MSG_SEEK) {
-            TRACE(ctx, "message is a seek, destroy filtergraph and forward message to out queue");
-            avfilter_graph_free(&ctx->filter_graph);
-            ctx->last_frame_format = AV_PIX_FMT_NONE;
-            av_thread_message_flush(ctx->out_queue);
-            ret = av_thread_message_queue_send(ctx->out_queue, &msg, 0);
-            if (ret < 0) {
-                nmdi_msg_free_data(&msg);
-                break;
-            }
-            continue;
-        }
+    /* Fetch remaining frames */
+    if (ctx->flushing) {
+        ret = pull_send_frame(ctx);
+        return ret == AVERROR(EAGAIN) ? AVERROR_EOF : ret;
+    }
 
-        frame = msg.data;
-
-        TRACE(ctx, "filtering %s %s frame @ ts=%s",
-              av_get_media_type_string(ctx->codecpar->codec_type),
-              ctx->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? av_get_pix_fmt_name(frame->format)
-                                                              : av_get_sample_fmt_name(frame->format),
-              av_ts2timestr(frame->pts, &ctx->st_timebase));
-
-        /* lazy filtergraph configuration */
-        // XXX: check width/height/samplerate/etc changes?
-        if (ctx->last_frame_format != frame->format) {
-            ctx->last_frame_format = frame->format;
-            ret = setup_filtergraph(ctx);
-            if (ret < 0)
-                break;
-        }
+    TRACE(ctx, "fetching a frame from the inqueue");
+    ret = nmdi_msg_queue_recv(ctx->in_queue, &msg, ctx->nonblock ? AV_THREAD_MESSAGE_NONBLOCK : 0);
+    if (ret == AVERROR(EAGAIN))
+        return ret;
+    if (ret < 0) {
+        if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
+            LOG(ctx, ERROR, "unable to fetch a frame from the inqueue: %s", av_err2str(ret));
+        if (ret != AVERROR_EOF || !ctx->filter_graph)
+            return ret;
+
+        TRACE(ctx, "push null frame into %s filtergraph to trigger flushing",
+              av_get_media_type_string(ctx->codecpar->codec_type));
+        ret = push_frame(ctx, NULL);
+        ctx->graph_reusable = 0;
+        if (ret < 0)
+            return ret;
+        ctx->flushing = 1;
+        return 0;
+    }
 
-        // TODO: replace with a trim filter in libavfilter (check if hw accelerated
-        // filters work)
-        if (frame->pts < 0) {
-            av_frame_free(&frame);
-            TRACE(ctx, "frame ts is negative, skipping");
-            continue;
-        } else if (ctx->max_pts != AV_NOPTS_VALUE && frame->pts > ctx->max_pts) {
-            av_frame_free(&frame);
-            TRACE(ctx, "reached trim duration");
-            ret = AVERROR_EXIT; // not EOF because we do not want to flush the frames
-            break;
+    if (msg.type == MSG_SEEK) {
+        TRACE(ctx, "message is a seek, reset filtergraph and forward message to out queue");
+        reset_filtergraph(ctx);
+        ctx->prev_pts = AV_NOPTS_VALUE;
+        nmdi_msg_queue_flush(ctx->out_queue);
+        drop_pending(ctx);
+        ret = send_msg(ctx, &msg);
+        if (ret < 0) {
+            nmdi_msg_free_data(&msg);
+            return ret;
         }
+        return 0;
+    }
 
-        if (!ctx->filter_graph) {
-            ret = send_frame(ctx, frame);
-            if (ret < 0) {
-                av_frame_free(&frame);
-                break;
-            }
-        } else {
-            ret = push_frame(ctx, frame);
-            av_frame_free(&frame);
-            if (ret < 0)
-                break;
-
-            ret = pull_send_frame(ctx);
-            if (ret < 0 && ret != AVERROR(EAGAIN))
-                break;
+    frame = msg.data;
+
+    TRACE(ctx, "filtering %s %s frame @ ts=%s",
+          av_get_media_type_string(ctx->codecpar->codec_type),
+          ctx->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? av_get_pix_fmt_name(frame->format)
+                                                          : av_get_sample_fmt_name(frame->format),
+          av_ts2timestr(frame->pts, &ctx->st_timebase));
+
+    /* lazy filtergraph configuration */
+    // XXX: check width/height/samplerate/etc changes?
+    if (ctx->last_frame_format != frame->format ||
+        (ctx->yuv_rgba_fmt != AV_PIX_FMT_NONE && !nmdi_yuv_rgba_supported(frame, ctx->yuv_rgba_fmt))) {
+        ctx->last_frame_format = frame->format;
+        ret = setup_filtergraph(ctx, frame);
+        if (ret < 0) {
+            free_frame(ctx, &frame);
+            return ret;
         }
     }
 
-    /* Fetch remaining frames */
-    if (ret == AVERROR_EOF)
-        ret = flush_frames(ctx);
+    // TODO: replace with a trim filter in libavfilter (check if hw accelerated
+    // filters work)
+    if (frame->pts < 0) {
+        free_frame(ctx, &frame);
+        TRACE(ctx, "frame ts is negative, skipping");
+        return 0;
+    } else if (ctx->max_pts != AV_NOPTS_VALUE && frame->pts > ctx->max_pts) {
+        free_frame(ctx, &frame);
+        TRACE(ctx, "reached trim duration");
+        return AVERROR_EXIT; // not EOF because we do not want to flush the frames
+    } else if (is_obsolete_frame(ctx, frame)) {
+        TRACE(ctx, "frame is obsolete, skipping");
+        free_frame(ctx, &frame);
+        return 0;
+    }
 
-    if (ret < 0 && ret != AVERROR_EOF) {
-        in_err = out_err = ret;
-    } else {
-        in_err = AVERROR_EXIT;
-        out_err = AVERROR_EOF;
+    if (ctx->yuv_rgba_fmt != AV_PIX_FMT_NONE) {
+        ret = convert_send_frame(ctx, frame);
+        free_frame(ctx, &frame);
+        nmdi_stats_add_time(ctx->stats, STATS_TIMING_FILTER, ctx->filter_time);
+        return ret;
     }
-    TRACE(ctx, "notify decoder with %s and sink with %s",
-          av_err2str(in_err), av_err2str(out_err));
-    av_thread_message_queue_set_err_send(ctx->in_queue,  in_err);
-    av_thread_message_flush(ctx->in_queue);
-    av_thread_message_queue_set_err_recv(ctx->out_queue, out_err);
+
+    if (!ctx->filter_graph) {
+        ret = send_frame(ctx, frame);
+        if (ret < 0) {
+            free_frame(ctx, &frame);
+            return ret;
+        }
+        return 0;
+    }
+
+    ret = push_frame(ctx, frame);
+    free_frame(ctx, &frame);
+    if (ret < 0)
+        return ret;
+
+    ret = pull_send_frame(ctx);
+    nmdi_stats_add_time(ctx->stats, STATS_TIMING_FILTER, ctx->filter_time);
+    if (ret < 0 && ret != AVERROR(EAGAIN))
+        return ret;
+    return 0;
+}
+
+void nmdi_filtering_run(struct filtering_ctx *ctx)
+{
+    int ret;
+
+    start_run(ctx, 0);
+    do {
+        ret = filtering_step(ctx);
+    } while (ret >= 0);
+    end_run(ctx, ret);
+}
+
+int nmdi_filtering_step(struct filtering_ctx *ctx)
+{
+    if (!ctx->running)
+        start_run(ctx, 1);
+    const int ret = filtering_step(ctx);
+    if (ret < 0 && ret != AVERROR(EAGAIN))
+        end_run(ctx, ret);
+    return ret;
 }
 
 void nmdi_filtering_free(struct filtering_ctx **fp)
@@ -631,15 +1098,26 @@ void nmdi_filtering_free(struct filtering_ctx **fp)
 
     if (ctx->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && ctx->audio_texture) {
         av_freep(&ctx->window_func_lut);
-        av_freep(&ctx->rdft_data[0]);
-        av_freep(&ctx->rdft_data[1]);
+#if USE_TX_RDFT
+        av_tx_uninit(&ctx->tx);
+        av_freep(&ctx->tx_in);
+        av_freep(&ctx->tx_out);
+#else
+        av_freep(&ctx->rdft_data);
         if (ctx->rdft) {
             av_rdft_end(ctx->rdft);
             ctx->rdft = NULL;
         }
+#endif
+        av_freep(&ctx->fft_levels);
+        av_buffer_pool_uninit(&ctx->texture_pool);
     }
     avfilter_graph_free(&ctx->filter_graph);
+    nmdi_yuv_rgba_free(&ctx->yuv_rgba);
+    if (ctx->nb_threads)
+        nmdi_thread_budget_release(ctx->nb_threads);
     avcodec_parameters_free(&ctx->codecpar);
     av_freep(&ctx->filters);
+    av_freep(&ctx->hw_filters);
     av_freep(fp);
 }
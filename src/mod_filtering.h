@@ -22,16 +22,24 @@
 #define MOD_FILTERING_H
 
 #include <libavcodec/avcodec.h>
-#include <libavutil/threadmessage.h>
 
+#include "mem_budget.h"
+#include "msg_queue.h"
+#include "obj_pool.h"
 #include "opts.h"
+#include "playback_hint.h"
+#include "stats.h"
 
 struct filtering_ctx *nmdi_filtering_alloc(void);
 
 int nmdi_filtering_init(void *log_ctx,
                         struct filtering_ctx *ctx,
-                        AVThreadMessageQueue *in_queue,
-                        AVThreadMessageQueue *out_queue,
+                        struct msg_queue *in_queue,
+                        struct msg_queue *out_queue,
+                        struct obj_pool *frame_pool,
+                        struct playback_hint *hint,
+                        struct stats *stats,
+                        struct mem_budget *mem_budget,
                         const AVStream *stream,
                         const AVCodecContext *avctx,
                         double media_rotation,
@@ -39,6 +47,13 @@ int nmdi_filtering_init(void *log_ctx,
 
 void nmdi_filtering_run(struct filtering_ctx *ctx);
 
+/**
+ * Non-blocking alternative to nmdi_filtering_run() for the scheduler (see
+ * sched.h): the run ends when the returned status is neither 0 nor
+ * AVERROR(EAGAIN).
+ */
+int nmdi_filtering_step(struct filtering_ctx *ctx);
+
 void nmdi_filtering_free(struct filtering_ctx **ctxp);
 
 #endif
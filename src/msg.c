@@ -23,6 +23,7 @@
 #include <libavcodec/avcodec.h>
 
 #include "msg.h"
+#include "obj_pool.h"
 
 void nmdi_msg_free_data(void *arg)
 {
@@ -31,16 +32,25 @@ void nmdi_msg_free_data(void *arg)
     switch (msg->type) {
     case MSG_FRAME: {
         AVFrame *frame = msg->data;
-        av_frame_free(&frame);
+        if (msg->pool)
+            nmdi_obj_pool_put(msg->pool, frame);
+        else
+            av_frame_free(&frame);
         msg->data = NULL;
         break;
     }
     case MSG_PACKET:
-        av_packet_unref(msg->data);
-        av_freep(&msg->data);
+        if (msg->pool) {
+            nmdi_obj_pool_put(msg->pool, msg->data);
+            msg->data = NULL;
+        } else {
+            av_packet_unref(msg->data);
+            av_freep(&msg->data);
+        }
         break;
     case MSG_SEEK:
     case MSG_INFO:
+    case MSG_REQUEST:
         av_freep(&msg->data);
         break;
     case MSG_START:
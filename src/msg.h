@@ -29,12 +29,16 @@ enum msg_type {
     MSG_START,
     MSG_STOP,
     MSG_SYNC,
+    MSG_REQUEST,
     NB_MSG
 };
 
+struct obj_pool;
+
 struct message {
     void *data;
     enum msg_type type;
+    struct obj_pool *pool;                  // pool the data is recycled into (NULL if it must be freed)
 };
 
 void nmdi_msg_free_data(void *arg);
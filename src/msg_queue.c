@@ -0,0 +1,356 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <limits.h>
+
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavutil/threadmessage.h>
+
+#include "msg_queue.h"
+#include "pthread_compat.h"
+#include "scheduler.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ATOMIC_LOAD(p)        ((unsigned)_InterlockedOr((volatile long *)(p), 0))
+#define ATOMIC_STORE(p, v)    ((void)_InterlockedExchange((volatile long *)(p), (long)(v)))
+#define ATOMIC_ADD(p, v)      ((void)_InterlockedExchangeAdd((volatile long *)(p), (long)(v)))
+#define ATOMIC_CAS(p, old, v) (_InterlockedCompareExchange((volatile long *)(p), (long)(v), (long)(old)) == (long)(old))
+#else
+#define ATOMIC_LOAD(p)        __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(p, v)    __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD(p, v)      ((void)__atomic_add_fetch(p, v, __ATOMIC_SEQ_CST))
+#define ATOMIC_CAS(p, old, v) cas_u32(p, old, v)
+static inline int cas_u32(volatile unsigned *p, unsigned old, unsigned v)
+{
+    return __atomic_compare_exchange_n(p, &old, v, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#endif
+
+/*
+ * The ring only takes the lock to sleep and to wake a sleeping peer: the
+ * messages are exchanged through the read and write indexes, which run freely
+ * (the slots are indexed modulo a power of two size).
+ *
+ * The read index is advanced with a compare and swap after the slot is
+ * copied, so that a flush from any thread can compete with the consumer: the
+ * slot can not be overwritten by the producer before the read index moves
+ * past it, and the side losing the race simply drops its copy.
+ */
+struct msg_queue {
+    AVThreadMessageQueue *locked;           // set if the queue is MSG_QUEUE_LOCKED
+    int locked_nb_elems;                    // size the AVThreadMessageQueue was allocated with
+
+    struct sched_task *reader;
+    struct sched_task *writer;
+
+    struct message *slots;
+    unsigned mask;
+    unsigned nb_elems;                      // capacity (lower or equal to the number of slots)
+    volatile unsigned capacity;             // current capacity (see nmdi_msg_queue_set_capacity())
+    volatile unsigned write_idx;            // only advanced by the producer
+    volatile unsigned read_idx;             // advanced by the consumer and the flushes
+    volatile unsigned err_send;
+    volatile unsigned err_recv;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond_send;
+    pthread_cond_t cond_recv;
+    volatile unsigned nb_waiting_send;
+    volatile unsigned nb_waiting_recv;
+};
+
+int nmdi_msg_queue_alloc(struct msg_queue **qp, int nb_elems, enum msg_queue_type type)
+{
+    struct msg_queue *q = av_mallocz(sizeof(*q));
+    if (!q)
+        return AVERROR(ENOMEM);
+
+    if (type == MSG_QUEUE_LOCKED) {
+        int ret = av_thread_message_queue_alloc(&q->locked, nb_elems, sizeof(struct message));
+        if (ret < 0) {
+            av_free(q);
+            return ret;
+        }
+        av_thread_message_queue_set_free_func(q->locked, nmdi_msg_free_data);
+        q->locked_nb_elems = nb_elems;
+        q->capacity = nb_elems;
+        pthread_mutex_init(&q->lock, NULL);
+        pthread_cond_init(&q->cond_send, NULL);
+        *qp = q;
+        return 0;
+    }
+
+    if (nb_elems <= 0 || nb_elems > INT_MAX / 2) {
+        av_free(q);
+        return AVERROR(EINVAL);
+    }
+
+    unsigned nb_slots = 1;
+    while (nb_slots < nb_elems)
+        nb_slots <<= 1;
+    q->slots = av_calloc(nb_slots, sizeof(*q->slots));
+    if (!q->slots) {
+        av_free(q);
+        return AVERROR(ENOMEM);
+    }
+    q->mask     = nb_slots - 1;
+    q->nb_elems = nb_elems;
+    q->capacity = nb_elems;
+
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond_send, NULL);
+    pthread_cond_init(&q->cond_recv, NULL);
+
+    *qp = q;
+    return 0;
+}
+
+static void wake_up(struct msg_queue *q, volatile unsigned *nb_waiting, pthread_cond_t *cond)
+{
+    if (!ATOMIC_LOAD(nb_waiting))
+        return;
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_broadcast(cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static int is_full(struct msg_queue *q)
+{
+    return ATOMIC_LOAD(&q->write_idx) - ATOMIC_LOAD(&q->read_idx) >= ATOMIC_LOAD(&q->capacity);
+}
+
+static int is_empty(struct msg_queue *q)
+{
+    return ATOMIC_LOAD(&q->write_idx) == ATOMIC_LOAD(&q->read_idx);
+}
+
+/* Pop the oldest message, return 0 if there is none */
+static int take_msg(struct msg_queue *q, struct message *msg)
+{
+    for (;;) {
+        const unsigned r = ATOMIC_LOAD(&q->read_idx);
+        if (ATOMIC_LOAD(&q->write_idx) == r)
+            return 0;
+        const struct message m = q->slots[r & q->mask];
+        if (ATOMIC_CAS(&q->read_idx, r, r + 1)) {
+            *msg = m;
+            return 1;
+        }
+    }
+}
+
+static int ring_send(struct msg_queue *q, struct message *msg, unsigned flags)
+{
+    for (;;) {
+        const int err = (int)ATOMIC_LOAD(&q->err_send);
+        if (err)
+            return err;
+        if (!is_full(q))
+            break;
+        if (flags & AV_THREAD_MESSAGE_NONBLOCK)
+            return AVERROR(EAGAIN);
+
+        pthread_mutex_lock(&q->lock);
+        ATOMIC_ADD(&q->nb_waiting_send, 1);
+        while (!ATOMIC_LOAD(&q->err_send) && is_full(q))
+            pthread_cond_wait(&q->cond_send, &q->lock);
+        ATOMIC_ADD(&q->nb_waiting_send, -1);
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    const unsigned w = q->write_idx;
+    q->slots[w & q->mask] = *msg;
+    ATOMIC_STORE(&q->write_idx, w + 1);
+
+    wake_up(q, &q->nb_waiting_recv, &q->cond_recv);
+    return 0;
+}
+
+static int ring_recv(struct msg_queue *q, struct message *msg, unsigned flags)
+{
+    for (;;) {
+        if (take_msg(q, msg)) {
+            wake_up(q, &q->nb_waiting_send, &q->cond_send);
+            return 0;
+        }
+        const int err = (int)ATOMIC_LOAD(&q->err_recv);
+        if (err)
+            return err;
+        if (flags & AV_THREAD_MESSAGE_NONBLOCK)
+            return AVERROR(EAGAIN);
+
+        pthread_mutex_lock(&q->lock);
+        ATOMIC_ADD(&q->nb_waiting_recv, 1);
+        while (!ATOMIC_LOAD(&q->err_recv) && is_empty(q))
+            pthread_cond_wait(&q->cond_recv, &q->lock);
+        ATOMIC_ADD(&q->nb_waiting_recv, -1);
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+/*
+ * The AVThreadMessageQueue can not be resized, so a capacity lower than its
+ * size is honored by waiting for room before sending the message. Only the
+ * producer waits on cond_send, so a message sent by another thread in the
+ * meantime can not fill the queue behind its back.
+ */
+static int is_locked_full(struct msg_queue *q)
+{
+    return av_thread_message_queue_nb_elems(q->locked) >= (int)ATOMIC_LOAD(&q->capacity);
+}
+
+static int wait_locked_room(struct msg_queue *q, unsigned flags)
+{
+    for (;;) {
+        const int err = (int)ATOMIC_LOAD(&q->err_send);
+        if (err)
+            return err;
+        if (!is_locked_full(q))
+            return 0;
+        if (flags & AV_THREAD_MESSAGE_NONBLOCK)
+            return AVERROR(EAGAIN);
+
+        pthread_mutex_lock(&q->lock);
+        ATOMIC_ADD(&q->nb_waiting_send, 1);
+        while (!ATOMIC_LOAD(&q->err_send) && is_locked_full(q))
+            pthread_cond_wait(&q->cond_send, &q->lock);
+        ATOMIC_ADD(&q->nb_waiting_send, -1);
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+static int locked_send(struct msg_queue *q, struct message *msg, unsigned flags)
+{
+    if ((int)ATOMIC_LOAD(&q->capacity) < q->locked_nb_elems) {
+        const int ret = wait_locked_room(q, flags);
+        if (ret < 0)
+            return ret;
+    }
+    return av_thread_message_queue_send(q->locked, msg, flags);
+}
+
+int nmdi_msg_queue_send(struct msg_queue *q, struct message *msg, unsigned flags)
+{
+    const int ret = q->locked ? locked_send(q, msg, flags)
+                              : ring_send(q, msg, flags);
+    if (ret >= 0)
+        nmdi_sched_task_wake(q->reader);
+    return ret;
+}
+
+int nmdi_msg_queue_recv(struct msg_queue *q, struct message *msg, unsigned flags)
+{
+    int ret;
+    if (q->locked) {
+        ret = av_thread_message_queue_recv(q->locked, msg, flags);
+        if (ret >= 0)
+            wake_up(q, &q->nb_waiting_send, &q->cond_send);
+    } else {
+        ret = ring_recv(q, msg, flags);
+    }
+    if (ret >= 0)
+        nmdi_sched_task_wake(q->writer);
+    return ret;
+}
+
+void nmdi_msg_queue_set_err_send(struct msg_queue *q, int err)
+{
+    if (q->locked)
+        av_thread_message_queue_set_err_send(q->locked, err);
+    pthread_mutex_lock(&q->lock);
+    ATOMIC_STORE(&q->err_send, (unsigned)err);
+    pthread_cond_broadcast(&q->cond_send);
+    pthread_mutex_unlock(&q->lock);
+    nmdi_sched_task_wake(q->writer);
+}
+
+void nmdi_msg_queue_set_err_recv(struct msg_queue *q, int err)
+{
+    if (q->locked) {
+        av_thread_message_queue_set_err_recv(q->locked, err);
+    } else {
+        pthread_mutex_lock(&q->lock);
+        ATOMIC_STORE(&q->err_recv, (unsigned)err);
+        pthread_cond_broadcast(&q->cond_recv);
+        pthread_mutex_unlock(&q->lock);
+    }
+    nmdi_sched_task_wake(q->reader);
+}
+
+void nmdi_msg_queue_flush(struct msg_queue *q)
+{
+    if (q->locked) {
+        av_thread_message_flush(q->locked);
+    } else {
+        struct message msg;
+        while (take_msg(q, &msg))
+            nmdi_msg_free_data(&msg);
+    }
+    wake_up(q, &q->nb_waiting_send, &q->cond_send);
+    nmdi_sched_task_wake(q->writer);
+}
+
+int nmdi_msg_queue_nb_elems(struct msg_queue *q)
+{
+    if (q->locked)
+        return av_thread_message_queue_nb_elems(q->locked);
+    return ATOMIC_LOAD(&q->write_idx) - ATOMIC_LOAD(&q->read_idx);
+}
+
+void nmdi_msg_queue_set_capacity(struct msg_queue *q, int capacity)
+{
+    const int max_capacity = q->locked ? q->locked_nb_elems : (int)q->nb_elems;
+    const unsigned prev = ATOMIC_LOAD(&q->capacity);
+    ATOMIC_STORE(&q->capacity, (unsigned)av_clip(capacity, 1, max_capacity));
+    if (ATOMIC_LOAD(&q->capacity) > prev) {
+        wake_up(q, &q->nb_waiting_send, &q->cond_send);
+        nmdi_sched_task_wake(q->writer);
+    }
+}
+
+void nmdi_msg_queue_set_tasks(struct msg_queue *q, struct sched_task *reader, struct sched_task *writer)
+{
+    q->reader = reader;
+    q->writer = writer;
+}
+
+void nmdi_msg_queue_free(struct msg_queue **qp)
+{
+    struct msg_queue *q = *qp;
+    if (!q)
+        return;
+
+    if (q->locked) {
+        av_thread_message_queue_free(&q->locked);
+        pthread_mutex_destroy(&q->lock);
+        pthread_cond_destroy(&q->cond_send);
+    } else {
+        nmdi_msg_queue_flush(q);
+        pthread_mutex_destroy(&q->lock);
+        pthread_cond_destroy(&q->cond_send);
+        pthread_cond_destroy(&q->cond_recv);
+        av_freep(&q->slots);
+    }
+    av_freep(qp);
+}
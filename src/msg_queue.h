@@ -0,0 +1,72 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef MSG_QUEUE_H
+#define MSG_QUEUE_H
+
+#include <libavutil/threadmessage.h>
+
+#include "msg.h"
+
+/*
+ * Queue of struct message between two threads, with the semantics of
+ * AVThreadMessageQueue: blocking or non-blocking (AV_THREAD_MESSAGE_NONBLOCK)
+ * send and receive, errors propagated to each side, and the pending messages
+ * released with nmdi_msg_free_data() when flushed.
+ */
+
+enum msg_queue_type {
+    MSG_QUEUE_LOCKED,                       // AVThreadMessageQueue (any number of producers and consumers)
+    MSG_QUEUE_SPSC,                         // lock-free ring (one producer and one consumer thread)
+};
+
+struct msg_queue;
+struct sched_task;
+
+/**
+ * With MSG_QUEUE_SPSC, messages must never be sent from several threads at
+ * the same time. The other functions can be called from anywhere, though the
+ * ring is meant to be read by a single thread at a time.
+ */
+int nmdi_msg_queue_alloc(struct msg_queue **qp, int nb_elems, enum msg_queue_type type);
+int nmdi_msg_queue_send(struct msg_queue *q, struct message *msg, unsigned flags);
+int nmdi_msg_queue_recv(struct msg_queue *q, struct message *msg, unsigned flags);
+void nmdi_msg_queue_set_err_send(struct msg_queue *q, int err);
+void nmdi_msg_queue_set_err_recv(struct msg_queue *q, int err);
+void nmdi_msg_queue_flush(struct msg_queue *q);
+int nmdi_msg_queue_nb_elems(struct msg_queue *q);
+
+/**
+ * Change the number of messages the queue accepts before a send blocks, within
+ * 1 and the size it was allocated with. Lowering it doesn't drop the messages
+ * already queued: the sends wait for the queue to drain below the new capacity.
+ */
+void nmdi_msg_queue_set_capacity(struct msg_queue *q, int capacity);
+
+/**
+ * Scheduler tasks (see scheduler.h) to wake up when the state of the queue changes:
+ * the reader when messages or an error become available to it, the writer
+ * when room or an error become available to it. Either can be NULL.
+ */
+void nmdi_msg_queue_set_tasks(struct msg_queue *q, struct sched_task *reader, struct sched_task *writer);
+void nmdi_msg_queue_free(struct msg_queue **qp);
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/mem.h>
+
+#include "obj_pool.h"
+#include "pthread_compat.h"
+
+struct obj_pool {
+    pthread_mutex_t lock;
+    int refcount;
+
+    void *(*alloc_obj)(void);
+    void (*reset_obj)(void *obj);
+    void (*free_obj)(void *obj);
+
+    void **objs;                            // available objects
+    int nb_objs;
+    unsigned objs_size;
+};
+
+struct obj_pool *nmdi_obj_pool_alloc(void)
+{
+    struct obj_pool *pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->refcount = 1;
+    return pool;
+}
+
+int nmdi_obj_pool_init(struct obj_pool *pool,
+                       void *(*alloc_obj)(void),
+                       void (*reset_obj)(void *obj),
+                       void (*free_obj)(void *obj))
+{
+    pool->alloc_obj = alloc_obj;
+    pool->reset_obj = reset_obj;
+    pool->free_obj  = free_obj;
+    return 0;
+}
+
+static void *alloc_packet(void)
+{
+    return av_packet_alloc();
+}
+
+static void reset_packet(void *obj)
+{
+    av_packet_unref(obj);
+}
+
+static void free_packet(void *obj)
+{
+    AVPacket *pkt = obj;
+    av_packet_free(&pkt);
+}
+
+int nmdi_obj_pool_init_packets(struct obj_pool *pool)
+{
+    return nmdi_obj_pool_init(pool, alloc_packet, reset_packet, free_packet);
+}
+
+static void *alloc_frame(void)
+{
+    return av_frame_alloc();
+}
+
+static void reset_frame(void *obj)
+{
+    av_frame_unref(obj);
+}
+
+static void free_frame(void *obj)
+{
+    AVFrame *frame = obj;
+    av_frame_free(&frame);
+}
+
+int nmdi_obj_pool_init_frames(struct obj_pool *pool)
+{
+    return nmdi_obj_pool_init(pool, alloc_frame, reset_frame, free_frame);
+}
+
+/* Must be called with the lock held */
+static int push_obj(struct obj_pool *pool, void *obj)
+{
+    if (pool->nb_objs * sizeof(*pool->objs) >= pool->objs_size) {
+        void **objs = av_fast_realloc(pool->objs, &pool->objs_size,
+                                      (pool->nb_objs + 1) * sizeof(*objs));
+        if (!objs)
+            return AVERROR(ENOMEM);
+        pool->objs = objs;
+    }
+    pool->objs[pool->nb_objs++] = obj;
+    return 0;
+}
+
+int nmdi_obj_pool_prealloc(struct obj_pool *pool, int n)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->nb_objs < n) {
+        void *obj = pool->alloc_obj();
+        if (!obj) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        ret = push_obj(pool, obj);
+        if (ret < 0) {
+            pool->free_obj(obj);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return ret;
+}
+
+void *nmdi_obj_pool_get(struct obj_pool *pool)
+{
+    void *obj = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->nb_objs)
+        obj = pool->objs[--pool->nb_objs];
+    pthread_mutex_unlock(&pool->lock);
+
+    return obj ? obj : pool->alloc_obj();
+}
+
+void nmdi_obj_pool_put(struct obj_pool *pool, void *obj)
+{
+    if (!obj)
+        return;
+
+    /* Releasing the object content (typically the data buffers) doesn't need
+     * to be serialized */
+    pool->reset_obj(obj);
+
+    pthread_mutex_lock(&pool->lock);
+    const int ret = push_obj(pool, obj);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (ret < 0)
+        pool->free_obj(obj);
+}
+
+struct obj_pool *nmdi_obj_pool_ref(struct obj_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->refcount++;
+    pthread_mutex_unlock(&pool->lock);
+    return pool;
+}
+
+void nmdi_obj_pool_unref(struct obj_pool **poolp)
+{
+    struct obj_pool *pool = *poolp;
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    const int refcount = --pool->refcount;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!refcount) {
+        while (pool->nb_objs)
+            pool->free_obj(pool->objs[--pool->nb_objs]);
+        av_freep(&pool->objs);
+        pthread_mutex_destroy(&pool->lock);
+        av_freep(poolp);
+    }
+    *poolp = NULL;
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef OBJ_POOL_H
+#define OBJ_POOL_H
+
+/*
+ * Thread-safe pool of recycled objects (typically AVPacket and AVFrame
+ * containers), so that the steady state of the pipeline doesn't allocate.
+ *
+ * The pool is refcounted: an object obtained from the pool can be put back
+ * into it as long as a reference is held, which allows objects to outlive the
+ * module that allocated them (for instance frames held by the user).
+ */
+
+struct obj_pool;
+
+struct obj_pool *nmdi_obj_pool_alloc(void);
+
+/**
+ * Set the functions used to create, clean (before recycling) and destroy the
+ * objects of the pool.
+ */
+int nmdi_obj_pool_init(struct obj_pool *pool,
+                       void *(*alloc_obj)(void),
+                       void (*reset_obj)(void *obj),
+                       void (*free_obj)(void *obj));
+
+/**
+ * Shortcuts for pools of AVPacket and AVFrame.
+ */
+int nmdi_obj_pool_init_packets(struct obj_pool *pool);
+int nmdi_obj_pool_init_frames(struct obj_pool *pool);
+
+/**
+ * Make sure at least n objects are available in the pool.
+ */
+int nmdi_obj_pool_prealloc(struct obj_pool *pool, int n);
+
+/**
+ * Get a clean object from the pool, allocating one if the pool is empty.
+ *
+ * Return NULL on error.
+ */
+void *nmdi_obj_pool_get(struct obj_pool *pool);
+
+/**
+ * Reset the object and keep it for a later nmdi_obj_pool_get(). Objects of
+ * the same type not obtained from the pool are accepted as well.
+ */
+void nmdi_obj_pool_put(struct obj_pool *pool, void *obj);
+
+struct obj_pool *nmdi_obj_pool_ref(struct obj_pool *pool);
+
+/**
+ * Drop a reference to the pool; the pool and its available objects are
+ * destroyed along with the last one.
+ */
+void nmdi_obj_pool_unref(struct obj_pool **poolp);
+
+#endif
@@ -23,6 +23,8 @@
 
 #include <stdint.h>
 
+#include "nopemd.h"
+
 struct nmdi_opts {
     int avselect;                           // select audio or video
     double start_time;                      // see public header
@@ -41,8 +43,34 @@ struct nmdi_opts {
     int max_pixels;                         // maximum number of pixels per frame
     int audio_texture;                      // output audio as a video texture
     char *vt_pix_fmt;                       // VideoToolbox pixel format in the CVPixelBufferRef
+    char *vaapi_pix_fmt;                    // pixel format of the VAAPI surfaces
+    char *hw_filters;                       // user filters applied to the VAAPI frames
+    int drm_prime;                          // export the VAAPI frames as DRM PRIME descriptors
     int stream_idx;
     int use_pkt_duration;
+    int max_nb_cached_frames;               // maximum number of recently decoded frames kept around
+    int max_cached_frames_size;             // maximum size in bytes of the recently decoded frames kept around
+    int max_cached_packets_size;            // maximum size in bytes of the recently demuxed packets kept around
+    char *keyframe_index_file;              // sidecar file path used to load and save the keyframe index
+    int adaptive_seek_trigger;              // derive the seek trigger from the measured decode and seek costs
+    int shared_pool;                        // share the decoded frames with the contexts on the same media
+    int lockfree_queues;                    // use lock-free rings between the pipeline stages
+    int shared_scheduler;                   // run the modules on the process-wide workers
+    int nb_threads;                         // threads of the decoder and of the filtergraph
+    int keyframes_only;                     // only decode the keyframes of the video stream
+    int reverse;                            // optimize for decreasing requested times
+    int io;                                 // I/O backend (NMD_IO_*)
+    int io_buffer_size;                     // size of the I/O buffer (0 for the backend default)
+    struct nmd_io_callbacks io_callbacks;   // user I/O, replaces the backend if read is set
+    int fast_open;                          // probe the media as little as possible
+    int probesize;                          // maximum number of bytes probed (0 for the default)
+    double analyzeduration;                 // maximum duration probed (0 for the default)
+    char *info_cache_dir;                   // directory of the cached stream information
+    int max_queued_memory;                  // maximum size in bytes of the frames waiting in the queues
+    int sample_rate;                        // output sample rate of the audio (0 to keep the decoded one)
+    char *waveform_file;                    // sidecar file path used to load and save the audio overview
+    int native_rgba;                        // convert to RGBA/BGRA with the built-in converter instead of libswscale
+    int export_segments;                    // number of GOP segments decoded concurrently by nmd_get_next_frame()
 
     int64_t start_time64;
     int64_t end_time64;
@@ -0,0 +1,190 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <libavutil/avassert.h>
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "log.h"
+#include "packet_cache.h"
+
+struct packet_cache {
+    void *log_ctx;
+    int64_t max_size;
+
+    AVPacket **pkts;                        // ring buffer of packets, ordered by demuxing
+    int capacity;
+    int first;                              // index of the oldest packet
+    int nb_pkts;
+    int64_t size;                           // total size of the cached packets in bytes
+
+    int replay;                             // offset from the oldest packet of the next one to replay (-1 if none)
+};
+
+#define GET_PKT(pc, i) ((pc)->pkts[((pc)->first + (i)) % (pc)->capacity])
+
+static int64_t get_pkt_ts(const AVPacket *pkt)
+{
+    return pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+}
+
+struct packet_cache *nmdi_packet_cache_alloc(void)
+{
+    struct packet_cache *pc = av_mallocz(sizeof(*pc));
+    if (!pc)
+        return NULL;
+    pc->replay = -1;
+    return pc;
+}
+
+int nmdi_packet_cache_init(struct packet_cache *pc, void *log_ctx, int64_t max_size)
+{
+    av_assert0(max_size > 0);
+    pc->log_ctx = log_ctx;
+    pc->max_size = max_size;
+    return 0;
+}
+
+static void drop_oldest(struct packet_cache *pc)
+{
+    AVPacket *pkt = GET_PKT(pc, 0);
+    pc->size -= pkt->size;
+    av_packet_free(&pkt);
+    pc->first = (pc->first + 1) % pc->capacity;
+    pc->nb_pkts--;
+    if (pc->replay > 0)
+        pc->replay--;
+}
+
+/* Drop the oldest GOP, so that the cache still starts with a keyframe */
+static void drop_oldest_gop(struct packet_cache *pc)
+{
+    do {
+        drop_oldest(pc);
+    } while (pc->nb_pkts && !(GET_PKT(pc, 0)->flags & AV_PKT_FLAG_KEY));
+}
+
+static int grow(struct packet_cache *pc)
+{
+    const int capacity = FFMAX(pc->capacity * 2, 64);
+    AVPacket **pkts = av_malloc_array(capacity, sizeof(*pkts));
+    if (!pkts)
+        return AVERROR(ENOMEM);
+    for (int i = 0; i < pc->nb_pkts; i++)
+        pkts[i] = GET_PKT(pc, i);
+    av_free(pc->pkts);
+    pc->pkts = pkts;
+    pc->capacity = capacity;
+    pc->first = 0;
+    return 0;
+}
+
+int nmdi_packet_cache_add(struct packet_cache *pc, const AVPacket *pkt)
+{
+    av_assert0(pc->replay < 0);
+
+    /* The replay always starts from a keyframe */
+    if (!pc->nb_pkts && !(pkt->flags & AV_PKT_FLAG_KEY))
+        return 0;
+
+    if (pc->nb_pkts == pc->capacity) {
+        int ret = grow(pc);
+        if (ret < 0)
+            return ret;
+    }
+
+    AVPacket *ref = av_packet_clone(pkt);
+    if (!ref)
+        return AVERROR(ENOMEM);
+    GET_PKT(pc, pc->nb_pkts) = ref;
+    pc->nb_pkts++;
+    pc->size += ref->size;
+
+    while (pc->size > pc->max_size) {
+        TRACE(pc, "drop cached GOP starting at ts=%"PRId64, get_pkt_ts(GET_PKT(pc, 0)));
+        drop_oldest_gop(pc);
+    }
+    return 0;
+}
+
+void nmdi_packet_cache_break(struct packet_cache *pc)
+{
+    while (pc->nb_pkts)
+        drop_oldest(pc);
+    pc->first = 0;
+    pc->replay = -1;
+}
+
+int nmdi_packet_cache_seek(struct packet_cache *pc, int64_t ts)
+{
+    int kf = -1;
+    int64_t max_ts = AV_NOPTS_VALUE;
+
+    for (int i = 0; i < pc->nb_pkts; i++) {
+        const AVPacket *pkt = GET_PKT(pc, i);
+        const int64_t pkt_ts = get_pkt_ts(pkt);
+        if (pkt_ts == AV_NOPTS_VALUE)
+            continue;
+        if ((pkt->flags & AV_PKT_FLAG_KEY) && pkt_ts <= ts)
+            kf = i;
+        if (max_ts == AV_NOPTS_VALUE || pkt_ts > max_ts)
+            max_ts = pkt_ts;
+    }
+
+    /* Past the cached packets, a seek in the media may skip some reading */
+    if (kf < 0 || ts > max_ts) {
+        TRACE(pc, "ts=%"PRId64" is not cached", ts);
+        pc->replay = -1;
+        return 0;
+    }
+
+    TRACE(pc, "replay %d packets from ts=%"PRId64" for ts=%"PRId64,
+          pc->nb_pkts - kf, get_pkt_ts(GET_PKT(pc, kf)), ts);
+    pc->replay = kf;
+    return 1;
+}
+
+int nmdi_packet_cache_replay(struct packet_cache *pc, AVPacket *pkt)
+{
+    if (pc->replay < 0)
+        return 0;
+    if (pc->replay == pc->nb_pkts) {
+        TRACE(pc, "end of the replay");
+        pc->replay = -1;
+        return 0;
+    }
+    int ret = av_packet_ref(pkt, GET_PKT(pc, pc->replay));
+    if (ret < 0)
+        return ret;
+    pc->replay++;
+    return 1;
+}
+
+void nmdi_packet_cache_free(struct packet_cache **pcp)
+{
+    struct packet_cache *pc = *pcp;
+    if (!pc)
+        return;
+    nmdi_packet_cache_break(pc);
+    av_freep(&pc->pkts);
+    av_freep(pcp);
+}
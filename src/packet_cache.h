@@ -0,0 +1,71 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef PACKET_CACHE_H
+#define PACKET_CACHE_H
+
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+/*
+ * Latest packets read by the demuxer for a stream, in their demuxing order
+ * and starting with a keyframe, so that a seek back into them is replayed
+ * from memory, after which the demuxing goes on from the current position in
+ * the media.
+ *
+ * All the timestamps are expressed in the stream timebase.
+ */
+
+struct packet_cache *nmdi_packet_cache_alloc(void);
+
+int nmdi_packet_cache_init(struct packet_cache *pc, void *log_ctx, int64_t max_size);
+
+/**
+ * Keep a reference to the packet just read from the media. The packets are
+ * considered contiguous unless nmdi_packet_cache_break() is called in
+ * between; the oldest GOPs are dropped to honor the size limit.
+ */
+int nmdi_packet_cache_add(struct packet_cache *pc, const AVPacket *pkt);
+
+/**
+ * Drop the cached packets (typically after a seek in the media).
+ */
+void nmdi_packet_cache_break(struct packet_cache *pc);
+
+/**
+ * Position the replay at the latest keyframe at or before ts.
+ *
+ * Return 1 if ts is within the cached packets, 0 otherwise (in which case
+ * the media needs to be seeked).
+ */
+int nmdi_packet_cache_seek(struct packet_cache *pc, int64_t ts);
+
+/**
+ * Get the next packet to replay.
+ *
+ * Return 1 if pkt is set, 0 if there is nothing (left) to replay, a negative
+ * value on error.
+ */
+int nmdi_packet_cache_replay(struct packet_cache *pc, AVPacket *pkt);
+
+void nmdi_packet_cache_free(struct packet_cache **pcp);
+
+#endif
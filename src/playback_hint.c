@@ -0,0 +1,93 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "log.h"
+#include "playback_hint.h"
+#include "pthread_compat.h"
+
+struct playback_hint {
+    void *log_ctx;
+    pthread_mutex_t lock;
+
+    double rate;
+    int64_t target;
+};
+
+struct playback_hint *nmdi_playback_hint_alloc(void)
+{
+    struct playback_hint *ph = av_mallocz(sizeof(*ph));
+    if (!ph)
+        return NULL;
+    return ph;
+}
+
+int nmdi_playback_hint_init(struct playback_hint *ph, void *log_ctx)
+{
+    ph->log_ctx = log_ctx;
+    ph->rate = 1.0;
+    ph->target = AV_NOPTS_VALUE;
+    pthread_mutex_init(&ph->lock, NULL);
+    return 0;
+}
+
+void nmdi_playback_hint_set_rate(struct playback_hint *ph, double rate)
+{
+    pthread_mutex_lock(&ph->lock);
+    if (rate != ph->rate)
+        TRACE(ph, "playback rate: %g", rate);
+    ph->rate = rate;
+    pthread_mutex_unlock(&ph->lock);
+}
+
+void nmdi_playback_hint_set_target(struct playback_hint *ph, int64_t target)
+{
+    pthread_mutex_lock(&ph->lock);
+    ph->target = target;
+    pthread_mutex_unlock(&ph->lock);
+}
+
+double nmdi_playback_hint_get_rate(struct playback_hint *ph)
+{
+    pthread_mutex_lock(&ph->lock);
+    const double rate = ph->rate;
+    pthread_mutex_unlock(&ph->lock);
+    return rate;
+}
+
+int64_t nmdi_playback_hint_get_ff_target(struct playback_hint *ph)
+{
+    pthread_mutex_lock(&ph->lock);
+    const int64_t target = ph->rate > 1.0 ? ph->target : AV_NOPTS_VALUE;
+    pthread_mutex_unlock(&ph->lock);
+    return target;
+}
+
+void nmdi_playback_hint_free(struct playback_hint **php)
+{
+    struct playback_hint *ph = *php;
+    if (!ph)
+        return;
+    pthread_mutex_destroy(&ph->lock);
+    av_freep(php);
+}
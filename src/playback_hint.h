@@ -0,0 +1,57 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PLAYBACK_HINT_H
+#define PLAYBACK_HINT_H
+
+#include <stdint.h>
+
+/*
+ * Playback state of the user, shared with the pipeline threads so that they
+ * can skip the work whose result would never be displayed.
+ *
+ * The target is expressed in AV_TIME_BASE.
+ */
+
+struct playback_hint *nmdi_playback_hint_alloc(void);
+
+int nmdi_playback_hint_init(struct playback_hint *ph, void *log_ctx);
+
+/**
+ * Set the playback rate (1.0 for normal speed, higher for fast-forward).
+ */
+void nmdi_playback_hint_set_rate(struct playback_hint *ph, double rate);
+
+/**
+ * Set the media time of the latest frame requested by the user.
+ */
+void nmdi_playback_hint_set_target(struct playback_hint *ph, int64_t target);
+
+double nmdi_playback_hint_get_rate(struct playback_hint *ph);
+
+/**
+ * Get the latest requested media time, only if playing fast-forward
+ * (AV_NOPTS_VALUE otherwise).
+ */
+int64_t nmdi_playback_hint_get_ff_target(struct playback_hint *ph);
+
+void nmdi_playback_hint_free(struct playback_hint **php);
+
+#endif
@@ -0,0 +1,235 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <libavutil/avassert.h>
+#include <libavutil/common.h>
+#include <libavutil/cpu.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "pthread_compat.h"
+#include "scheduler.h"
+
+#define MAX_WORKERS 64
+
+enum task_state {
+    TASK_DONE,                              // not started or returned its final status
+    TASK_IDLE,                              // waiting to be woken up
+    TASK_READY,                             // in the ready list
+    TASK_RUNNING,                           // step in progress in one of the workers
+};
+
+struct sched_task {
+    int (*step)(void *arg);
+    int (*get_priority)(void *arg);
+    void *arg;
+
+    /* All the following fields are protected by the scheduler lock */
+    enum task_state state;
+    int woken;                              // woken up while running
+    int ret;                                // final status
+    struct sched_task *next;                // next task in the ready list
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;               // signaled when a task becomes ready
+    pthread_cond_t done_cond;               // signaled when a task is done
+    int refcount;                           // protected by life_lock
+    int quit;
+    pthread_t workers[MAX_WORKERS];
+    int nb_workers;
+    struct sched_task *ready;               // ready list head
+} sched = {
+    .lock      = PTHREAD_MUTEX_INITIALIZER,
+    .work_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* Serializes the workers startup and shutdown */
+static pthread_mutex_t life_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Must be called with the lock held */
+static void push_ready(struct sched_task *task)
+{
+    task->state = TASK_READY;
+    task->next = sched.ready;
+    sched.ready = task;
+    pthread_cond_signal(&sched.work_cond);
+}
+
+/* Must be called with the lock held. The priorities are evaluated again each
+ * time a worker takes a task since they depend on the state of the queues. */
+static struct sched_task *pop_ready(void)
+{
+    struct sched_task **bestp = &sched.ready;
+    int best_prio = (*bestp)->get_priority ? (*bestp)->get_priority((*bestp)->arg) : 0;
+
+    for (struct sched_task **taskp = &(*bestp)->next; *taskp; taskp = &(*taskp)->next) {
+        const struct sched_task *task = *taskp;
+        const int prio = task->get_priority ? task->get_priority(task->arg) : 0;
+        if (prio <= best_prio) { // the oldest task of the list wins ties
+            best_prio = prio;
+            bestp = taskp;
+        }
+    }
+
+    struct sched_task *task = *bestp;
+    *bestp = task->next;
+    task->next = NULL;
+    return task;
+}
+
+static void *worker_thread(void *arg)
+{
+    nmdi_set_thread_name("nmd/worker");
+
+    pthread_mutex_lock(&sched.lock);
+    for (;;) {
+        while (!sched.ready && !sched.quit)
+            pthread_cond_wait(&sched.work_cond, &sched.lock);
+        if (!sched.ready)
+            break;
+
+        struct sched_task *task = pop_ready();
+        task->state = TASK_RUNNING;
+        task->woken = 0;
+        pthread_mutex_unlock(&sched.lock);
+
+        const int ret = task->step(task->arg);
+
+        pthread_mutex_lock(&sched.lock);
+        if (ret >= 0 || (ret == AVERROR(EAGAIN) && task->woken)) {
+            push_ready(task);
+        } else if (ret == AVERROR(EAGAIN)) {
+            task->state = TASK_IDLE;
+        } else {
+            task->state = TASK_DONE;
+            task->ret = ret;
+            pthread_cond_broadcast(&sched.done_cond);
+        }
+    }
+    pthread_mutex_unlock(&sched.lock);
+    return NULL;
+}
+
+static void stop_workers(void)
+{
+    pthread_mutex_lock(&sched.lock);
+    sched.quit = 1;
+    pthread_cond_broadcast(&sched.work_cond);
+    pthread_mutex_unlock(&sched.lock);
+
+    for (int i = 0; i < sched.nb_workers; i++)
+        pthread_join(sched.workers[i], NULL);
+    sched.nb_workers = 0;
+    sched.quit = 0;
+}
+
+int nmdi_sched_ref(void)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&life_lock);
+    if (!sched.refcount) {
+        const int nb_workers = av_clip(av_cpu_count(), 1, MAX_WORKERS);
+        for (int i = 0; i < nb_workers; i++) {
+            ret = pthread_create(&sched.workers[i], NULL, worker_thread, NULL);
+            if (ret) {
+                ret = AVERROR(ret);
+                break;
+            }
+            sched.nb_workers++;
+        }
+    }
+    if (sched.nb_workers) {
+        sched.refcount++;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&life_lock);
+    return ret;
+}
+
+void nmdi_sched_unref(void)
+{
+    pthread_mutex_lock(&life_lock);
+    av_assert0(sched.refcount > 0);
+    if (!--sched.refcount)
+        stop_workers();
+    pthread_mutex_unlock(&life_lock);
+}
+
+struct sched_task *nmdi_sched_task_alloc(int (*step)(void *arg),
+                                         int (*get_priority)(void *arg),
+                                         void *arg)
+{
+    struct sched_task *task = av_mallocz(sizeof(*task));
+    if (!task)
+        return NULL;
+    task->step         = step;
+    task->get_priority = get_priority;
+    task->arg          = arg;
+    task->state        = TASK_DONE;
+    return task;
+}
+
+void nmdi_sched_task_start(struct sched_task *task)
+{
+    pthread_mutex_lock(&sched.lock);
+    if (task->state == TASK_DONE) {
+        task->ret = 0;
+        push_ready(task);
+    }
+    pthread_mutex_unlock(&sched.lock);
+}
+
+void nmdi_sched_task_wake(struct sched_task *task)
+{
+    if (!task)
+        return;
+
+    pthread_mutex_lock(&sched.lock);
+    if (task->state == TASK_IDLE)
+        push_ready(task);
+    else if (task->state == TASK_RUNNING)
+        task->woken = 1;
+    pthread_mutex_unlock(&sched.lock);
+}
+
+int nmdi_sched_task_join(struct sched_task *task)
+{
+    pthread_mutex_lock(&sched.lock);
+    while (task->state != TASK_DONE)
+        pthread_cond_wait(&sched.done_cond, &sched.lock);
+    const int ret = task->ret;
+    pthread_mutex_unlock(&sched.lock);
+    return ret;
+}
+
+void nmdi_sched_task_free(struct sched_task **taskp)
+{
+    struct sched_task *task = *taskp;
+    if (!task)
+        return;
+    av_assert0(task->state == TASK_DONE);
+    av_freep(taskp);
+}
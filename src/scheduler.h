@@ -0,0 +1,68 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/*
+ * Process-wide pool of workers running the steps of the pipeline modules, so
+ * that the number of threads doesn't grow with the number of contexts.
+ *
+ * A task is a function making a bit of progress without blocking. It returns
+ * 0 if it should be called again, AVERROR(EAGAIN) if it can't progress until
+ * it is woken up (typically when one of its queues changes state), and any
+ * other error when it is done. A task is never run by two workers at the same
+ * time.
+ *
+ * Among the tasks ready to run, the workers pick the one with the lowest
+ * priority value first.
+ */
+
+struct sched_task;
+
+/**
+ * Reference the scheduler, starting its workers if needed.
+ */
+int nmdi_sched_ref(void);
+void nmdi_sched_unref(void);
+
+struct sched_task *nmdi_sched_task_alloc(int (*step)(void *arg),
+                                         int (*get_priority)(void *arg),
+                                         void *arg);
+
+/**
+ * Queue the task for running; the scheduler must be referenced.
+ */
+void nmdi_sched_task_start(struct sched_task *task);
+
+/**
+ * Make sure the task is run again if it is waiting.
+ */
+void nmdi_sched_task_wake(struct sched_task *task);
+
+/**
+ * Wait for the task to be done and return its final status.
+ */
+int nmdi_sched_task_join(struct sched_task *task);
+
+void nmdi_sched_task_free(struct sched_task **taskp);
+
+#endif
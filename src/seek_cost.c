@@ -0,0 +1,124 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "log.h"
+#include "pthread_compat.h"
+#include "seek_cost.h"
+
+#define DECODE_WEIGHT 0.1                   // weight of a new decode ratio sample
+#define SEEK_WEIGHT   0.25                  // weight of a new seek sample
+
+struct seek_cost {
+    void *log_ctx;
+    pthread_mutex_t lock;
+
+    double decode_ratio;                    // wall time spent decoding per unit of media time
+    int nb_decode_samples;
+
+    double seek_time;                       // wall time of a seek, preroll decoding excluded
+    double preroll;                         // media time decoded and dropped after a seek
+    int nb_seek_samples;
+
+    int64_t last_preroll;                   // preroll of the seek being measured
+};
+
+struct seek_cost *nmdi_seek_cost_alloc(void)
+{
+    struct seek_cost *sc = av_mallocz(sizeof(*sc));
+    if (!sc)
+        return NULL;
+    return sc;
+}
+
+int nmdi_seek_cost_init(struct seek_cost *sc, void *log_ctx)
+{
+    sc->log_ctx = log_ctx;
+    pthread_mutex_init(&sc->lock, NULL);
+    return 0;
+}
+
+static double ewma(double avg, double value, double weight, int nb_samples)
+{
+    return nb_samples ? avg + (value - avg) * weight : value;
+}
+
+void nmdi_seek_cost_add_decode(struct seek_cost *sc, int64_t media_duration, int64_t busy_time)
+{
+    if (media_duration <= 0 || busy_time < 0)
+        return;
+
+    pthread_mutex_lock(&sc->lock);
+    const double ratio = busy_time / (double)media_duration;
+    sc->decode_ratio = ewma(sc->decode_ratio, ratio, DECODE_WEIGHT, sc->nb_decode_samples++);
+    TRACE(sc, "decoded %s in %s, decode ratio: %f",
+          PTS2TIMESTR(media_duration), PTS2TIMESTR(busy_time), sc->decode_ratio);
+    pthread_mutex_unlock(&sc->lock);
+}
+
+void nmdi_seek_cost_add_preroll(struct seek_cost *sc, int64_t preroll)
+{
+    pthread_mutex_lock(&sc->lock);
+    sc->last_preroll = FFMAX(preroll, 0);
+    pthread_mutex_unlock(&sc->lock);
+}
+
+void nmdi_seek_cost_add_seek(struct seek_cost *sc, int64_t latency)
+{
+    pthread_mutex_lock(&sc->lock);
+    const int64_t preroll = sc->last_preroll;
+    sc->last_preroll = 0;
+    if (latency >= 0) {
+        /* The preroll decoding is accounted separately since it depends on
+         * the distance between the target and its keyframe */
+        const double seek_time = FFMAX(latency - preroll * sc->decode_ratio, 0.);
+        sc->seek_time = ewma(sc->seek_time, seek_time, SEEK_WEIGHT, sc->nb_seek_samples);
+        sc->preroll   = ewma(sc->preroll,   preroll,   SEEK_WEIGHT, sc->nb_seek_samples);
+        sc->nb_seek_samples++;
+        TRACE(sc, "seek took %s (preroll of %s), average seek time: %s",
+              PTS2TIMESTR(latency), PTS2TIMESTR(preroll), PTS2TIMESTR((int64_t)sc->seek_time));
+    }
+    pthread_mutex_unlock(&sc->lock);
+}
+
+int nmdi_seek_cost_get(struct seek_cost *sc, int64_t *overhead, int64_t *preroll)
+{
+    int ret = 0;
+    pthread_mutex_lock(&sc->lock);
+    if (sc->nb_decode_samples && sc->nb_seek_samples && sc->decode_ratio > 0.) {
+        *overhead = llrint(FFMIN(sc->seek_time / sc->decode_ratio, (double)INT64_MAX / 2));
+        *preroll  = llrint(sc->preroll);
+        ret = 1;
+    }
+    pthread_mutex_unlock(&sc->lock);
+    return ret;
+}
+
+void nmdi_seek_cost_free(struct seek_cost **scp)
+{
+    struct seek_cost *sc = *scp;
+    if (!sc)
+        return;
+    pthread_mutex_destroy(&sc->lock);
+    av_freep(scp);
+}
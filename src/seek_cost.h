@@ -0,0 +1,67 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef SEEK_COST_H
+#define SEEK_COST_H
+
+#include <stdint.h>
+
+/*
+ * Runtime model of the cost of decoding forward versus seeking, calibrated
+ * from the measurements made by the decoder and the async layer.
+ *
+ * All the durations (media and wall clock) are expressed in AV_TIME_BASE.
+ */
+
+struct seek_cost *nmdi_seek_cost_alloc(void);
+
+int nmdi_seek_cost_init(struct seek_cost *sc, void *log_ctx);
+
+/**
+ * Register that decoding media_duration worth of frames kept the decoder
+ * busy for busy_time.
+ */
+void nmdi_seek_cost_add_decode(struct seek_cost *sc, int64_t media_duration, int64_t busy_time);
+
+/**
+ * Register the amount of media the decoder had to decode and drop after a
+ * seek before reaching the requested time.
+ */
+void nmdi_seek_cost_add_preroll(struct seek_cost *sc, int64_t preroll);
+
+/**
+ * Register the time it took between a seek request and the first frame
+ * obtained after it. Must be called after the corresponding preroll (if any)
+ * has been registered.
+ */
+void nmdi_seek_cost_add_seek(struct seek_cost *sc, int64_t latency);
+
+/**
+ * Get the model estimations, in media time: overhead is the time that could
+ * have been decoded in place of the seek itself, preroll the average amount
+ * of media decoded after a seek before reaching the target.
+ *
+ * Return 1 if the model is calibrated, 0 otherwise (outputs are untouched).
+ */
+int nmdi_seek_cost_get(struct seek_cost *sc, int64_t *overhead, int64_t *preroll);
+
+void nmdi_seek_cost_free(struct seek_cost **scp);
+
+#endif
@@ -0,0 +1,400 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libavutil/avassert.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "log.h"
+#include "mem_budget.h"
+#include "pthread_compat.h"
+#include "segment_export.h"
+
+/*
+ * Each worker buffers its whole segment, so that it can go on with its next
+ * one while the output is still on the previous segments. The buffers are
+ * charged to a memory budget (see mem_budget.h), which lowers the number of
+ * frames of the workers down to what fits.
+ */
+#define MAX_SEGMENT_FRAMES 1024                     // frames buffered per worker at most
+#define DEFAULT_MAX_MEMORY (INT64_C(2) << 30)       // limit when the context has none
+#define MIN_SEGMENT_DURATION AV_TIME_BASE           // shorter segments would be dominated by their seek
+
+struct worker {
+    struct segment_export *e;
+    int idx;                                // index of the worker and of its reader
+    pthread_t tid;
+    AVFrame *tmp_frame;                     // frame being read
+    int64_t frame_size;                     // size of the latest frame reported to the budget
+
+    /* Segment being decoded, shared with the output under the lock */
+    int seg;                                // -1 until the first segment is planned
+    AVFrame **frames;                       // ring of the decoded frames, grown on demand
+    int frames_size;
+    int rd, nb;
+    int done;                               // the segment is entirely decoded
+    int err;
+};
+
+struct segment_export {
+    void *log_ctx;
+    struct segment_export_callbacks cb;
+    struct worker *workers;
+    int nb_workers;
+    int nb_started;
+
+    int64_t end;
+    int64_t resume_ts;
+    int64_t min_duration;
+    struct mem_budget *mem_budget;
+
+    /* Boundaries of the segments planned so far, the segment i spanning from
+     * bounds[i] to bounds[i+1] */
+    pthread_mutex_t plan_lock;
+    int64_t *bounds;
+    int nb_bounds;
+    unsigned bounds_size;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;                    // any change of the workers or output state
+    int quit;
+    int max_frames;                         // frames each worker can buffer within the budget
+    int nb_segments;                        // -1 until the last segment is planned
+    int cur;                                // segment being output
+};
+
+struct segment_export *nmdi_segment_export_alloc(void)
+{
+    struct segment_export *e = av_mallocz(sizeof(*e));
+    if (!e)
+        return NULL;
+    pthread_mutex_init(&e->plan_lock, NULL);
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->cond, NULL);
+    e->nb_segments = -1;
+    return e;
+}
+
+static int add_bound(struct segment_export *e, int64_t ts)
+{
+    int64_t *bounds = av_fast_realloc(e->bounds, &e->bounds_size, (e->nb_bounds + 1) * sizeof(*bounds));
+    if (!bounds)
+        return AVERROR(ENOMEM);
+    e->bounds = bounds;
+    bounds[e->nb_bounds++] = ts;
+    return 0;
+}
+
+/*
+ * Get the boundaries of the segment seg (the end of the last one being
+ * AV_NOPTS_VALUE), planning the segments up to it as the keyframes get
+ * located. Return AVERROR_EOF if the stream has less segments.
+ */
+static int plan_segment(struct segment_export *e, int reader, int seg, int64_t *start, int64_t *end)
+{
+    pthread_mutex_lock(&e->plan_lock);
+
+    int ret = 0;
+    while (e->nb_segments < 0 && e->nb_bounds <= seg + 1) {
+        const int64_t prev = e->bounds[e->nb_bounds - 1];
+        int64_t kf;
+        ret = e->cb.next_keyframe(e->cb.opaque, reader, prev + e->min_duration - 1, &kf);
+        if (ret < 0)
+            goto end;
+        if (kf == AV_NOPTS_VALUE || (e->end != AV_NOPTS_VALUE && kf >= e->end)) {
+            TRACE(e, "%d segments planned", e->nb_bounds);
+            pthread_mutex_lock(&e->lock);
+            e->nb_segments = e->nb_bounds;
+            pthread_cond_broadcast(&e->cond);
+            pthread_mutex_unlock(&e->lock);
+            break;
+        }
+        ret = add_bound(e, kf);
+        if (ret < 0)
+            goto end;
+    }
+
+    if (e->nb_segments >= 0 && seg >= e->nb_segments) {
+        ret = AVERROR_EOF;
+        goto end;
+    }
+    *start = e->bounds[seg];
+    *end = seg + 1 < e->nb_bounds ? e->bounds[seg + 1] : AV_NOPTS_VALUE;
+
+end:
+    pthread_mutex_unlock(&e->plan_lock);
+    return ret;
+}
+
+/* Must be called with the lock held */
+static int push_frame(struct worker *w, AVFrame *frame)
+{
+    if (w->nb == w->frames_size) {
+        const int size = FFMAX(w->frames_size * 2, 16);
+        AVFrame **frames = av_calloc(size, sizeof(*frames));
+        if (!frames)
+            return AVERROR(ENOMEM);
+        for (int i = 0; i < size; i++) {
+            frames[i] = i < w->frames_size ? w->frames[(w->rd + i) % w->frames_size] : av_frame_alloc();
+            if (!frames[i]) {
+                for (int j = w->frames_size; j < i; j++)
+                    av_frame_free(&frames[j]);
+                av_free(frames);
+                return AVERROR(ENOMEM);
+            }
+        }
+        av_free(w->frames);
+        w->frames = frames;
+        w->frames_size = size;
+        w->rd = 0;
+    }
+    av_frame_move_ref(w->frames[(w->rd + w->nb) % w->frames_size], frame);
+    w->nb++;
+    return 0;
+}
+
+static void set_max_frames(void *opaque, int depth)
+{
+    struct segment_export *e = opaque;
+    pthread_mutex_lock(&e->lock);
+    e->max_frames = FFMAX(depth / e->nb_workers, 1);
+    pthread_cond_broadcast(&e->cond);
+    pthread_mutex_unlock(&e->lock);
+}
+
+static int decode_segment(struct segment_export *e, struct worker *w, int64_t start, int64_t end)
+{
+    TRACE(e, "worker %d: decode segment %d from %"PRId64" to %"PRId64, w->idx, w->seg, start, end);
+
+    int ret = e->cb.seek(e->cb.opaque, w->idx, start);
+    if (ret < 0)
+        return ret;
+
+    AVFrame *frame = w->tmp_frame;
+    for (;;) {
+        ret = e->cb.read(e->cb.opaque, w->idx, frame);
+        if (ret < 0)
+            return ret;
+        if (end != AV_NOPTS_VALUE && frame->pts >= end) {
+            av_frame_unref(frame);
+            return 0;
+        }
+
+        /* The frames preceding the keyframe belong to the previous segment */
+        if ((w->seg && frame->pts < start) ||
+            (e->resume_ts != AV_NOPTS_VALUE && frame->pts <= e->resume_ts)) {
+            av_frame_unref(frame);
+            continue;
+        }
+
+        const int64_t frame_size = nmdi_get_frame_size(frame);
+        if (frame_size != w->frame_size) {
+            w->frame_size = frame_size;
+            nmdi_mem_budget_set_frame_size(e->mem_budget, MEM_BUDGET_EXPORT, frame_size);
+        }
+
+        pthread_mutex_lock(&e->lock);
+        while (!e->quit && w->nb >= e->max_frames)
+            pthread_cond_wait(&e->cond, &e->lock);
+        ret = e->quit ? AVERROR_EXIT : push_frame(w, frame);
+        if (ret >= 0)
+            pthread_cond_broadcast(&e->cond);
+        pthread_mutex_unlock(&e->lock);
+        if (ret < 0) {
+            av_frame_unref(frame);
+            return ret;
+        }
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    struct worker *w = arg;
+    struct segment_export *e = w->e;
+
+    nmdi_set_thread_name("nmd/export");
+
+    /* The segments are assigned to the workers in turn */
+    for (int seg = w->idx; ; seg += e->nb_workers) {
+        /* Wait for the output of the previous segment of the worker */
+        pthread_mutex_lock(&e->lock);
+        while (!e->quit && e->cur <= seg - e->nb_workers)
+            pthread_cond_wait(&e->cond, &e->lock);
+        const int quit = e->quit;
+        pthread_mutex_unlock(&e->lock);
+        if (quit)
+            break;
+
+        int64_t start, end;
+        int ret = plan_segment(e, w->idx, seg, &start, &end);
+        if (ret == AVERROR_EOF)
+            break;
+
+        pthread_mutex_lock(&e->lock);
+        w->seg = seg;
+        w->rd = w->nb = 0;
+        w->done = ret < 0;
+        w->err = ret;
+        pthread_cond_broadcast(&e->cond);
+        pthread_mutex_unlock(&e->lock);
+        if (ret < 0)
+            break;
+
+        ret = decode_segment(e, w, start, end);
+
+        pthread_mutex_lock(&e->lock);
+        w->done = 1;
+        w->err = ret == AVERROR_EOF ? 0 : ret;
+        pthread_cond_broadcast(&e->cond);
+        pthread_mutex_unlock(&e->lock);
+        if (ret < 0 && ret != AVERROR_EOF)
+            break;
+    }
+
+    return NULL;
+}
+
+int nmdi_segment_export_init(struct segment_export *e, void *log_ctx, int nb_workers, int64_t max_memory,
+                             AVRational time_base, int64_t start, int64_t end, int64_t resume_ts,
+                             const struct segment_export_callbacks *cb)
+{
+    av_assert0(nb_workers > 0);
+
+    e->log_ctx = log_ctx;
+    e->cb = *cb;
+    e->end = end;
+    e->resume_ts = resume_ts;
+    e->min_duration = FFMAX(av_rescale_q(MIN_SEGMENT_DURATION, AV_TIME_BASE_Q, time_base), 1);
+
+    int ret = add_bound(e, start);
+    if (ret < 0)
+        return ret;
+
+    e->workers = av_calloc(nb_workers, sizeof(*e->workers));
+    if (!e->workers)
+        return AVERROR(ENOMEM);
+    e->nb_workers = nb_workers;
+    e->max_frames = MAX_SEGMENT_FRAMES;
+
+    e->mem_budget = nmdi_mem_budget_alloc();
+    if (!e->mem_budget)
+        return AVERROR(ENOMEM);
+    ret = nmdi_mem_budget_init(e->mem_budget, log_ctx, max_memory ? max_memory : DEFAULT_MAX_MEMORY);
+    if (ret < 0)
+        return ret;
+    nmdi_mem_budget_set_queue_cb(e->mem_budget, MEM_BUDGET_EXPORT, set_max_frames, e,
+                                 nb_workers * MAX_SEGMENT_FRAMES);
+
+    for (int i = 0; i < nb_workers; i++) {
+        struct worker *w = &e->workers[i];
+        w->e = e;
+        w->idx = i;
+        w->seg = -1;
+        w->tmp_frame = av_frame_alloc();
+        if (!w->tmp_frame)
+            return AVERROR(ENOMEM);
+    }
+
+    for (int i = 0; i < nb_workers; i++) {
+        ret = pthread_create(&e->workers[i].tid, NULL, worker_thread, &e->workers[i]);
+        if (ret) {
+            ret = AVERROR(ret);
+            LOG(e, ERROR, "Unable to start export thread: %s", av_err2str(ret));
+            return ret;
+        }
+        e->nb_started++;
+    }
+
+    TRACE(e, "export from %"PRId64" with %d workers", start, nb_workers);
+    return 0;
+}
+
+int nmdi_segment_export_read(struct segment_export *e, AVFrame *frame)
+{
+    int ret;
+
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        if (e->nb_segments >= 0 && e->cur >= e->nb_segments) {
+            ret = AVERROR_EOF;
+            break;
+        }
+
+        struct worker *w = &e->workers[e->cur % e->nb_workers];
+        if (w->seg == e->cur) {
+            if (w->nb) {
+                av_frame_move_ref(frame, w->frames[w->rd]);
+                w->rd = (w->rd + 1) % w->frames_size;
+                w->nb--;
+                pthread_cond_broadcast(&e->cond);
+                ret = 0;
+                break;
+            }
+            if (w->done) {
+                if (w->err < 0) {
+                    ret = w->err;
+                    break;
+                }
+                e->cur++;
+                pthread_cond_broadcast(&e->cond);
+                continue;
+            }
+        }
+
+        pthread_cond_wait(&e->cond, &e->lock);
+    }
+    pthread_mutex_unlock(&e->lock);
+
+    if (ret >= 0)
+        nmdi_mem_budget_touch(e->mem_budget);
+    return ret;
+}
+
+void nmdi_segment_export_free(struct segment_export **ep)
+{
+    struct segment_export *e = *ep;
+    if (!e)
+        return;
+
+    pthread_mutex_lock(&e->lock);
+    e->quit = 1;
+    pthread_cond_broadcast(&e->cond);
+    pthread_mutex_unlock(&e->lock);
+    for (int i = 0; i < e->nb_started; i++)
+        pthread_join(e->workers[i].tid, NULL);
+
+    /* The budget may call back until it is unregistered */
+    nmdi_mem_budget_free(&e->mem_budget);
+
+    for (int i = 0; i < e->nb_workers; i++) {
+        struct worker *w = &e->workers[i];
+        av_frame_free(&w->tmp_frame);
+        for (int j = 0; j < w->frames_size; j++)
+            av_frame_free(&w->frames[j]);
+        av_freep(&w->frames);
+    }
+    av_freep(&e->workers);
+    av_freep(&e->bounds);
+    pthread_cond_destroy(&e->cond);
+    pthread_mutex_destroy(&e->lock);
+    pthread_mutex_destroy(&e->plan_lock);
+    av_freep(ep);
+}
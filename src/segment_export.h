@@ -0,0 +1,75 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef SEGMENT_EXPORT_H
+#define SEGMENT_EXPORT_H
+
+#include <stdint.h>
+#include <libavutil/frame.h>
+#include <libavutil/rational.h>
+
+/*
+ * Sequential read of a video stream split at its keyframes into segments,
+ * decoded concurrently by a set of workers (each with its own reader) and
+ * returned in order.
+ *
+ * All the timestamps are expressed in the stream timebase.
+ */
+
+/* Operations on the reader of a worker, only called from the thread of this
+ * worker */
+struct segment_export_callbacks {
+    void *opaque;
+
+    /* Position the reader at ts */
+    int (*seek)(void *opaque, int reader, int64_t ts);
+
+    /* Get the next frame of the reader, AVERROR_EOF at the end of the stream */
+    int (*read)(void *opaque, int reader, AVFrame *frame);
+
+    /* Get the first keyframe after ts (AV_NOPTS_VALUE if there is none),
+     * reading the stream ahead if it is not known yet; the calls are
+     * serialized between the workers */
+    int (*next_keyframe)(void *opaque, int reader, int64_t ts, int64_t *kf);
+};
+
+struct segment_export *nmdi_segment_export_alloc(void);
+
+/**
+ * Start the nb_workers workers reading the stream from start (up to end if
+ * not AV_NOPTS_VALUE), the frames up to resume_ts included being skipped (if
+ * not AV_NOPTS_VALUE). The frames buffered by the workers are limited to
+ * max_memory bytes (0 for the default limit) and to the process-wide limit set
+ * with nmd_set_max_queued_memory().
+ */
+int nmdi_segment_export_init(struct segment_export *e, void *log_ctx, int nb_workers, int64_t max_memory,
+                             AVRational time_base, int64_t start, int64_t end, int64_t resume_ts,
+                             const struct segment_export_callbacks *cb);
+
+/**
+ * Get the next frame of the stream, waiting for it to be decoded. Return
+ * AVERROR_EOF after the last one.
+ */
+int nmdi_segment_export_read(struct segment_export *e, AVFrame *frame);
+
+void nmdi_segment_export_free(struct segment_export **ep);
+
+#endif
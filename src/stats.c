@@ -0,0 +1,96 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "pthread_compat.h"
+#include "stats.h"
+
+struct timing {
+    int64_t count;
+    int64_t total;
+    int64_t max;
+};
+
+struct stats {
+    pthread_mutex_t lock;
+    struct timing timings[NB_STATS_TIMING];
+    int64_t counters[NB_STATS_COUNTER];
+};
+
+struct stats *nmdi_stats_alloc(void)
+{
+    struct stats *st = av_mallocz(sizeof(*st));
+    if (!st)
+        return NULL;
+    return st;
+}
+
+int nmdi_stats_init(struct stats *st)
+{
+    pthread_mutex_init(&st->lock, NULL);
+    return 0;
+}
+
+void nmdi_stats_add_time(struct stats *st, enum stats_timing timing, int64_t duration)
+{
+    pthread_mutex_lock(&st->lock);
+    struct timing *t = &st->timings[timing];
+    t->count++;
+    t->total += duration;
+    t->max = FFMAX(t->max, duration);
+    pthread_mutex_unlock(&st->lock);
+}
+
+void nmdi_stats_count(struct stats *st, enum stats_counter counter, int64_t n)
+{
+    pthread_mutex_lock(&st->lock);
+    st->counters[counter] += n;
+    pthread_mutex_unlock(&st->lock);
+}
+
+void nmdi_stats_get_timing(struct stats *st, enum stats_timing timing, struct nmd_timing_stats *ts)
+{
+    pthread_mutex_lock(&st->lock);
+    const struct timing *t = &st->timings[timing];
+    ts->count = t->count;
+    ts->avg   = t->count ? t->total / (double)t->count / AV_TIME_BASE : 0.;
+    ts->max   = t->max / (double)AV_TIME_BASE;
+    pthread_mutex_unlock(&st->lock);
+}
+
+int64_t nmdi_stats_get_counter(struct stats *st, enum stats_counter counter)
+{
+    pthread_mutex_lock(&st->lock);
+    const int64_t n = st->counters[counter];
+    pthread_mutex_unlock(&st->lock);
+    return n;
+}
+
+void nmdi_stats_free(struct stats **stp)
+{
+    struct stats *st = *stp;
+    if (!st)
+        return;
+    pthread_mutex_destroy(&st->lock);
+    av_freep(stp);
+}
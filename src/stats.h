@@ -0,0 +1,64 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#include "nopemd.h"
+
+/*
+ * Performance counters and timings of the pipeline (see nmd_get_stats()),
+ * updated by the modules from their own threads. The durations are expressed
+ * in microseconds.
+ */
+
+enum stats_timing {
+    STATS_TIMING_DEMUX,                     // reading of a packet
+    STATS_TIMING_DECODE,                    // decoding of a packet
+    STATS_TIMING_FILTER,                    // filtering of a frame
+    STATS_TIMING_SINK_WAIT,                 // wait for a frame in the sink
+    STATS_TIMING_SEEK,                      // seek up to the first frame obtained
+    NB_STATS_TIMING
+};
+
+enum stats_counter {
+    STATS_COUNTER_SEEKS,
+    STATS_COUNTER_FRAMES_DECODED,
+    STATS_COUNTER_FRAMES_DROPPED,           // decoded frames preceding the seek target
+    NB_STATS_COUNTER
+};
+
+struct stats *nmdi_stats_alloc(void);
+
+int nmdi_stats_init(struct stats *st);
+
+void nmdi_stats_add_time(struct stats *st, enum stats_timing timing, int64_t duration);
+
+void nmdi_stats_count(struct stats *st, enum stats_counter counter, int64_t n);
+
+void nmdi_stats_get_timing(struct stats *st, enum stats_timing timing, struct nmd_timing_stats *ts);
+
+int64_t nmdi_stats_get_counter(struct stats *st, enum stats_counter counter);
+
+void nmdi_stats_free(struct stats **stp);
+
+#endif
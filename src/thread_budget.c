@@ -0,0 +1,60 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libavutil/common.h>
+#include <libavutil/cpu.h>
+
+#include "pthread_compat.h"
+#include "thread_budget.h"
+
+static pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+static int max_threads;
+static int used_threads;
+
+/* A reservation of 0 threads stands for one per core */
+static int get_nb_reserved(int nb_threads)
+{
+    return nb_threads ? nb_threads : av_cpu_count();
+}
+
+void nmdi_thread_budget_set(int max)
+{
+    pthread_mutex_lock(&budget_lock);
+    max_threads = FFMAX(max, 0);
+    pthread_mutex_unlock(&budget_lock);
+}
+
+int nmdi_thread_budget_acquire(int nb_threads)
+{
+    nb_threads = FFMIN(nb_threads, av_cpu_count());
+    pthread_mutex_lock(&budget_lock);
+    if (max_threads)
+        nb_threads = av_clip(max_threads - used_threads, 1, get_nb_reserved(nb_threads));
+    used_threads += get_nb_reserved(nb_threads);
+    pthread_mutex_unlock(&budget_lock);
+    return nb_threads;
+}
+
+void nmdi_thread_budget_release(int nb_threads)
+{
+    pthread_mutex_lock(&budget_lock);
+    used_threads = FFMAX(used_threads - get_nb_reserved(nb_threads), 0);
+    pthread_mutex_unlock(&budget_lock);
+}
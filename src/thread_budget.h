@@ -0,0 +1,48 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef THREAD_BUDGET_H
+#define THREAD_BUDGET_H
+
+/*
+ * Process-wide budget of threads shared by the decoders and filtergraphs of
+ * all the contexts (see nmd_set_max_threads()).
+ *
+ * All the functions are thread-safe.
+ */
+
+/**
+ * Set the maximum number of threads (0 for no limit). The reservations
+ * already made are not affected.
+ */
+void nmdi_thread_budget_set(int max_threads);
+
+/**
+ * Reserve up to nb_threads threads (clipped to the number of cores); 0 lets
+ * FFmpeg pick (one per core) as long as there is no limit. The returned count
+ * is never 0 when a limit is set, and at least one thread is always granted,
+ * even past the limit.
+ *
+ * The returned value must be given back to nmdi_thread_budget_release().
+ */
+int nmdi_thread_budget_acquire(int nb_threads);
+void nmdi_thread_budget_release(int nb_threads);
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#define _GNU_SOURCE // syscall() on Linux
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+
+#include "log.h"
+#include "pthread_compat.h"
+#include "trace.h"
+
+struct thread_name {
+    uint64_t tid;
+    char name[32];
+};
+
+/* Thread of a context whose names have been written to the trace */
+struct track {
+    int pid;
+    uint64_t tid;
+};
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_file;
+static int64_t trace_start_time;
+static int nb_events;
+static struct thread_name *thread_names;
+static int nb_thread_names;
+static struct track *tracks;
+static int nb_tracks;
+
+volatile int nmdi_trace_on;
+
+static uint64_t get_thread_id(void)
+{
+#if defined(_WIN32)
+    return GetCurrentThreadId();
+#elif defined(__APPLE__)
+    uint64_t tid = 0;
+    pthread_threadid_np(NULL, &tid);
+    return tid;
+#elif defined(__linux__)
+    return syscall(SYS_gettid);
+#else
+    return (uintptr_t)pthread_self();
+#endif
+}
+
+static void write_string(const char *s)
+{
+    fputc('"', trace_file);
+    for (; *s; s++) {
+        const unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(trace_file, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(trace_file, "\\u%04x", c);
+        else
+            fputc(c, trace_file);
+    }
+    fputc('"', trace_file);
+}
+
+static void write_separator(void)
+{
+    fputs(nb_events++ ? ",\n" : "\n", trace_file);
+}
+
+static void write_metadata(const char *type, int pid, uint64_t tid, const char *name)
+{
+    write_separator();
+    fprintf(trace_file, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%"PRIu64",\"args\":{\"name\":",
+            type, pid, tid);
+    write_string(name);
+    fputs("}}", trace_file);
+}
+
+/* Name the process of the context and its thread the first time they appear */
+static void write_track_names(const struct log_ctx *log_ctx, int pid, uint64_t tid)
+{
+    int pid_known = 0;
+    for (int i = 0; i < nb_tracks; i++) {
+        if (tracks[i].pid != pid)
+            continue;
+        if (tracks[i].tid == tid)
+            return;
+        pid_known = 1;
+    }
+
+    struct track *new_tracks = av_realloc_array(tracks, nb_tracks + 1, sizeof(*tracks));
+    if (!new_tracks)
+        return;
+    tracks = new_tracks;
+    tracks[nb_tracks++] = (struct track){.pid = pid, .tid = tid};
+
+    if (!pid_known)
+        write_metadata("process_name", pid, tid, nmdi_log_get_name(log_ctx));
+    for (int i = 0; i < nb_thread_names; i++) {
+        if (thread_names[i].tid == tid) {
+            write_metadata("thread_name", pid, tid, thread_names[i].name);
+            break;
+        }
+    }
+}
+
+static void write_event_header(const struct log_ctx *log_ctx, const char *name, char phase)
+{
+    const int pid = nmdi_log_get_id(log_ctx);
+    const uint64_t tid = get_thread_id();
+    write_track_names(log_ctx, pid, tid);
+    write_separator();
+    fprintf(trace_file, "{\"name\":\"%s\",\"cat\":\"nmd\",\"ph\":\"%c\",\"ts\":%"PRId64",\"pid\":%d,\"tid\":%"PRIu64,
+            name, phase, av_gettime_relative() - trace_start_time, pid, tid);
+}
+
+int nmdi_trace_start(const char *filename)
+{
+    int ret = 0;
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file) {
+        ret = AVERROR(EBUSY);
+        goto end;
+    }
+    trace_file = fopen(filename, "w");
+    if (!trace_file) {
+        ret = AVERROR(errno);
+        goto end;
+    }
+    fputs("{\"traceEvents\":[", trace_file);
+    nb_events = 0;
+    trace_start_time = av_gettime_relative();
+    nmdi_trace_on = 1;
+end:
+    pthread_mutex_unlock(&trace_lock);
+    return ret;
+}
+
+void nmdi_trace_span(void *log_ctx, int begin, const char *name)
+{
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file) {
+        write_event_header(log_ctx, name, begin ? 'B' : 'E');
+        fputc('}', trace_file);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void nmdi_trace_counter(void *log_ctx, const char *name, int64_t value)
+{
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file) {
+        write_event_header(log_ctx, name, 'C');
+        fprintf(trace_file, ",\"args\":{\"value\":%"PRId64"}}", value);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * Only the threads started while recording are named. A thread identifier
+ * can be reused by the system for a new thread, in which case its name is
+ * written again for every context.
+ */
+void nmdi_trace_set_thread_name(const char *name)
+{
+    if (!nmdi_trace_on)
+        return;
+
+    const uint64_t tid = get_thread_id();
+    pthread_mutex_lock(&trace_lock);
+    if (!trace_file)
+        goto end;
+
+    int i;
+    for (i = 0; i < nb_thread_names; i++)
+        if (thread_names[i].tid == tid)
+            break;
+    if (i == nb_thread_names) {
+        struct thread_name *new_names = av_realloc_array(thread_names, nb_thread_names + 1, sizeof(*thread_names));
+        if (!new_names)
+            goto end;
+        thread_names = new_names;
+        thread_names[nb_thread_names++].tid = tid;
+    }
+    snprintf(thread_names[i].name, sizeof(thread_names[i].name), "%s", name);
+
+    int nb_kept = 0;
+    for (int j = 0; j < nb_tracks; j++)
+        if (tracks[j].tid != tid)
+            tracks[nb_kept++] = tracks[j];
+    nb_tracks = nb_kept;
+
+end:
+    pthread_mutex_unlock(&trace_lock);
+}
+
+int nmdi_trace_stop(void)
+{
+    int ret = 0;
+    pthread_mutex_lock(&trace_lock);
+    if (!trace_file)
+        goto end;
+    nmdi_trace_on = 0;
+    fputs("\n]}\n", trace_file);
+    if (fclose(trace_file) < 0)
+        ret = AVERROR(errno);
+    trace_file = NULL;
+    av_freep(&thread_names);
+    nb_thread_names = 0;
+    av_freep(&tracks);
+    nb_tracks = 0;
+end:
+    pthread_mutex_unlock(&trace_lock);
+    return ret;
+}
@@ -0,0 +1,64 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Structured tracing of the pipeline events (see nmd_trace_start()): spans
+ * and counters are written to a file in the Chrome trace event JSON format,
+ * where each context is a process and each module thread a thread.
+ *
+ * The TRACE_* macros only cost a test of nmdi_trace_on when the recording is
+ * off. The flag is read without synchronization: an event racing with the
+ * start or the stop of the recording is dropped under the trace lock.
+ */
+
+extern volatile int nmdi_trace_on;
+
+#define TRACE_BEGIN(c, name) do {                                   \
+    if (nmdi_trace_on)                                              \
+        nmdi_trace_span((c)->log_ctx, 1, name);                     \
+} while (0)
+
+#define TRACE_END(c, name) do {                                     \
+    if (nmdi_trace_on)                                              \
+        nmdi_trace_span((c)->log_ctx, 0, name);                     \
+} while (0)
+
+#define TRACE_COUNTER(c, name, value) do {                          \
+    if (nmdi_trace_on)                                              \
+        nmdi_trace_counter((c)->log_ctx, name, value);              \
+} while (0)
+
+int nmdi_trace_start(const char *filename);
+
+void nmdi_trace_span(void *log_ctx, int begin, const char *name);
+
+void nmdi_trace_counter(void *log_ctx, const char *name, int64_t value);
+
+void nmdi_trace_set_thread_name(const char *name);
+
+int nmdi_trace_stop(void);
+
+#endif
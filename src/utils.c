@@ -23,6 +23,7 @@
 #include "nopemd.h"
 #include "internal.h"
 #include "pthread_compat.h"
+#include "trace.h"
 
 static const struct {
     enum AVPixelFormat ff;
@@ -30,6 +31,7 @@ static const struct {
 } pix_fmts_mapping[] = {
     {AV_PIX_FMT_MEDIACODEC,   NMD_PIXFMT_MEDIACODEC},
     {AV_PIX_FMT_VAAPI,        NMD_PIXFMT_VAAPI},
+    {AV_PIX_FMT_DRM_PRIME,    NMD_PIXFMT_DRM_PRIME},
     {AV_PIX_FMT_VIDEOTOOLBOX, NMD_PIXFMT_VT},
     {AV_PIX_FMT_BGRA,         NMD_PIXFMT_BGRA},
     {AV_PIX_FMT_RGBA,         NMD_PIXFMT_RGBA},
@@ -84,6 +86,17 @@ void nmdi_set_thread_name(const char *name)
 #elif defined(__linux__) && defined(__GLIBC__)
     pthread_setname_np(pthread_self(), name);
 #endif
+    nmdi_trace_set_thread_name(name);
+}
+
+int64_t nmdi_get_frame_size(const AVFrame *frame)
+{
+    int64_t size = 0;
+    for (int i = 0; i < FF_ARRAY_ELEMS(frame->buf) && frame->buf[i]; i++)
+        size += frame->buf[i]->size;
+    for (int i = 0; i < frame->nb_extended_buf; i++)
+        size += frame->extended_buf[i]->size;
+    return size;
 }
 
 void nmdi_update_dimensions(int *width, int *height, int max_pixels)
@@ -0,0 +1,458 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavutil/avassert.h>
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include <libavutil/samplefmt.h>
+
+#include "internal.h"
+#include "log.h"
+#include "pthread_compat.h"
+#include "waveform.h"
+
+#define SIDECAR_MAGIC   "nmd-waveform"
+#define SIDECAR_VERSION 1
+
+#define BLOCK_SIZE 256                      // samples per peak of the finest level
+#define MAX_LEVELS 32
+
+struct peak_level {
+    struct nmd_audio_peak *peaks;
+    int nb_peaks;
+    unsigned peaks_size;
+};
+
+struct waveform {
+    void *log_ctx;
+    char *sidecar;                          // NULL if the overview is not persisted
+
+    /* Identification of the media in the sidecar file */
+    int64_t file_size;
+    int64_t mtime;
+    int stream_idx;
+    int64_t start_time, end_time;
+
+    nmdi_waveform_read_func read;
+    void *opaque;
+    pthread_t tid;
+    int thread_started;
+
+    pthread_mutex_t lock;
+    int quit;                               // the computation must be aborted
+    int done;                               // the levels are complete (and not modified anymore)
+    int err;                                // error of the computation
+
+    int sample_rate;
+    int64_t first_pos;                      // position of the first sample, in samples
+    struct peak_level levels[MAX_LEVELS];
+    int nb_levels;
+
+    /* Block being reduced */
+    float cur_min, cur_max;
+    double cur_sq;
+    int cur_nb;
+};
+
+struct waveform *nmdi_waveform_alloc(void)
+{
+    struct waveform *w = av_mallocz(sizeof(*w));
+    if (!w)
+        return NULL;
+    pthread_mutex_init(&w->lock, NULL);
+    return w;
+}
+
+static int add_peak(struct peak_level *level, struct nmd_audio_peak peak)
+{
+    struct nmd_audio_peak *peaks = av_fast_realloc(level->peaks, &level->peaks_size,
+                                                   (level->nb_peaks + 1) * sizeof(*peaks));
+    if (!peaks)
+        return AVERROR(ENOMEM);
+    level->peaks = peaks;
+    peaks[level->nb_peaks++] = peak;
+    return 0;
+}
+
+static struct nmd_audio_peak merge_peaks(const struct nmd_audio_peak *peaks, int nb_peaks)
+{
+    struct nmd_audio_peak ret = peaks[0];
+    double sq = 0.;
+    for (int i = 0; i < nb_peaks; i++) {
+        ret.min = FFMIN(ret.min, peaks[i].min);
+        ret.max = FFMAX(ret.max, peaks[i].max);
+        sq += peaks[i].rms * peaks[i].rms;
+    }
+    ret.rms = sqrt(sq / nb_peaks);
+    return ret;
+}
+
+/* Derive the coarser levels from the finest one */
+static int build_levels(struct waveform *w)
+{
+    w->nb_levels = 1;
+    while (w->nb_levels < MAX_LEVELS && w->levels[w->nb_levels - 1].nb_peaks > 1) {
+        const struct peak_level *src = &w->levels[w->nb_levels - 1];
+        struct peak_level *dst = &w->levels[w->nb_levels];
+        for (int i = 0; i < src->nb_peaks; i += 2) {
+            int ret = add_peak(dst, merge_peaks(src->peaks + i, FFMIN(2, src->nb_peaks - i)));
+            if (ret < 0)
+                return ret;
+        }
+        w->nb_levels++;
+    }
+    return 0;
+}
+
+static int flush_block(struct waveform *w)
+{
+    if (!w->cur_nb)
+        return 0;
+    const struct nmd_audio_peak peak = {
+        .min = w->cur_min,
+        .max = w->cur_max,
+        .rms = sqrt(w->cur_sq / (w->cur_nb * 2)),
+    };
+    w->cur_nb = 0;
+    return add_peak(&w->levels[0], peak);
+}
+
+static int add_frame(struct waveform *w, const AVFrame *frame)
+{
+    av_assert0(frame->format == AV_SAMPLE_FMT_FLT);
+
+    if (!w->sample_rate) {
+        w->sample_rate = frame->sample_rate;
+        w->first_pos = frame->pts;
+        TRACE(w, "first samples at %"PRId64" (%d Hz)", w->first_pos, w->sample_rate);
+    }
+
+    const float *samples = (const float *)frame->data[0];
+    for (int i = 0; i < frame->nb_samples; i++) {
+        const float l = samples[2*i], r = samples[2*i + 1];
+        if (!w->cur_nb) {
+            w->cur_min = FFMIN(l, r);
+            w->cur_max = FFMAX(l, r);
+            w->cur_sq = 0.;
+        } else {
+            w->cur_min = FFMIN3(w->cur_min, l, r);
+            w->cur_max = FFMAX3(w->cur_max, l, r);
+        }
+        w->cur_sq += l*l + r*r;
+        if (++w->cur_nb == BLOCK_SIZE) {
+            int ret = flush_block(w);
+            if (ret < 0)
+                return ret;
+        }
+    }
+    return 0;
+}
+
+static void write_header(FILE *fp, const struct waveform *w)
+{
+    fprintf(fp, "%s %d\n", SIDECAR_MAGIC, SIDECAR_VERSION);
+    fprintf(fp, "media %"PRId64" %"PRId64" %d %"PRId64" %"PRId64"\n",
+            w->file_size, w->mtime, w->stream_idx, w->start_time, w->end_time);
+    fprintf(fp, "peaks %d %d %"PRId64" %d\n",
+            w->sample_rate, BLOCK_SIZE, w->first_pos, w->levels[0].nb_peaks);
+}
+
+/* The peaks are stored as little-endian 16-bit values */
+static void write_value(FILE *fp, float v)
+{
+    const int x = lrintf(av_clipf(v, -1.f, 1.f) * 32767.f);
+    fputc(x & 0xff, fp);
+    fputc((x >> 8) & 0xff, fp);
+}
+
+static int read_value(FILE *fp, float *v)
+{
+    const int lo = fgetc(fp);
+    const int hi = fgetc(fp);
+    if (lo == EOF || hi == EOF)
+        return AVERROR_INVALIDDATA;
+    *v = (int16_t)(lo | hi << 8) / 32767.f;
+    return 0;
+}
+
+static int save_sidecar(struct waveform *w)
+{
+    int ret = 0;
+
+    char *tmp = av_asprintf("%s.tmp", w->sidecar);
+    if (!tmp)
+        return AVERROR(ENOMEM);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        ret = AVERROR(errno);
+        LOG(w, ERROR, "Unable to open %s for writing: %s", tmp, av_err2str(ret));
+        goto end;
+    }
+
+    write_header(fp, w);
+    const struct peak_level *level = &w->levels[0];
+    for (int i = 0; i < level->nb_peaks; i++) {
+        write_value(fp, level->peaks[i].min);
+        write_value(fp, level->peaks[i].max);
+        write_value(fp, level->peaks[i].rms);
+    }
+
+    const int err = ferror(fp);
+    if (fclose(fp) || err) {
+        ret = AVERROR(EIO);
+        goto end;
+    }
+
+    if (rename(tmp, w->sidecar)) {
+        /* rename() does not replace an existing file on Windows */
+        remove(w->sidecar);
+        if (rename(tmp, w->sidecar)) {
+            ret = AVERROR(errno);
+            LOG(w, ERROR, "Unable to write waveform to %s: %s", w->sidecar, av_err2str(ret));
+            goto end;
+        }
+    }
+
+    LOG(w, INFO, "Saved %d peaks to %s", level->nb_peaks, w->sidecar);
+
+end:
+    if (ret < 0)
+        remove(tmp);
+    av_free(tmp);
+    return ret;
+}
+
+/* Return 1 if the overview was loaded from the sidecar file */
+static int load_sidecar(struct waveform *w)
+{
+    char magic[32];
+    int version, stream_idx, block_size, nb_peaks;
+    int64_t file_size, mtime, start_time, end_time;
+    int ret = 0;
+
+    FILE *fp = fopen(w->sidecar, "rb");
+    if (!fp) {
+        TRACE(w, "no waveform sidecar found at %s", w->sidecar);
+        return 0;
+    }
+
+    if (fscanf(fp, "%31s %d", magic, &version) != 2 ||
+        strcmp(magic, SIDECAR_MAGIC) || version != SIDECAR_VERSION ||
+        fscanf(fp, " media %"SCNd64" %"SCNd64" %d %"SCNd64" %"SCNd64, &file_size, &mtime,
+               &stream_idx, &start_time, &end_time) != 5) {
+        LOG(w, WARNING, "Ignoring invalid waveform sidecar %s", w->sidecar);
+        goto end;
+    }
+
+    if (file_size != w->file_size || mtime != w->mtime || stream_idx != w->stream_idx ||
+        start_time != w->start_time || end_time != w->end_time) {
+        LOG(w, WARNING, "Waveform sidecar %s does not match the media, ignoring it", w->sidecar);
+        goto end;
+    }
+
+    /* The header ends with a single line feed right before the peaks */
+    if (fscanf(fp, " peaks %d %d %"SCNd64" %d", &w->sample_rate, &block_size,
+               &w->first_pos, &nb_peaks) != 4 || w->sample_rate < 0 ||
+        block_size != BLOCK_SIZE || nb_peaks < 0 || fgetc(fp) != '\n')
+        goto invalid;
+
+    struct peak_level *level = &w->levels[0];
+    for (int i = 0; i < nb_peaks; i++) {
+        struct nmd_audio_peak peak;
+        if (read_value(fp, &peak.min) < 0 ||
+            read_value(fp, &peak.max) < 0 ||
+            read_value(fp, &peak.rms) < 0)
+            goto invalid;
+        if ((ret = add_peak(level, peak)) < 0)
+            goto end;
+    }
+
+    LOG(w, INFO, "Loaded %d peaks from %s", nb_peaks, w->sidecar);
+    ret = 1;
+    goto end;
+
+invalid:
+    LOG(w, WARNING, "Waveform sidecar %s is corrupted, ignoring it", w->sidecar);
+    w->levels[0].nb_peaks = 0;
+    w->sample_rate = 0;
+    w->first_pos = 0;
+end:
+    fclose(fp);
+    return ret;
+}
+
+static void *waveform_thread(void *arg)
+{
+    struct waveform *w = arg;
+    int ret = 0;
+
+    nmdi_set_thread_name("nmd/waveform");
+
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        const int quit = w->quit;
+        pthread_mutex_unlock(&w->lock);
+        if (quit) {
+            TRACE(w, "waveform computation aborted");
+            goto end;
+        }
+
+        ret = w->read(w->opaque, frame);
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret < 0)
+            goto end;
+        ret = add_frame(w, frame);
+        av_frame_unref(frame);
+        if (ret < 0)
+            goto end;
+    }
+
+    if ((ret = flush_block(w)) < 0 || (ret = build_levels(w)) < 0)
+        goto end;
+    LOG(w, INFO, "Waveform computed: %d peaks in %d levels", w->levels[0].nb_peaks, w->nb_levels);
+    if (w->sidecar)
+        save_sidecar(w);
+
+end:
+    if (ret < 0 && ret != AVERROR_EOF)
+        LOG(w, ERROR, "Unable to compute the waveform: %s", av_err2str(ret));
+    av_frame_free(&frame);
+    pthread_mutex_lock(&w->lock);
+    w->err = ret < 0 && ret != AVERROR_EOF ? ret : 0;
+    w->done = 1;
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+int nmdi_waveform_init(struct waveform *w, void *log_ctx, const char *filename,
+                       const struct nmdi_opts *o, const char *sidecar,
+                       nmdi_waveform_read_func read, void *opaque)
+{
+    w->log_ctx = log_ctx;
+    w->read = read;
+    w->opaque = opaque;
+    w->stream_idx = o->stream_idx;
+    w->start_time = o->start_time64;
+    w->end_time = o->end_time64;
+
+    /* Only the local files can be identified in the sidecar */
+    struct stat st;
+    av_strstart(filename, "file:", &filename);
+    if (sidecar && !o->io_callbacks.open && stat(filename, &st) == 0 && S_ISREG(st.st_mode)) {
+        w->file_size = st.st_size;
+        w->mtime = st.st_mtime;
+        w->sidecar = av_strdup(sidecar);
+        if (!w->sidecar)
+            return AVERROR(ENOMEM);
+
+        int ret = load_sidecar(w);
+        if (ret < 0)
+            return ret;
+        if (ret) {
+            ret = build_levels(w);
+            if (ret < 0)
+                return ret;
+            w->done = 1;
+            return 0;
+        }
+    } else if (sidecar) {
+        LOG(w, INFO, "'%s' is not a local file, its waveform won't be saved", filename);
+    }
+
+    int ret = pthread_create(&w->tid, NULL, waveform_thread, w);
+    if (ret) {
+        ret = AVERROR(ret);
+        LOG(w, ERROR, "Unable to start waveform thread: %s", av_err2str(ret));
+        return ret;
+    }
+    w->thread_started = 1;
+    return 0;
+}
+
+int nmdi_waveform_get(struct waveform *w, int64_t start, int64_t end,
+                      int nb_peaks, struct nmd_audio_peak *peaks)
+{
+    pthread_mutex_lock(&w->lock);
+    const int done = w->done;
+    const int err = w->err;
+    pthread_mutex_unlock(&w->lock);
+    if (err < 0)
+        return err;
+    if (!done)
+        return 0;
+
+    memset(peaks, 0, nb_peaks * sizeof(*peaks));
+    if (!w->sample_rate || !w->levels[0].nb_peaks)
+        return 1;
+
+    /* Pick the coarsest level with blocks not larger than the output peaks */
+    const double start_pos = (double)start * w->sample_rate / AV_TIME_BASE - w->first_pos;
+    const double peak_len = (double)(end - start) * w->sample_rate / AV_TIME_BASE / nb_peaks;
+    int lvl = 0;
+    while (lvl + 1 < w->nb_levels && (int64_t)BLOCK_SIZE << (lvl + 1) <= peak_len)
+        lvl++;
+    const struct peak_level *level = &w->levels[lvl];
+    const double block_len = (double)((int64_t)BLOCK_SIZE << lvl);
+
+    for (int i = 0; i < nb_peaks; i++) {
+        const double p0 = start_pos + i * peak_len;
+        const int64_t j0 = FFMAX(floor(p0 / block_len), 0);
+        const int64_t j1 = FFMIN(FFMAX(ceil((p0 + peak_len) / block_len), j0 + 1), level->nb_peaks);
+        if (j0 < j1)
+            peaks[i] = merge_peaks(level->peaks + j0, j1 - j0);
+    }
+    return 1;
+}
+
+void nmdi_waveform_free(struct waveform **wp)
+{
+    struct waveform *w = *wp;
+    if (!w)
+        return;
+    if (w->thread_started) {
+        pthread_mutex_lock(&w->lock);
+        w->quit = 1;
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->tid, NULL);
+    }
+    pthread_mutex_destroy(&w->lock);
+    for (int i = 0; i < MAX_LEVELS; i++)
+        av_freep(&w->levels[i].peaks);
+    av_freep(&w->sidecar);
+    av_freep(wp);
+}
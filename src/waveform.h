@@ -0,0 +1,71 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+#include "nopemd.h"
+#include "opts.h"
+
+/*
+ * Overview of an audio stream: min/max/RMS peaks of blocks of samples, with
+ * coarser levels each merging two blocks of the previous one, so that any
+ * zoom level is served from a bounded number of peaks.
+ */
+
+/**
+ * Read the next interleaved stereo float frame into frame, with its pts
+ * expressed in samples. Return 0 on success, AVERROR_EOF at the end of the
+ * stream, another negative value on error.
+ */
+typedef int (*nmdi_waveform_read_func)(void *opaque, AVFrame *frame);
+
+struct waveform *nmdi_waveform_alloc(void);
+
+/**
+ * Load the overview from the sidecar file if it matches the media, otherwise
+ * compute it in a background thread from the frames returned by read (called
+ * from that thread only). The overview is saved to the sidecar file (if any)
+ * once complete.
+ */
+int nmdi_waveform_init(struct waveform *w, void *log_ctx, const char *filename,
+                       const struct nmdi_opts *o, const char *sidecar,
+                       nmdi_waveform_read_func read, void *opaque);
+
+/**
+ * Fill peaks with nb_peaks peaks evenly covering the media time range
+ * [start,end[ (in microseconds).
+ *
+ * Return 1 on success, 0 if the overview is still being computed, a negative
+ * value on error (including the error of the computation).
+ */
+int nmdi_waveform_get(struct waveform *w, int64_t start, int64_t end,
+                      int nb_peaks, struct nmd_audio_peak *peaks);
+
+/**
+ * Stop the computation (if still running) and free the overview.
+ */
+void nmdi_waveform_free(struct waveform **wp);
+
+#endif
@@ -0,0 +1,397 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+
+#include <libavutil/buffer.h>
+#include <libavutil/common.h>
+#include <libavutil/mem.h>
+
+#include "internal.h"
+#include "log.h"
+#include "pthread_compat.h"
+#include "yuv_rgba.h"
+
+#define COEF_BITS 16
+#define CHROMA_SCALE 8                      // the interpolated chroma is 8 times its value
+
+/* Fixed point conversion coefficients of a frame */
+struct coeffs {
+    int y_off, c_off;
+    int y_mul;
+    int v_r, u_g, v_g, u_b;
+};
+
+struct slice_job {
+    const AVFrame *src;
+    AVFrame *dst;
+    struct coeffs c;
+    int depth;
+    int interleaved;                        // NV12 and P010 have their U and V samples in one plane
+    int r_idx, b_idx;                       // position of the red and blue bytes of the output pixels
+};
+
+struct worker {
+    struct yuv_rgba *c;
+    pthread_t tid;
+    int slice;
+};
+
+struct yuv_rgba {
+    void *log_ctx;
+    int nb_threads;                         // number of slices, the calling thread converts the first one
+    struct worker *workers;
+    int nb_workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;                // a job is started or the workers must quit
+    pthread_cond_t done_cond;               // a worker completed its slice
+    int quit;
+    unsigned job_id;
+    int nb_pending;
+    struct slice_job job;
+
+    int32_t *scratch;                       // rows of each slice (luma, chroma, interpolated chroma)
+    int scratch_width;
+    AVBufferPool *pool;
+    int pool_size;
+};
+
+struct yuv_rgba *nmdi_yuv_rgba_alloc(void)
+{
+    struct yuv_rgba *c = av_mallocz(sizeof(*c));
+    if (!c)
+        return NULL;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->job_cond, NULL);
+    pthread_cond_init(&c->done_cond, NULL);
+    return c;
+}
+
+/* Luma and blue weights of the matrix */
+static int get_matrix(enum AVColorSpace csp, double *kr, double *kb)
+{
+    switch (csp) {
+    case AVCOL_SPC_BT709:       *kr = 0.2126; *kb = 0.0722; return 0;
+    case AVCOL_SPC_FCC:         *kr = 0.30;   *kb = 0.11;   return 0;
+    case AVCOL_SPC_SMPTE240M:   *kr = 0.212;  *kb = 0.087;  return 0;
+    case AVCOL_SPC_BT2020_NCL:  *kr = 0.2627; *kb = 0.0593; return 0;
+    case AVCOL_SPC_UNSPECIFIED: // same default as libswscale
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M:   *kr = 0.299;  *kb = 0.114;  return 0;
+    default:
+        return AVERROR(ENOSYS);
+    }
+}
+
+static int get_depth(enum AVPixelFormat fmt)
+{
+    switch (fmt) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+    case AV_PIX_FMT_NV12:    return 8;
+    case AV_PIX_FMT_P010LE:  return 10;
+    default:                 return 0;
+    }
+}
+
+int nmdi_yuv_rgba_supported(const AVFrame *frame, enum AVPixelFormat dst_fmt)
+{
+    double kr, kb;
+    return (dst_fmt == AV_PIX_FMT_RGBA || dst_fmt == AV_PIX_FMT_BGRA) &&
+           get_depth(frame->format) && frame->width > 0 && frame->height > 0 &&
+           get_matrix(frame->colorspace, &kr, &kb) >= 0;
+}
+
+static void get_coeffs(struct coeffs *c, const AVFrame *frame, int depth)
+{
+    double kr, kb;
+    get_matrix(frame->colorspace, &kr, &kb);
+    const double kg = 1. - kr - kb;
+
+    /* Unspecified ranges are considered limited, as in libswscale */
+    const int full = frame->color_range == AVCOL_RANGE_JPEG || frame->format == AV_PIX_FMT_YUVJ420P;
+    const int max = (1 << depth) - 1;
+    const double y_mul = 255. / (full ? max : 219 << (depth - 8));
+    const double c_mul = 255. / (full ? max : 224 << (depth - 8)) * (1 << COEF_BITS) / CHROMA_SCALE;
+
+    c->y_off = full ? 0 : 16 << (depth - 8);
+    c->c_off = CHROMA_SCALE << (depth - 1);
+    c->y_mul = lrint(y_mul * (1 << COEF_BITS));
+    c->v_r   = lrint(2. * (1. - kr) * c_mul);
+    c->u_g   = lrint(2. * kb * (1. - kb) / kg * c_mul);
+    c->v_g   = lrint(2. * kr * (1. - kr) / kg * c_mul);
+    c->u_b   = lrint(2. * (1. - kb) * c_mul);
+}
+
+static inline int clip_uint8(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/* Load a row of samples taking every step-th one */
+static void load_row(int32_t * restrict dst, const uint8_t *src, int depth, int step, int n)
+{
+    if (depth == 8) {
+        for (int i = 0; i < n; i++)
+            dst[i] = src[i * step];
+    } else {
+        /* P010 samples are stored in the upper bits */
+        const uint16_t *src16 = (const uint16_t *)src;
+        for (int i = 0; i < n; i++)
+            dst[i] = src16[i * step] >> (16 - depth);
+    }
+}
+
+/* Vertical interpolation, weighted 3:1 between the nearest chroma row (dst)
+ * and the other one */
+static void blend_rows(int32_t * restrict dst, const int32_t * restrict other, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = 3 * dst[i] + other[i];
+}
+
+/* Horizontal interpolation, the chroma samples are sited on the even pixels */
+static void upsample_row(int32_t * restrict dst, int32_t * restrict src, int width)
+{
+    const int n = (width + 1) / 2;
+    src[n] = src[n - 1];
+    for (int i = 0; i < width / 2; i++) {
+        dst[2*i]     = 2 * src[i];
+        dst[2*i + 1] = src[i] + src[i + 1];
+    }
+    if (width & 1)
+        dst[width - 1] = 2 * src[n - 1];
+}
+
+static void convert_pixels(uint8_t * restrict dst, const int32_t * restrict y,
+                           const int32_t * restrict u, const int32_t * restrict v,
+                           const struct coeffs *c, int r_idx, int b_idx, int width)
+{
+    const int round = 1 << (COEF_BITS - 1);
+    for (int x = 0; x < width; x++) {
+        const int yy = (y[x] - c->y_off) * c->y_mul + round;
+        const int uu = u[x] - c->c_off;
+        const int vv = v[x] - c->c_off;
+        dst[4*x + r_idx] = clip_uint8((yy + c->v_r * vv) >> COEF_BITS);
+        dst[4*x + 1]     = clip_uint8((yy - c->u_g * uu - c->v_g * vv) >> COEF_BITS);
+        dst[4*x + b_idx] = clip_uint8((yy + c->u_b * uu) >> COEF_BITS);
+        dst[4*x + 3]     = 255;
+    }
+}
+
+static int get_scratch_size(int width)
+{
+    return 3 * width + 4 * ((width + 1) / 2 + 1);
+}
+
+static void convert_slice(struct yuv_rgba *c, int slice)
+{
+    const struct slice_job *j = &c->job;
+    const AVFrame *src = j->src;
+    const int width = src->width;
+    const int height = src->height;
+    const int chroma_width = (width + 1) / 2;
+    const int chroma_height = (height + 1) / 2;
+    const int bps = j->depth > 8 ? 2 : 1;
+    const int step = j->interleaved ? 2 : 1;
+    const uint8_t *u_plane = src->data[1];
+    const uint8_t *v_plane = j->interleaved ? src->data[1] + bps : src->data[2];
+    const int u_linesize = src->linesize[1];
+    const int v_linesize = j->interleaved ? src->linesize[1] : src->linesize[2];
+
+    int32_t *y_row = c->scratch + slice * get_scratch_size(width);
+    int32_t *u_row = y_row + width;
+    int32_t *v_row = u_row + width;
+    int32_t *cu0 = v_row + width;
+    int32_t *cu1 = cu0 + chroma_width + 1;
+    int32_t *cv0 = cu1 + chroma_width + 1;
+    int32_t *cv1 = cv0 + chroma_width + 1;
+
+    const int y0 = height *  slice      / c->nb_threads;
+    const int y1 = height * (slice + 1) / c->nb_threads;
+    for (int y = y0; y < y1; y++) {
+        /* The chroma row is centered between two luma rows: the other nearest
+         * one is above for the even rows and below for the odd ones */
+        const int k = y >> 1;
+        const int n = y & 1 ? FFMIN(k + 1, chroma_height - 1) : FFMAX(k - 1, 0);
+
+        load_row(y_row, src->data[0] + y * src->linesize[0], j->depth, 1, width);
+        load_row(cu0, u_plane + k * u_linesize, j->depth, step, chroma_width);
+        load_row(cu1, u_plane + n * u_linesize, j->depth, step, chroma_width);
+        load_row(cv0, v_plane + k * v_linesize, j->depth, step, chroma_width);
+        load_row(cv1, v_plane + n * v_linesize, j->depth, step, chroma_width);
+        blend_rows(cu0, cu1, chroma_width);
+        blend_rows(cv0, cv1, chroma_width);
+        upsample_row(u_row, cu0, width);
+        upsample_row(v_row, cv0, width);
+
+        convert_pixels(j->dst->data[0] + y * j->dst->linesize[0], y_row, u_row, v_row,
+                       &j->c, j->r_idx, j->b_idx, width);
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    struct worker *w = arg;
+    struct yuv_rgba *c = w->c;
+
+    nmdi_set_thread_name("nmd/yuv_rgba");
+
+    /* The workers are started before the first job */
+    unsigned job_id = 0;
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        while (!c->quit && c->job_id == job_id)
+            pthread_cond_wait(&c->job_cond, &c->lock);
+        if (c->quit)
+            break;
+        job_id = c->job_id;
+        pthread_mutex_unlock(&c->lock);
+
+        convert_slice(c, w->slice);
+
+        pthread_mutex_lock(&c->lock);
+        if (!--c->nb_pending)
+            pthread_cond_signal(&c->done_cond);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+int nmdi_yuv_rgba_init(struct yuv_rgba *c, void *log_ctx, int nb_threads)
+{
+    c->log_ctx = log_ctx;
+    c->nb_threads = FFMAX(nb_threads, 1);
+
+    c->workers = av_calloc(c->nb_threads - 1, sizeof(*c->workers));
+    if (c->nb_threads > 1 && !c->workers)
+        return AVERROR(ENOMEM);
+
+    for (int i = 0; i < c->nb_threads - 1; i++) {
+        struct worker *w = &c->workers[i];
+        w->c = c;
+        w->slice = i + 1;
+        int ret = pthread_create(&w->tid, NULL, worker_thread, w);
+        if (ret) {
+            ret = AVERROR(ret);
+            LOG(c, ERROR, "Unable to start YUV to RGBA conversion thread: %s", av_err2str(ret));
+            return ret;
+        }
+        c->nb_workers++;
+    }
+
+    TRACE(c, "YUV to RGBA conversion in %d slices", c->nb_threads);
+    return 0;
+}
+
+static int get_buffer(struct yuv_rgba *c, AVFrame *dst, enum AVPixelFormat dst_fmt,
+                      int width, int height)
+{
+    const int linesize = FFALIGN(width * 4, 64);
+    const int size = linesize * height;
+    if (size != c->pool_size) {
+        av_buffer_pool_uninit(&c->pool);
+        c->pool_size = 0;
+        c->pool = av_buffer_pool_init(size, NULL);
+        if (!c->pool)
+            return AVERROR(ENOMEM);
+        c->pool_size = size;
+    }
+
+    dst->buf[0] = av_buffer_pool_get(c->pool);
+    if (!dst->buf[0])
+        return AVERROR(ENOMEM);
+    dst->data[0] = dst->buf[0]->data;
+    dst->linesize[0] = linesize;
+    dst->format = dst_fmt;
+    dst->width  = width;
+    dst->height = height;
+    return 0;
+}
+
+int nmdi_yuv_rgba_convert(struct yuv_rgba *c, AVFrame *dst, const AVFrame *src,
+                          enum AVPixelFormat dst_fmt)
+{
+    if (!nmdi_yuv_rgba_supported(src, dst_fmt))
+        return AVERROR(ENOSYS);
+
+    if (src->width > c->scratch_width) {
+        av_freep(&c->scratch);
+        c->scratch_width = 0;
+        c->scratch = av_malloc_array(c->nb_threads, get_scratch_size(src->width) * sizeof(*c->scratch));
+        if (!c->scratch)
+            return AVERROR(ENOMEM);
+        c->scratch_width = src->width;
+    }
+
+    int ret = get_buffer(c, dst, dst_fmt, src->width, src->height);
+    if (ret < 0)
+        return ret;
+    ret = av_frame_copy_props(dst, src);
+    if (ret < 0) {
+        av_frame_unref(dst);
+        return ret;
+    }
+
+    struct slice_job *j = &c->job;
+    j->src = src;
+    j->dst = dst;
+    j->depth = get_depth(src->format);
+    j->interleaved = src->format == AV_PIX_FMT_NV12 || src->format == AV_PIX_FMT_P010LE;
+    j->r_idx = dst_fmt == AV_PIX_FMT_RGBA ? 0 : 2;
+    j->b_idx = 2 - j->r_idx;
+    get_coeffs(&j->c, src, j->depth);
+
+    pthread_mutex_lock(&c->lock);
+    c->nb_pending = c->nb_workers;
+    c->job_id++;
+    pthread_cond_broadcast(&c->job_cond);
+    pthread_mutex_unlock(&c->lock);
+
+    convert_slice(c, 0);
+
+    pthread_mutex_lock(&c->lock);
+    while (c->nb_pending)
+        pthread_cond_wait(&c->done_cond, &c->lock);
+    pthread_mutex_unlock(&c->lock);
+
+    return 0;
+}
+
+void nmdi_yuv_rgba_free(struct yuv_rgba **cp)
+{
+    struct yuv_rgba *c = *cp;
+    if (!c)
+        return;
+    pthread_mutex_lock(&c->lock);
+    c->quit = 1;
+    pthread_cond_broadcast(&c->job_cond);
+    pthread_mutex_unlock(&c->lock);
+    for (int i = 0; i < c->nb_workers; i++)
+        pthread_join(c->workers[i].tid, NULL);
+    pthread_cond_destroy(&c->done_cond);
+    pthread_cond_destroy(&c->job_cond);
+    pthread_mutex_destroy(&c->lock);
+    av_freep(&c->workers);
+    av_freep(&c->scratch);
+    av_buffer_pool_uninit(&c->pool);
+    av_freep(cp);
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of nope.media.
+ *
+ * Copyright (c) 2026 nope.media contributors
+ *
+ * nope.media is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * nope.media is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with nope.media; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef YUV_RGBA_H
+#define YUV_RGBA_H
+
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+
+/*
+ * Conversion of the most common decoder outputs (YUV420P, NV12 and P010) to
+ * RGBA or BGRA, sliced across a set of threads. The chroma is interpolated
+ * bilinearly (left sited horizontally, centered vertically) as done by
+ * libswscale with full_chroma_int, and the BT.601, BT.709 and BT.2020 (non
+ * constant luminance) matrices are supported in limited and full range.
+ */
+struct yuv_rgba *nmdi_yuv_rgba_alloc(void);
+
+/**
+ * Start the nb_threads-1 threads helping the calling one.
+ */
+int nmdi_yuv_rgba_init(struct yuv_rgba *c, void *log_ctx, int nb_threads);
+
+/**
+ * Whether the frame can be converted to the dst_fmt pixel format.
+ */
+int nmdi_yuv_rgba_supported(const AVFrame *frame, enum AVPixelFormat dst_fmt);
+
+/**
+ * Convert the src frame into dst (which must be blank) in the dst_fmt pixel
+ * format. The frames properties are copied from src.
+ */
+int nmdi_yuv_rgba_convert(struct yuv_rgba *c, AVFrame *dst, const AVFrame *src,
+                          enum AVPixelFormat dst_fmt);
+
+void nmdi_yuv_rgba_free(struct yuv_rgba **cp);
+
+#endif
@@ -0,0 +1,254 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libavutil/time.h>
+
+#include <nopemd.h>
+
+#define FRAME_RATE 25
+
+/*
+ * Replay an access pattern and print the throughput and the latency
+ * percentiles of nmd_get_frame() (or nmd_get_next_frame()) as a single JSON
+ * line on stdout.
+ */
+
+struct bench {
+    struct nmd_ctx *s;
+    double duration;        // media duration
+    int64_t *latencies;     // latency of each request, in microseconds
+    int nb_requests;
+    int nb_frames;          // requests returning a new frame
+};
+
+struct pattern {
+    const char *name;
+    void (*setup)(struct bench *b);
+    void (*run)(struct bench *b);
+};
+
+static void get_frame(struct bench *b, double t)
+{
+    const int64_t t0 = av_gettime_relative();
+    struct nmd_frame *f = nmd_get_frame(b->s, t);
+    b->latencies[b->nb_requests++] = av_gettime_relative() - t0;
+    if (f)
+        b->nb_frames++;
+    nmd_frame_releasep(&f);
+}
+
+/* Upper bound of the number of requests made by any of the patterns */
+static int get_max_requests(double duration)
+{
+    return lrint(ceil(duration) * FRAME_RATE) + 1024;
+}
+
+static int get_next_frame(struct bench *b)
+{
+    const int64_t t0 = av_gettime_relative();
+    struct nmd_frame *f = nmd_get_next_frame(b->s);
+    b->latencies[b->nb_requests++] = av_gettime_relative() - t0;
+    if (!f)
+        return 0;
+    b->nb_frames++;
+    nmd_frame_releasep(&f);
+    return 1;
+}
+
+static double clip_duration(const struct bench *b, double max)
+{
+    return b->duration < max ? b->duration : max;
+}
+
+/* Deterministic pseudo-random sequence so that runs are comparable */
+static double get_random(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return (*state >> 8) / (double)(1 << 24);
+}
+
+static void run_sequential(struct bench *b)
+{
+    const int n = lrint(clip_duration(b, 30.) * FRAME_RATE);
+    for (int i = 0; i < n; i++)
+        get_frame(b, (double)i / FRAME_RATE);
+}
+
+static void run_random_seek(struct bench *b)
+{
+    uint32_t state = 0x2a;
+    for (int i = 0; i < 100; i++)
+        get_frame(b, get_random(&state) * b->duration);
+}
+
+/* Back and forth around the middle of the media, with the strides of a user
+ * dragging a cursor */
+static void run_scrub(struct bench *b)
+{
+    const double center = b->duration / 2.;
+    const double amplitude = clip_duration(b, 10.) / 2.;
+    for (int pass = 0; pass < 4; pass++) {
+        const double dir = pass & 1 ? -1. : 1.;
+        for (int i = 0; i <= 50; i++)
+            get_frame(b, center + dir * amplitude * (i / 25. - 1.));
+    }
+}
+
+static void setup_reverse(struct bench *b)
+{
+    nmd_set_option(b->s, "reverse", 1);
+}
+
+static void run_reverse(struct bench *b)
+{
+    const int n = lrint(clip_duration(b, 10.) * FRAME_RATE);
+    for (int i = n; i >= 0; i--)
+        get_frame(b, (double)i / FRAME_RATE);
+}
+
+static void setup_fast_forward(struct bench *b)
+{
+    nmd_set_playback_rate(b->s, 8.);
+}
+
+static void run_fast_forward(struct bench *b)
+{
+    const double rate = 8.;
+    for (int i = 0; i * rate / FRAME_RATE < b->duration; i++)
+        get_frame(b, i * rate / FRAME_RATE);
+}
+
+static void setup_thumbnails(struct bench *b)
+{
+    nmd_set_option(b->s, "keyframes_only", 1);
+}
+
+static void run_thumbnails(struct bench *b)
+{
+    const int n = 20;
+    for (int i = 0; i < n; i++)
+        get_frame(b, i * b->duration / n);
+}
+
+/* The sequential nmd_get_next_frame() is the reference of the exports
+ * decoding several segments concurrently */
+static void setup_export_2(struct bench *b)
+{
+    nmd_set_option(b->s, "export_segments", 2);
+}
+
+static void setup_export_4(struct bench *b)
+{
+    nmd_set_option(b->s, "export_segments", 4);
+}
+
+static void run_export(struct bench *b)
+{
+    const int n = get_max_requests(b->duration);
+    while (b->nb_requests < n && get_next_frame(b))
+        ;
+}
+
+static const struct pattern patterns[] = {
+    {"sequential",   NULL,               run_sequential},
+    {"random_seek",  NULL,               run_random_seek},
+    {"scrub",        NULL,               run_scrub},
+    {"reverse",      setup_reverse,      run_reverse},
+    {"fast_forward", setup_fast_forward, run_fast_forward},
+    {"thumbnails",   setup_thumbnails,   run_thumbnails},
+    {"export_1",     NULL,               run_export},
+    {"export_2",     setup_export_2,     run_export},
+    {"export_4",     setup_export_4,     run_export},
+};
+
+static int cmp_latency(const void *a, const void *b)
+{
+    const int64_t la = *(const int64_t *)a;
+    const int64_t lb = *(const int64_t *)b;
+    return (la > lb) - (la < lb);
+}
+
+static double get_percentile_ms(const int64_t *sorted, int n, int p)
+{
+    return sorted[(int64_t)(n - 1) * p / 100] / 1000.;
+}
+
+static const char *get_basename(const char *path)
+{
+    const char *p = strrchr(path, '/');
+    const char *q = strrchr(path, '\\');
+    if (q > p)
+        p = q;
+    return p ? p + 1 : path;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 3) {
+        fprintf(stderr, "Usage: %s <media> <pattern>\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const struct pattern *pattern = NULL;
+    for (int i = 0; i < sizeof(patterns) / sizeof(*patterns); i++)
+        if (!strcmp(patterns[i].name, av[2]))
+            pattern = &patterns[i];
+    if (!pattern) {
+        fprintf(stderr, "unknown pattern %s\n", av[2]);
+        return -1;
+    }
+
+    struct bench b = {0};
+    b.s = nmd_create(filename);
+    if (!b.s)
+        return -1;
+    nmd_set_option(b.s, "auto_hwaccel", 0);
+    if (pattern->setup)
+        pattern->setup(&b);
+
+    /* The media probing is not part of the measures */
+    struct nmd_info info;
+    int ret = nmd_get_info(b.s, &info);
+    if (ret < 0 || info.duration <= 0) {
+        fprintf(stderr, "unable to get the duration of %s\n", filename);
+        ret = -1;
+        goto end;
+    }
+    b.duration = info.duration;
+
+    b.latencies = malloc(get_max_requests(b.duration) * sizeof(*b.latencies));
+    if (!b.latencies) {
+        ret = -1;
+        goto end;
+    }
+
+    const int64_t t0 = av_gettime_relative();
+    pattern->run(&b);
+    const double elapsed = (av_gettime_relative() - t0) / 1000000.;
+
+    if (!b.nb_frames) {
+        fprintf(stderr, "no frame obtained\n");
+        ret = -1;
+        goto end;
+    }
+
+    qsort(b.latencies, b.nb_requests, sizeof(*b.latencies), cmp_latency);
+    printf("{\"benchmark\":\"%s\",\"media\":\"%s\",\"width\":%d,\"height\":%d,"
+           "\"requests\":%d,\"frames\":%d,\"elapsed\":%f,\"fps\":%f,"
+           "\"latency_ms\":{\"p50\":%f,\"p95\":%f,\"p99\":%f,\"max\":%f}}\n",
+           pattern->name, get_basename(filename), info.width, info.height,
+           b.nb_requests, b.nb_frames, elapsed, b.nb_frames / elapsed,
+           get_percentile_ms(b.latencies, b.nb_requests, 50),
+           get_percentile_ms(b.latencies, b.nb_requests, 95),
+           get_percentile_ms(b.latencies, b.nb_requests, 99),
+           b.latencies[b.nb_requests - 1] / 1000.);
+
+end:
+    free(b.latencies);
+    nmd_freep(&b.s);
+    return ret;
+}
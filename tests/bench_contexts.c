@@ -0,0 +1,195 @@
+#ifndef _WIN32
+#define _XOPEN_SOURCE 700 // getrusage()
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <libavutil/time.h>
+
+#include <nopemd.h>
+
+#define RENDER_RATE 30
+#define NB_TICKS (10 * RENDER_RATE)
+
+/*
+ * Open many contexts and drive them from a single render loop, as an
+ * application compositing many media would, then print the resources used
+ * per context and the missed deadlines as a single JSON line on stdout.
+ */
+
+struct usage {
+    int64_t cpu_time;       // user and system time of the process, in microseconds
+    int64_t rss;            // resident memory, in bytes (-1 if unknown)
+    int nb_threads;         // threads of the process (-1 if unknown)
+};
+
+static void get_usage(struct usage *u)
+{
+    u->rss = -1;
+    u->nb_threads = -1;
+
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    const uint64_t k = (uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime;
+    const uint64_t us = (uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime;
+    u->cpu_time = (k + us) / 10;
+#else
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    u->cpu_time = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * INT64_C(1000000)
+                + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#endif
+
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        long v;
+        if (sscanf(line, "VmRSS: %ld kB", &v) == 1)
+            u->rss = v * 1024;
+        else if (sscanf(line, "Threads: %ld", &v) == 1)
+            u->nb_threads = v;
+    }
+    fclose(f);
+#endif
+}
+
+static void update_peak_usage(struct usage *peak)
+{
+    struct usage u;
+    get_usage(&u);
+    if (u.rss > peak->rss)
+        peak->rss = u.rss;
+    if (u.nb_threads > peak->nb_threads)
+        peak->nb_threads = u.nb_threads;
+}
+
+static double get_per_context(int64_t value, int64_t base, int nb_contexts)
+{
+    return value < 0 || base < 0 ? -1. : (double)(value - base) / nb_contexts;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 5) {
+        fprintf(stderr, "Usage: %s <nb_contexts> <video|audio_video> <threads|shared> <media> [<media>...]\n", av[0]);
+        return -1;
+    }
+
+    const int nb_contexts = atoi(av[1]);
+    const int with_audio = !strcmp(av[2], "audio_video");
+    const int shared = !strcmp(av[3], "shared");
+    const char * const *media = (const char * const *)av + 4;
+    const int nb_media = ac - 4;
+    if (nb_contexts <= 0) {
+        fprintf(stderr, "invalid number of contexts %d\n", nb_contexts);
+        return -1;
+    }
+
+    struct nmd_ctx **ctxs = calloc(nb_contexts, sizeof(*ctxs));
+    double *durations = calloc(nb_contexts, sizeof(*durations));
+    if (!ctxs || !durations) {
+        free(ctxs);
+        free(durations);
+        return -1;
+    }
+
+    struct usage base;
+    get_usage(&base);
+
+    /* The media are spread across the contexts, and every other context reads
+     * the audio stream if requested */
+    int ret = 0;
+    for (int i = 0; i < nb_contexts; i++) {
+        struct nmd_ctx *s = nmd_create(media[i % nb_media]);
+        if (!s) {
+            ret = -1;
+            goto end;
+        }
+        ctxs[i] = s;
+        nmd_set_option(s, "auto_hwaccel", 0);
+        nmd_set_option(s, "shared_scheduler", shared);
+        if (with_audio && i & 1)
+            nmd_set_option(s, "avselect", NMD_SELECT_AUDIO);
+
+        struct nmd_info info;
+        ret = nmd_get_info(s, &info);
+        if (ret < 0 || info.duration <= 0) {
+            fprintf(stderr, "unable to get the duration of %s\n", media[i % nb_media]);
+            ret = -1;
+            goto end;
+        }
+        durations[i] = info.duration;
+    }
+
+    /* Each context plays from its own offset so that their seeks and GOP
+     * boundaries are not aligned */
+    struct usage peak = base;
+    struct usage start;
+    get_usage(&start);
+    int nb_frames = 0, nb_missed = 0;
+    int64_t max_tick_time = 0;
+    const int64_t period = 1000000 / RENDER_RATE;
+    const int64_t t0 = av_gettime_relative();
+    for (int tick = 0; tick < NB_TICKS; tick++) {
+        const int64_t deadline = t0 + (tick + 1) * period;
+        const int64_t tick_start = av_gettime_relative();
+        for (int i = 0; i < nb_contexts; i++) {
+            const double offset = i * 0.7;
+            const double t = offset + (double)tick / RENDER_RATE;
+            struct nmd_frame *f = nmd_get_frame(ctxs[i], fmod(t, durations[i]));
+            if (f)
+                nb_frames++;
+            nmd_frame_releasep(&f);
+        }
+        const int64_t now = av_gettime_relative();
+        if (now - tick_start > max_tick_time)
+            max_tick_time = now - tick_start;
+        if (now > deadline)
+            nb_missed++;
+        else
+            av_usleep(deadline - now);
+        if (tick % RENDER_RATE == 0)
+            update_peak_usage(&peak);
+    }
+    struct usage end_usage;
+    get_usage(&end_usage);
+
+    if (!nb_frames) {
+        fprintf(stderr, "no frame obtained\n");
+        ret = -1;
+        goto end;
+    }
+
+    printf("{\"benchmark\":\"contexts\",\"contexts\":%d,\"media\":%d,\"streams\":\"%s\",\"scheduler\":\"%s\","
+           "\"threads\":%d,\"threads_per_context\":%f,\"rss\":%"PRId64",\"rss_per_context\":%f,"
+           "\"ticks\":%d,\"missed_deadlines\":%d,\"max_tick_ms\":%f,"
+           "\"frames\":%d,\"cpu_ms_per_frame\":%f}\n",
+           nb_contexts, nb_media, with_audio ? "audio_video" : "video", shared ? "shared" : "threads",
+           peak.nb_threads, get_per_context(peak.nb_threads, base.nb_threads, nb_contexts),
+           peak.rss, get_per_context(peak.rss, base.rss, nb_contexts),
+           NB_TICKS, nb_missed, max_tick_time / 1000.,
+           nb_frames, (end_usage.cpu_time - start.cpu_time) / 1000. / nb_frames);
+
+end:
+    for (int i = 0; i < nb_contexts; i++)
+        nmd_freep(&ctxs[i]);
+    free(ctxs);
+    free(durations);
+    return ret;
+}
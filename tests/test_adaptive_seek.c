@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "adaptive_seek_trigger", 1);
+
+    /* Small and large forward jumps, mixed with backward seeks so the seek
+     * cost gets calibrated along the way */
+    static const double times[] = {
+        0.0, 0.5, 1.0, 4.0, 4.2, 1.5, 2.5, 9.0, 3.0, 3.1,
+        6.0, 6.7, 0.2, 12.0, 12.5, 5.0, 5.5, 11.0, 2.0, 7.0,
+    };
+
+    int ret = 0;
+    for (int i = 0; i < sizeof(times) / sizeof(*times); i++) {
+        const double t = times[i];
+        struct nmd_frame *f = nmd_get_frame(s, t);
+        if (!f) {
+            fprintf(stderr, "no frame obtained for t=%f\n", t);
+            ret = -1;
+            break;
+        }
+        if (fabs(f->ts - t) > 1/25.) {
+            fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, f->ts);
+            ret = -1;
+        }
+        nmd_frame_releasep(&f);
+        if (ret < 0)
+            break;
+    }
+
+    nmd_freep(&s);
+    return ret;
+}
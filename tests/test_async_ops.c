@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <libavutil/time.h>
+
+#include <nopemd.h>
+
+#define OPEN_TIMEOUT 3000000
+
+struct user_io {
+    volatile int released;  // the function under test returned
+    int nb_opened;
+    int nb_blocked;         // opened before the function under test returned
+};
+
+struct user_file {
+    FILE *f;
+};
+
+/* Wait for the caller to be released: an operation opening the media
+ * synchronously times out here since it can not return before the open */
+static void *io_open(void *opaque, const char *filename)
+{
+    struct user_io *uio = opaque;
+    const int64_t start = av_gettime_relative();
+    while (!uio->released) {
+        if (av_gettime_relative() - start > OPEN_TIMEOUT) {
+            uio->nb_blocked++;
+            break;
+        }
+        av_usleep(1000);
+    }
+
+    struct user_file *uf = calloc(1, sizeof(*uf));
+    if (!uf)
+        return NULL;
+    uf->f = fopen(filename, "rb");
+    if (!uf->f) {
+        free(uf);
+        return NULL;
+    }
+    uio->nb_opened++;
+    return uf;
+}
+
+static int io_read(void *handle, uint8_t *buf, int size)
+{
+    struct user_file *uf = handle;
+    const size_t n = fread(buf, 1, size, uf->f);
+    return n ? (int)n : ferror(uf->f) ? -1 : 0;
+}
+
+static int64_t io_seek(void *handle, int64_t offset, int whence)
+{
+    struct user_file *uf = handle;
+    if (fseek(uf->f, offset, whence) < 0)
+        return -1;
+    return ftell(uf->f);
+}
+
+static void io_close(void *handle)
+{
+    struct user_file *uf = handle;
+    fclose(uf->f);
+    free(uf);
+}
+
+static struct nmd_ctx *create_context(const char *filename, int use_pkt_duration, struct user_io *uio)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+
+    const struct nmd_io_callbacks cb = {
+        .opaque = uio,
+        .open   = io_open,
+        .read   = io_read,
+        .seek   = io_seek,
+        .close  = io_close,
+    };
+    if (nmd_set_io_callbacks(s, &cb) < 0)
+        nmd_freep(&s);
+    return s;
+}
+
+static int check_frame(struct nmd_ctx *s, const char *op, double t)
+{
+    struct nmd_frame *f = nmd_get_frame(s, t);
+    if (!f || fabs(f->ts - t) > 1/25.) {
+        fprintf(stderr, "%s: unable to get the frame at t=%f\n", op, t);
+        nmd_frame_releasep(&f);
+        return -1;
+    }
+    nmd_frame_releasep(&f);
+    return 0;
+}
+
+static int check_start(const char *filename, int use_pkt_duration)
+{
+    struct user_io uio = {0};
+    struct nmd_ctx *s = create_context(filename, use_pkt_duration, &uio);
+    if (!s)
+        return -1;
+
+    int ret = nmd_start(s);
+    uio.released = 1;
+    if (ret < 0)
+        goto end;
+
+    ret = check_frame(s, "start", 3.0);
+    if (ret < 0)
+        goto end;
+    if (uio.nb_blocked) {
+        fprintf(stderr, "start: media opened before nmd_start() returned\n");
+        ret = -1;
+    }
+
+end:
+    nmd_freep(&s);
+    return ret;
+}
+
+static int check_seek(const char *filename, int use_pkt_duration)
+{
+    struct user_io uio = {0};
+    struct nmd_ctx *s = create_context(filename, use_pkt_duration, &uio);
+    if (!s)
+        return -1;
+
+    /* The seek is memorized until the pipeline is started */
+    int ret = nmd_seek(s, 12.0);
+    uio.released = 1;
+    if (ret < 0)
+        goto end;
+    if (uio.nb_opened) {
+        fprintf(stderr, "seek: media opened by nmd_seek()\n");
+        ret = -1;
+        goto end;
+    }
+
+    ret = check_frame(s, "seek", 12.0);
+    if (ret < 0)
+        goto end;
+    if (uio.nb_blocked) {
+        fprintf(stderr, "seek: media opened before nmd_seek() returned\n");
+        ret = -1;
+    }
+
+end:
+    nmd_freep(&s);
+    return ret;
+}
+
+static int check_request(const char *filename, int use_pkt_duration)
+{
+    struct user_io uio = {0};
+    struct nmd_ctx *s = create_context(filename, use_pkt_duration, &uio);
+    if (!s)
+        return -1;
+
+    /* Neither the request nor the polls may wait for the media to be opened */
+    const double t = 5.0;
+    struct nmd_frame *f = NULL;
+    int ret = nmd_request_frame(s, t);
+    if (ret < 0) {
+        uio.released = 1;
+        goto end;
+    }
+    for (int i = 0; i < 10; i++) {
+        ret = nmd_poll_frame(s, &f);
+        if (ret != 0)
+            break;
+    }
+    uio.released = 1;
+    if (ret != 0) {
+        fprintf(stderr, "request: frame ready before the media was opened (ret=%d)\n", ret);
+        ret = -1;
+        goto end;
+    }
+
+    while ((ret = nmd_poll_frame(s, &f)) == 0)
+        av_usleep(1000);
+    if (ret < 0)
+        goto end;
+    if (!f || fabs(f->ts - t) > 1/25.) {
+        fprintf(stderr, "request: unable to get the frame at t=%f\n", t);
+        ret = -1;
+        goto end;
+    }
+    ret = 0;
+    if (uio.nb_blocked) {
+        fprintf(stderr, "request: media opened before nmd_poll_frame() returned\n");
+        ret = -1;
+    }
+
+end:
+    nmd_frame_releasep(&f);
+    nmd_freep(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = check_start(filename, use_pkt_duration);
+    if (ret >= 0)
+        ret = check_seek(filename, use_pkt_duration);
+    if (ret >= 0)
+        ret = check_request(filename, use_pkt_duration);
+    return ret;
+}
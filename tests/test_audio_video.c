@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+static int check_frame(struct nmd_frame *f, const char *type, double t, double max_dist)
+{
+    if (!f) {
+        fprintf(stderr, "no %s frame obtained for t=%f\n", type, t);
+        return -1;
+    }
+    const double dist = fabs(f->ts - t);
+    nmd_frame_releasep(&f);
+    if (dist > max_dist) {
+        fprintf(stderr, "requested %s t=%f, got frame %f away\n", type, t, dist);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+
+    struct nmd_ctx *a = nmd_get_audio_context(s);
+    if (!a) {
+        fprintf(stderr, "unable to get an audio context\n");
+        nmd_freep(&s);
+        return -1;
+    }
+
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(a, "use_pkt_duration", use_pkt_duration);
+
+    int ret = 0;
+
+    /* Both streams pulled alternately, with seeks in both directions */
+    static const double times[] = {
+        0.0, 0.5, 1.0, 1.5, 7.0, 7.2, 3.0, 12.0, 12.1, 0.4,
+    };
+    for (int i = 0; i < sizeof(times) / sizeof(*times) && ret >= 0; i++) {
+        const double t = times[i];
+        if ((ret = check_frame(nmd_get_frame(s, t), "video", t, 1/25.)) < 0 ||
+            (ret = check_frame(nmd_get_frame(a, t), "audio", t, 0.1))   < 0)
+            break;
+    }
+
+    /* Audio played linearly must not be disturbed by video seeks */
+    double last_ts = -1;
+    for (int i = 0; i < 20 && ret >= 0; i++) {
+        if (i % 5 == 4) {
+            const double t = i * 0.6;
+            ret = check_frame(nmd_get_frame(s, t), "video", t, 1/25.);
+            if (ret < 0)
+                break;
+        }
+
+        struct nmd_frame *f = nmd_get_next_frame(a);
+        if (!f) {
+            fprintf(stderr, "no audio frame obtained after ts=%f\n", last_ts);
+            ret = -1;
+            break;
+        }
+        if (last_ts >= 0 && (f->ts <= last_ts || f->ts - last_ts > 0.1)) {
+            fprintf(stderr, "audio frame ts=%f does not follow ts=%f\n", f->ts, last_ts);
+            ret = -1;
+        }
+        last_ts = f->ts;
+        nmd_frame_releasep(&f);
+    }
+
+    nmd_freep(&a);
+    nmd_freep(&s);
+    return ret;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+static int nb_opened;
+
+static void *io_open(void *opaque, const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (f)
+        nb_opened++;
+    return f;
+}
+
+static int io_read(void *handle, uint8_t *buf, int size)
+{
+    const size_t n = fread(buf, 1, size, handle);
+    return n ? (int)n : ferror(handle) ? -1 : 0;
+}
+
+static int64_t io_seek(void *handle, int64_t offset, int whence)
+{
+    if (fseek(handle, offset, whence) < 0)
+        return -1;
+    return ftell(handle);
+}
+
+static void io_close(void *handle)
+{
+    fclose(handle);
+}
+
+static struct nmd_ctx *create_context(const char *filename, int use_pkt_duration)
+{
+    static const struct nmd_io_callbacks cb = {
+        .open  = io_open,
+        .read  = io_read,
+        .seek  = io_seek,
+        .close = io_close,
+    };
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "fast_open", 1);
+    nmd_set_option(s, "info_cache_dir", ".");
+    if (nmd_set_io_callbacks(s, &cb) < 0)
+        nmd_freep(&s);
+    return s;
+}
+
+static int check_frames(struct nmd_ctx *s)
+{
+    static const double times[] = {0.0, 0.04, 0.5, 30.0, 12.0, 75.0};
+    for (int i = 0; i < sizeof(times) / sizeof(*times); i++) {
+        struct nmd_frame *f = nmd_get_frame(s, times[i]);
+        if (!f || fabs(f->ts - times[i]) > 1/25.) {
+            fprintf(stderr, "requested t=%f, got frame with ts=%f\n", times[i], f ? f->ts : -1.);
+            nmd_frame_releasep(&f);
+            return -1;
+        }
+        nmd_frame_releasep(&f);
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    /* The first context probes the media (unless a previous run already
+     * cached its information) and saves it to the cache */
+    struct nmd_info ref;
+    struct nmd_ctx *s = create_context(filename, use_pkt_duration);
+    if (!s)
+        return -1;
+    int ret = nmd_get_info(s, &ref);
+    if (ret >= 0)
+        ret = check_frames(s);
+    nmd_freep(&s);
+    if (ret < 0)
+        return ret;
+
+    /* The information of a cached media is known without opening it */
+    nb_opened = 0;
+    struct nmd_info info;
+    s = create_context(filename, use_pkt_duration);
+    if (!s)
+        return -1;
+    ret = nmd_get_info(s, &info);
+    if (ret < 0)
+        goto end;
+    if (nb_opened) {
+        fprintf(stderr, "the media was opened to get its information\n");
+        ret = -1;
+        goto end;
+    }
+    if (info.width != ref.width || info.height != ref.height ||
+        fabs(info.duration - ref.duration) > 1e-6 || info.is_image != ref.is_image ||
+        info.timebase[0] != ref.timebase[0] || info.timebase[1] != ref.timebase[1]) {
+        fprintf(stderr, "cached info %dx%d %f tb:%d/%d differs from %dx%d %f tb:%d/%d\n",
+                info.width, info.height, info.duration, info.timebase[0], info.timebase[1],
+                ref.width, ref.height, ref.duration, ref.timebase[0], ref.timebase[1]);
+        ret = -1;
+        goto end;
+    }
+
+    /* The decoding relies on the cached stream parameters */
+    ret = check_frames(s);
+
+end:
+    nmd_freep(&s);
+    return ret;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+static int check_frame(struct nmd_ctx *s, double t, int w, int h)
+{
+    struct nmd_frame *f = nmd_get_frame(s, t);
+    if (!f) {
+        fprintf(stderr, "no frame obtained for t=%f\n", t);
+        return -1;
+    }
+    const double ts = f->ts;
+    const int fw = f->width, fh = f->height;
+    nmd_frame_releasep(&f);
+    if (fabs(ts - t) > 1/25.) {
+        fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, ts);
+        return -1;
+    }
+    if (w && (fw != w || fh != h)) {
+        fprintf(stderr, "frame at t=%f is %dx%d instead of %dx%d\n", t, fw, fh, w, h);
+        return -1;
+    }
+    return 0;
+}
+
+/* Scrub back and forth: the kept filtergraph must not leak frames from
+ * before a seek, nor change the output */
+static int scrub(const char *filename, int use_pkt_duration, const char *filters)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "filters", filters);
+    nmd_set_option(s, "max_pixels", 320 * 240);
+
+    static const double times[] = {3.0, 1.0, 12.0, 11.5, 40.0, 2.0, 2.04, 75.0, 0.0};
+    int ret = check_frame(s, 0.5, 0, 0);
+    struct nmd_frame *f = nmd_get_frame(s, 0.6);
+    const int w = f ? f->width : 0, h = f ? f->height : 0;
+    nmd_frame_releasep(&f);
+    for (int i = 0; i < sizeof(times) / sizeof(*times) && ret >= 0; i++) {
+        for (int j = 0; j < 5 && ret >= 0; j++)
+            ret = check_frame(s, times[i] + j / 25., w, h);
+        if (ret < 0)
+            fprintf(stderr, "scrubbing with filters \"%s\" failed\n", filters);
+    }
+
+    nmd_freep(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    /* Stateless graph, kept across the seeks */
+    int ret = scrub(filename, use_pkt_duration, "hflip,negate");
+    if (ret < 0)
+        return ret;
+
+    /* Graph with a filter not known to be stateless, rebuilt at every seek */
+    return scrub(filename, use_pkt_duration, "boxblur=2:1");
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+#define N 4
+#define SOURCE_FPS 25
+
+static int check_frame(const struct nmd_frame *f, double t)
+{
+    if (!f) {
+        fprintf(stderr, "no frame obtained for t=%f\n", t);
+        return -1;
+    }
+
+    const uint32_t c = *(const uint32_t *)f->datap[0];
+    const int r = c >> (N+16) & 0xf;
+    const int g = c >> (N+ 8) & 0xf;
+    const int b = c >> (N+ 0) & 0xf;
+    const int frame_id = r<<(N*2) | g<<N | b;
+    const double video_ts = frame_id * 1. / SOURCE_FPS;
+
+    if (fabs(t - f->ts) > 1. / SOURCE_FPS || fabs(t - video_ts) > 1. / SOURCE_FPS) {
+        fprintf(stderr, "requested t=%f, got frame with ts=%f (frame id #%d)\n",
+                t, f->ts, frame_id);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "max_nb_cached_frames", 32);
+
+    static const double times[] = {
+        5.0, 5.04, 5.08, 5.12, 5.16, 5.2, 5.24, 5.28, 5.32, 5.36, 5.4, // forward
+        5.3, 5.21, 5.13, 5.0,                                         // backward, within the cache
+        5.3, 5.45,                                                    // forward again
+        2.0, 5.1,                                                     // out of the cache
+    };
+
+    int ret = 0;
+    double prev_ts = -1;
+    for (int i = 0; i < sizeof(times) / sizeof(*times); i++) {
+        const double t = times[i];
+        struct nmd_frame *f = nmd_get_frame(s, t);
+        if (!f && prev_ts >= 0 && prev_ts <= t && t - prev_ts < 1. / SOURCE_FPS)
+            continue;
+        if (check_frame(f, t) < 0) {
+            ret = -1;
+            nmd_frame_releasep(&f);
+            break;
+        }
+        prev_ts = f->ts;
+        nmd_frame_releasep(&f);
+    }
+
+    nmd_freep(&s);
+    return ret;
+}
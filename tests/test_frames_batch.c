@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+#define NB_REQUESTS 12
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+
+    /* The first request is the frame returned just before the batch */
+    struct nmd_frame *f = nmd_get_frame(s, 30.0);
+    if (!f) {
+        fprintf(stderr, "no frame obtained for t=30\n");
+        return -1;
+    }
+    nmd_frame_releasep(&f);
+
+    /* Unsorted, with duplicates and several times in the same GOP */
+    static const int64_t ts[NB_REQUESTS] = {
+        62000000, 30000000, 1000000, 71000000, 1000000, 30010000,
+        45500000, 2000000, 44000000, 62000000, 5000000, 0,
+    };
+    struct nmd_frame *frames[NB_REQUESTS];
+    int ret = nmd_get_frames_ms(s, ts, NB_REQUESTS, frames);
+    if (ret < 0) {
+        fprintf(stderr, "unable to get the frames\n");
+        nmd_freep(&s);
+        return ret;
+    }
+
+    for (int i = 0; i < NB_REQUESTS; i++) {
+        const double t = ts[i] / 1000000.;
+        if (!frames[i]) {
+            fprintf(stderr, "no frame obtained for t=%f\n", t);
+            ret = -1;
+        } else if (fabs(frames[i]->ts - t) > 1/25.) {
+            fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, frames[i]->ts);
+            ret = -1;
+        }
+    }
+
+    /* The frames outlive the context */
+    nmd_freep(&s);
+    for (int i = 0; i < NB_REQUESTS; i++)
+        nmd_frame_releasep(&frames[i]);
+    return ret;
+}
@@ -0,0 +1,121 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nopemd.h>
+
+static struct nmd_ctx *create_ctx(const char *filename, int use_pkt_duration, const char *filters)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    if (filters)
+        nmd_set_option(s, "filters", filters);
+    return s;
+}
+
+/* Get the image and check whether it was decoded by the context */
+static int get_image(struct nmd_ctx *s, struct nmd_frame **framep, int expect_decoded)
+{
+    struct nmd_stats stats;
+    *framep = nmd_get_frame(s, 2.0);
+    if (!*framep) {
+        fprintf(stderr, "didn't get an image\n");
+        return -1;
+    }
+    nmd_get_stats(s, &stats);
+    if (!!stats.nb_frames_decoded != expect_decoded) {
+        fprintf(stderr, "%"PRId64" frames decoded, expected the image to be %s\n",
+                stats.nb_frames_decoded, expect_decoded ? "decoded" : "cached");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <image.jpg> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret;
+    struct nmd_ctx *s0 = NULL, *s1 = NULL, *s2 = NULL;
+    struct nmd_frame *f0 = NULL, *f1 = NULL, *f2 = NULL;
+
+    nmd_set_image_cache_size(64 << 20);
+
+    /* The second context shares the frame decoded by the first one */
+    s0 = create_ctx(filename, use_pkt_duration, NULL);
+    s1 = create_ctx(filename, use_pkt_duration, NULL);
+    s2 = create_ctx(filename, use_pkt_duration, "hflip");
+    if (!s0 || !s1 || !s2) {
+        ret = -1;
+        goto end;
+    }
+    if ((ret = get_image(s0, &f0, 1)) < 0 ||
+        (ret = get_image(s1, &f1, 0)) < 0)
+        goto end;
+    if (f0->datap[0] != f1->datap[0] || f1->width != 480 || f1->height != 640) {
+        fprintf(stderr, "the cached image is not shared\n");
+        ret = -1;
+        goto end;
+    }
+
+    struct nmd_info info;
+    if ((ret = nmd_get_info(s1, &info)) < 0)
+        goto end;
+    if (!info.is_image || info.width != 480 || info.height != 640) {
+        fprintf(stderr, "unexpected cached image info %dx%d is_image=%d\n",
+                info.width, info.height, info.is_image);
+        ret = -1;
+        goto end;
+    }
+
+    /* The image is served again after a restart, and only once */
+    nmd_frame_releasep(&f1);
+    if ((ret = nmd_stop(s1)) < 0 || (ret = get_image(s1, &f1, 0)) < 0)
+        goto end;
+    nmd_frame_releasep(&f1);
+    f1 = nmd_get_frame(s1, 5.0);
+    if (f1) {
+        fprintf(stderr, "we got a new frame even though the source is an image\n");
+        ret = -1;
+        goto end;
+    }
+
+    /* Different filters lead to another image */
+    if ((ret = get_image(s2, &f2, 1)) < 0)
+        goto end;
+    nmd_frame_releasep(&f2);
+    nmd_freep(&s2);
+
+    /* The evicted images are decoded again, while the frames obtained
+     * earlier remain valid */
+    nmd_set_image_cache_size(0);
+    s2 = create_ctx(filename, use_pkt_duration, NULL);
+    if (!s2) {
+        ret = -1;
+        goto end;
+    }
+    if ((ret = get_image(s2, &f2, 1)) < 0)
+        goto end;
+    if (f0->datap[0][0] != f2->datap[0][0]) {
+        fprintf(stderr, "evicted image altered\n");
+        ret = -1;
+    }
+
+end:
+    nmd_frame_releasep(&f0);
+    nmd_frame_releasep(&f1);
+    nmd_frame_releasep(&f2);
+    nmd_freep(&s0);
+    nmd_freep(&s1);
+    nmd_freep(&s2);
+    return ret;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nopemd.h>
+
+#define NB_CTX 64
+
+/* Number of threads of the process, -1 if unknown */
+static int get_nb_threads(void)
+{
+    int nb_threads = -1;
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f)
+        return -1;
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "Threads: %d", &nb_threads) == 1)
+            break;
+    fclose(f);
+#endif
+    return nb_threads;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <image.jpg> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    struct nmd_ctx *ctxs[NB_CTX] = {0};
+    const int nb_threads = get_nb_threads();
+
+    for (int i = 0; i < NB_CTX; i++) {
+        ctxs[i] = nmd_create(filename);
+        if (!ctxs[i]) {
+            ret = -1;
+            goto end;
+        }
+        nmd_set_option(ctxs[i], "auto_hwaccel", 0);
+        nmd_set_option(ctxs[i], "use_pkt_duration", use_pkt_duration);
+    }
+
+    for (int i = 0; i < NB_CTX; i++) {
+        struct nmd_frame *f = nmd_get_frame(ctxs[i], i * 0.5);
+        if (!f || f->width != 480 || f->height != 640) {
+            fprintf(stderr, "context %d: didn't get the image\n", i);
+            nmd_frame_releasep(&f);
+            ret = -1;
+            goto end;
+        }
+        nmd_frame_releasep(&f);
+    }
+
+    /* The images are decoded in the calling thread, and their pipeline is
+     * released as soon as the frame is obtained */
+    const int nb_threads_after = get_nb_threads();
+    if (nb_threads_after > nb_threads) {
+        fprintf(stderr, "%d threads alive after decoding the images, %d before\n",
+                nb_threads_after, nb_threads);
+        ret = -1;
+        goto end;
+    }
+
+    /* The image remains the only frame, even after a restart */
+    for (int i = 0; i < NB_CTX; i++) {
+        struct nmd_frame *f = nmd_get_frame(ctxs[i], 10.0);
+        if (f) {
+            fprintf(stderr, "context %d: got a new frame even though the source is an image\n", i);
+            nmd_frame_releasep(&f);
+            ret = -1;
+            goto end;
+        }
+    }
+    if ((ret = nmd_stop(ctxs[0])) < 0)
+        goto end;
+    struct nmd_frame *f = nmd_get_frame(ctxs[0], 1.0);
+    if (!f) {
+        fprintf(stderr, "didn't get the image after a restart\n");
+        ret = -1;
+        goto end;
+    }
+    nmd_frame_releasep(&f);
+
+end:
+    for (int i = 0; i < NB_CTX; i++)
+        nmd_freep(&ctxs[i]);
+    return ret;
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+struct user_io {
+    int nb_opened;
+    int nb_reads;
+};
+
+struct user_file {
+    FILE *f;
+    struct user_io *uio;
+};
+
+static void *io_open(void *opaque, const char *filename)
+{
+    struct user_file *uf = calloc(1, sizeof(*uf));
+    if (!uf)
+        return NULL;
+    uf->f = fopen(filename, "rb");
+    if (!uf->f) {
+        free(uf);
+        return NULL;
+    }
+    uf->uio = opaque;
+    uf->uio->nb_opened++;
+    return uf;
+}
+
+static int io_read(void *handle, uint8_t *buf, int size)
+{
+    struct user_file *uf = handle;
+    uf->uio->nb_reads++;
+    const size_t n = fread(buf, 1, size, uf->f);
+    return n ? (int)n : ferror(uf->f) ? -1 : 0;
+}
+
+static int64_t io_seek(void *handle, int64_t offset, int whence)
+{
+    struct user_file *uf = handle;
+    if (fseek(uf->f, offset, whence) < 0)
+        return -1;
+    return ftell(uf->f);
+}
+
+static int64_t io_size(void *handle)
+{
+    struct user_file *uf = handle;
+    const long pos = ftell(uf->f);
+    if (pos < 0 || fseek(uf->f, 0, SEEK_END) < 0)
+        return -1;
+    const long size = ftell(uf->f);
+    fseek(uf->f, pos, SEEK_SET);
+    return size;
+}
+
+static void io_close(void *handle)
+{
+    struct user_file *uf = handle;
+    fclose(uf->f);
+    free(uf);
+}
+
+static int check_frames(const char *filename, int use_pkt_duration, int io, struct user_io *uio)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "io", io);
+
+    int ret = 0;
+    if (uio) {
+        const struct nmd_io_callbacks cb = {
+            .opaque = uio,
+            .open   = io_open,
+            .read   = io_read,
+            .seek   = io_seek,
+            .size   = io_size,
+            .close  = io_close,
+        };
+        nmd_set_option(s, "io_buffer_size", 4096);
+        ret = nmd_set_io_callbacks(s, &cb);
+        if (ret < 0)
+            goto end;
+    }
+
+    /* Playback, then jumps forward and backward */
+    static const double times[] = {0.0, 0.04, 0.08, 0.5, 30.0, 30.04, 12.0, 75.0, 2.0};
+    for (int i = 0; i < sizeof(times) / sizeof(*times); i++) {
+        struct nmd_frame *f = nmd_get_frame(s, times[i]);
+        if (!f) {
+            fprintf(stderr, "io=%d: no frame obtained for t=%f\n", io, times[i]);
+            ret = -1;
+            break;
+        }
+        if (fabs(f->ts - times[i]) > 1/25.) {
+            fprintf(stderr, "io=%d: requested t=%f, got frame with ts=%f\n", io, times[i], f->ts);
+            ret = -1;
+        }
+        nmd_frame_releasep(&f);
+        if (ret < 0)
+            break;
+    }
+
+    /* Restarting the pipeline opens the media again */
+    if (ret >= 0)
+        ret = nmd_stop(s);
+    if (ret >= 0) {
+        struct nmd_frame *f = nmd_get_frame(s, 5.0);
+        if (!f || fabs(f->ts - 5.0) > 1/25.) {
+            fprintf(stderr, "io=%d: unable to get a frame after restart\n", io);
+            ret = -1;
+        }
+        nmd_frame_releasep(&f);
+    }
+
+end:
+    nmd_freep(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = check_frames(filename, use_pkt_duration, NMD_IO_DEFAULT, NULL);
+#ifndef _WIN32
+    if (ret >= 0)
+        ret = check_frames(filename, use_pkt_duration, NMD_IO_MMAP, NULL);
+#endif
+    if (ret >= 0)
+        ret = check_frames(filename, use_pkt_duration, NMD_IO_READAHEAD, NULL);
+
+    /* The user callbacks take precedence over the backend */
+    struct user_io uio = {0};
+    if (ret >= 0)
+        ret = check_frames(filename, use_pkt_duration, NMD_IO_READAHEAD, &uio);
+    if (ret >= 0 && (uio.nb_opened < 2 || !uio.nb_reads)) {
+        fprintf(stderr, "user I/O callbacks not used (opened %d times, %d reads)\n",
+                uio.nb_opened, uio.nb_reads);
+        ret = -1;
+    }
+
+    /* Mandatory callbacks */
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    const struct nmd_io_callbacks incomplete_cb = {.open = io_open, .read = io_read};
+    if (ret >= 0 && nmd_set_io_callbacks(s, &incomplete_cb) >= 0) {
+        fprintf(stderr, "incomplete I/O callbacks accepted\n");
+        ret = -1;
+    }
+    nmd_freep(&s);
+
+    return ret;
+}
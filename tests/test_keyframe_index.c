@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+static int run(const char *filename, const char *sidecar, int use_pkt_duration,
+               const double *times, int n)
+{
+    int ret = 0;
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "keyframe_index_file", sidecar);
+
+    for (int i = 0; i < n; i++) {
+        const double t = times[i];
+        struct nmd_frame *f = nmd_get_frame(s, t);
+        if (!f) {
+            fprintf(stderr, "no frame obtained for t=%f\n", t);
+            ret = -1;
+            break;
+        }
+        if (fabs(f->ts - t) > 1/25.) {
+            fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, f->ts);
+            ret = -1;
+        }
+        nmd_frame_releasep(&f);
+        if (ret < 0)
+            break;
+    }
+
+    nmd_freep(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    /* Runs with and without packet duration may happen in parallel */
+    char sidecar[64];
+    snprintf(sidecar, sizeof(sidecar), "test_keyframe_index-%d.idx", use_pkt_duration);
+    remove(sidecar);
+
+    /* Linear playback to build the index */
+    double times[64];
+    const int n = sizeof(times) / sizeof(*times);
+    for (int i = 0; i < n; i++)
+        times[i] = i * 0.2;
+    if (run(filename, sidecar, use_pkt_duration, times, n) < 0)
+        return -1;
+
+    char magic[32] = {0};
+    FILE *fp = fopen(sidecar, "r");
+    if (!fp) {
+        fprintf(stderr, "keyframe index sidecar was not written\n");
+        return -1;
+    }
+    const int nb_read = fscanf(fp, "%31s", magic);
+    fclose(fp);
+    if (nb_read != 1 || strcmp(magic, "nmd-keyframe-index")) {
+        fprintf(stderr, "unexpected keyframe index sidecar content\n");
+        return -1;
+    }
+
+    /* Random accesses with the index loaded from the sidecar */
+    static const double jumps[] = {0.0, 3.0, 9.5, 10.2, 2.0, 11.0, 12.4, 4.8};
+    const int ret = run(filename, sidecar, use_pkt_duration, jumps, sizeof(jumps) / sizeof(*jumps));
+
+    remove(sidecar);
+    return ret;
+}
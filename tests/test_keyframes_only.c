@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+/* The test media has a keyframe every 10 seconds */
+#define GOP_DURATION 10.0
+
+static int sweep(struct nmd_ctx *s, double step)
+{
+    double last_ts = -1;
+
+    for (double t = 0; t < 80; t += step) {
+        const double expected = floor(t / GOP_DURATION) * GOP_DURATION;
+        struct nmd_frame *f = nmd_get_frame(s, t);
+        double ts = last_ts;
+        if (f) {
+            ts = f->ts;
+            nmd_frame_releasep(&f);
+        } else if (last_ts < 0) {
+            fprintf(stderr, "no frame obtained for t=%f\n", t);
+            return -1;
+        }
+        if (fabs(ts - expected) > 1/25.) {
+            fprintf(stderr, "requested t=%f, got frame with ts=%f instead of keyframe %f\n",
+                    t, ts, expected);
+            return -1;
+        }
+        last_ts = ts;
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "keyframes_only", 1);
+
+    /* The first sweep reads the whole stream, indexing the keyframes; the
+     * second one can jump from one keyframe to the next */
+    int ret = sweep(s, 0.5);
+    if (ret >= 0)
+        ret = sweep(s, 2.5);
+
+    /* Backward scrubbing */
+    static const double times[] = {55.0, 35.2, 12.0, 9.9, 0.5};
+    for (int i = 0; i < sizeof(times) / sizeof(*times) && ret >= 0; i++) {
+        struct nmd_frame *f = nmd_get_frame(s, times[i]);
+        if (!f) {
+            fprintf(stderr, "no frame obtained for t=%f\n", times[i]);
+            ret = -1;
+            break;
+        }
+        const double expected = floor(times[i] / GOP_DURATION) * GOP_DURATION;
+        if (fabs(f->ts - expected) > 1/25.) {
+            fprintf(stderr, "requested t=%f, got frame with ts=%f instead of keyframe %f\n",
+                    times[i], f->ts, expected);
+            ret = -1;
+        }
+        nmd_frame_releasep(&f);
+    }
+
+    nmd_freep(&s);
+    return ret;
+}
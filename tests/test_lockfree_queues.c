@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+static int check_frame(struct nmd_ctx *s, double t)
+{
+    struct nmd_frame *f = nmd_get_frame(s, t);
+    if (!f) {
+        fprintf(stderr, "no frame obtained for t=%f\n", t);
+        return -1;
+    }
+    const double ts = f->ts;
+    nmd_frame_releasep(&f);
+    if (fabs(ts - t) > 1/25.) {
+        fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, ts);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "lockfree_queues", 1);
+
+    int ret = 0;
+
+    /* Continuous playback faster than the media frame rate */
+    for (int i = 0; i < 120 && ret >= 0; i++)
+        ret = check_frame(s, i / 60.);
+
+    /* Seeks flush the rings while the workers are feeding them */
+    static const double times[] = {0.5, 7.0, 3.0, 3.04, 9.5, 70.0};
+    for (int i = 0; i < sizeof(times) / sizeof(*times) && ret >= 0; i++)
+        ret = check_frame(s, times[i]);
+
+    /* Decode up to EOF, keeping a frame beyond the context life */
+    struct nmd_frame *last = NULL;
+    for (int i = 0; ret >= 0; i++) {
+        struct nmd_frame *f = nmd_get_next_frame(s);
+        if (!f) {
+            if (!i) {
+                fprintf(stderr, "no frame returned\n");
+                ret = -1;
+            }
+            break;
+        }
+        if (last && f->ts <= last->ts) {
+            fprintf(stderr, "frame ts=%f is not after ts=%f\n", f->ts, last->ts);
+            ret = -1;
+        }
+        nmd_frame_releasep(&last);
+        last = f;
+    }
+
+    nmd_freep(&s);
+    nmd_frame_releasep(&last);
+    return ret;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+static int check_size(const char *filename, int use_pkt_duration, int max_pixels)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "max_pixels", max_pixels);
+
+    int ret = 0;
+    struct nmd_info info;
+    struct nmd_frame *f = nmd_get_frame(s, 1.0);
+    if (!f || nmd_get_info(s, &info) < 0) {
+        fprintf(stderr, "unable to get a frame with max_pixels=%d\n", max_pixels);
+        ret = -1;
+        goto end;
+    }
+
+    /* Same rounding as the library, whatever the decoder resolution is */
+    int w = info.width, h = info.height;
+    if (w * h > max_pixels) {
+        const double factor = sqrt((double)max_pixels / (w * h));
+        w = (int)(w * factor) & ~1;
+        h = (int)(h * factor) & ~1;
+    }
+    if (f->width != w || f->height != h) {
+        fprintf(stderr, "got a %dx%d frame from a %dx%d media with max_pixels=%d, expected %dx%d\n",
+                f->width, f->height, info.width, info.height, max_pixels, w, h);
+        ret = -1;
+    }
+
+end:
+    nmd_frame_releasep(&f);
+    nmd_freep(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    /* Exact and inexact fractions of the decoder resolutions */
+    static const int max_pixels[] = {480 * 640 / 4, 10000, 320 * 240, 1 << 30};
+    for (int i = 0; i < sizeof(max_pixels) / sizeof(*max_pixels); i++) {
+        int ret = check_size(filename, use_pkt_duration, max_pixels[i]);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libavutil/time.h>
+
+#include <nopemd.h>
+
+#define NB_CONTEXTS 2
+
+static struct nmd_ctx *create_context(const char *filename, int use_pkt_duration, int max_queued_memory)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "max_nb_frames", 8);
+    nmd_set_option(s, "max_nb_sink", 8);
+    nmd_set_option(s, "max_queued_memory", max_queued_memory);
+    return s;
+}
+
+/* Give the pipeline some time to fill the queues, then check they didn't
+ * grow past a single frame */
+static int check_queues(struct nmd_ctx *s, int idx)
+{
+    av_usleep(100000);
+    struct nmd_stats stats;
+    nmd_get_stats(s, &stats);
+    if (stats.frames_queue_fill > 1 || stats.sink_queue_fill > 1) {
+        fprintf(stderr, "context %d: %d frames in the frames queue and %d in the sink over the budget\n",
+                idx, stats.frames_queue_fill, stats.sink_queue_fill);
+        return -1;
+    }
+    return 0;
+}
+
+static int play(struct nmd_ctx *s, int idx, double from)
+{
+    for (int i = 0; i < 25; i++) {
+        const double t = from + i / 25.;
+        struct nmd_frame *f = nmd_get_frame(s, t);
+        if (!f || fabs(f->ts - t) > 1/25.) {
+            fprintf(stderr, "context %d: requested t=%f, got frame with ts=%f\n", idx, t, f ? f->ts : -1.);
+            nmd_frame_releasep(&f);
+            return -1;
+        }
+        nmd_frame_releasep(&f);
+    }
+    return 0;
+}
+
+static int check_frames(struct nmd_ctx *s, int idx, double from)
+{
+    const int ret = play(s, idx, from);
+    return ret < 0 ? ret : check_queues(s, idx);
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    /* A limit of the context smaller than a frame leaves a single frame per
+     * queue */
+    struct nmd_ctx *s = create_context(filename, use_pkt_duration, 1);
+    if (!s)
+        return -1;
+    int ret = check_frames(s, 0, 0.0);
+    if (ret >= 0)
+        ret = check_frames(s, 0, 30.0);
+    nmd_freep(&s);
+    if (ret < 0)
+        return ret;
+
+    /* Same with the process-wide limit, shared by several contexts */
+    struct nmd_ctx *ctxs[NB_CONTEXTS] = {0};
+    nmd_set_max_queued_memory(1);
+    for (int i = 0; i < NB_CONTEXTS; i++) {
+        ctxs[i] = create_context(filename, use_pkt_duration, 0);
+        if (!ctxs[i]) {
+            ret = -1;
+            goto end;
+        }
+    }
+    for (int i = 0; i < NB_CONTEXTS && ret >= 0; i++)
+        ret = check_frames(ctxs[i], i, i * 10.0);
+
+    /* Removing the limit gives the queues their full depth back */
+    nmd_set_max_queued_memory(0);
+    for (int i = 0; i < NB_CONTEXTS && ret >= 0; i++)
+        ret = play(ctxs[i], i, 40.0 + i * 10.0);
+
+end:
+    nmd_set_max_queued_memory(0);
+    for (int i = 0; i < NB_CONTEXTS; i++)
+        nmd_freep(&ctxs[i]);
+    return ret;
+}
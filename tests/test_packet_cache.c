@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+static int nb_seeks;
+
+static void *io_open(void *opaque, const char *filename)
+{
+    return fopen(filename, "rb");
+}
+
+static int io_read(void *handle, uint8_t *buf, int size)
+{
+    const size_t n = fread(buf, 1, size, handle);
+    return n ? (int)n : ferror(handle) ? -1 : 0;
+}
+
+static int64_t io_seek(void *handle, int64_t offset, int whence)
+{
+    nb_seeks++;
+    if (fseek(handle, offset, whence) < 0)
+        return -1;
+    return ftell(handle);
+}
+
+static void io_close(void *handle)
+{
+    fclose(handle);
+}
+
+static int check_frame(struct nmd_ctx *s, double t)
+{
+    struct nmd_frame *f = nmd_get_frame(s, t);
+    if (!f || fabs(f->ts - t) > 1/25.) {
+        fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, f ? f->ts : -1.);
+        nmd_frame_releasep(&f);
+        return -1;
+    }
+    nmd_frame_releasep(&f);
+    return 0;
+}
+
+/* Play, jump back and play again: return the number of I/O seeks of the jump
+ * and of the following playback */
+static int play_and_jump_back(const char *filename, int use_pkt_duration, int max_size)
+{
+    static const struct nmd_io_callbacks cb = {
+        .open  = io_open,
+        .read  = io_read,
+        .seek  = io_seek,
+        .close = io_close,
+    };
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "max_cached_packets_size", max_size);
+    int ret = nmd_set_io_callbacks(s, &cb);
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i < 3 * 25 && ret >= 0; i++)
+        ret = check_frame(s, i / 25.);
+    if (ret < 0)
+        goto end;
+
+    nb_seeks = 0;
+    for (int i = 25; i < 5 * 25 && ret >= 0; i++)
+        ret = check_frame(s, i / 25.);
+    if (ret >= 0)
+        ret = nb_seeks;
+
+end:
+    nmd_freep(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    /* Without the cache, jumping back seeks in the media */
+    int ret = play_and_jump_back(filename, use_pkt_duration, 0);
+    if (ret < 0)
+        return ret;
+    if (!ret) {
+        fprintf(stderr, "no seek in the media without the packet cache\n");
+        return -1;
+    }
+
+    /* With the cache, the packets are replayed from memory and the reading
+     * of the media goes on where it was */
+    ret = play_and_jump_back(filename, use_pkt_duration, 16 << 20);
+    if (ret < 0)
+        return ret;
+    if (ret) {
+        fprintf(stderr, "%d seeks in the media with the packet cache\n", ret);
+        return -1;
+    }
+
+    /* A cache too small to hold a GOP still plays correctly */
+    ret = play_and_jump_back(filename, use_pkt_duration, 1024);
+    return ret < 0 ? ret : 0;
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+#define FRAME_RATE 25
+
+/* Non-reference frames may be skipped when playing fast, so the frame
+ * returned can be a few frames behind the requested time, but never after */
+static int check_frame(struct nmd_ctx *s, double t, double max_late, double *last_ts)
+{
+    struct nmd_frame *f = nmd_get_frame(s, t);
+    double ts = *last_ts;
+    if (f) {
+        ts = f->ts;
+        nmd_frame_releasep(&f);
+    } else if (ts < 0) {
+        fprintf(stderr, "no frame obtained for t=%f\n", t);
+        return -1;
+    }
+    if (ts - t > 1. / FRAME_RATE || t - ts > max_late) {
+        fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, ts);
+        return -1;
+    }
+    *last_ts = ts;
+    return 0;
+}
+
+static int play(struct nmd_ctx *s, double rate, double from, double to, double *last_ts)
+{
+    int ret = nmd_set_playback_rate(s, rate);
+    if (ret < 0)
+        return ret;
+
+    const double max_late = rate > 1. ? 8. / FRAME_RATE : 1. / FRAME_RATE;
+    for (int i = 0; from + i * rate / FRAME_RATE < to && ret >= 0; i++)
+        ret = check_frame(s, from + i * rate / FRAME_RATE, max_late, last_ts);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+
+    int ret = 0;
+    if (nmd_set_playback_rate(s, 0.) >= 0 || nmd_set_playback_rate(s, -1.) >= 0) {
+        fprintf(stderr, "invalid playback rate accepted\n");
+        ret = -1;
+        goto end;
+    }
+
+    /* The rate can be changed before and after the context is started */
+    double last_ts = -1;
+    ret = play(s, 4., 0., 20., &last_ts);
+    if (ret >= 0)
+        ret = play(s, 1., 20., 22., &last_ts);
+    if (ret >= 0)
+        ret = play(s, 8., 22., 60., &last_ts);
+    if (ret >= 0)
+        ret = play(s, 1., 60., 62., &last_ts);
+
+end:
+    nmd_freep(&s);
+    return ret;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+#define FRAME_RATE 25
+#define NB_FRAMES (20 * FRAME_RATE)
+
+static struct nmd_ctx *create_context(const char *filename, int use_pkt_duration)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    return s;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    /* Timestamps of the frames obtained by decoding them all in a row */
+    static double ref_ts[NB_FRAMES];
+    struct nmd_ctx *s = create_context(filename, use_pkt_duration);
+    if (!s)
+        return -1;
+    int ret = 0;
+    for (int i = 0; i < NB_FRAMES; i++) {
+        struct nmd_frame *f = nmd_get_frame(s, i / (double)FRAME_RATE);
+        if (!f) {
+            fprintf(stderr, "no frame obtained for t=%f\n", i / (double)FRAME_RATE);
+            ret = -1;
+            break;
+        }
+        ref_ts[i] = f->ts;
+        nmd_frame_releasep(&f);
+    }
+    nmd_freep(&s);
+    if (ret < 0)
+        return ret;
+
+    /* The frames returned after a seek, in the middle of a GOP or between two
+     * frames, are the ones a continuous playback returns */
+    static const double times[] = {3.01, 7.5, 12.345, 1.99, 15.0, 9.02, 18.7, 5.039};
+    s = create_context(filename, use_pkt_duration);
+    if (!s)
+        return -1;
+    for (int i = 0; i < sizeof(times) / sizeof(*times); i++) {
+        double expected = ref_ts[0];
+        for (int j = 0; j < NB_FRAMES && ref_ts[j] <= times[i] + 1e-6; j++)
+            expected = ref_ts[j];
+
+        struct nmd_frame *f = nmd_get_frame(s, times[i]);
+        if (!f || fabs(f->ts - expected) > 1e-6) {
+            fprintf(stderr, "requested t=%f, got frame with ts=%f instead of %f\n",
+                    times[i], f ? f->ts : -1., expected);
+            ret = -1;
+        }
+        nmd_frame_releasep(&f);
+        if (ret < 0)
+            break;
+    }
+
+    struct nmd_stats stats;
+    nmd_get_stats(s, &stats);
+    if (ret >= 0 && !stats.nb_seeks) {
+        fprintf(stderr, "the requests did not involve any seek\n");
+        ret = -1;
+    }
+
+    nmd_freep(&s);
+    return ret;
+}
@@ -0,0 +1,142 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+#define SAMPLE_RATE 48000
+#define NB_SAMPLES 1000
+
+static struct nmd_ctx *create_context(const char *filename, int use_pkt_duration)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "avselect", NMD_SELECT_AUDIO);
+    nmd_set_option(s, "audio_texture", 0);
+    nmd_set_option(s, "sample_rate", SAMPLE_RATE);
+    return s;
+}
+
+static int read_window(struct nmd_ctx *s, double t, int nb_samples, float *dst, int expected)
+{
+    const int ret = nmd_read_audio(s, t, nb_samples, dst);
+    if (ret < 0 || (expected >= 0 && ret != expected)) {
+        fprintf(stderr, "read %d samples at t=%f: got %d, expected %d\n", nb_samples, t, ret, expected);
+        return -1;
+    }
+    return ret;
+}
+
+static int compare_samples(const float *a, const float *b, int nb_samples)
+{
+    for (int i = 0; i < nb_samples * 2; i++) {
+        if (fabsf(a[i] - b[i]) > 1e-2f) {
+            fprintf(stderr, "sample %d differs: %f vs %f\n", i / 2, a[i], b[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    static float ref[SAMPLE_RATE * 2];
+    static float buf[NB_SAMPLES * 2];
+
+    struct nmd_ctx *s = NULL;
+    struct nmd_ctx *ref_s = create_context(filename, use_pkt_duration);
+    if (!ref_s)
+        return -1;
+
+    /* Reference: a second of audio read from 9.5s in small windows */
+    int ret = 0;
+    for (int i = 0; i < SAMPLE_RATE / 480; i++) {
+        ret = read_window(ref_s, 9.5 + i * 480. / SAMPLE_RATE, 480, ref + i * 480 * 2, 480);
+        if (ret < 0)
+            goto end;
+    }
+
+    /* A window at an exact time matches the reference, whatever the frame
+     * boundaries */
+    s = create_context(filename, use_pkt_duration);
+    if (!s) {
+        ret = -1;
+        goto end;
+    }
+    ret = read_window(s, 10.0, NB_SAMPLES, buf, NB_SAMPLES);
+    if (ret >= 0)
+        ret = compare_samples(buf, ref + SAMPLE_RATE / 2 * 2, NB_SAMPLES);
+    if (ret < 0)
+        goto end;
+
+    /* Small shifts backward and forward are served without seeking */
+    struct nmd_stats stats;
+    nmd_get_stats(s, &stats);
+    const int64_t nb_seeks = stats.nb_seeks;
+    static const int offsets[] = {37, 10, 0, 1234, 5000, 20001};
+    for (int i = 0; i < sizeof(offsets) / sizeof(*offsets); i++) {
+        const int offset = offsets[i];
+        ret = read_window(s, 10.0 + offset / (double)SAMPLE_RATE, NB_SAMPLES, buf, NB_SAMPLES);
+        if (ret >= 0)
+            ret = compare_samples(buf, ref + (SAMPLE_RATE / 2 + offset) * 2, NB_SAMPLES);
+        if (ret < 0)
+            goto end;
+    }
+    nmd_get_stats(s, &stats);
+    if (stats.nb_seeks != nb_seeks) {
+        fprintf(stderr, "%"PRId64" seeks for small shifts\n", stats.nb_seeks - nb_seeks);
+        ret = -1;
+        goto end;
+    }
+
+    /* Jumping far away and back works */
+    if ((ret = read_window(s, 120.0, NB_SAMPLES, buf, NB_SAMPLES)) < 0 ||
+        (ret = read_window(s, 9.5, NB_SAMPLES, buf, NB_SAMPLES)) < 0 ||
+        (ret = compare_samples(buf, ref, NB_SAMPLES)) < 0)
+        goto end;
+
+    /* The samples after the end of the media are zero-filled */
+    double duration;
+    ret = nmd_get_duration(s, &duration);
+    if (ret < 0)
+        goto end;
+    ret = read_window(s, duration - 0.01, NB_SAMPLES, buf, -1);
+    if (ret < 0)
+        goto end;
+    if (ret == 0 || ret >= NB_SAMPLES || buf[NB_SAMPLES * 2 - 1] != 0.f) {
+        fprintf(stderr, "got %d samples at the end of the media\n", ret);
+        ret = -1;
+        goto end;
+    }
+    ret = 0;
+
+    /* Only the audio contexts without audio_texture can be read */
+    nmd_freep(&s);
+    s = nmd_create(filename);
+    if (!s) {
+        ret = -1;
+        goto end;
+    }
+    nmd_set_option(s, "auto_hwaccel", 0);
+    if (nmd_read_audio(s, 0.0, NB_SAMPLES, buf) >= 0) {
+        fprintf(stderr, "audio read from a video context\n");
+        ret = -1;
+    }
+
+end:
+    nmd_freep(&ref_s);
+    nmd_freep(&s);
+    return ret;
+}
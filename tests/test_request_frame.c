@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <libavutil/time.h>
+
+#include <nopemd.h>
+
+/* Poll until the request is complete, counting how many times the frame was
+ * not ready yet */
+static int wait_frame(struct nmd_ctx *s, struct nmd_frame **framep, int *nb_pending)
+{
+    for (;;) {
+        int ret = nmd_poll_frame(s, framep);
+        if (ret)
+            return ret;
+        (*nb_pending)++;
+        av_usleep(1000);
+    }
+}
+
+static int check_request(struct nmd_ctx *s, double t, double *last_ts, int *nb_pending)
+{
+    int ret = nmd_request_frame(s, t);
+    if (ret < 0) {
+        fprintf(stderr, "unable to request frame at t=%f\n", t);
+        return ret;
+    }
+
+    struct nmd_frame *f = NULL;
+    ret = wait_frame(s, &f, nb_pending);
+    if (ret < 0) {
+        fprintf(stderr, "unable to poll frame at t=%f\n", t);
+        return ret;
+    }
+
+    double ts = *last_ts;
+    if (f) {
+        ts = f->ts;
+        nmd_frame_releasep(&f);
+    } else if (ts < 0) {
+        fprintf(stderr, "no frame obtained for t=%f\n", t);
+        return -1;
+    }
+    if (fabs(ts - t) > 1/25.) {
+        fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, ts);
+        return -1;
+    }
+    *last_ts = ts;
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+
+    int ret = 0;
+    int nb_pending = 0;
+    double last_ts = -1;
+
+    /* Polling without request is an error */
+    struct nmd_frame *f = NULL;
+    if (nmd_poll_frame(s, &f) >= 0 || f) {
+        fprintf(stderr, "polling without request did not fail\n");
+        ret = -1;
+        goto end;
+    }
+
+    /* Playback, then jumps forward and backward */
+    static const double times[] = {0.0, 0.04, 0.08, 0.1, 0.5, 0.5, 30.0, 30.04, 12.0, 75.0, 2.0};
+    for (int i = 0; i < sizeof(times) / sizeof(*times) && ret >= 0; i++)
+        ret = check_request(s, times[i], &last_ts, &nb_pending);
+    if (ret < 0)
+        goto end;
+
+    /* A seek can not be honored instantly, so the frame must have been
+     * reported as not ready at least once */
+    if (!nb_pending) {
+        fprintf(stderr, "all the frames were ready immediately\n");
+        ret = -1;
+        goto end;
+    }
+
+    /* Requests replacing each other before the frame is collected */
+    for (int i = 0; i < 10 && ret >= 0; i++) {
+        ret = nmd_request_frame(s, 40.0 + i);
+        if (ret >= 0)
+            ret = nmd_poll_frame(s, &f);
+        nmd_frame_releasep(&f);
+    }
+    if (ret < 0)
+        goto end;
+    ret = check_request(s, 20.0, &last_ts, &nb_pending);
+    if (ret < 0)
+        goto end;
+
+    /* A cancelled request must not break the blocking API */
+    ret = nmd_request_frame(s, 60.0);
+    if (ret < 0)
+        goto end;
+    f = nmd_get_frame(s, 20.5);
+    if (!f || fabs(f->ts - 20.5) > 1/25.) {
+        fprintf(stderr, "blocking call after a cancelled request failed\n");
+        ret = -1;
+    }
+    nmd_frame_releasep(&f);
+
+end:
+    nmd_freep(&s);
+    return ret;
+}
@@ -0,0 +1,116 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+#define FRAME_RATE 25
+
+static int check_frame(struct nmd_ctx *s, double t, double *last_ts)
+{
+    struct nmd_frame *f = nmd_get_frame(s, t);
+    double ts = *last_ts;
+    if (f) {
+        ts = f->ts;
+        nmd_frame_releasep(&f);
+    } else if (ts < 0) {
+        fprintf(stderr, "no frame obtained for t=%f\n", t);
+        return -1;
+    }
+    if (fabs(ts - t) > 1. / FRAME_RATE) {
+        fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, ts);
+        return -1;
+    }
+    *last_ts = ts;
+    return 0;
+}
+
+/* Play backward frame by frame, across several GOP and window boundaries */
+static int play_backward(struct nmd_ctx *s, double from, double to, double *last_ts)
+{
+    int ret = 0;
+    for (int i = lrint(from * FRAME_RATE); i >= lrint(to * FRAME_RATE) && ret >= 0; i--)
+        ret = check_frame(s, (double)i / FRAME_RATE, last_ts);
+    return ret;
+}
+
+/* The media has a keyframe every 10 seconds: the GOP is decoded once and its
+ * frames are then returned backward from memory */
+static int check_gop_window(const char *filename, int use_pkt_duration)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "reverse", 1);
+
+    double last_ts = -1;
+    int ret = play_backward(s, 19.96, 10.0, &last_ts);
+    if (ret >= 0) {
+        /* The initial seek, the one starting the window at the keyframe and
+         * the one prefetching the previous GOP */
+        struct nmd_stats stats;
+        nmd_get_stats(s, &stats);
+        if (stats.nb_seeks > 3) {
+            fprintf(stderr, "%"PRId64" seeks to play a GOP backward\n", stats.nb_seeks);
+            ret = -1;
+        }
+    }
+
+    nmd_freep(&s);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "reverse", 1);
+    nmd_set_option(s, "max_nb_cached_frames", 20);
+
+    double last_ts = -1;
+    int ret = play_backward(s, 22.0, 8.0, &last_ts);
+
+    /* Jumps away from the prefetched window */
+    if (ret >= 0)
+        ret = check_frame(s, 40.0, &last_ts);
+    if (ret >= 0)
+        ret = play_backward(s, 41.0, 39.0, &last_ts);
+    if (ret >= 0)
+        ret = check_frame(s, 60.0, &last_ts);
+
+    /* Play forward again */
+    for (int i = 0; i < 30 && ret >= 0; i++)
+        ret = check_frame(s, 60.0 + (double)i / FRAME_RATE, &last_ts);
+
+    /* The next frame follows the latest one returned, whatever the position
+     * of the prefetched window */
+    if (ret >= 0)
+        ret = play_backward(s, 3.0, 1.0, &last_ts);
+    if (ret >= 0) {
+        struct nmd_frame *f = nmd_get_next_frame(s);
+        if (!f || fabs(f->ts - (last_ts + 1. / FRAME_RATE)) > 1. / (2 * FRAME_RATE)) {
+            fprintf(stderr, "next frame after %f is %f\n", last_ts, f ? f->ts : -1.);
+            ret = -1;
+        }
+        nmd_frame_releasep(&f);
+    }
+
+    nmd_freep(&s);
+    if (ret >= 0)
+        ret = check_gop_window(filename, use_pkt_duration);
+    return ret;
+}
@@ -0,0 +1,153 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+#define END_TIME 30.0
+#define MAX_FRAMES 4096
+
+struct frame_ref {
+    int64_t pts;
+    uint32_t crc;
+};
+
+static uint32_t hash_frame(const struct nmd_frame *f)
+{
+    uint32_t h = 2166136261u;
+    for (int y = 0; y < f->height; y++) {
+        const uint8_t *p = f->datap[0] + y * f->linesizep[0];
+        for (int x = 0; x < f->width * 4; x++)
+            h = (h ^ p[x]) * 16777619u;
+    }
+    return h;
+}
+
+static struct nmd_ctx *create_context(const char *filename, int use_pkt_duration, int export_segments)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "end_time", END_TIME);
+    nmd_set_option(s, "export_segments", export_segments);
+    return s;
+}
+
+/* Read the frames up to EOF, starting with the ones already in refs */
+static int read_frames(struct nmd_ctx *s, struct frame_ref *refs, int nb_refs)
+{
+    for (int n = 0;; n++) {
+        struct nmd_frame *f = nmd_get_next_frame(s);
+        if (!f)
+            return n;
+        if (n == nb_refs) {
+            nmd_frame_releasep(&f);
+            fprintf(stderr, "more than %d frames\n", nb_refs);
+            return -1;
+        }
+        refs[n].pts = f->pts;
+        refs[n].crc = hash_frame(f);
+        nmd_frame_releasep(&f);
+    }
+}
+
+static int check_frames(const struct frame_ref *refs, const struct frame_ref *frames, int nb_frames)
+{
+    for (int i = 0; i < nb_frames; i++) {
+        if (frames[i].pts != refs[i].pts || frames[i].crc != refs[i].crc) {
+            fprintf(stderr, "frame %d: got pts=%"PRId64" crc=%08x, expected pts=%"PRId64" crc=%08x\n",
+                    i, frames[i].pts, frames[i].crc, refs[i].pts, refs[i].crc);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct frame_ref *refs = calloc(MAX_FRAMES, sizeof(*refs));
+    struct frame_ref *frames = calloc(MAX_FRAMES, sizeof(*frames));
+    if (!refs || !frames) {
+        free(refs);
+        free(frames);
+        return -1;
+    }
+
+    /* Sequential reference */
+    int ret = -1;
+    struct nmd_ctx *s = create_context(filename, use_pkt_duration, 0);
+    if (!s)
+        goto end;
+    const int nb_refs = read_frames(s, refs, MAX_FRAMES);
+    nmd_freep(&s);
+    if (nb_refs <= 0)
+        goto end;
+
+    /* The segments decoded concurrently are returned in order */
+    s = create_context(filename, use_pkt_duration, 4);
+    if (!s)
+        goto end;
+    int nb_frames = read_frames(s, frames, MAX_FRAMES);
+    if (nb_frames != nb_refs) {
+        fprintf(stderr, "got %d frames instead of %d\n", nb_frames, nb_refs);
+        goto end;
+    }
+    if (check_frames(refs, frames, nb_frames) < 0)
+        goto end;
+
+    /* The media has several GOPs within END_TIME, each segment being
+     * decoded after a seek */
+    struct nmd_stats stats;
+    if (nmd_get_stats(s, &stats) < 0 || stats.nb_seeks < 2) {
+        fprintf(stderr, "the export was not split into segments (%"PRId64" seeks)\n", stats.nb_seeks);
+        goto end;
+    }
+
+    /* The export restarts from the beginning after EOF */
+    struct nmd_frame *f = nmd_get_next_frame(s);
+    if (!f || f->pts != refs[0].pts) {
+        fprintf(stderr, "unexpected frame after EOF: pts=%"PRId64"\n", f ? f->pts : -1);
+        nmd_frame_releasep(&f);
+        goto end;
+    }
+    nmd_frame_releasep(&f);
+
+    /* ...and resumes after a frame obtained with nmd_get_frame() */
+    f = nmd_get_frame(s, 10.0);
+    if (!f) {
+        fprintf(stderr, "no frame obtained for t=10\n");
+        goto end;
+    }
+    const int64_t pts = f->pts;
+    nmd_frame_releasep(&f);
+    int idx = 0;
+    while (idx < nb_refs && refs[idx].pts != pts)
+        idx++;
+    if (idx >= nb_refs) {
+        fprintf(stderr, "frame pts=%"PRId64" not in the reference\n", pts);
+        goto end;
+    }
+    nb_frames = read_frames(s, frames, MAX_FRAMES);
+    if (nb_frames != nb_refs - idx - 1) {
+        fprintf(stderr, "got %d frames after t=10 instead of %d\n", nb_frames, nb_refs - idx - 1);
+        goto end;
+    }
+    ret = check_frames(refs + idx + 1, frames, nb_frames);
+
+end:
+    nmd_freep(&s);
+    free(refs);
+    free(frames);
+    return ret;
+}
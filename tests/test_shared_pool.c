@@ -0,0 +1,110 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+static struct nmd_ctx *create_ctx(const char *filename, int use_pkt_duration)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "max_nb_cached_frames", 100);
+    nmd_set_option(s, "shared_pool", 1);
+    return s;
+}
+
+static int check_frame(struct nmd_ctx *s, double t)
+{
+    struct nmd_frame *f = nmd_get_frame(s, t);
+    if (!f) {
+        fprintf(stderr, "no frame obtained for t=%f\n", t);
+        return -1;
+    }
+    const double ts = f->ts;
+    nmd_frame_releasep(&f);
+    if (fabs(ts - t) > 1/25.) {
+        fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, ts);
+        return -1;
+    }
+    return 0;
+}
+
+/* Display rate above the media frame rate: most requests get the same frame
+ * as the previous one */
+static int play_60hz(struct nmd_ctx *s, double duration)
+{
+    for (int i = 0; i < duration * 60; i++) {
+        const double t = i / 60.;
+        struct nmd_frame *f = nmd_get_frame(s, t);
+        if (!f && !i) {
+            fprintf(stderr, "no frame obtained for t=%f\n", t);
+            return -1;
+        }
+        if (f && fabs(f->ts - t) > 1/25.) {
+            fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, f->ts);
+            nmd_frame_releasep(&f);
+            return -1;
+        }
+        nmd_frame_releasep(&f);
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s0 = create_ctx(filename, use_pkt_duration);
+    struct nmd_ctx *s1 = create_ctx(filename, use_pkt_duration);
+    if (!s0 || !s1) {
+        nmd_freep(&s0);
+        nmd_freep(&s1);
+        return -1;
+    }
+
+    int ret = 0;
+
+    /* The first context decodes a range of the media */
+    for (int i = 0; i < 50 && ret >= 0; i++)
+        ret = check_frame(s0, i / 25.);
+
+    /* The second one is served within that range, then goes beyond it and
+     * jumps back into it */
+    static const double times[] = {1.0, 1.04, 0.2, 1.9, 2.5, 2.6, 0.5, 3.0};
+    for (int i = 0; i < sizeof(times) / sizeof(*times) && ret >= 0; i++)
+        ret = check_frame(s1, times[i]);
+
+    /* The frames remain available as long as one context is alive */
+    nmd_freep(&s0);
+    for (int i = 0; i < 10 && ret >= 0; i++)
+        ret = check_frame(s1, 1.0 + i / 25.);
+
+    nmd_freep(&s1);
+    if (ret < 0)
+        return ret;
+
+    /* The frames found in the pool were decoded by our own pipeline, which
+     * keeps going without seeking */
+    struct nmd_ctx *s2 = create_ctx(filename, use_pkt_duration);
+    if (!s2)
+        return -1;
+    ret = play_60hz(s2, 3.);
+    struct nmd_stats stats;
+    nmd_get_stats(s2, &stats);
+    if (ret >= 0 && stats.nb_seeks) {
+        fprintf(stderr, "%"PRId64" seeks during the playback\n", stats.nb_seeks);
+        ret = -1;
+    }
+    nmd_freep(&s2);
+    return ret;
+}
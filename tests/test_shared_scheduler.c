@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+#define NB_CONTEXTS 8
+
+static int check_frame(struct nmd_ctx *s, double t)
+{
+    struct nmd_frame *f = nmd_get_frame(s, t);
+    if (!f) {
+        fprintf(stderr, "no frame obtained for t=%f\n", t);
+        return -1;
+    }
+    const double ts = f->ts;
+    nmd_frame_releasep(&f);
+    if (fabs(ts - t) > 1/25.) {
+        fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, ts);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+    struct nmd_ctx *ctxs[NB_CONTEXTS] = {0};
+    for (int i = 0; i < NB_CONTEXTS; i++) {
+        struct nmd_ctx *s = nmd_create(filename);
+        if (!s) {
+            ret = -1;
+            goto end;
+        }
+        nmd_set_option(s, "auto_hwaccel", 0);
+        nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+        nmd_set_option(s, "shared_scheduler", 1);
+        ctxs[i] = s;
+    }
+
+    /* Every context plays a different range of the media, interleaved like
+     * the clips of a composition */
+    for (int n = 0; n < 50 && ret >= 0; n++)
+        for (int i = 0; i < NB_CONTEXTS && ret >= 0; i++)
+            ret = check_frame(ctxs[i], i * 5.0 + n / 25.);
+
+    /* Seeks and idle contexts must not prevent the others from progressing */
+    for (int n = 0; n < 5 && ret >= 0; n++)
+        ret = check_frame(ctxs[0], 40.0 - n);
+    for (int i = 1; i < NB_CONTEXTS && ret >= 0; i++)
+        ret = check_frame(ctxs[i], 60.0 + i);
+
+    /* Destroying a context while the others keep running */
+    nmd_freep(&ctxs[NB_CONTEXTS - 1]);
+    for (int n = 0; n < 10 && ret >= 0; n++)
+        for (int i = 0; i < NB_CONTEXTS - 1 && ret >= 0; i++)
+            ret = check_frame(ctxs[i], 61.0 + i + n / 25.);
+
+end:
+    for (int i = 0; i < NB_CONTEXTS; i++)
+        nmd_freep(&ctxs[i]);
+    return ret;
+}
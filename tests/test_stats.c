@@ -0,0 +1,98 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+#define NB_FRAMES 50
+
+static int check_timing(const char *name, const struct nmd_timing_stats *t)
+{
+    if (!t->count || t->avg < 0 || t->max < t->avg) {
+        fprintf(stderr, "unexpected %s timing: count=%"PRId64" avg=%f max=%f\n",
+                name, t->count, t->avg, t->max);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return -1;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+
+    int ret = 0;
+    struct nmd_stats stats;
+    nmd_get_stats(s, &stats);
+    if (stats.nb_frames_returned || stats.nb_frames_decoded || stats.demux.count) {
+        fprintf(stderr, "statistics are not empty before any decoding\n");
+        ret = -1;
+        goto end;
+    }
+
+    for (int i = 0; i < NB_FRAMES; i++) {
+        struct nmd_frame *f = nmd_get_frame(s, i / 25.);
+        if (!f) {
+            fprintf(stderr, "no frame obtained for t=%f\n", i / 25.);
+            ret = -1;
+            goto end;
+        }
+        nmd_frame_releasep(&f);
+    }
+
+    nmd_get_stats(s, &stats);
+    if (stats.nb_frames_returned != NB_FRAMES || stats.nb_frames_decoded < NB_FRAMES) {
+        fprintf(stderr, "%"PRId64" frames returned and %"PRId64" decoded, expected %d\n",
+                stats.nb_frames_returned, stats.nb_frames_decoded, NB_FRAMES);
+        ret = -1;
+        goto end;
+    }
+    if ((ret = check_timing("demux",     &stats.demux))     < 0 ||
+        (ret = check_timing("decode",    &stats.decode))    < 0 ||
+        (ret = check_timing("filter",    &stats.filter))    < 0 ||
+        (ret = check_timing("sink wait", &stats.sink_wait)) < 0)
+        goto end;
+
+    /* A seek in the middle of a GOP decodes frames before the target */
+    const int64_t nb_dropped = stats.nb_frames_dropped;
+    const int64_t nb_seeks = stats.nb_seeks;
+    struct nmd_frame *f = nmd_get_frame(s, 45.0);
+    if (!f) {
+        fprintf(stderr, "no frame obtained after seek\n");
+        ret = -1;
+        goto end;
+    }
+    nmd_frame_releasep(&f);
+
+    nmd_get_stats(s, &stats);
+    if (stats.nb_seeks <= nb_seeks || stats.nb_frames_dropped <= nb_dropped) {
+        fprintf(stderr, "seek not accounted: %"PRId64" seeks, %"PRId64" frames dropped\n",
+                stats.nb_seeks, stats.nb_frames_dropped);
+        ret = -1;
+        goto end;
+    }
+    if ((ret = check_timing("seek latency", &stats.seek_latency)) < 0)
+        goto end;
+
+    if (stats.pkt_queue_fill < 0 || stats.frames_queue_fill < 0 || stats.sink_queue_fill < 0) {
+        fprintf(stderr, "invalid queue fill levels %d %d %d\n",
+                stats.pkt_queue_fill, stats.frames_queue_fill, stats.sink_queue_fill);
+        ret = -1;
+    }
+
+end:
+    nmd_freep(&s);
+    return ret;
+}
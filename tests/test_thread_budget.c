@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+#define NB_CTX 4
+
+static int check_frame(struct nmd_ctx *s, double t)
+{
+    struct nmd_frame *f = nmd_get_frame(s, t);
+    if (!f) {
+        fprintf(stderr, "no frame obtained for t=%f\n", t);
+        return -1;
+    }
+    const double ts = f->ts;
+    nmd_frame_releasep(&f);
+    if (fabs(ts - t) > 1/25.) {
+        fprintf(stderr, "requested t=%f, got frame with ts=%f\n", t, ts);
+        return -1;
+    }
+    return 0;
+}
+
+static struct nmd_ctx *create_ctx(const char *filename, int use_pkt_duration, int nb_threads)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "nb_threads", nb_threads);
+    return s;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = 0;
+
+    /* A single context allowed to use every core */
+    struct nmd_ctx *s = create_ctx(filename, use_pkt_duration, 1000);
+    if (!s)
+        return -1;
+    for (int i = 0; i < 50 && ret >= 0; i++)
+        ret = check_frame(s, i / 25.);
+    nmd_freep(&s);
+    if (ret < 0)
+        return ret;
+
+    /* More contexts than the budget can afford: each of them must still get
+     * its frames, the late ones with a single thread */
+    nmd_set_max_threads(3);
+
+    struct nmd_ctx *ctxs[NB_CTX] = {0};
+    for (int i = 0; i < NB_CTX; i++) {
+        ctxs[i] = create_ctx(filename, use_pkt_duration, i & 1 ? 1 : 4);
+        if (!ctxs[i]) {
+            ret = -1;
+            goto end;
+        }
+    }
+
+    for (int i = 0; i < 25 && ret >= 0; i++)
+        for (int c = 0; c < NB_CTX && ret >= 0; c++)
+            ret = check_frame(ctxs[c], c * 10 + i / 25.);
+
+    /* The threads of a destroyed context are available to the next one */
+    nmd_freep(&ctxs[0]);
+    ctxs[0] = create_ctx(filename, use_pkt_duration, 2);
+    if (!ctxs[0]) {
+        ret = -1;
+        goto end;
+    }
+    for (int i = 0; i < 25 && ret >= 0; i++)
+        ret = check_frame(ctxs[0], 60 + i / 25.);
+
+end:
+    for (int i = 0; i < NB_CTX; i++)
+        nmd_freep(&ctxs[i]);
+    nmd_set_max_threads(0);
+    return ret;
+}
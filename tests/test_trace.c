@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nopemd.h>
+
+#define TRACE_FILE "test_trace.json"
+
+static char *read_file(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        return NULL;
+    char *buf = NULL;
+    if (fseek(f, 0, SEEK_END) < 0)
+        goto end;
+    const long size = ftell(f);
+    if (size < 0 || fseek(f, 0, SEEK_SET) < 0)
+        goto end;
+    buf = malloc(size + 1);
+    if (!buf)
+        goto end;
+    if (fread(buf, 1, size, f) != size) {
+        free(buf);
+        buf = NULL;
+        goto end;
+    }
+    buf[size] = 0;
+end:
+    fclose(f);
+    return buf;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = nmd_trace_start(TRACE_FILE);
+    if (ret < 0) {
+        fprintf(stderr, "unable to start the trace recording\n");
+        return ret;
+    }
+    if (nmd_trace_start(TRACE_FILE) >= 0) {
+        fprintf(stderr, "a second recording was started\n");
+        nmd_trace_stop();
+        return -1;
+    }
+
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s) {
+        nmd_trace_stop();
+        return -1;
+    }
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+
+    static const double times[] = {0.0, 0.04, 0.08, 30.0, 12.0};
+    for (int i = 0; i < sizeof(times) / sizeof(*times); i++) {
+        struct nmd_frame *f = nmd_get_frame(s, times[i]);
+        if (!f) {
+            fprintf(stderr, "no frame obtained for t=%f\n", times[i]);
+            ret = -1;
+            break;
+        }
+        nmd_frame_releasep(&f);
+    }
+    nmd_freep(&s);
+
+    const int stop_ret = nmd_trace_stop();
+    if (ret < 0)
+        return ret;
+    if (stop_ret < 0) {
+        fprintf(stderr, "unable to stop the trace recording\n");
+        return stop_ret;
+    }
+
+    char *trace = read_file(TRACE_FILE);
+    if (!trace) {
+        fprintf(stderr, "unable to read the trace file\n");
+        return -1;
+    }
+
+    static const char * const expected[] = {
+        "{\"traceEvents\":[",
+        "\"process_name\"",
+        "\"thread_name\"",
+        "\"nmd/demuxer\"",
+        "\"name\":\"seek\"",
+        "\"name\":\"packet read\"",
+        "\"name\":\"decode\"",
+        "\"name\":\"filter push\"",
+        "\"name\":\"filter pull\"",
+        "\"name\":\"sink pop\"",
+        "\"name\":\"pkt_queue\"",
+        "\"name\":\"frames_queue\"",
+        "\"name\":\"sink_queue\"",
+    };
+    for (int i = 0; i < sizeof(expected) / sizeof(*expected); i++) {
+        if (!strstr(trace, expected[i])) {
+            fprintf(stderr, "%s not found in the trace\n", expected[i]);
+            ret = -1;
+        }
+    }
+    const size_t len = strlen(trace);
+    if (len < 3 || strcmp(trace + len - 3, "]}\n")) {
+        fprintf(stderr, "trace file not terminated\n");
+        ret = -1;
+    }
+    free(trace);
+
+    return ret;
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <libavutil/time.h>
+
+#include <nopemd.h>
+
+#define SIDECAR "test_waveform.nmd-waveform"
+#define NB_PEAKS 100
+
+static struct nmd_ctx *create_context(const char *filename, int use_pkt_duration, const char *sidecar)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    if (sidecar)
+        nmd_set_option(s, "waveform_file", sidecar);
+    return s;
+}
+
+/* Poll until the overview is ready, counting how many times it was not */
+static int wait_waveform(struct nmd_ctx *s, double start, double end, int nb_peaks,
+                         struct nmd_audio_peak *peaks, int *nb_pending)
+{
+    for (;;) {
+        int ret = nmd_get_waveform(s, start, end, nb_peaks, peaks);
+        if (ret)
+            return ret;
+        (*nb_pending)++;
+        av_usleep(1000);
+    }
+}
+
+static int check_peaks(const struct nmd_audio_peak *peaks, int nb_peaks)
+{
+    int nb_silent = 0;
+    for (int i = 0; i < nb_peaks; i++) {
+        const struct nmd_audio_peak *p = &peaks[i];
+        if (p->min > p->max || p->rms < 0.f || p->rms > fmaxf(fabsf(p->min), fabsf(p->max)) + 1e-3f ||
+            p->min < -1.f || p->max > 1.f) {
+            fprintf(stderr, "invalid peak #%d: min=%f max=%f rms=%f\n", i, p->min, p->max, p->rms);
+            return -1;
+        }
+        nb_silent += p->max == p->min;
+    }
+    if (nb_silent == nb_peaks) {
+        fprintf(stderr, "the waveform is flat\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    static struct nmd_audio_peak ref[NB_PEAKS], peaks[NB_PEAKS];
+    int nb_pending = 0;
+
+    remove(SIDECAR);
+
+    /* The overview is computed in the background from a video context */
+    struct nmd_ctx *s = create_context(filename, use_pkt_duration, SIDECAR);
+    if (!s)
+        return -1;
+    double duration;
+    int ret = nmd_get_duration(s, &duration);
+    if (ret >= 0)
+        ret = wait_waveform(s, 0., duration, NB_PEAKS, ref, &nb_pending);
+    if (ret >= 0)
+        ret = check_peaks(ref, NB_PEAKS);
+    if (ret < 0)
+        goto end;
+    if (!nb_pending) {
+        fprintf(stderr, "the overview was ready before being computed\n");
+        ret = -1;
+        goto end;
+    }
+
+    /* A zoomed view stays within the peaks of the coarse one */
+    const double peak_len = duration / NB_PEAKS;
+    ret = nmd_get_waveform(s, 5 * peak_len, 6 * peak_len, NB_PEAKS, peaks);
+    if (ret != 1) {
+        fprintf(stderr, "zoomed view not available: %d\n", ret);
+        ret = -1;
+        goto end;
+    }
+    for (int i = 0; i < NB_PEAKS; i++) {
+        if (peaks[i].min < ref[5].min - 1e-4f || peaks[i].max > ref[5].max + 1e-4f) {
+            fprintf(stderr, "zoomed peak #%d [%f,%f] out of [%f,%f]\n",
+                    i, peaks[i].min, peaks[i].max, ref[5].min, ref[5].max);
+            ret = -1;
+            goto end;
+        }
+    }
+
+    /* Nothing after the end of the media */
+    ret = nmd_get_waveform(s, duration + 1., duration + 2., 1, peaks);
+    if (ret != 1 || peaks[0].min || peaks[0].max || peaks[0].rms) {
+        fprintf(stderr, "unexpected peak after the end of the media\n");
+        ret = -1;
+        goto end;
+    }
+    nmd_freep(&s);
+
+    /* The later contexts load it from the sidecar file */
+    s = create_context(filename, use_pkt_duration, SIDECAR);
+    if (!s)
+        return -1;
+    ret = nmd_get_waveform(s, 0., duration, NB_PEAKS, peaks);
+    if (ret != 1) {
+        fprintf(stderr, "overview not loaded from the sidecar file: %d\n", ret);
+        ret = -1;
+        goto end;
+    }
+    for (int i = 0; i < NB_PEAKS; i++) {
+        if (fabsf(peaks[i].min - ref[i].min) > 1e-4f ||
+            fabsf(peaks[i].max - ref[i].max) > 1e-4f ||
+            fabsf(peaks[i].rms - ref[i].rms) > 1e-4f) {
+            fprintf(stderr, "loaded peak #%d differs from the computed one\n", i);
+            ret = -1;
+            goto end;
+        }
+    }
+    ret = 0;
+    nmd_freep(&s);
+
+    /* A context can be destroyed while its overview is being computed */
+    s = create_context(filename, use_pkt_duration, NULL);
+    if (!s)
+        return -1;
+    ret = nmd_get_waveform(s, 0., duration, NB_PEAKS, peaks);
+    if (ret < 0)
+        goto end;
+    ret = 0;
+
+end:
+    nmd_freep(&s);
+    remove(SIDECAR);
+    return ret;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <nopemd.h>
+
+static struct nmd_ctx *create_context(const char *filename, int use_pkt_duration,
+                                      int sw_pix_fmt, int native_rgba)
+{
+    struct nmd_ctx *s = nmd_create(filename);
+    if (!s)
+        return NULL;
+    nmd_set_option(s, "auto_hwaccel", 0);
+    nmd_set_option(s, "use_pkt_duration", use_pkt_duration);
+    nmd_set_option(s, "sw_pix_fmt", sw_pix_fmt);
+    nmd_set_option(s, "native_rgba", native_rgba);
+    nmd_set_option(s, "nb_threads", 4);
+    return s;
+}
+
+/* The built-in converter and libswscale only differ by rounding errors */
+static int compare_frames(const struct nmd_frame *a, const struct nmd_frame *b, int swap)
+{
+    if (a->width != b->width || a->height != b->height || a->pix_fmt != b->pix_fmt) {
+        fprintf(stderr, "frame %dx%d fmt:%d differs from %dx%d fmt:%d\n",
+                a->width, a->height, a->pix_fmt, b->width, b->height, b->pix_fmt);
+        return -1;
+    }
+
+    double sum = 0.;
+    for (int y = 0; y < a->height; y++) {
+        const uint8_t *pa = a->datap[0] + y * a->linesizep[0];
+        const uint8_t *pb = b->datap[0] + y * b->linesizep[0];
+        for (int x = 0; x < a->width; x++) {
+            if (pa[4*x + 3] != 255 || pb[4*x + 3] != 255) {
+                fprintf(stderr, "pixel (%d,%d) is not opaque\n", x, y);
+                return -1;
+            }
+            for (int c = 0; c < 3; c++)
+                sum += abs(pa[4*x + c] - pb[4*x + (swap ? 2 - c : c)]);
+        }
+    }
+
+    const double mean = sum / (3. * a->width * a->height);
+    if (mean > 1.5) {
+        fprintf(stderr, "mean difference of %f between the frames at t=%f\n", mean, a->ts);
+        return -1;
+    }
+    return 0;
+}
+
+static int check_conversion(const char *filename, int use_pkt_duration, int sw_pix_fmt)
+{
+    static const double times[] = {0.0, 0.04, 3.0, 30.0, 12.0};
+    int ret = 0;
+
+    struct nmd_ctx *native = create_context(filename, use_pkt_duration, sw_pix_fmt, 1);
+    struct nmd_ctx *swscale = create_context(filename, use_pkt_duration, sw_pix_fmt, 0);
+    struct nmd_ctx *swapped = create_context(filename, use_pkt_duration,
+                                             sw_pix_fmt == NMD_PIXFMT_RGBA ? NMD_PIXFMT_BGRA : NMD_PIXFMT_RGBA, 1);
+    if (!native || !swscale || !swapped) {
+        ret = -1;
+        goto end;
+    }
+
+    for (int i = 0; i < sizeof(times) / sizeof(*times) && ret >= 0; i++) {
+        struct nmd_frame *a = nmd_get_frame(native, times[i]);
+        struct nmd_frame *b = nmd_get_frame(swscale, times[i]);
+        struct nmd_frame *c = nmd_get_frame(swapped, times[i]);
+        if (!a || !b || !c || a->ts != b->ts || a->ts != c->ts) {
+            fprintf(stderr, "unable to get the same frames at t=%f\n", times[i]);
+            ret = -1;
+        } else if (a->pix_fmt != sw_pix_fmt) {
+            fprintf(stderr, "got pixel format %d instead of %d\n", a->pix_fmt, sw_pix_fmt);
+            ret = -1;
+        } else {
+            ret = compare_frames(a, b, 0);
+            if (ret >= 0) {
+                /* Only the order of the components differs */
+                struct nmd_frame c_as_a = *c;
+                c_as_a.pix_fmt = a->pix_fmt;
+                ret = compare_frames(a, &c_as_a, 1);
+            }
+        }
+        nmd_frame_releasep(&a);
+        nmd_frame_releasep(&b);
+        nmd_frame_releasep(&c);
+    }
+
+end:
+    nmd_freep(&native);
+    nmd_freep(&swscale);
+    nmd_freep(&swapped);
+    return ret;
+}
+
+int main(int ac, char **av)
+{
+    if (ac < 2) {
+        fprintf(stderr, "Usage: %s <media.mkv> [<use_pkt_duration>]\n", av[0]);
+        return -1;
+    }
+
+    const char *filename = av[1];
+    const int use_pkt_duration = ac > 2 ? atoi(av[2]) : 0;
+
+    int ret = check_conversion(filename, use_pkt_duration, NMD_PIXFMT_BGRA);
+    if (ret >= 0)
+        ret = check_conversion(filename, use_pkt_duration, NMD_PIXFMT_RGBA);
+    return ret;
+}